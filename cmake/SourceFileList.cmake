@@ -55,6 +55,10 @@ set(eoserv_ALL_SOURCE_FILES
 	src/eoserver.hpp
 	src/extra/seose_compat.cpp
 	src/extra/seose_compat.hpp
+	src/filecache.cpp
+	src/filecache.hpp
+	src/formula.cpp
+	src/formula.hpp
 	src/fwd/arena.hpp
 	src/fwd/character.hpp
 	src/fwd/command_source.hpp
@@ -66,15 +70,21 @@ set(eoserv_ALL_SOURCE_FILES
 	src/fwd/eodata.hpp
 	src/fwd/eoplus.hpp
 	src/fwd/eoserver.hpp
+	src/fwd/filecache.hpp
+	src/fwd/formula.hpp
 	src/fwd/guild.hpp
 	src/fwd/hook.hpp
 	src/fwd/i18n.hpp
 	src/fwd/map.hpp
 	src/fwd/nanohttp.hpp
+	src/fwd/netthread.hpp
 	src/fwd/npc.hpp
 	src/fwd/npc_data.hpp
 	src/fwd/packet.hpp
+	src/fwd/packettrace.hpp
 	src/fwd/party.hpp
+	src/fwd/persistence.hpp
+	src/fwd/pathfinder.hpp
 	src/fwd/player.hpp
 	src/fwd/quest.hpp
 	src/fwd/sln.hpp
@@ -96,14 +106,22 @@ set(eoserv_ALL_SOURCE_FILES
 	src/map.hpp
 	src/nanohttp.cpp
 	src/nanohttp.hpp
+	src/netthread.cpp
+	src/netthread.hpp
 	src/npc.cpp
 	src/npc.hpp
 	src/npc_data.cpp
 	src/npc_data.hpp
 	src/packet.cpp
 	src/packet.hpp
+	src/packettrace.cpp
+	src/packettrace.hpp
 	src/party.cpp
 	src/party.hpp
+	src/persistence.cpp
+	src/persistence.hpp
+	src/pathfinder.cpp
+	src/pathfinder.hpp
 	src/platform.h
 	src/player.cpp
 	src/player.hpp
@@ -121,11 +139,19 @@ set(eoserv_ALL_SOURCE_FILES
 	src/util.cpp
 	src/util.hpp
 	src/util/async.hpp
+	src/util/boundedqueue.hpp
+	src/util/mpscqueue.hpp
+	src/util/parallelfor.cpp
+	src/util/parallelfor.hpp
 	src/util/rpn.cpp
 	src/util/rpn.hpp
+	src/util/ringbuffer.cpp
+	src/util/ringbuffer.hpp
 	src/util/secure_string.hpp
 	src/util/semaphore.cpp
 	src/util/semaphore.hpp
+	src/util/spscqueue.hpp
+	src/util/string_view.hpp
 	src/util/threadpool.cpp
 	src/util/threadpool.hpp
 	src/util/variant.cpp
@@ -279,13 +305,38 @@ set(ExtraFiles
 )
 
 set(TestFiles
+	src/test/character_test.cpp
 	src/test/config_test.cpp
+	src/test/database_test.cpp
+	src/test/filecache_test.cpp
+	src/test/formula_test.cpp
+	src/test/map_test.cpp
+	src/test/packet_test.cpp
+	src/test/packettrace_test.cpp
+	src/test/pathfinder_test.cpp
+	src/test/persistence_test.cpp
+	src/test/socket_test.cpp
+	src/test/timer_test.cpp
 	src/test/worlddump_test.cpp
 	src/test/handlers/Login_test.cpp
+	src/test/util/boundedqueue_test.cpp
+	src/test/util/mpscqueue_test.cpp
+	src/test/util/parallelfor_test.cpp
+	src/test/util/ringbuffer_test.cpp
 	src/test/util/semaphore_test.cpp
+	src/test/util/spscqueue_test.cpp
 	src/test/util/threadpool_test.cpp
 )
 
+set(BenchmarkFiles
+	src/test/benchmark/database_benchmark.cpp
+	src/test/benchmark/formula_benchmark.cpp
+	src/test/benchmark/packet_benchmark.cpp
+	src/test/benchmark/socket_benchmark.cpp
+	src/test/benchmark/threadpool_benchmark.cpp
+	src/test/benchmark/timer_benchmark.cpp
+)
+
 set(LocalConf
 	config_local/
 )
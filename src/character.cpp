@@ -12,11 +12,14 @@
 #include "eoclient.hpp"
 #include "eodata.hpp"
 #include "eoplus.hpp"
+#include "eoserv_config.hpp"
+#include "formula.hpp"
 #include "map.hpp"
 #include "npc.hpp"
 #include "guild.hpp"
 #include "packet.hpp"
 #include "party.hpp"
+#include "persistence.hpp"
 #include "player.hpp"
 #include "quest.hpp"
 #include "timer.hpp"
@@ -24,7 +27,6 @@
 
 #include "console.hpp"
 #include "util.hpp"
-#include "util/rpn.hpp"
 #include "util/variant.hpp"
 
 #include <algorithm>
@@ -348,47 +350,60 @@ std::vector<std::string> BotListUnserialize(std::string serialized)
 	return bots;
 }
 
-template <typename T> static T GetRow(std::unordered_map<std::string, util::variant> &row, const char *col)
+template <typename T> static T GetRow(const Database_Result::Row &row, const char *col);
+
+template <> int GetRow<int>(const Database_Result::Row &row, const char *col)
+{
+	return row.GetInt(row.Column(col));
+}
+
+template <> std::string GetRow<std::string>(const Database_Result::Row &row, const char *col)
 {
-	return row[col];
+	return row.GetString(row.Column(col));
 }
 
 Character::Character(World * world)
 	: online(false)
 	, world(world)
-	, display_str(this->world->config["UseAdjustedStats"] ? adj_str : str)
-	, display_intl(this->world->config["UseAdjustedStats"] ? adj_intl : intl)
-	, display_wis(this->world->config["UseAdjustedStats"] ? adj_wis : wis)
-	, display_agi(this->world->config["UseAdjustedStats"] ? adj_agi : agi)
-	, display_con(this->world->config["UseAdjustedStats"] ? adj_con : con)
-	, display_cha(this->world->config["UseAdjustedStats"] ? adj_cha : cha)
+	, display_str(this->world->settings->UseAdjustedStats ? adj_str : str)
+	, display_intl(this->world->settings->UseAdjustedStats ? adj_intl : intl)
+	, display_wis(this->world->settings->UseAdjustedStats ? adj_wis : wis)
+	, display_agi(this->world->settings->UseAdjustedStats ? adj_agi : agi)
+	, display_con(this->world->settings->UseAdjustedStats ? adj_con : con)
+	, display_cha(this->world->settings->UseAdjustedStats ? adj_cha : cha)
 {
 }
 
+const char *const Character::Columns = "`name`, `title`, `home`, `fiance`, `partner`, `admin`, `class`, `gender`, `race`, `hairstyle`, `haircolor`,"
+	"`map`, `x`, `y`, `direction`, `level`, `exp`, `hp`, `tp`, `str`, `int`, `wis`, `agi`, `con`, `cha`, `statpoints`, `skillpoints`, "
+	"`karma`, `sitting`, `hidden`, `bankmax`, `goldbank`, `usage`, `inventory`, `bank`, `paperdoll`, `spells`, `guild`, `guild_rank`, `guild_rank_string`, `quest`, `vars`, "
+	"`nointeract`";
+
 Character::Character(std::string name, World *world)
+	: Character(world, world->db->Query((std::string("SELECT ") + Columns + " FROM `characters` WHERE `name` = '$'").c_str(), name.c_str()), 0)
+{
+}
+
+Character::Character(World *world, const Database_Result &res, std::size_t row_index)
 	: muted_until(0)
 	, bot(false)
 	, cosmetic_paperdoll{{}}
 	, world(world)
-	, display_str(this->world->config["UseAdjustedStats"] ? adj_str : str)
-	, display_intl(this->world->config["UseAdjustedStats"] ? adj_intl : intl)
-	, display_wis(this->world->config["UseAdjustedStats"] ? adj_wis : wis)
-	, display_agi(this->world->config["UseAdjustedStats"] ? adj_agi : agi)
-	, display_con(this->world->config["UseAdjustedStats"] ? adj_con : con)
-	, display_cha(this->world->config["UseAdjustedStats"] ? adj_cha : cha)
+	, display_str(this->world->settings->UseAdjustedStats ? adj_str : str)
+	, display_intl(this->world->settings->UseAdjustedStats ? adj_intl : intl)
+	, display_wis(this->world->settings->UseAdjustedStats ? adj_wis : wis)
+	, display_agi(this->world->settings->UseAdjustedStats ? adj_agi : agi)
+	, display_con(this->world->settings->UseAdjustedStats ? adj_con : con)
+	, display_cha(this->world->settings->UseAdjustedStats ? adj_cha : cha)
 {
+	Database_Result::Row row = res[row_index];
+
 	{
 		std::vector<std::string> bot_characters = BotListUnserialize(this->world->config["BotCharacters"]);
-		auto bot_it = std::find(UTIL_CRANGE(bot_characters), util::lowercase(name));
+		auto bot_it = std::find(UTIL_CRANGE(bot_characters), util::lowercase(GetRow<std::string>(row, "name")));
 		this->bot = bot_it != bot_characters.end();
 	}
 
-	Database_Result res = this->world->db->Query("SELECT `name`, `title`, `home`, `fiance`, `partner`, `admin`, `class`, `gender`, `race`, `hairstyle`, `haircolor`,"
-		"`map`, `x`, `y`, `direction`, `level`, `exp`, `hp`, `tp`, `str`, `int`, `wis`, `agi`, `con`, `cha`, `statpoints`, `skillpoints`, "
-		"`karma`, `sitting`, `hidden`, `bankmax`, `goldbank`, `usage`, `inventory`, `bank`, `paperdoll`, `spells`, `guild`, `guild_rank`, `guild_rank_string`, `quest`, `vars`, "
-		"`nointeract` FROM `characters` WHERE `name` = '$'", name.c_str());
-	std::unordered_map<std::string, util::variant> row = res.front();
-
 	this->login_time = static_cast<int>(std::time(0));
 
 	this->online = false;
@@ -475,13 +490,13 @@ Character::Character(std::string name, World *world)
 
 	this->usage = GetRow<int>(row, "usage");
 
-	this->inventory = ItemUnserialize(row["inventory"]);
-	this->bank = ItemUnserialize(row["bank"]);
-	this->paperdoll = DollUnserialize(row["paperdoll"]);
-	this->spells = SpellUnserialize(row["spells"]);
+	this->inventory = ItemUnserialize(GetRow<std::string>(row, "inventory"));
+	this->bank = ItemUnserialize(GetRow<std::string>(row, "bank"));
+	this->paperdoll = DollUnserialize(GetRow<std::string>(row, "paperdoll"));
+	this->spells = SpellUnserialize(GetRow<std::string>(row, "spells"));
 
 	this->player = 0;
-	std::string guild_tag = util::trim(static_cast<std::string>(row["guild"]));
+	std::string guild_tag = util::trim(GetRow<std::string>(row, "guild"));
 
 	if (!guild_tag.empty())
 	{
@@ -509,6 +524,14 @@ Character::Character(std::string name, World *world)
 	{
 		this->nointeract = static_cast<int>(world->config["NoInteractDefault"]);
 	}
+
+	// As stored, so the first save only writes what actually differs
+	this->saved_columns.reserve(SaveColumns.size());
+
+	UTIL_FOREACH_CREF(SaveColumns, column)
+	{
+		this->saved_columns.push_back(GetRow<std::string>(row, column.name));
+	}
 }
 
 unsigned int Character::PlayerID() const
@@ -575,7 +598,7 @@ bool Character::ValidName(std::string name)
 
 void Character::Msg(Character *from, std::string message)
 {
-	message = util::text_cap(message, static_cast<int>(this->world->config["ChatMaxWidth"]) - util::text_width(util::ucfirst(from->SourceName()) + "  "));
+	message = util::text_cap(message, this->world->settings->ChatMaxWidth - util::text_width(util::ucfirst(from->SourceName()) + "  "));
 
 	from->AddChatLog("!", "to " + this->SourceName(), message);
 	this->AddChatLog("!", "from " + from->SourceName(), message);
@@ -588,7 +611,7 @@ void Character::Msg(Character *from, std::string message)
 
 void Character::ServerMsg(std::string message)
 {
-	message = util::text_cap(message, static_cast<int>(this->world->config["ChatMaxWidth"]) - util::text_width("Server  "));
+	message = util::text_cap(message, this->world->settings->ChatMaxWidth - util::text_width("Server  "));
 
 	PacketBuilder builder(PACKET_TALK, PACKET_SERVER, message.length());
 	builder.AddString(message);
@@ -597,7 +620,7 @@ void Character::ServerMsg(std::string message)
 
 void Character::StatusMsg(std::string message)
 {
-	message = util::text_cap(message, static_cast<int>(this->world->config["ChatMaxWidth"]));
+	message = util::text_cap(message, this->world->settings->ChatMaxWidth);
 
 	PacketBuilder builder(PACKET_MESSAGE, PACKET_OPEN, message.length());
 	builder.AddString(message);
@@ -738,7 +761,7 @@ bool Character::AddItem(short item, int amount)
 
 			it->amount += amount;
 
-			it->amount = std::min<int>(it->amount, this->world->config["MaxItem"]);
+			it->amount = std::min<int>(it->amount, this->world->settings->MaxItem);
 
 			this->CalculateStats();
 
@@ -812,7 +835,7 @@ int Character::CanHoldItem(short itemid, int max_amount)
 {
 	int amount = max_amount;
 
-	if (int(this->world->config["EnforceWeight"]) >= 2
+	if (this->world->settings->EnforceWeight >= 2
 	 && SourceDutyAccess() < static_cast<int>(world->admin_config["unlimitedweight"]))
 	{
 		const EIF_Data &item = this->world->eif->Get(itemid);
@@ -825,7 +848,7 @@ int Character::CanHoldItem(short itemid, int max_amount)
 			amount = std::min((this->maxweight - this->weight) / item.weight, max_amount);
 	}
 
-	return std::min<int>(amount, this->world->config["MaxItem"]);
+	return std::min<int>(amount, this->world->settings->MaxItem);
 }
 
 bool Character::AddTradeItem(short item, int amount)
@@ -1023,7 +1046,7 @@ void Character::SpellAct()
 
 double Character::SpellCooldownTime() const
 {
-	double cooldown_period = this->world->config["SpellCastCooldown"];
+	double cooldown_period = this->world->settings->SpellCastCooldown;
 	double cooldown = (this->spell_fired_time + cooldown_period) - Timer::GetTime();
 
 	if (cooldown < 0.0)
@@ -1171,7 +1194,7 @@ bool Character::Equip(short item, unsigned char subloc)
 
 bool Character::InRange(unsigned char x, unsigned char y) const
 {
-	return util::path_length(this->x, this->y, x, y) <= static_cast<int>(this->world->config.at("SeeDistance"));
+	return util::path_length(this->x, this->y, x, y) <= this->world->settings->SeeDistance;
 }
 
 bool Character::InRange(const Character *other) const
@@ -1227,7 +1250,7 @@ void Character::Warp(short map, unsigned char x, unsigned char y, WarpAnimation
 		builder.AddChar(WARP_SWITCH);
 		builder.AddShort(map);
 
-		if (this->world->config["GlobalPK"] && !this->world->PKExcept(map))
+		if (this->world->settings->GlobalPK && !this->world->PKExcept(map))
 		{
 			builder.AddByte(0xFF);
 			builder.AddByte(0x01);
@@ -1311,29 +1334,32 @@ void Character::Refresh()
 	std::vector<NPC *> updatenpcs;
 	std::vector<std::shared_ptr<Map_Item>> updateitems;
 
-	UTIL_FOREACH(this->map->characters, character)
+	this->map->grid.ForEachCell(this->x, this->y, this->world->settings->SeeDistance, [&](const Map_Grid::Cell &cell)
 	{
-		if (this->InRange(character))
+		UTIL_FOREACH(cell.characters, character)
 		{
-			updatecharacters.push_back(character);
+			if (this->InRange(character))
+			{
+				updatecharacters.push_back(character);
+			}
 		}
-	}
 
-	UTIL_FOREACH(this->map->npcs, npc)
-	{
-		if (this->InRange(npc) && npc->alive)
+		UTIL_FOREACH(cell.npcs, npc)
 		{
-			updatenpcs.push_back(npc);
+			if (this->InRange(npc) && npc->alive)
+			{
+				updatenpcs.push_back(npc);
+			}
 		}
-	}
 
-	UTIL_FOREACH(this->map->items, item)
-	{
-		if (this->InRange(*item))
+		UTIL_FOREACH(cell.items, item)
 		{
-			updateitems.push_back(item);
+			if (this->InRange(*item))
+			{
+				updateitems.push_back(item);
+			}
 		}
-	}
+	});
 
 	PacketBuilder builder(PACKET_REFRESH, PACKET_REPLY, 3 + updatecharacters.size() * 60 + updatenpcs.size() * 6 + updateitems.size() * 9);
 	builder.AddChar(static_cast<char>(updatecharacters.size())); // Number of players
@@ -1451,7 +1477,7 @@ std::string Character::PaddedGuildTag()
 {
 	std::string tag;
 
-	if (this->world->config["ShowLevel"])
+	if (this->world->settings->ShowLevel)
 	{
 		tag = util::to_string(this->level);
 		if (tag.length() < 3)
@@ -1587,13 +1613,15 @@ void Character::CalculateStats(bool trigger_quests)
 		this->weight = 250;
 	}
 
-	std::unordered_map<std::string, double> formula_vars;
+	FormulaValues formula_vars;
 	this->FormulaVars(formula_vars);
 
-	this->maxhp += static_cast<short>(rpn_eval(rpn_parse(this->world->formulas_config["hp"]), formula_vars));
-	this->maxtp += static_cast<short>(rpn_eval(rpn_parse(this->world->formulas_config["tp"]), formula_vars));
-	this->maxsp += static_cast<short>(rpn_eval(rpn_parse(this->world->formulas_config["sp"]), formula_vars));
-	this->maxweight = static_cast<short>(rpn_eval(rpn_parse(this->world->formulas_config["weight"]), formula_vars));
+	const Formulas &formulas = *this->world->formulas;
+
+	this->maxhp += static_cast<short>(formulas.hp.eval(formula_vars.data()));
+	this->maxtp += static_cast<short>(formulas.tp.eval(formula_vars.data()));
+	this->maxsp += static_cast<short>(formulas.sp.eval(formula_vars.data()));
+	this->maxweight = static_cast<short>(formulas.weight.eval(formula_vars.data()));
 
 	if (this->hp > this->maxhp || this->tp > this->maxtp)
 	{
@@ -1620,15 +1648,16 @@ void Character::CalculateStats(bool trigger_quests)
 		}
 	}
 
-	if (this->world->config["UseClassFormulas"])
+	if (this->world->settings->UseClassFormulas)
 	{
-		auto dam = static_cast<short>(rpn_eval(rpn_parse(this->world->formulas_config["class." + util::to_string(ecf.type) + ".damage"]), formula_vars));
+		const Formulas::Class &class_formulas = formulas.GetClass(ecf.type);
+		auto dam = static_cast<short>(class_formulas.damage.eval(formula_vars.data()));
 
 		this->mindam += dam;
 		this->maxdam += dam;
-		this->armor += static_cast<short>(rpn_eval(rpn_parse(this->world->formulas_config["class." + util::to_string(ecf.type) + ".defence"]), formula_vars));
-		this->accuracy += static_cast<short>(rpn_eval(rpn_parse(this->world->formulas_config["class." + util::to_string(ecf.type) + ".accuracy"]), formula_vars));
-		this->evade += static_cast<short>(rpn_eval(rpn_parse(this->world->formulas_config["class." + util::to_string(ecf.type) + ".evade"]), formula_vars));
+		this->armor += static_cast<short>(class_formulas.defence.eval(formula_vars.data()));
+		this->accuracy += static_cast<short>(class_formulas.accuracy.eval(formula_vars.data()));
+		this->evade += static_cast<short>(class_formulas.evade.eval(formula_vars.data()));
 	}
 	else
 	{
@@ -1639,11 +1668,11 @@ void Character::CalculateStats(bool trigger_quests)
 		this->armor += this->adj_con / 2;
 	}
 
-	if (this->mindam == 0 || !this->world->config["BaseDamageAtZero"])
-		this->mindam += int(this->world->config["BaseMinDamage"]);
+	if (this->mindam == 0 || !this->world->settings->BaseDamageAtZero)
+		this->mindam += this->world->settings->BaseMinDamage;
 
-	if (this->maxdam == 0 || !this->world->config["BaseDamageAtZero"])
-		this->maxdam += int(this->world->config["BaseMaxDamage"]);
+	if (this->maxdam == 0 || !this->world->settings->BaseDamageAtZero)
+		this->maxdam += this->world->settings->BaseMaxDamage;
 
 	if (trigger_quests)
 		this->CheckQuestRules();
@@ -1675,12 +1704,12 @@ void Character::DropAll(Character *killer)
 			if (killer)
 			{
 				map_item->owner = killer->PlayerID();
-				map_item->unprotecttime = Timer::GetTime() + static_cast<double>(this->world->config["ProtectPKDrop"]);
+				map_item->unprotecttime = Timer::GetTime() + this->world->settings->ProtectPKDrop;
 			}
 			else
 			{
 				map_item->owner = this->PlayerID();
-				map_item->unprotecttime = Timer::GetTime() + static_cast<double>(this->world->config["ProtectDeathDrop"]);
+				map_item->unprotecttime = Timer::GetTime() + this->world->settings->ProtectDeathDrop;
 			}
 
 			PacketBuilder builder(PACKET_ITEM, PACKET_DROP, 15);
@@ -1716,12 +1745,12 @@ void Character::DropAll(Character *killer)
 			if (killer)
 			{
 				map_item->owner = killer->PlayerID();
-				map_item->unprotecttime = Timer::GetTime() + static_cast<double>(this->world->config["ProtectPKDrop"]);
+				map_item->unprotecttime = Timer::GetTime() + this->world->settings->ProtectPKDrop;
 			}
 			else
 			{
 				map_item->owner = this->PlayerID();
-				map_item->unprotecttime = Timer::GetTime() + static_cast<double>(this->world->config["ProtectDeathDrop"]);
+				map_item->unprotecttime = Timer::GetTime() + this->world->settings->ProtectDeathDrop;
 			}
 
 			int subloc = 0;
@@ -1821,8 +1850,8 @@ void Character::Reset()
 
 	this->CancelSpell();
 
-	this->statpoints = this->level * int(this->world->config["StatPerLevel"]);
-	this->skillpoints = this->level * int(this->world->config["SkillPerLevel"]);
+	this->statpoints = this->level * this->world->settings->StatPerLevel;
+	this->skillpoints = this->level * this->world->settings->SkillPerLevel;
 
 	this->CalculateStats();
 }
@@ -1846,7 +1875,7 @@ void Character::SpikeDamage(int amount)
 {
 	int limitamount = std::min(amount, int(this->hp));
 
-	if (this->world->config["LimitDamage"])
+	if (this->world->settings->LimitDamage)
 	{
 		amount = limitamount;
 	}
@@ -1867,7 +1896,7 @@ void Character::SpikeDamage(int amount)
 
 	this->Send(builder2);
 
-	for (Character* watcher : this->map->CharactersInRange(this->x, this->y, static_cast<int>(this->world->config["SeeDistance"])))
+	for (Character* watcher : this->map->CharactersInRange(this->x, this->y, this->world->settings->SeeDistance))
 	{
 		if (watcher == this)
 			continue;
@@ -1881,7 +1910,7 @@ void Character::DeathRespawn()
 {
 	this->hp = int(this->maxhp * static_cast<double>(this->world->config["DeathRecover"]) / 100.0);
 
-	if (this->world->config["Deadly"])
+	if (this->world->settings->Deadly)
 	{
 		this->DropAll(nullptr);
 	}
@@ -1893,13 +1922,11 @@ void Character::DeathRespawn()
 	this->x = this->SpawnX();
 	this->y = this->SpawnY();
 
-	this->player->client->queue.AddAction(PacketReader(std::array<char, 2>{
-		{char(PACKET_INTERNAL_NULL), char(PACKET_INTERNAL)}
-	}.data()), 1.5);
+	const std::array<char, 2> null_packet{{char(PACKET_INTERNAL_NULL), char(PACKET_INTERNAL)}};
+	const std::array<char, 2> warp_packet{{char(PACKET_INTERNAL_WARP), char(PACKET_INTERNAL)}};
 
-	this->player->client->queue.AddAction(PacketReader(std::array<char, 2>{
-		{char(PACKET_INTERNAL_WARP), char(PACKET_INTERNAL)}
-	}.data()), 0.0);
+	this->player->client->queue.AddAction(PacketReader(util::string_view(null_packet.data(), null_packet.size())), 1.5);
+	this->player->client->queue.AddAction(PacketReader(util::string_view(warp_packet.data(), warp_packet.size())), 0.0);
 }
 
 void Character::Mute(const Command_Source *by)
@@ -1917,18 +1944,27 @@ void Character::PlaySound(unsigned char id)
 	this->Send(builder);
 }
 
-#define v(x) vars[prefix + #x] = x;
-#define vv(x, n) vars[prefix + n] = x;
-
 void Character::FormulaVars(std::unordered_map<std::string, double> &vars, std::string prefix)
 {
-	v(level) vv(exp, "experience") v(hp) v(maxhp) v(tp) v(maxtp) v(maxsp)
+	FormulaValues values;
+	this->FormulaVars(values);
+
+	for (std::size_t i = 0; i < FormulaValues::VarCount; ++i)
+		vars[prefix + FormulaValues::Name(FormulaValues::Var(i))] = values[i];
+}
+
+#define v(x) vars[offset + FormulaValues::Var_##x] = x;
+#define vv(x, n) vars[offset + FormulaValues::Var_##n] = x;
+
+void Character::FormulaVars(FormulaValues &vars, std::size_t offset)
+{
+	v(level) vv(exp, experience) v(hp) v(maxhp) v(tp) v(maxtp) v(maxsp)
 	v(weight) v(maxweight) v(karma) v(mindam) v(maxdam)
-	vv(adj_str, "str") vv(adj_intl, "int") vv(adj_wis, "wis") vv(adj_agi, "agi") vv(adj_con, "con") vv(adj_cha, "cha")
-	vv(str, "base_str") vv(intl, "base_int") vv(wis, "base_wis") vv(agi, "base_agi") vv(con, "base_con") vv(cha, "base_cha")
-	v(display_str) vv(display_intl, "display_int") v(display_wis) v(display_agi) v(display_con) v(display_cha)
+	vv(adj_str, str) vv(adj_intl, int) vv(adj_wis, wis) vv(adj_agi, agi) vv(adj_con, con) vv(adj_cha, cha)
+	vv(str, base_str) vv(intl, base_int) vv(wis, base_wis) vv(agi, base_agi) vv(con, base_con) vv(cha, base_cha)
+	v(display_str) vv(display_intl, display_int) v(display_wis) v(display_agi) v(display_con) v(display_cha)
 	v(accuracy) v(evade) v(armor) v(admin) v(bot) v(usage)
-	vv(clas, "class") v(gender) v(race) v(hairstyle) v(haircolor)
+	vv(clas, class) v(gender) v(race) v(hairstyle) v(haircolor)
 	v(mapid) v(x) v(y) v(direction) v(sitting) v(hidden) v(whispers) v(goldbank)
 	v(statpoints) v(skillpoints)
 }
@@ -2038,7 +2074,7 @@ void Character::AddPaperdollData(PacketBuilder& builder, const char* format)
 
 void Character::AddChatLog(std::string marker, std::string name, std::string msg)
 {
-	if (int(chat_log.size()) >= int(this->world->config["ReportChatLogSize"]))
+	if (int(chat_log.size()) >= this->world->settings->ReportChatLogSize)
 		chat_log.pop_front();
 
 	chat_log.push_back(marker + " " + util::ucfirst(name) + ": " + msg);
@@ -2062,6 +2098,11 @@ void Character::Send(const PacketBuilder &builder)
 	this->player->Send(builder);
 }
 
+void Character::Send(const SharedPacket &packet)
+{
+	this->player->Send(packet);
+}
+
 void Character::Logout()
 {
 	if (!this->online)
@@ -2124,36 +2165,221 @@ void Character::Logout()
 	this->world->Logout(this);
 }
 
-void Character::Save()
-{
-	const std::string & quest_data = (!this->quest_string.empty())
-	                               ? this->quest_string
-	                               : QuestSerialize(this->quests, this->quests_inactive);
+const std::array<Character::SaveColumn, 42> Character::SaveColumns = {{
+	{"title", true}, {"home", true}, {"fiance", true}, {"partner", true},
+	{"admin", false}, {"class", false}, {"gender", false}, {"race", false}, {"hairstyle", false}, {"haircolor", false},
+	{"map", false}, {"x", false}, {"y", false}, {"direction", false}, {"level", false}, {"exp", false}, {"hp", false}, {"tp", false},
+	{"str", false}, {"int", false}, {"wis", false}, {"agi", false}, {"con", false}, {"cha", false},
+	{"statpoints", false}, {"skillpoints", false}, {"karma", false}, {"sitting", false}, {"hidden", false},
+	{"nointeract", false}, {"bankmax", false}, {"goldbank", false}, {"usage", false},
+	{"inventory", true}, {"bank", true}, {"paperdoll", true}, {"spells", true},
+	{"guild", true}, {"guild_rank", false}, {"guild_rank_string", true}, {"quest", true}, {"vars", true}
+}};
 
-	int nointeract = this->nointeract;
+// Characters per batched UPDATE, which keeps SQL Server well under its limit of 2100 bound parameters
+static const std::size_t character_save_batch = 16;
 
-	if (!(nointeract & NoInteractCustom))
+// Current values of every column in Character::SaveColumns
+static void character_save_values(Character *character, std::vector<std::string> &values)
+{
+	int nointeract = character->nointeract;
+
+	if (!(nointeract & Character::NoInteractCustom))
 		nointeract = 0;
 
+	values.clear();
+	values.reserve(Character::SaveColumns.size());
+
+	auto number = [&values](int value) { values.push_back(util::to_string(value)); };
+
+	values.push_back(character->title);
+	values.push_back(character->home);
+	values.push_back(character->fiance);
+	values.push_back(character->partner);
+	number(character->admin);
+	number(character->clas);
+	number(character->gender);
+	number(character->race);
+	number(character->hairstyle);
+	number(character->haircolor);
+	number(character->mapid);
+	number(character->x);
+	number(character->y);
+	number(character->direction);
+	number(character->level);
+	number(character->exp);
+	number(character->hp);
+	number(character->tp);
+	number(character->str);
+	number(character->intl);
+	number(character->wis);
+	number(character->agi);
+	number(character->con);
+	number(character->cha);
+	number(character->statpoints);
+	number(character->skillpoints);
+	number(character->karma);
+	number(character->sitting);
+	number(character->hidden);
+	number(nointeract);
+	number(character->bankmax);
+	number(character->goldbank);
+	number(character->Usage());
+	values.push_back(character->inventory_cache.Get(character->inventory, ItemSerialize));
+	values.push_back(character->bank_cache.Get(character->bank, ItemSerialize));
+	values.push_back(character->paperdoll_cache.Get(character->paperdoll, DollSerialize));
+	values.push_back(character->spells_cache.Get(character->spells, SpellSerialize));
+	values.push_back(character->guild ? character->guild->tag : std::string());
+	number(character->guild_rank);
+	values.push_back(character->guild_rank_string);
+	values.push_back((!character->quest_string.empty())
+	                 ? character->quest_string
+	                 : QuestSerialize(character->quests, character->quests_inactive));
+	values.push_back(std::string());
+}
+
+void Character::Save()
+{
+	Character_SaveDelta delta;
+
+	if (!this->CollectSave(delta))
+		return;
+
 #ifdef DEBUG
-	Console::Dbg("Saving character '%s' (session lasted %i minutes)", this->real_name.c_str(), int(std::time(0) - this->login_time) / 60);
+	Console::Dbg("Saving character '%s' (session lasted %i minutes, %i columns changed)", this->real_name.c_str(), int(std::time(0) - this->login_time) / 60, int(delta.columns.size()));
 #endif // DEBUG
-	this->world->db->Query("UPDATE `characters` SET `title` = '$', `home` = '$', `fiance` = '$', `partner` = '$', `admin` = #, `class` = #, `gender` = #, `race` = #, "
-		"`hairstyle` = #, `haircolor` = #, `map` = #, `x` = #, `y` = #, `direction` = #, `level` = #, `exp` = #, `hp` = #, `tp` = #, "
-		"`str` = #, `int` = #, `wis` = #, `agi` = #, `con` = #, `cha` = #, `statpoints` = #, `skillpoints` = #, `karma` = #, `sitting` = #, `hidden` = #, "
-		"`nointeract` = #, `bankmax` = #, `goldbank` = #, `usage` = #, `inventory` = '$', `bank` = '$', `paperdoll` = '$', "
-		"`spells` = '$', `guild` = '$', `guild_rank` = #, `guild_rank_string` = '$', `quest` = '$', `vars` = '$' WHERE `name` = '$'",
-		this->title.c_str(), this->home.c_str(), this->fiance.c_str(), this->partner.c_str(), int(this->admin), this->clas, int(this->gender), int(this->race),
-		this->hairstyle, this->haircolor, this->mapid, this->x, this->y, int(this->direction), this->level, this->exp, this->hp, this->tp,
-		this->str, this->intl, this->wis, this->agi, this->con, this->cha, this->statpoints, this->skillpoints, this->karma, int(this->sitting), int(this->hidden),
-		nointeract, this->bankmax, this->goldbank, this->Usage(), ItemSerialize(this->inventory).c_str(), ItemSerialize(this->bank).c_str(),
-		DollSerialize(this->paperdoll).c_str(), SpellSerialize(this->spells).c_str(), (this->guild ? this->guild->tag.c_str() : ""),
-		this->guild_rank, this->guild_rank_string.c_str(), quest_data.c_str(), "", this->real_name.c_str());
+
+	Persistence_Batch batch;
+	Character::SaveQueries(std::vector<Character_SaveDelta>{delta}, batch.queries);
+	batch.characters.push_back(delta.name);
+
+	this->SaveCompleted(delta);
+	this->world->persistence->Queue(std::move(batch));
+}
+
+bool Character::CollectSave(Character_SaveDelta &delta)
+{
+	std::vector<std::string> values;
+	character_save_values(this, values);
+
+	bool all = this->saved_columns.size() != values.size();
+
+	delta.character = this;
+	delta.name = this->real_name;
+	delta.columns.clear();
+
+	for (std::size_t i = 0; i < values.size(); ++i)
+	{
+		if (all || values[i] != this->saved_columns[i])
+			delta.columns.emplace_back(i, std::move(values[i]));
+	}
+
+	return !delta.columns.empty();
+}
+
+void Character::SaveCompleted(Character_SaveDelta &delta)
+{
+	this->saved_columns.resize(SaveColumns.size());
+
+	UTIL_FOREACH_REF(delta.columns, column)
+	{
+		this->saved_columns[column.first] = std::move(column.second);
+	}
+
+	delta.columns.clear();
+}
+
+void Character::SaveQueries(const std::vector<Character_SaveDelta> &deltas, std::vector<Database_Query> &queries)
+{
+	std::vector<bool> changed(SaveColumns.size());
+	std::vector<std::size_t> next(character_save_batch);
+
+	for (std::size_t begin = 0; begin < deltas.size(); begin += character_save_batch)
+	{
+		std::size_t end = std::min(begin + character_save_batch, deltas.size());
+
+		queries.push_back(Database_Query{"UPDATE `characters` SET ", {}});
+		std::string &query = queries.back().format;
+		std::vector<std::string> &args = queries.back().args;
+
+		if (end - begin == 1)
+		{
+			const Character_SaveDelta &delta = deltas[begin];
+
+			UTIL_CIFOREACH(delta.columns, column)
+			{
+				const SaveColumn &info = SaveColumns[column->first];
+
+				if (column != delta.columns.begin())
+					query += ", ";
+
+				query += std::string("`") + info.name + "` = " + (info.text ? "'$'" : "#");
+				args.push_back(column->second);
+			}
+
+			query += " WHERE `name` = '$'";
+			args.push_back(delta.name);
+		}
+		else
+		{
+			// Every column changed by anyone in the batch gets a CASE, leaving the rest of the rows as they were
+			std::fill(UTIL_RANGE(changed), false);
+			std::fill(UTIL_RANGE(next), 0);
+
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				UTIL_FOREACH_CREF(deltas[i].columns, column)
+				{
+					changed[column.first] = true;
+				}
+			}
+
+			bool first = true;
+
+			for (std::size_t c = 0; c < SaveColumns.size(); ++c)
+			{
+				if (!changed[c])
+					continue;
+
+				const SaveColumn &info = SaveColumns[c];
+
+				query += std::string(first ? "" : ", ") + "`" + info.name + "` = CASE `name`";
+				first = false;
+
+				// Each delta lists its columns in order, so it only ever needs to look at the next one
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					const Character_SaveDelta &delta = deltas[i];
+					std::size_t &n = next[i - begin];
+
+					if (n < delta.columns.size() && delta.columns[n].first == c)
+					{
+						query += std::string(" WHEN '$' THEN ") + (info.text ? "'$'" : "#");
+						args.push_back(delta.name);
+						args.push_back(delta.columns[n].second);
+						++n;
+					}
+				}
+
+				query += std::string(" ELSE `") + info.name + "` END";
+			}
+
+			query += " WHERE `name` IN (";
+
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				query += (i == begin) ? "'$'" : ", '$'";
+				args.push_back(deltas[i].name);
+			}
+
+			query += ")";
+		}
+	}
 }
 
 AdminLevel Character::SourceAccess() const
 {
-	return world->config["UseDutyAdmin"] ? player->Admin() : admin;
+	return world->settings->UseDutyAdmin ? player->Admin() : admin;
 }
 
 AdminLevel Character::SourceDutyAccess() const
@@ -10,6 +10,8 @@
 #include "fwd/character.hpp"
 
 #include "fwd/arena.hpp"
+#include "fwd/database.hpp"
+#include "fwd/formula.hpp"
 #include "fwd/guild.hpp"
 #include "fwd/npc.hpp"
 #include "fwd/packet.hpp"
@@ -30,6 +32,8 @@
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 struct Timestamp
 {
@@ -107,6 +111,8 @@ struct Character_Item
 
 	Character_Item() = default;
 	Character_Item(short id, int amount) : id(id), amount(amount) { }
+
+	bool operator ==(const Character_Item &rhs) const { return this->id == rhs.id && this->amount == rhs.amount; }
 };
 
 /**
@@ -119,6 +125,8 @@ struct Character_Spell
 
 	Character_Spell() = default;
 	Character_Spell(short id, unsigned char level) : id(id), level(level) { }
+
+	bool operator ==(const Character_Spell &rhs) const { return this->id == rhs.id && this->level == rhs.level; }
 };
 
 struct Character_QuestState
@@ -133,6 +141,40 @@ struct Character_QuestState
 	}
 };
 
+/**
+ * Keeps the serialized form of a container until the container changes, which is much cheaper to check than to serialize again
+ */
+template <class T> class Character_SerializeCache
+{
+	private:
+		T source;
+		std::string serialized;
+		bool valid = false;
+
+	public:
+		template <class F> const std::string &Get(const T &current, F serialize)
+		{
+			if (!this->valid || !(this->source == current))
+			{
+				this->source = current;
+				this->serialized = serialize(current);
+				this->valid = true;
+			}
+
+			return this->serialized;
+		}
+};
+
+/**
+ * The columns of a character's row which changed since it was last saved, by index in to Character::SaveColumns
+ */
+struct Character_SaveDelta
+{
+	Character *character;
+	std::string name;
+	std::vector<std::pair<std::size_t, std::string>> columns;
+};
+
 class Character : public Command_Source
 {
 	public:
@@ -280,8 +322,23 @@ class Character : public Command_Source
 		std::set<Character_QuestState> quests_inactive;
 		std::string quest_string;
 
+		/**
+		 * Column values as last loaded or saved, see CollectSave
+		 */
+		std::vector<std::string> saved_columns;
+		Character_SerializeCache<std::list<Character_Item>> inventory_cache;
+		Character_SerializeCache<std::list<Character_Item>> bank_cache;
+		Character_SerializeCache<std::array<int, 15>> paperdoll_cache;
+		Character_SerializeCache<std::list<Character_Spell>> spells_cache;
+
+		/**
+		 * Columns a character is loaded from, as a list for a SELECT
+		 */
+		static const char *const Columns;
+
 		Character(World *);
 		Character(std::string name, World *);
+		Character(World *, const Database_Result &res, std::size_t row);
 
 		bool IsHideInvisible() const { return hidden & HideInvisible; }
 		bool IsHideOnline() const { return hidden & HideOnline; }
@@ -360,6 +417,12 @@ class Character : public Command_Source
 
 		void FormulaVars(std::unordered_map<std::string, double> &vars, std::string prefix = "");
 
+		/**
+		 * Fills in one set of slots for compiled formulas
+		 * @param offset FormulaValues::Self or FormulaValues::Target
+		 */
+		void FormulaVars(FormulaValues &vars, std::size_t offset = 0);
+
 		void Dress(EquipLocation, unsigned short gfx_id);
 		void Undress();
 		void Undress(EquipLocation);
@@ -369,10 +432,38 @@ class Character : public Command_Source
 		std::string GetChatLogDump();
 
 		void Send(const PacketBuilder &);
+		void Send(const SharedPacket &);
 
 		void Logout();
+
+		/**
+		 * Queues any columns that changed since the last save to be written
+		 */
 		void Save();
 
+		/**
+		 * Finds the columns that changed since the last save, returns false if there are none
+		 */
+		bool CollectSave(Character_SaveDelta &delta);
+
+		/**
+		 * Records that the changes in a delta are on their way to the database
+		 */
+		void SaveCompleted(Character_SaveDelta &delta);
+
+		/**
+		 * Builds the queries writing the changes of many characters, several per UPDATE statement
+		 */
+		static void SaveQueries(const std::vector<Character_SaveDelta> &deltas, std::vector<Database_Query> &queries);
+
+		struct SaveColumn
+		{
+			const char *name;
+			bool text;
+		};
+
+		static const std::array<SaveColumn, 42> SaveColumns;
+
 		AdminLevel SourceAccess() const;
 		AdminLevel SourceDutyAccess() const;
 		std::string SourceName() const;
@@ -390,6 +481,13 @@ class Character : public Command_Source
 		Party *party;
 		Map *map;
 
+		/**
+		 * Characters and live NPCs within SeeDistance, kept up to date by the map as anything moves.
+		 * Characters see each other from the same distance, so view_characters also lists everyone who can see this character.
+		 */
+		std::vector<Character *> view_characters;
+		std::vector<NPC *> view_npcs;
+
 		const short &display_str, &display_intl, &display_wis, &display_agi, &display_con, &display_cha;
 };
 
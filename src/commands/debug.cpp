@@ -104,6 +104,7 @@ void SpawnNPC(const std::vector<std::string>& arguments, Character* from)
 
 		NPC *npc = new NPC(from->map, id, from->x, from->y, speed, direction, index, true);
 		from->map->npcs.push_back(npc);
+		from->map->grid.Add(npc, npc->x, npc->y);
 		npc->Spawn();
 	}
 }
@@ -9,15 +9,19 @@
 #include "../character.hpp"
 #include "../command_source.hpp"
 #include "../config.hpp"
+#include "../eoclient.hpp"
 #include "../eoserver.hpp"
 #include "../map.hpp"
+#include "../player.hpp"
 #include "../timer.hpp"
 #include "../world.hpp"
 
 #include "../console.hpp"
 #include "../util.hpp"
+#include "../util/threadpool.hpp"
 
 #include <csignal>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -178,6 +182,102 @@ void Uptime(const std::vector<std::string>& arguments, Command_Source* from)
 	from->ServerMsg(buffer);
 }
 
+static std::string netstats_format(std::uint64_t bytes_sent, std::uint64_t send_calls, std::uint64_t bytes_received, std::uint64_t recv_calls)
+{
+	std::string buffer = std::to_string(bytes_sent / 1024) + " KiB sent in " + std::to_string(send_calls) + " sends";
+
+	if (send_calls > 0)
+		buffer += " (" + std::to_string(bytes_sent / send_calls) + " bytes/send)";
+
+	buffer += ", " + std::to_string(bytes_received / 1024) + " KiB received in " + std::to_string(recv_calls) + " reads";
+
+	return buffer;
+}
+
+void NetStats(const std::vector<std::string>& arguments, Command_Source* from)
+{
+	World* world = from->SourceWorld();
+
+	if (arguments.size() >= 1)
+	{
+		Character* victim = world->GetCharacter(arguments[0]);
+
+		if (!victim || !victim->player || !victim->player->client)
+		{
+			from->ServerMsg(world->i18n.Format("character_not_found"));
+			return;
+		}
+
+		const Client::IOStats& stats = victim->player->client->Stats();
+
+		from->ServerMsg(util::ucfirst(victim->SourceName()) + ": " + netstats_format(stats.bytes_sent, stats.send_calls, stats.bytes_received, stats.recv_calls));
+		return;
+	}
+
+	std::uint64_t bytes_sent = 0, send_calls = 0, bytes_received = 0, recv_calls = 0;
+
+	UTIL_FOREACH(world->server->clients, client)
+	{
+		const Client::IOStats& stats = client->Stats();
+		bytes_sent += stats.bytes_sent;
+		send_calls += stats.send_calls;
+		bytes_received += stats.bytes_received;
+		recv_calls += stats.recv_calls;
+	}
+
+	from->ServerMsg(std::to_string(world->server->clients.size()) + " clients: " + netstats_format(bytes_sent, send_calls, bytes_received, recv_calls));
+}
+
+void DBStats(const std::vector<std::string>& arguments, Command_Source* from)
+{
+	(void)arguments;
+
+	const DatabasePoolStats stats = from->SourceWorld()->DBPoolStats();
+
+	std::string buffer = std::to_string(stats.in_use) + "/" + std::to_string(stats.open) + " pooled connections in use, "
+		+ std::to_string(stats.acquired) + " acquired, " + std::to_string(stats.reconnects) + " reconnects";
+
+	if (stats.waited > 0)
+		buffer += ", " + std::to_string(stats.waited) + " waited (avg " + std::to_string(int(stats.wait_time / stats.waited * 1000.0)) + " ms, max "
+			+ std::to_string(int(stats.max_wait * 1000.0)) + " ms)";
+
+	if (stats.timeouts > 0)
+		buffer += ", " + std::to_string(stats.timeouts) + " timed out";
+
+	from->ServerMsg(buffer);
+}
+
+static std::string poolstats_percentile(const unsigned long long (&histogram)[util::ThreadPoolStats::LATENCY_BUCKETS], double fraction)
+{
+	int ms = util::ThreadPoolStats::Class::Percentile(histogram, fraction);
+
+	if (ms < 0)
+		return ">" + std::to_string(1 << (util::ThreadPoolStats::LATENCY_BUCKETS - 2)) + " ms";
+
+	return "<" + std::to_string(ms) + " ms";
+}
+
+void PoolStats(const std::vector<std::string>& arguments, Command_Source* from)
+{
+	(void)arguments;
+
+	const util::ThreadPoolStats stats = util::ThreadPool::Stats();
+	const char* names[] = {"interactive", "background"};
+
+	for (std::size_t i = 0; i < 2; ++i)
+	{
+		const util::ThreadPoolStats::Class& c = stats.classes[i];
+
+		from->ServerMsg(std::string(names[i]) + ": " + std::to_string(c.queued) + " queued, " + std::to_string(c.max_pending) + " max pending, "
+			+ std::to_string(c.running) + " running, " + std::to_string(c.completed) + " done, " + std::to_string(c.stolen) + " stolen, "
+			+ std::to_string(c.cancelled) + " cancelled, " + std::to_string(c.rejected) + " rejected");
+
+		if (c.completed > 0)
+			from->ServerMsg(std::string(names[i]) + " wait p50 " + poolstats_percentile(c.wait_latency, 0.5) + ", p99 " + poolstats_percentile(c.wait_latency, 0.99)
+				+ " / run p50 " + poolstats_percentile(c.run_latency, 0.5) + ", p99 " + poolstats_percentile(c.run_latency, 0.99));
+	}
+}
+
 COMMAND_HANDLER_REGISTER(server)
 	RegisterCharacter({"remap", {}, {"mapid"}, 3}, ReloadMap);
 	Register({"repub", {}, {"announce"}, 3}, ReloadPub);
@@ -187,6 +287,9 @@ COMMAND_HANDLER_REGISTER(server)
 	Register({"reload", {}, {}, 6}, Reload);
 	Register({"cancel", {}, {}, 6}, Cancel);
 	Register({"uptime"}, Uptime);
+	Register({"netstats", {}, {"victim"}, 4}, NetStats);
+	Register({"dbstats", {}, {}, 4}, DBStats);
+	Register({"poolstats", {}, {}, 4}, PoolStats);
 COMMAND_HANDLER_REGISTER_END(server)
 
 }
@@ -17,14 +17,21 @@
 #include "util/variant.hpp"
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
 #include <exception>
 #include <fstream>
+#include <functional>
+#include <limits>
 #include <list>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "database_impl.hpp"
 
@@ -44,6 +51,23 @@
 #define SQLSERVER_SUCCEEDED(x) (x == SQL_SUCCESS || x == SQL_SUCCESS_WITH_INFO)
 #endif
 
+#ifndef ER_UNSUPPORTED_PS
+#define ER_UNSUPPORTED_PS 1295
+#endif
+
+#if defined(DATABASE_MYSQL) || defined(DATABASE_SQLITE)
+// Prepared statements kept per connection, least recently used are finalized first
+static const std::size_t database_statement_cache_size = 64;
+#endif // defined(DATABASE_MYSQL) || defined(DATABASE_SQLITE)
+
+#ifdef DATABASE_MYSQL
+// Errors RawQuery recovers from by reconnecting or trying again
+static bool database_mysql_recoverable(unsigned int error)
+{
+	return error == CR_SERVER_GONE_ERROR || error == CR_SERVER_LOST || error == ER_LOCK_WAIT_TIMEOUT;
+}
+#endif // DATABASE_MYSQL
+
 struct Database::impl_
 {
 	union
@@ -60,6 +84,154 @@ struct Database::impl_
 		HSTMT hstmt;
 #endif //DATABASE_SQLSERVER
 	};
+
+#if defined(DATABASE_MYSQL) || defined(DATABASE_SQLITE)
+	std::mutex statement_lock;
+#endif // defined(DATABASE_MYSQL) || defined(DATABASE_SQLITE)
+
+#ifdef DATABASE_MYSQL
+	struct MySQL_Statement
+	{
+		std::string sql;
+		MYSQL_STMT *stmt;
+	};
+
+	// Most recently used first
+	std::list<MySQL_Statement> mysql_statements;
+	std::unordered_map<std::string, std::list<MySQL_Statement>::iterator> mysql_statement_index;
+
+	/**
+	 * Finds or prepares the statement for sql
+	 * @return nullptr if the server can't prepare sql or the connection is gone, to run it as a plain query instead
+	 * @throw Database_QueryFailed
+	 */
+	MYSQL_STMT *PrepareMySQL(const std::string &sql)
+	{
+		auto it = this->mysql_statement_index.find(sql);
+
+		if (it != this->mysql_statement_index.end())
+		{
+			this->mysql_statements.splice(this->mysql_statements.begin(), this->mysql_statements, it->second);
+			return it->second->stmt;
+		}
+
+		MYSQL_STMT *stmt = mysql_stmt_init(this->mysql_handle);
+
+		if (!stmt)
+			throw Database_QueryFailed(mysql_error(this->mysql_handle));
+
+		if (mysql_stmt_prepare(stmt, sql.c_str(), sql.length()) != 0)
+		{
+			unsigned int error = mysql_stmt_errno(stmt);
+			bool fallback = database_mysql_recoverable(error) || error == ER_UNSUPPORTED_PS;
+
+			if (!fallback)
+				Console::Err("%s", mysql_stmt_error(stmt));
+
+			mysql_stmt_close(stmt);
+
+			if (fallback)
+				return nullptr;
+
+			throw Database_QueryFailed("Unable to prepare query for execution!");
+		}
+
+		if (this->mysql_statements.size() >= database_statement_cache_size)
+		{
+			mysql_stmt_close(this->mysql_statements.back().stmt);
+			this->mysql_statement_index.erase(this->mysql_statements.back().sql);
+			this->mysql_statements.pop_back();
+		}
+
+		this->mysql_statements.push_front(MySQL_Statement{sql, stmt});
+		this->mysql_statement_index[sql] = this->mysql_statements.begin();
+
+		return stmt;
+	}
+
+	void CloseMySQLStatements()
+	{
+		std::lock_guard<std::mutex> guard(this->statement_lock);
+
+		for (MySQL_Statement &statement : this->mysql_statements)
+			mysql_stmt_close(statement.stmt);
+
+		this->mysql_statements.clear();
+		this->mysql_statement_index.clear();
+	}
+#endif // DATABASE_MYSQL
+
+#ifdef DATABASE_SQLITE
+	struct Statement
+	{
+		std::string sql;
+		sqlite3_stmt *stmt;
+	};
+
+	// Most recently used first
+	std::list<Statement> statements;
+	std::unordered_map<std::string, std::list<Statement>::iterator> statement_index;
+
+	/**
+	 * Finds or prepares the statement for sql
+	 * @return nullptr if sql is not exactly one statement
+	 * @throw Database_QueryFailed
+	 */
+	sqlite3_stmt *Prepare(const std::string &sql)
+	{
+		auto it = this->statement_index.find(sql);
+
+		if (it != this->statement_index.end())
+		{
+			this->statements.splice(this->statements.begin(), this->statements, it->second);
+			return it->second->stmt;
+		}
+
+		sqlite3_stmt *stmt = nullptr;
+		const char *tail = nullptr;
+
+#if SQLITE_VERSION_NUMBER >= 3020000
+		int rc = sqlite3_prepare_v3(this->sqlite_handle, sql.c_str(), int(sql.size() + 1), SQLITE_PREPARE_PERSISTENT, &stmt, &tail);
+#else
+		int rc = sqlite3_prepare_v2(this->sqlite_handle, sql.c_str(), int(sql.size() + 1), &stmt, &tail);
+#endif
+
+		if (rc != SQLITE_OK)
+		{
+			sqlite3_finalize(stmt);
+			throw Database_QueryFailed(sqlite3_errmsg(this->sqlite_handle));
+		}
+
+		if (!stmt || (tail && util::trim(tail).length() > 0))
+		{
+			sqlite3_finalize(stmt);
+			return nullptr;
+		}
+
+		if (this->statements.size() >= database_statement_cache_size)
+		{
+			sqlite3_finalize(this->statements.back().stmt);
+			this->statement_index.erase(this->statements.back().sql);
+			this->statements.pop_back();
+		}
+
+		this->statements.push_front(Statement{sql, stmt});
+		this->statement_index[sql] = this->statements.begin();
+
+		return stmt;
+	}
+
+	void FinalizeStatements()
+	{
+		std::lock_guard<std::mutex> guard(this->statement_lock);
+
+		for (Statement &statement : this->statements)
+			sqlite3_finalize(statement.stmt);
+
+		this->statements.clear();
+		this->statement_index.clear();
+	}
+#endif // DATABASE_SQLITE
 };
 
 #ifdef DATABASE_SQLSERVER
@@ -102,38 +274,154 @@ void HandleSqlServerError(SQLSMALLINT handleType, SQLHANDLE handle, SQLRETURN co
 #ifdef DATABASE_SQLITE
 static int sqlite_callback(void *data, int num, char *fields[], char *columns[])
 {
-	std::unordered_map<std::string, util::variant> result;
-	std::string column;
-	util::variant field;
-	int i;
+	Database_Result &result = static_cast<Database *>(data)->callbackdata;
 
-	for (i = 0; i < num; ++i)
+	if (result.Columns().empty())
 	{
-		if (columns[i] == NULL)
-		{
-			column = "";
-		}
-		else
-		{
-			column = columns[i];
-		}
+		for (int i = 0; i < num; ++i)
+			result.AddColumn(columns[i] ? columns[i] : "");
+	}
 
-		if (fields[i] == NULL)
-		{
-			field = "";
-		}
+	result.AddRow();
+
+	for (int i = 0; i < num; ++i)
+	{
+		if (fields[i])
+			result.AddText(fields[i], std::strlen(fields[i]));
 		else
+			result.AddText("", 0);
+	}
+
+	return 0;
+}
+#endif
+
+const std::size_t Database_Result::npos;
+
+const Database_Result::Cell *Database_Result::At(std::size_t row, std::size_t column) const
+{
+	if (row >= this->rows || column >= this->columns.size())
+		return nullptr;
+
+	return &this->cells[row * this->columns.size() + column];
+}
+
+int Database_Result::Row::GetInt(std::size_t column) const
+{
+	const Cell *cell = this->result->At(this->row, column);
+
+	if (!cell)
+		return 0;
+
+	if (cell->text)
+		return util::to_int(std::string(this->result->text, cell->offset, cell->length));
+
+	return cell->value;
+}
+
+std::string Database_Result::Row::GetString(std::size_t column) const
+{
+	const Cell *cell = this->result->At(this->row, column);
+
+	if (!cell)
+		return std::string();
+
+	if (cell->text)
+		return std::string(this->result->text, cell->offset, cell->length);
+
+	return util::to_string(cell->value);
+}
+
+util::variant Database_Result::Row::operator [](const std::string &column) const
+{
+	std::size_t index = this->result->Column(column);
+	const Cell *cell = this->result->At(this->row, index);
+
+	if (!cell)
+		return util::variant();
+
+	if (cell->text)
+		return util::variant(std::string(this->result->text, cell->offset, cell->length));
+
+	return util::variant(cell->value);
+}
+
+Database_Result::Row::operator std::unordered_map<std::string, util::variant>() const
+{
+	std::unordered_map<std::string, util::variant> row;
+
+	for (std::size_t i = 0; i < this->result->columns.size(); ++i)
+		row[this->result->columns[i]] = (*this)[this->result->columns[i]];
+
+	return row;
+}
+
+std::size_t Database_Result::Column(const std::string &name) const
+{
+	for (std::size_t i = 0; i < this->columns.size(); ++i)
+	{
+		if (this->columns[i] == name)
+			return i;
+	}
+
+	return npos;
+}
+
+void Database_Result::AddColumn(const std::string &name)
+{
+	if (this->rows > 0)
+	{
+		// Widen the rows already added with an empty cell for the new column
+		std::size_t width = this->columns.size();
+		std::vector<Cell> cells;
+		cells.reserve(this->rows * (width + 1));
+
+		for (std::size_t row = 0; row < this->rows; ++row)
 		{
-			field = fields[i];
+			cells.insert(cells.end(), this->cells.begin() + row * width, this->cells.begin() + (row + 1) * width);
+			cells.push_back(Cell{0, 0, 0, true});
 		}
 
-		result.insert(result.begin(), make_pair(column, field));
+		this->cells = std::move(cells);
 	}
 
-	static_cast<Database *>(data)->callbackdata.push_back(result);
-	return 0;
+	this->columns.push_back(name);
+}
+
+void Database_Result::AddRow()
+{
+	++this->rows;
+	this->cells.reserve(this->rows * this->columns.size());
+}
+
+void Database_Result::AddInt(int value)
+{
+	this->cells.push_back(Cell{0, 0, value, false});
+}
+
+void Database_Result::AddText(const char *value, std::size_t length)
+{
+	this->cells.push_back(Cell{static_cast<std::uint32_t>(this->text.size()), static_cast<std::uint32_t>(length), 0, true});
+	this->text.append(value, length);
+}
+
+void Database_Result::push_back(const std::unordered_map<std::string, util::variant> &row)
+{
+	for (const auto &cell : row)
+	{
+		if (this->Column(cell.first) == npos)
+			this->AddColumn(cell.first);
+	}
+
+	this->AddRow();
+
+	for (const std::string &column : this->columns)
+	{
+		auto it = row.find(column);
+		std::string value = (it != row.end()) ? it->second.GetString() : std::string();
+		this->AddText(value.data(), value.length());
+	}
 }
-#endif
 
 int Database_Result::AffectedRows()
 {
@@ -254,6 +542,199 @@ std::shared_ptr<Database> DatabaseFactory::CreateDatabase(Config& config, bool l
 	return std::shared_ptr<Database>(new Database(engine, dbHost, dbPort, dbUser, dbPass, dbName));
 }
 
+// Connections idle for longer than this are checked with a trivial query before being lent out
+static const double database_pool_check_idle = 30.0;
+
+struct DatabaseFactory::Pool
+{
+	typedef std::chrono::steady_clock clock;
+
+	struct Idle
+	{
+		std::shared_ptr<Database> db;
+		std::thread::id last_thread;
+		clock::time_point last_used;
+	};
+
+	mutable std::mutex lock;
+	std::condition_variable returned;
+	std::vector<Idle> idle;
+	DatabasePoolStats stats;
+
+	void Release(std::shared_ptr<Database> db)
+	{
+		// A connection which has thrown may be broken, so it is closed rather than lent out again
+		if (db->Failed())
+		{
+			db.reset();
+		}
+		// A connection left inside a transaction must not leak it to the next borrower
+		else if (db->Pending())
+		{
+			try
+			{
+				db->Rollback();
+			}
+			catch (Database_Exception&)
+			{
+				db.reset();
+			}
+		}
+
+		std::lock_guard<std::mutex> guard(this->lock);
+		--this->stats.in_use;
+
+		if (db)
+			this->idle.push_back(Idle{std::move(db), std::this_thread::get_id(), clock::now()});
+		else
+			--this->stats.open;
+
+		this->returned.notify_one();
+	}
+};
+
+DatabaseFactory::DatabaseFactory()
+	: _pool(std::make_shared<Pool>())
+{ }
+
+std::shared_ptr<Database> DatabaseFactory::AcquireDatabase(Config& config)
+{
+	// The SQLite connection is shared by every thread already
+	if (!util::lowercase(std::string(config["DBType"])).compare("sqlite"))
+		return this->CreateDatabase(config);
+
+	std::size_t max_open = std::max(1, int(config["DBPoolSize"]));
+	double timeout = std::max(0.0, double(config["DBPoolTimeout"]));
+
+	Pool& pool = *this->_pool;
+	auto start = Pool::clock::now();
+	auto deadline = start + std::chrono::duration_cast<Pool::clock::duration>(std::chrono::duration<double>(timeout));
+	bool waited = false;
+
+	std::shared_ptr<Database> db;
+	std::unique_lock<std::mutex> guard(pool.lock);
+
+	while (!db)
+	{
+		if (!pool.idle.empty())
+		{
+			// Prefer the connection this thread used last, otherwise the most recently returned one
+			auto it = std::find_if(pool.idle.begin(), pool.idle.end(), [](const Pool::Idle& idle)
+			{
+				return idle.last_thread == std::this_thread::get_id();
+			});
+
+			if (it == pool.idle.end())
+				it = pool.idle.end() - 1;
+
+			Pool::Idle idle = std::move(*it);
+			pool.idle.erase(it);
+			++pool.stats.in_use;
+			guard.unlock();
+
+			bool healthy = true;
+
+			if (std::chrono::duration<double>(Pool::clock::now() - idle.last_used).count() > database_pool_check_idle)
+			{
+				try
+				{
+					idle.db->RawQuery("SELECT 1");
+				}
+				catch (Database_Exception&)
+				{
+					healthy = false;
+				}
+			}
+
+			if (healthy)
+			{
+				db = std::move(idle.db);
+				guard.lock();
+				break;
+			}
+
+			idle.db.reset();
+
+			try
+			{
+				db = this->CreateDatabase(config);
+			}
+			catch (...)
+			{
+				guard.lock();
+				--pool.stats.open;
+				--pool.stats.in_use;
+				pool.returned.notify_one();
+				throw;
+			}
+
+			guard.lock();
+			++pool.stats.reconnects;
+			break;
+		}
+
+		if (pool.stats.open < max_open)
+		{
+			++pool.stats.open;
+			++pool.stats.in_use;
+			guard.unlock();
+
+			try
+			{
+				db = this->CreateDatabase(config);
+			}
+			catch (...)
+			{
+				guard.lock();
+				--pool.stats.open;
+				--pool.stats.in_use;
+				pool.returned.notify_one();
+				throw;
+			}
+
+			guard.lock();
+			break;
+		}
+
+		if (Pool::clock::now() >= deadline)
+		{
+			++pool.stats.timeouts;
+			throw Database_OpenFailed("All pooled database connections are in use");
+		}
+
+		waited = true;
+		pool.returned.wait_until(guard, deadline);
+	}
+
+	++pool.stats.acquired;
+
+	if (waited)
+	{
+		double wait = std::chrono::duration<double>(Pool::clock::now() - start).count();
+		++pool.stats.waited;
+		pool.stats.wait_time += wait;
+		pool.stats.max_wait = std::max(pool.stats.max_wait, wait);
+	}
+
+	guard.unlock();
+
+	// Hand out an alias whose deleter puts the connection back, if the pool still exists
+	std::weak_ptr<Pool> weak_pool = this->_pool;
+	Database* raw = db.get();
+
+	return std::shared_ptr<Database>(raw, [weak_pool, db](Database*)
+	{
+		if (auto pool = weak_pool.lock())
+			pool->Release(db);
+	});
+}
+
+DatabasePoolStats DatabaseFactory::PoolStats() const
+{
+	std::lock_guard<std::mutex> guard(this->_pool->lock);
+	return this->_pool->stats;
+}
+
 Database::Bulk_Query_Context::Bulk_Query_Context(Database& db)
 	: db(db)
 	, pending(false)
@@ -297,12 +778,14 @@ Database::Database()
 	: impl(new impl_)
 	, connected(false)
 	, engine(Engine(0))
+	, failed(false)
 	, in_transaction(false)
 { }
 
 Database::Database(Database::Engine type, const std::string& host, unsigned short port, const std::string& user, const std::string& pass, const std::string& db, bool connectnow)
 	: impl(new impl_)
 	, connected(false)
+	, failed(false)
 	, in_transaction(false)
 {
 	if (connectnow)
@@ -534,12 +1017,14 @@ void Database::Close()
 	{
 		case MySQL:
 #ifdef DATABASE_MYSQL
+			this->impl->CloseMySQLStatements();
 			mysql_close(this->impl->mysql_handle);
 #endif // DATABASE_MYSQL
 			break;
 
 		case SQLite:
 #ifdef DATABASE_SQLITE
+			this->impl->FinalizeStatements();
 			sqlite3_close(this->impl->sqlite_handle);
 #endif // DATABASE_SQLITE
 			break;
@@ -556,6 +1041,19 @@ void Database::Close()
 }
 
 Database_Result Database::RawQuery(const char* query, bool tx_control, bool prepared)
+{
+	try
+	{
+		return this->ExecuteRaw(query, tx_control, prepared);
+	}
+	catch (Database_Exception &)
+	{
+		this->failed = true;
+		throw;
+	}
+}
+
+Database_Result Database::ExecuteRaw(const char* query, bool tx_control, bool prepared)
 {
 	if (!this->connected)
 	{
@@ -719,39 +1217,32 @@ Database_Result Database::RawQuery(const char* query, bool tx_control, bool prep
 				}
 			}
 
-			result.resize(static_cast<unsigned int>(mysql_num_rows(mresult)));
-			int i = 0;
+			for (int i = 0; i < num_fields; ++i)
+			{
+				result.AddColumn(fields[i].name);
+			}
+
+			result.cells.reserve(static_cast<std::size_t>(mysql_num_rows(mresult)) * num_fields);
+
 			for (MYSQL_ROW row = mysql_fetch_row(mresult); row != 0; row = mysql_fetch_row(mresult))
 			{
-				std::unordered_map<std::string, util::variant> resrow;
+				result.AddRow();
+
 				for (int ii = 0; ii < num_fields; ++ii)
 				{
-					util::variant rescell;
 					if (IS_NUM(fields[ii].type))
 					{
-						if (row[ii])
-						{
-							rescell = util::to_int(row[ii]);
-						}
-						else
-						{
-							rescell = 0;
-						}
+						result.AddInt(row[ii] ? util::to_int(row[ii]) : 0);
+					}
+					else if (row[ii])
+					{
+						result.AddText(row[ii], std::strlen(row[ii]));
 					}
 					else
 					{
-						if (row[ii])
-						{
-							rescell = row[ii];
-						}
-						else
-						{
-							rescell = "";
-						}
+						result.AddText("", 0);
 					}
-					resrow[fields[ii].name] = rescell;
 				}
-				result[i++] = resrow;
 			}
 
 			mysql_free_result(mresult);
@@ -765,8 +1256,8 @@ Database_Result Database::RawQuery(const char* query, bool tx_control, bool prep
 			{
 				throw Database_QueryFailed(sqlite3_errmsg(this->impl->sqlite_handle));
 			}
-			result = this->callbackdata;
-			this->callbackdata.clear();
+			result = std::move(this->callbackdata);
+			this->callbackdata = Database_Result();
 			break;
 #endif // DATABASE_SQLITE
 
@@ -786,20 +1277,19 @@ Database_Result Database::RawQuery(const char* query, bool tx_control, bool prep
 					if (numCols > 0)
 					{
 						// select data - get column names
-						std::vector<std::string> fields;
-						fields.reserve(numCols);
-
 						for (int colNdx = 1; colNdx <= numCols; ++colNdx)
 						{
 							char titleBuf[50] = { 0 };
 							SQLColAttribute(this->impl->hstmt, colNdx, SQL_DESC_NAME, titleBuf, sizeof(titleBuf), NULL, NULL);
-							fields.push_back(std::string(titleBuf));
+							result.AddColumn(std::string(titleBuf));
 						}
 
 						// get data values
 						while (SQLFetch(this->impl->hstmt) == SQL_SUCCESS && SQLSERVER_SUCCEEDED(ret))
 						{
-							std::unordered_map<std::string, util::variant> resrow;
+							std::size_t cells_before = result.cells.size();
+							std::size_t text_before = result.text.size();
+							result.AddRow();
 
 							for (SQLUSMALLINT colNdx = 1; colNdx <= numCols && SQLSERVER_SUCCEEDED(ret); ++colNdx)
 							{
@@ -814,9 +1304,12 @@ Database_Result Database::RawQuery(const char* query, bool tx_control, bool prep
 										SQLCHAR resultStr[2048] = { 0 };
 										ret = SQLGetData(this->impl->hstmt, colNdx, SQL_C_CHAR, resultStr, 2048, &nullIndicator);
 										if (SQLSERVER_SUCCEEDED(ret))
-											resrow[fields[colNdx-1]] = nullIndicator != SQL_NULL_DATA
-												? util::variant(std::string((const char*)resultStr))
-												: util::variant(std::string());
+										{
+											if (nullIndicator != SQL_NULL_DATA)
+												result.AddText((const char*)resultStr, std::strlen((const char*)resultStr));
+											else
+												result.AddText("", 0);
+										}
 									}
 									else
 									{
@@ -824,15 +1317,18 @@ Database_Result Database::RawQuery(const char* query, bool tx_control, bool prep
 										SQLINTEGER resultInt;
 										ret = SQLGetData(this->impl->hstmt, colNdx, static_cast<SQLSMALLINT>(colType), &resultInt, 0, &nullIndicator);
 										if (SQLSERVER_SUCCEEDED(ret))
-											resrow[fields[colNdx-1]] = nullIndicator != SQL_NULL_DATA
-												? util::variant(resultInt)
-												: util::variant(0);
+											result.AddInt(nullIndicator != SQL_NULL_DATA ? int(resultInt) : 0);
 									}
 								}
 							}
 
-							if (SQLSERVER_SUCCEEDED(ret))
-								result.push_back(resrow);
+							// Drop a row which could not be read in full
+							if (!SQLSERVER_SUCCEEDED(ret))
+							{
+								result.cells.resize(cells_before);
+								result.text.resize(text_before);
+								--result.rows;
+							}
 						}
 					}
 					else
@@ -871,12 +1367,19 @@ Database_Result Database::RawQuery(const char* query, bool tx_control, bool prep
 }
 
 Database::QueryParameterPair Database::ParseQueryArgs(const char * format, va_list ap) const
+{
+	return this->ParseQuery(format,
+		[&ap]() -> int { return va_arg(ap, int); },
+		[&ap]() -> const char * { return va_arg(ap, char *); });
+}
+
+Database::QueryParameterPair Database::ParseQuery(const char *format, const std::function<int()> &next_int, const std::function<const char *()> &next_string) const
 {
 	std::string finalquery;
 	std::list<std::string> parameters;
 
 	int tempi;
-	char *tempc;
+	const char *tempc;
 #if defined(DATABASE_MYSQL) || defined(DATABASE_SQLITE)
 	char *escret;
 #ifdef DATABASE_MYSQL
@@ -889,12 +1392,12 @@ Database::QueryParameterPair Database::ParseQueryArgs(const char * format, va_li
 	{
 		if (*p == '#')
 		{
-			tempi = va_arg(ap,int);
+			tempi = next_int();
 			finalquery += util::to_string(tempi);
 		}
 		else if (*p == '@')
 		{
-			tempc = va_arg(ap,char *);
+			tempc = next_string();
 			auto tmpStr = static_cast<std::string>(tempc);
 
 			if (this->engine == Database::SqlServer)
@@ -907,7 +1410,7 @@ Database::QueryParameterPair Database::ParseQueryArgs(const char * format, va_li
 		}
 		else if (*p == '$')
 		{
-			tempc = va_arg(ap,char *);
+			tempc = next_string();
 			switch (this->engine)
 			{
 				case MySQL:
@@ -965,10 +1468,383 @@ Database_Result Database::Query(const char *format, ...)
 	}
 
 	std::va_list ap;
+
+	if (this->engine == SQLite || this->engine == MySQL)
+	{
+		std::vector<Query_Arg> args;
+
+		va_start(ap, format);
+
+		for (const char *p = format; *p != '\0'; ++p)
+		{
+			if (*p == '#')
+				args.push_back(Query_Arg{true, va_arg(ap, int), nullptr});
+			else if (*p == '$' || *p == '@')
+				args.push_back(Query_Arg{false, 0, va_arg(ap, char *)});
+		}
+
+		va_end(ap);
+
+		return this->ExecuteFormatted(format, args);
+	}
+
 	va_start(ap, format);
 	QueryParameterPair queryState = std::move(this->ParseQueryArgs(format, ap));
 	va_end(ap);
 
+	return this->ExecuteQuery(queryState);
+}
+
+Database_Result Database::QueryValues(const char *format, const std::vector<std::string> &args)
+{
+	if (!this->connected)
+	{
+		throw Database_QueryFailed("Not connected to database.");
+	}
+
+	std::size_t next = 0;
+
+	auto next_arg = [&]() -> const std::string &
+	{
+		if (next >= args.size())
+			throw Database_QueryFailed("Not enough arguments for query.");
+
+		return args[next++];
+	};
+
+	if (this->engine == SQLite || this->engine == MySQL)
+	{
+		std::vector<Query_Arg> values;
+
+		for (const char *p = format; *p != '\0'; ++p)
+		{
+			if (*p == '#')
+				values.push_back(Query_Arg{true, util::to_int(next_arg()), nullptr});
+			else if (*p == '$' || *p == '@')
+				values.push_back(Query_Arg{false, 0, next_arg().c_str()});
+		}
+
+		return this->ExecuteFormatted(format, values);
+	}
+
+	QueryParameterPair queryState = this->ParseQuery(format,
+		[&]() { return util::to_int(next_arg()); },
+		[&]() { return next_arg().c_str(); });
+
+	return this->ExecuteQuery(queryState);
+}
+
+Database_Result Database::ExecuteFormatted(const char *format, const std::vector<Query_Arg> &args)
+{
+	std::string sql;
+	std::vector<const Query_Arg *> bound;
+	bool bindable = true;
+	std::size_t next = 0;
+
+	for (const char *p = format; *p != '\0' && bindable; ++p)
+	{
+		if (*p == '#' || *p == '$' || *p == '@')
+		{
+			const Query_Arg &arg = args[next++];
+
+			if (*p == '@')
+			{
+				sql += arg.text;
+				continue;
+			}
+
+			// Only a value which makes up a whole string literal can be bound in its place
+			bool quoted = !sql.empty() && sql.back() == '\'' && p[1] == '\'';
+
+			if (quoted)
+			{
+				sql.pop_back();
+				++p;
+			}
+			else if (*p == '$')
+			{
+				bindable = false;
+			}
+
+			sql += '?';
+			bound.push_back(&arg);
+		}
+		else
+		{
+			sql += *p;
+		}
+	}
+
+	Database_Result result;
+	bool executed = false;
+
+	try
+	{
+		executed = bindable && this->ExecutePrepared(sql, bound, result);
+	}
+	catch (Database_Exception &)
+	{
+		this->failed = true;
+		throw;
+	}
+
+	if (executed)
+		return result;
+
+	next = 0;
+
+	QueryParameterPair queryState = this->ParseQuery(format,
+		[&]() { return args[next++].i; },
+		[&]() { return args[next++].text; });
+
+	return this->ExecuteQuery(queryState);
+}
+
+bool Database::ExecutePrepared(const std::string &sql, const std::vector<const Query_Arg *> &bound, Database_Result &result)
+{
+#ifdef DATABASE_DEBUG
+	Console::Dbg("%s", sql.c_str());
+#endif // DATABASE_DEBUG
+
+	switch (this->engine)
+	{
+#ifdef DATABASE_MYSQL
+		case MySQL:
+		{
+			// Writes in a transaction are logged as text for RawQuery to replay after a reconnect
+			if (this->in_transaction && std::strncmp(sql.c_str(), "SELECT", 6) != 0)
+				return false;
+
+			std::lock_guard<std::mutex> guard(this->impl->statement_lock);
+			MYSQL_STMT *stmt = this->impl->PrepareMySQL(sql);
+
+			// A ? inside a literal would take the place of an argument
+			if (!stmt || mysql_stmt_param_count(stmt) != bound.size())
+				return false;
+
+			std::vector<MYSQL_BIND> params(bound.size());
+			std::vector<unsigned long> lengths(bound.size());
+
+			for (std::size_t i = 0; i < bound.size(); ++i)
+			{
+				MYSQL_BIND &param = params[i];
+
+				if (bound[i]->integer)
+				{
+					param.buffer_type = MYSQL_TYPE_LONG;
+					param.buffer = const_cast<int *>(&bound[i]->i);
+				}
+				else
+				{
+					lengths[i] = std::strlen(bound[i]->text);
+					param.buffer_type = MYSQL_TYPE_STRING;
+					param.buffer = const_cast<char *>(bound[i]->text);
+					param.buffer_length = lengths[i];
+					param.length = &lengths[i];
+				}
+			}
+
+			if ((!params.empty() && mysql_stmt_bind_param(stmt, params.data()) != 0) || mysql_stmt_execute(stmt) != 0)
+			{
+				// RawQuery reconnects, and closes the statements of the old connection when it does
+				if (database_mysql_recoverable(mysql_stmt_errno(stmt)))
+					return false;
+
+				throw Database_QueryFailed(mysql_stmt_error(stmt));
+			}
+
+			MYSQL_RES *metadata = mysql_stmt_result_metadata(stmt);
+
+			if (!metadata)
+			{
+				if (mysql_stmt_field_count(stmt) != 0)
+					throw Database_QueryFailed(mysql_stmt_error(stmt));
+
+				result.affected_rows = static_cast<int>(mysql_stmt_affected_rows(stmt));
+				return true;
+			}
+
+			unsigned int num_fields = mysql_num_fields(metadata);
+			MYSQL_FIELD *fields = mysql_fetch_fields(metadata);
+
+			// Every column is fetched as text, the same as RawQuery reads it
+			std::vector<MYSQL_BIND> columns(num_fields);
+			std::vector<std::vector<char>> buffers(num_fields);
+
+			for (unsigned int i = 0; i < num_fields; ++i)
+			{
+				result.AddColumn(fields[i].name ? fields[i].name : "");
+
+				buffers[i].resize(std::min<unsigned long>(fields[i].length, 255) + 1);
+
+				MYSQL_BIND &column = columns[i];
+				column.buffer_type = MYSQL_TYPE_STRING;
+				column.buffer = buffers[i].data();
+				column.buffer_length = buffers[i].size();
+				column.length = &column.length_value;
+				column.is_null = &column.is_null_value;
+				column.error = &column.error_value;
+			}
+
+			int rc = 1;
+
+			try
+			{
+				if (mysql_stmt_bind_result(stmt, columns.data()) != 0 || mysql_stmt_store_result(stmt) != 0)
+					throw Database_QueryFailed(mysql_stmt_error(stmt));
+
+				result.cells.reserve(static_cast<std::size_t>(mysql_stmt_num_rows(stmt)) * num_fields);
+
+				std::string long_value;
+
+				while ((rc = mysql_stmt_fetch(stmt)) == 0 || rc == MYSQL_DATA_TRUNCATED)
+				{
+					result.AddRow();
+
+					for (unsigned int i = 0; i < num_fields; ++i)
+					{
+						MYSQL_BIND &column = columns[i];
+
+						if (column.is_null_value)
+						{
+							if (IS_NUM(fields[i].type))
+								result.AddInt(0);
+							else
+								result.AddText("", 0);
+
+							continue;
+						}
+
+						const char *data = buffers[i].data();
+						std::size_t length = column.length_value;
+
+						// Values longer than the buffer are fetched again whole
+						if (column.error_value)
+						{
+							long_value.resize(length);
+
+							MYSQL_BIND whole = column;
+							whole.buffer = &long_value[0];
+							whole.buffer_length = length;
+
+							if (mysql_stmt_fetch_column(stmt, &whole, i, 0) != 0)
+								throw Database_QueryFailed(mysql_stmt_error(stmt));
+
+							data = long_value.data();
+						}
+
+						if (IS_NUM(fields[i].type))
+							result.AddInt(util::to_int(std::string(data, length)));
+						else
+							result.AddText(data, length);
+					}
+				}
+			}
+			catch (...)
+			{
+				mysql_stmt_free_result(stmt);
+				mysql_free_result(metadata);
+				throw;
+			}
+
+			mysql_stmt_free_result(stmt);
+			mysql_free_result(metadata);
+
+			if (rc != MYSQL_NO_DATA)
+				throw Database_QueryFailed(mysql_stmt_error(stmt));
+
+			return true;
+		}
+#endif // DATABASE_MYSQL
+
+#ifdef DATABASE_SQLITE
+		case SQLite:
+		{
+			std::lock_guard<std::mutex> guard(this->impl->statement_lock);
+			sqlite3_stmt *stmt = this->impl->Prepare(sql);
+
+			if (!stmt)
+				return false;
+
+			int index = 0;
+
+			for (const Query_Arg *arg : bound)
+			{
+				++index;
+
+				if (arg->integer)
+					sqlite3_bind_int(stmt, index, arg->i);
+				else
+					sqlite3_bind_text(stmt, index, arg->text, -1, SQLITE_STATIC);
+			}
+
+			int columns = sqlite3_column_count(stmt);
+
+			for (int i = 0; i < columns; ++i)
+			{
+				const char *name = sqlite3_column_name(stmt, i);
+				result.AddColumn(name ? name : "");
+			}
+
+			int rc;
+
+			while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+			{
+				result.AddRow();
+
+				for (int i = 0; i < columns; ++i)
+				{
+					switch (sqlite3_column_type(stmt, i))
+					{
+						case SQLITE_INTEGER:
+						{
+							sqlite3_int64 value = sqlite3_column_int64(stmt, i);
+
+							if (value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max())
+							{
+								result.AddInt(int(value));
+								break;
+							}
+						}
+						// fall through
+
+						default:
+						{
+							const unsigned char *text = sqlite3_column_text(stmt, i);
+							result.AddText(text ? reinterpret_cast<const char *>(text) : "", std::size_t(sqlite3_column_bytes(stmt, i)));
+							break;
+						}
+
+						case SQLITE_NULL:
+							result.AddText("", 0);
+							break;
+					}
+				}
+			}
+
+			sqlite3_reset(stmt);
+			sqlite3_clear_bindings(stmt);
+
+			if (rc != SQLITE_DONE)
+				throw Database_QueryFailed(sqlite3_errmsg(this->impl->sqlite_handle));
+
+			if (columns == 0)
+				result.affected_rows = sqlite3_changes(this->impl->sqlite_handle);
+
+			return true;
+		}
+#endif // DATABASE_SQLITE
+
+		default:
+			(void)sql;
+			(void)bound;
+			(void)result;
+			return false;
+	}
+}
+
+Database_Result Database::ExecuteQuery(QueryParameterPair &queryState)
+{
 	std::string& finalquery = queryState.first;
 	bool prepared = false;
 
@@ -1114,6 +1990,11 @@ void Database::ExecuteFile(const std::string& filename)
 	this->ExecuteQueries(queries.begin(), queriesEnd);
 }
 
+bool Database::Failed() const
+{
+	return this->failed;
+}
+
 bool Database::Pending() const
 {
 	return this->in_transaction;
@@ -12,8 +12,11 @@
 #include "util/variant.hpp"
 
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <functional>
+#include <iterator>
 #include <list>
 #include <memory>
 #include <string>
@@ -56,20 +59,140 @@ class Database_QueryFailed : public Database_Exception
 };
 
 /**
- * Result from a Database Query containing the SELECTed rows, and/or affected row counts and error information
+ * Result from a Database Query containing the SELECTed rows, and/or affected row counts and error information.
+ * Column names are stored once, every row's cells are packed in to one array and all text shares one buffer.
  */
-class Database_Result : public std::vector<std::unordered_map<std::string, util::variant>>
+class Database_Result
 {
 	protected:
+		struct Cell
+		{
+			std::uint32_t offset;
+			std::uint32_t length;
+			int value;
+			bool text;
+		};
+
+		std::vector<std::string> columns;
+		std::vector<Cell> cells;
+		std::string text;
+		std::size_t rows;
+
 		int affected_rows;
 		bool error;
 
+		const Cell *At(std::size_t row, std::size_t column) const;
+
 	public:
+		static const std::size_t npos = std::size_t(-1);
+
+		/**
+		 * View of one row of a result, valid for as long as the result it came from
+		 */
+		class Row
+		{
+			protected:
+				const Database_Result *result;
+				std::size_t row;
+
+			public:
+				Row(const Database_Result *result, std::size_t row)
+					: result(result)
+					, row(row)
+				{ }
+
+				/**
+				 * Returns the index of a column, see Database_Result::Column
+				 */
+				std::size_t Column(const std::string &name) const { return this->result->Column(name); }
+
+				/**
+				 * Returns a cell as an integer, converting text if neccessary. Missing columns read as 0.
+				 */
+				int GetInt(std::size_t column) const;
+
+				/**
+				 * Returns a cell as a string, converting integers if neccessary. Missing columns read as "".
+				 */
+				std::string GetString(std::size_t column) const;
+
+				/**
+				 * Looks a cell up by column name, for callers written against the old row maps
+				 */
+				util::variant operator[](const std::string &column) const;
+
+				/**
+				 * Copies the row in to the map of column names to values results used to be made of
+				 */
+				operator std::unordered_map<std::string, util::variant>() const;
+
+			friend class Database_Result;
+		};
+
+		class const_iterator
+		{
+			protected:
+				Row row;
+
+			public:
+				typedef std::forward_iterator_tag iterator_category;
+				typedef Row value_type;
+				typedef std::ptrdiff_t difference_type;
+				typedef const Row *pointer;
+				typedef const Row &reference;
+
+				const_iterator(const Database_Result *result, std::size_t row) : row(result, row) { }
+
+				reference operator *() const { return this->row; }
+				pointer operator ->() const { return &this->row; }
+				const_iterator &operator ++() { ++this->row.row; return *this; }
+				const_iterator operator ++(int) { const_iterator it(*this); ++this->row.row; return it; }
+				bool operator ==(const const_iterator &other) const { return this->row.row == other.row.row; }
+				bool operator !=(const const_iterator &other) const { return this->row.row != other.row.row; }
+		};
+
+		typedef const_iterator iterator;
+		typedef Row value_type;
+
 		Database_Result()
-			: affected_rows(0)
+			: rows(0)
+			, affected_rows(0)
 			, error(false)
 		{ }
 
+		std::size_t size() const { return this->rows; }
+		bool empty() const { return this->rows == 0; }
+
+		Row operator [](std::size_t row) const { return Row(this, row); }
+		Row front() const { return Row(this, 0); }
+
+		const_iterator begin() const { return const_iterator(this, 0); }
+		const_iterator end() const { return const_iterator(this, this->rows); }
+
+		/**
+		 * Returns the index of the named column, to look cells up by in every row, or npos if there is no such column
+		 */
+		std::size_t Column(const std::string &name) const;
+
+		const std::vector<std::string> &Columns() const { return this->columns; }
+
+		/**
+		 * Adds a column. Rows already in the result read as "" in it.
+		 */
+		void AddColumn(const std::string &name);
+
+		/**
+		 * Starts a new row, to be filled with one AddInt or AddText per column in order
+		 */
+		void AddRow();
+		void AddInt(int value);
+		void AddText(const char *value, std::size_t length);
+
+		/**
+		 * Appends a row given as a map of column names to values, adding any columns not seen before
+		 */
+		void push_back(const std::unordered_map<std::string, util::variant> &row);
+
 		/**
 		 * Returns the number of affected rows from an UPDATE or INSERT query
 		 */
@@ -83,12 +206,56 @@ class Database_Result : public std::vector<std::unordered_map<std::string, util:
 	friend class Database;
 };
 
+/**
+ * A formatted query and its arguments, for running later with Database::QueryValues
+ */
+struct Database_Query
+{
+	std::string format;
+	std::vector<std::string> args;
+};
+
+/**
+ * Counters kept by the connection pool behind DatabaseFactory::AcquireDatabase
+ */
+struct DatabasePoolStats
+{
+	std::size_t open = 0;
+	std::size_t in_use = 0;
+
+	unsigned long long acquired = 0;
+	unsigned long long waited = 0;
+	unsigned long long timeouts = 0;
+	unsigned long long reconnects = 0;
+
+	double wait_time = 0.0;
+	double max_wait = 0.0;
+};
+
 class DatabaseFactory
 {
 public:
+	DatabaseFactory();
+
 	virtual std::shared_ptr<Database> CreateDatabase(Config& config, bool logConnection = false);
 
+	/**
+	 * Lends out a pooled connection, opening a new one only when all are busy and DBPoolSize allows it.
+	 * A thread is given back the connection it last used where possible.
+	 * The connection returns to the pool once the last copy of the returned pointer is released, unless a query on it threw,
+	 * in which case it is closed instead.
+	 * @throw Database_OpenFailed if the pool stays exhausted for DBPoolTimeout seconds
+	 */
+	std::shared_ptr<Database> AcquireDatabase(Config& config);
+
+	DatabasePoolStats PoolStats() const;
+
+	virtual ~DatabaseFactory() = default;
+
 private:
+	struct Pool;
+
+	std::shared_ptr<Pool> _pool;
 	std::shared_ptr<Database> _sqliteConnection;
 };
 
@@ -113,14 +280,53 @@ class Database
 		bool connected;
 		Engine engine;
 
+		/**
+		 * Set once a query on this connection has thrown, after which it can't be trusted to be lent out again
+		 */
+		bool failed;
+
 		std::string host, user, pass, db;
 		unsigned int port;
 
 		bool in_transaction;
 		std::list<std::string> transaction_log;
 
+		/**
+		 * Runs a query for RawQuery, which marks the connection as failed if this throws
+		 */
+		Database_Result ExecuteRaw(const char* query, bool tx_control, bool prepared);
+
 		typedef std::pair<std::string, std::list<std::string>> QueryParameterPair;
 		QueryParameterPair ParseQueryArgs(const char * format, va_list ap) const;
+		QueryParameterPair ParseQuery(const char *format, const std::function<int()> &next_int, const std::function<const char *()> &next_string) const;
+
+		/**
+		 * Binds any parameters (SqlServer) and runs a query parsed by ParseQuery
+		 */
+		Database_Result ExecuteQuery(QueryParameterPair &queryState);
+
+		/**
+		 * An argument to a formatted query, in the order of its #, $ and @ tokens
+		 */
+		struct Query_Arg
+		{
+			bool integer;
+			int i;
+			const char *text;
+		};
+
+		/**
+		 * Runs a formatted query with its # and '$' arguments bound to a cached prepared statement (SQLite and MySQL).
+		 * Queries which can't be bound that way, such as a $ in the middle of a string literal, are escaped and run by ExecuteQuery.
+		 */
+		Database_Result ExecuteFormatted(const char *format, const std::vector<Query_Arg> &args);
+
+		/**
+		 * Binds the arguments to the cached statement for sql and steps it to completion
+		 * @return false if the engine has no statement cache or sql is not a single statement, or for MySQL if RawQuery has to recover the connection or log the query for replay
+		 * @throw Database_QueryFailed
+		 */
+		bool ExecutePrepared(const std::string &sql, const std::vector<const Query_Arg *> &bound, Database_Result &result);
 
 	public:
 		struct Bulk_Query_Context
@@ -174,6 +380,14 @@ class Database
 		 */
 		virtual Database_Result Query(const char *format, ...);
 
+		/**
+		 * Executes a formatted query taking its arguments from a list, for queries built at runtime.
+		 * Arguments are used in order for both # and $ tokens, and # arguments are converted to integers.
+		 * @throw Database_QueryFailed
+		 * @throw Database_OpenFailed
+		 */
+		virtual Database_Result QueryValues(const char *format, const std::vector<std::string> &args);
+
 		/**
 		 * Escapes a piece of text (including Query replacement tokens)
 		 */
@@ -206,6 +420,11 @@ class Database
 		 */
 		virtual void ExecuteFile(const std::string& filename);
 
+		/**
+		 * Whether any query on this connection has thrown a Database_Exception
+		 */
+		bool Failed() const;
+
 		virtual bool Pending() const;
 		virtual bool BeginTransaction();
 		virtual void Commit();
@@ -10,8 +10,12 @@
 #include "config.hpp"
 #include "eoclient.hpp"
 #include "eodata.hpp"
+#include "eoserv_config.hpp"
 #include "eoserver.hpp"
+#include "filecache.hpp"
+#include "netthread.hpp"
 #include "packet.hpp"
+#include "packettrace.hpp"
 #include "player.hpp"
 #include "timer.hpp"
 #include "world.hpp"
@@ -25,26 +29,83 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <utility>
 
-void ActionQueue::AddAction(const PacketReader& reader, double time, bool auto_queue)
+void ActionQueue_Action::Set(const PacketReader &reader_, double time_, bool auto_queue_)
 {
-	this->queue.emplace(new ActionQueue_Action(reader, time, auto_queue));
+	util::string_view packet = reader_.Data();
+
+	this->data.assign(packet.data(), packet.length());
+	this->reader = PacketReader(this->data, reader_.Position());
+	this->time = time_;
+	this->auto_queue = auto_queue_;
 }
 
-ActionQueue::~ActionQueue()
+ActionQueue_Action::~ActionQueue_Action()
+{
+	std::fill(UTIL_RANGE(this->data), '\0');
+}
+
+void ActionQueue::AddAction(const PacketReader& reader, double time, bool auto_queue)
 {
-	while (!this->queue.empty())
+	if (this->count == this->actions.size())
 	{
-		this->queue.pop();
+		// Unwrap the queue before growing it
+		std::rotate(this->actions.begin(), this->actions.begin() + this->head, this->actions.end());
+		this->head = 0;
+		this->actions.resize(std::max<std::size_t>(8, this->actions.size() * 2));
 	}
+
+	std::unique_ptr<ActionQueue_Action> &slot = this->actions[(this->head + this->count) % this->actions.size()];
+
+	if (!this->spare.empty())
+	{
+		slot = std::move(this->spare.back());
+		this->spare.pop_back();
+	}
+	else
+	{
+		slot.reset(new ActionQueue_Action);
+	}
+
+	slot->Set(reader, time, auto_queue);
+	++this->count;
+}
+
+std::unique_ptr<ActionQueue_Action> ActionQueue::Pop()
+{
+	if (this->count == 0)
+		return nullptr;
+
+	std::unique_ptr<ActionQueue_Action> action = std::move(this->actions[this->head]);
+	this->head = (this->head + 1) % this->actions.size();
+	--this->count;
+
+	return action;
+}
+
+void ActionQueue::Recycle(std::unique_ptr<ActionQueue_Action> action)
+{
+	std::fill(UTIL_RANGE(action->data), '\0');
+	action->data.clear();
+	action->reader = PacketReader(util::string_view());
+
+	this->spare.push_back(std::move(action));
+}
+
+ActionQueue::~ActionQueue()
+{
+
 }
 
 void EOClient::Initialize()
 {
-	this->upload_fh = 0;
+	this->uploading = false;
+	this->net_thread = nullptr;
+	this->net_released = false;
 	this->seq_start = 0;
 	this->upcoming_seq_start = -1;
 	this->seq = 0;
@@ -60,151 +121,102 @@ void EOClient::Initialize()
 	this->start = Timer::GetTime();
 }
 
-void EOClient::LogPacket(PacketFamily family, PacketAction action, size_t sz, const char * const actionStr)
+void EOClient::TracePacket(PacketFamily family, PacketAction action, std::size_t length, PacketTrace::Direction direction)
 {
-	std::string ignoreFamilies = static_cast<std::string>(this->server()->world->config["IgnorePacketFamilies"]);
+	PacketTrace &trace = this->server()->packet_trace;
 
-	if (ignoreFamilies != "*")
-	{
-		time_t rawtime;
-		time(&rawtime);
-		const tm * timeinfo = localtime(&rawtime);
+	if (!trace.Enabled(family, action))
+		return;
 
-		std::string fam = PacketProcessor::GetFamilyName(family);
-		std::string act = PacketProcessor::GetActionName(action);
-		if (ignoreFamilies.find(fam) == std::string::npos)
-		{
-			Console::Out("%02d/%02d/%04d - %02d:%02d:%02d | %-12s | %4s Family: %-15s | Action: %-15s | SIZE=%d",
-				timeinfo->tm_mon + 1,
-				timeinfo->tm_mday,
-				timeinfo->tm_year + 1900,
-				timeinfo->tm_hour,
-				timeinfo->tm_min,
-				timeinfo->tm_sec,
-				player ? player->character ? player->character->real_name.c_str() : "no char" : "no char",
-				actionStr,
-				fam.c_str(),
-				act.c_str(),
-				sz);
-		}
-	}
+	const char *name = (this->player && this->player->character) ? this->player->character->real_name.c_str() : nullptr;
+	trace.Trace(this->id, family, action, length, direction, name);
 }
 
 bool EOClient::NeedTick()
 {
-	return this->upload_fh;
+	return this->uploading;
 }
 
 void EOClient::Tick()
 {
-	std::string data;
-	int done = false;
-	int oldlength;
-
-	if (this->upload_fh)
+	if (this->uploading)
 	{
-		// Send more of the file instead of doing other tasks
-		std::size_t upload_available = std::min(this->upload_size - this->upload_pos, Client::SendBufferRemaining());
-
-		if (upload_available != 0)
-		{
-			upload_available = std::fread(&this->send_buffer[this->send_buffer_ppos + 1], 1, upload_available, this->upload_fh);
-
-			// Dynamically rewrite the bytes of the map to enable PK
-			if (this->upload_type == FILE_MAP && this->server()->world->config["GlobalPK"] && !this->server()->world->PKExcept(player->character->mapid))
-			{
-				if (this->upload_pos <= 0x03 && this->upload_pos + upload_available > 0x03)
-					this->send_buffer[this->send_buffer_ppos + 1 + 0x03 - this->upload_pos] = (char)0xFF;
-
-				if (this->upload_pos <= 0x03 && this->upload_pos + upload_available > 0x04)
-					this->send_buffer[this->send_buffer_ppos + 1 + 0x04 - this->upload_pos] = static_cast<char>(0x01);
-
-				if (this->upload_pos <= 0x1F && this->upload_pos + upload_available > 0x1F)
-					this->send_buffer[this->send_buffer_ppos + 1 + 0x1F - this->upload_pos] = static_cast<char>(0x04);
-			}
-
-			this->upload_pos += upload_available;
-			this->send_buffer_ppos += upload_available;
-			this->send_buffer_used += upload_available;
-		}
-		else if (this->upload_pos == this->upload_size && this->SendBufferRemaining() == this->send_buffer.length())
+		// The file is streamed straight from the shared image by Client::DoSend
+		if (!Client::SendPending())
 		{
 			using std::swap;
 
-			std::fclose(this->upload_fh);
-			this->upload_fh = 0;
-			this->upload_pos = 0;
-			this->upload_size = 0;
+			this->uploading = false;
 
 			// Place our temporary buffer back as the real one
 			swap(this->send_buffer, this->send_buffer2);
-			swap(this->send_buffer_gpos, this->send_buffer2_gpos);
-			swap(this->send_buffer_ppos, this->send_buffer2_ppos);
-			swap(this->send_buffer_used, this->send_buffer2_used);
+			this->send_buffer2.Reset(0);
 
-			// We're not using this anymore...
-			std::string empty;
-			swap(this->send_buffer2, empty);
+			if (!this->send_buffer.Empty())
+				this->CommitSend(0);
 		}
 	}
 	else
 	{
-		data = this->Recv((this->packet_state == EOClient::ReadData) ? this->length : 1);
+		if (this->ReadPacket(this->received))
+		{
+			this->Execute(this->received);
+			std::fill(UTIL_RANGE(this->received), '\0');
+		}
+	}
+}
+
+bool EOClient::ReadPacket(std::string &packet)
+{
+	char byte;
 
-		while (data.length() > 0 && !done)
+	for (;;)
+	{
+		switch (this->packet_state)
 		{
-			switch (this->packet_state)
+			case EOClient::ReadLen1:
+				if (this->Recv(&byte, 1) == 0)
+					return false;
+
+				this->raw_length[0] = byte;
+				this->packet_state = EOClient::ReadLen2;
+				break;
+
+			case EOClient::ReadLen2:
+				if (this->Recv(&byte, 1) == 0)
+					return false;
+
+				this->raw_length[1] = byte;
+				this->length = PacketProcessor::Number(this->raw_length[0], this->raw_length[1]);
+				this->packet_state = (this->length == 0) ? EOClient::ReadLen1 : EOClient::ReadData;
+				break;
+
+			case EOClient::ReadData:
 			{
-				case EOClient::ReadLen1:
-					this->raw_length[0] = data[0];
-					data[0] = '\0';
-					data.erase(0, 1);
-					this->packet_state = EOClient::ReadLen2;
-
-					if (data.length() == 0)
-					{
-						break;
-					}
-					// fall through
-				case EOClient::ReadLen2:
-					this->raw_length[1] = data[0];
-					data[0] = '\0';
-					data.erase(0, 1);
-					this->length = PacketProcessor::Number(this->raw_length[0], this->raw_length[1]);
-					this->packet_state = EOClient::ReadData;
-
-					if (data.length() == 0)
-					{
-						break;
-					}
-					// fall through
-				case EOClient::ReadData:
-					oldlength = this->data.length();
-					this->data += data.substr(0, this->length);
-					std::fill(data.begin(), data.begin() + std::min<std::size_t>(data.length(), this->length), '\0');
-					data.erase(0, this->length);
-					this->length -= this->data.length() - oldlength;
-
-					if (this->length == 0)
-					{
-						this->Execute(this->data);
-
-						std::fill(UTIL_RANGE(this->data), '\0');
-						this->data.erase();
-						this->packet_state = EOClient::ReadLen1;
-
-						done = true;
-					}
-					break;
-
-				default:
-					// If the code ever gets here, something is broken, so we just reset the client's state.
-					std::fill(UTIL_RANGE(data), '\0');
-					std::fill(UTIL_RANGE(this->data), '\0');
-					data.erase();
-					this->data.erase();
-					this->packet_state = EOClient::ReadLen1;
+				// Read straight in to the packet buffer, which keeps its capacity between packets
+				std::size_t have = this->data.length();
+				this->data.resize(have + this->length);
+
+				std::size_t got = this->Recv(&this->data[have], this->length);
+				this->data.resize(have + got);
+				this->length -= got;
+
+				if (this->length != 0)
+					return false;
+
+				// Whatever the caller's string held is cleared along with our buffer
+				packet.swap(this->data);
+				std::fill(UTIL_RANGE(this->data), '\0');
+				this->data.clear();
+				this->packet_state = EOClient::ReadLen1;
+				return true;
 			}
+
+			default:
+				// If the code ever gets here, something is broken, so we just reset the client's state.
+				std::fill(UTIL_RANGE(this->data), '\0');
+				this->data.clear();
+				this->packet_state = EOClient::ReadLen1;
 		}
 	}
 }
@@ -287,9 +299,20 @@ void EOClient::Execute(const std::string &data)
 	if (!this->Connected())
 		return;
 
-	PacketReader reader(processor.Decode(data));
+	this->decoded.resize(data.length());
+	this->processor.Decode(data.data(), data.length(), &this->decoded[0]);
+	this->Dispatch(this->decoded);
+	std::fill(UTIL_RANGE(this->decoded), '\0');
+}
+
+void EOClient::Dispatch(util::string_view decoded)
+{
+	if (!this->Connected())
+		return;
+
+	PacketReader reader(decoded);
 
-	this->LogPacket(reader.Family(), reader.Action(), reader.Length(), "RECV");
+	this->TracePacket(reader.Family(), reader.Action(), reader.Length(), PacketTrace::Recv);
 
 	if (reader.Family() == PACKET_INTERNAL)
 	{
@@ -314,7 +337,7 @@ void EOClient::Execute(const std::string &data)
 		else
 			client_seq = reader.GetChar();
 
-		if (this->server()->world->config["EnforceSequence"])
+		if (this->server()->world->settings->EnforceSequence)
 		{
 			if (client_seq != server_seq)
 			{
@@ -351,43 +374,19 @@ bool EOClient::Upload(FileType type, int id, InitReply init_reply)
 
 bool EOClient::Upload(FileType type, const std::string &filename, InitReply init_reply)
 {
-	using std::swap;
-
-	if (this->upload_fh)
+	if (this->uploading)
 		throw std::runtime_error("Already uploading file");
 
-	this->upload_fh = std::fopen(filename.c_str(), "rb");
-
-	if (!this->upload_fh)
-		return false;
-
-	if (std::fseek(this->upload_fh, 0, SEEK_END) != 0)
-	{
-		std::fclose(this->upload_fh);
-		return false;
-	}
-
-	this->upload_type = type;
-	this->upload_pos = 0;
-	this->upload_size = std::ftell(this->upload_fh);
-
-	std::fseek(this->upload_fh, 0, SEEK_SET);
-
-	std::size_t temp_buffer_size = this->send_buffer.size();
+	World *world = this->server()->world;
+	FileCache::Variant variant = FileCache::Raw;
 
-	// Allocate a power-of-two buffer size large enough to hold the file
-	while (temp_buffer_size < this->upload_size + 6)
-		temp_buffer_size *= 2;
+	if (type == FILE_MAP && world->settings->GlobalPK && !world->PKExcept(player->character->mapid))
+		variant = FileCache::GlobalPK;
 
-	this->send_buffer2.resize(temp_buffer_size);
-	this->send_buffer2_gpos = 0;
-	this->send_buffer2_ppos = 0;
-	this->send_buffer2_used = 0;
+	FileCache::ImagePtr image = world->file_cache.Get(filename, variant);
 
-	swap(this->send_buffer, this->send_buffer2);
-	swap(this->send_buffer_gpos, this->send_buffer2_gpos);
-	swap(this->send_buffer_ppos, this->send_buffer2_ppos);
-	swap(this->send_buffer_used, this->send_buffer2_used);
+	if (!image)
+		return false;
 
 	// Build the file upload header packet
 	PacketBuilder builder(PACKET_F_INIT, PACKET_A_INIT, 2);
@@ -396,57 +395,98 @@ bool EOClient::Upload(FileType type, const std::string &filename, InitReply init
 	if (type != FILE_MAP)
 		builder.AddChar(1);
 
-	builder.AddSize(this->upload_size);
+	builder.AddSize(image->Size());
+
+	this->TracePacket(PACKET_F_INIT, PACKET_A_INIT, builder.Length(), PacketTrace::Upload);
 
-	LogPacket(PACKET_F_INIT, PACKET_A_INIT, builder.Length(), "UPLD");
+	// The network thread holds back later packets until the file is out by itself
+	if (this->net_thread)
+	{
+		this->net_thread->Send(this, builder.Raw(), this->processor.GetEMulti().first);
+		this->net_thread->SendFile(this, FileCache::Data(image));
+		return true;
+	}
 
 	Client::Send(builder);
+	Client::SendFile(FileCache::Data(image));
+
+	// Anything sent from now on has to wait until the whole file is out
+	this->uploading = true;
+	this->send_buffer2.Reset(this->send_buffer.Capacity());
 
 	return true;
 }
 
-void EOClient::Send(const PacketBuilder &builder)
+void EOClient::SendRaw(unsigned short id, std::size_t payload_length, util::string_view raw)
 {
-	std::lock_guard<std::mutex> lock(send_mutex);
-
-	auto fam = PacketFamily(PacketProcessor::EPID(builder.GetID())[1]);
-	auto act = PacketAction(PacketProcessor::EPID(builder.GetID())[0]);
-	this->LogPacket(fam, act, builder.Length(), "SEND");
+	auto fam = PacketFamily(PacketProcessor::EPID(id)[1]);
+	auto act = PacketAction(PacketProcessor::EPID(id)[0]);
+	this->TracePacket(fam, act, payload_length, PacketTrace::Send);
 
-	std::string data = this->processor.Encode(builder);
+	// Stick any data sent during an upload in to our temporary buffer
+	util::RingBuffer &buffer = this->uploading ? this->send_buffer2 : this->send_buffer;
 
-	if (this->upload_fh)
+	if (raw.length() > buffer.Remaining())
 	{
-		// Stick any incoming data in to our temporary buffer
-		if (data.length() > this->send_buffer2.length() - this->send_buffer2_used)
-		{
-			this->Close(true);
-			return;
-		}
+		this->Close(true);
+		return;
+	}
 
-		const std::size_t mask = this->send_buffer2.length() - 1;
+	this->processor.Encode(raw.data(), raw.length(), buffer.WritableSegments());
 
-		for (std::size_t i = 0; i < data.length(); ++i)
-		{
-			this->send_buffer2_ppos = (this->send_buffer2_ppos + 1) & mask;
-			this->send_buffer2[this->send_buffer2_ppos] = data[i];
-		}
+	if (this->uploading)
+		buffer.Commit(raw.length());
+	else
+		this->CommitSend(raw.length());
+}
 
-		this->send_buffer2_used += data.length();
-	}
+void EOClient::QueueRaw(unsigned short id, std::size_t payload_length, std::shared_ptr<const std::string> raw)
+{
+	auto fam = PacketFamily(PacketProcessor::EPID(id)[1]);
+	auto act = PacketAction(PacketProcessor::EPID(id)[0]);
+	this->TracePacket(fam, act, payload_length, PacketTrace::Send);
+
+	this->net_thread->Send(this, std::move(raw), this->processor.GetEMulti().first);
+}
+
+void EOClient::QueueRaw(unsigned short id, std::size_t payload_length, util::string_view raw)
+{
+	auto fam = PacketFamily(PacketProcessor::EPID(id)[1]);
+	auto act = PacketAction(PacketProcessor::EPID(id)[0]);
+	this->TracePacket(fam, act, payload_length, PacketTrace::Send);
+
+	this->net_thread->Send(this, raw, this->processor.GetEMulti().first);
+}
+
+bool EOClient::SendEncoded(util::string_view raw, unsigned char emulti)
+{
+	if (raw.length() > this->send_buffer.Remaining())
+		return false;
+
+	PacketProcessor::Encode(raw.data(), raw.length(), this->send_buffer.WritableSegments(), emulti);
+	this->CommitSend(raw.length());
+
+	return true;
+}
+
+void EOClient::Send(const PacketBuilder &builder)
+{
+	if (this->net_thread)
+		this->QueueRaw(builder.GetID(), builder.Length(), builder.Raw());
 	else
-	{
-		Client::Send(data);
-	}
+		this->SendRaw(builder.GetID(), builder.Length(), builder.Raw());
 }
 
-EOClient::~EOClient()
+void EOClient::Send(const SharedPacket &packet)
 {
-	if (this->upload_fh)
-	{
-		std::fclose(this->upload_fh);
-	}
+	if (this->net_thread)
+		this->QueueRaw(packet.GetID(), packet.Length(), packet.Data());
+	else
+		this->SendRaw(packet.GetID(), packet.Length(), packet.Get());
+}
 
+EOClient::~EOClient()
+{
 	if (this->player)
 	{
 		delete this->player;
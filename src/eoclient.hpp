@@ -11,48 +11,84 @@
 
 #include "fwd/character.hpp"
 #include "fwd/eodata.hpp"
+#include "fwd/netthread.hpp"
 #include "fwd/player.hpp"
 #include "eoserver.hpp"
 #include "packet.hpp"
+#include "packettrace.hpp"
 
 #include "socket.hpp"
 
 #include <cstddef>
 #include <cstdio>
 #include <memory>
-#include <queue>
 #include <string>
 #include <utility>
-#include <mutex>
+#include <vector>
 
 /**
  * An action the server will execute for the client
  */
 struct ActionQueue_Action
 {
+	/**
+	 * Copy of the packet, which reader refers to.
+	 */
+	std::string data;
+
 	PacketReader reader;
 	double time;
 	bool auto_queue;
 
-	ActionQueue_Action(PacketReader reader_, double time_, bool auto_queue_ = false)
-		: reader(reader_)
-		, time(time_)
-		, auto_queue(auto_queue_)
+	ActionQueue_Action()
+		: reader(util::string_view())
+		, time(0.0)
+		, auto_queue(false)
 	{ }
+
+	ActionQueue_Action(const ActionQueue_Action &) = delete;
+	ActionQueue_Action &operator =(const ActionQueue_Action &) = delete;
+
+	/**
+	 * Copies a packet in to the action, keeping the reader's position.
+	 */
+	void Set(const PacketReader &reader_, double time_, bool auto_queue_);
+
+	~ActionQueue_Action();
 };
 
 /**
- * A list of actions a client needs to eventually have executed for it
+ * A list of actions a client needs to eventually have executed for it.
+ * Actions are recycled once they have been handled, so queueing a packet doesn't allocate in steady state.
  */
 class ActionQueue
 {
-	public:
-		std::queue<std::unique_ptr<ActionQueue_Action>> queue;
+	protected:
+		/**
+		 * Circular buffer of queued actions starting at head.
+		 */
+		std::vector<std::unique_ptr<ActionQueue_Action>> actions;
+		std::size_t head;
+		std::size_t count;
 
+		std::vector<std::unique_ptr<ActionQueue_Action>> spare;
+
+	public:
 		double next;
+
+		ActionQueue() : head(0), count(0), next(0) {};
+
 		void AddAction(const PacketReader& reader, double time, bool auto_queue = false);
 
-		ActionQueue() : next(0) {};
+		std::size_t Size() const { return this->count; }
+		bool Empty() const { return this->count == 0; }
+
+		/**
+		 * Removes the first action from the queue. Pass it to Recycle once it has been handled.
+		 */
+		std::unique_ptr<ActionQueue_Action> Pop();
+
+		void Recycle(std::unique_ptr<ActionQueue_Action> action);
 
 		~ActionQueue();
 };
@@ -82,24 +118,33 @@ class EOClient : public Client
 		void Initialize();
 		EOClient();
 
-		void LogPacket(PacketFamily family, PacketAction action, size_t sz, const char * const actionStr);
+		/**
+		 * Hands a packet to the server's packet trace if its family and action are being traced.
+		 */
+		void TracePacket(PacketFamily family, PacketAction action, std::size_t length, PacketTrace::Direction direction);
+
+		/**
+		 * Encodes a raw packet straight in to the active send buffer.
+		 */
+		void SendRaw(unsigned short id, std::size_t payload_length, util::string_view raw);
+
+		/**
+		 * Hands a raw packet to the client's network thread to be encoded and sent.
+		 */
+		void QueueRaw(unsigned short id, std::size_t payload_length, std::shared_ptr<const std::string> raw);
+		void QueueRaw(unsigned short id, std::size_t payload_length, util::string_view raw);
 
-		FileType upload_type;
-		std::FILE *upload_fh;
-		std::size_t upload_pos;
-		std::size_t upload_size;
+		/**
+		 * Set while a file is being streamed to the client, other packets are held in send_buffer2 until it is done.
+		 */
+		bool uploading;
 
-		std::string send_buffer2;
-		std::size_t send_buffer2_gpos;
-		std::size_t send_buffer2_ppos;
-		std::size_t send_buffer2_used;
+		util::RingBuffer send_buffer2;
 
 		int seq_start;
 		int upcoming_seq_start;
 		int seq;
 
-		std::mutex send_mutex;
-
 	public:
 		EOServer *server() { return static_cast<EOServer *>(Client::server); };
 		int version;
@@ -119,8 +164,21 @@ class EOClient : public Client
 		unsigned int length;
 		std::string data;
 
+		/**
+		 * Reused buffers for the last complete packet and its decoded form.
+		 */
+		std::string received;
+		std::string decoded;
+
 		PacketProcessor processor;
 
+		/**
+		 * Network thread servicing the client's socket, or null if it is serviced by EOServer::Tick.
+		 * Set and cleared by the game thread, net_released is set once the client has been handed back to it.
+		 */
+		NetThread *net_thread;
+		bool net_released;
+
 		EOClient(EOServer *server_) : Client(server_)
 		{
 			this->Initialize();
@@ -146,11 +204,29 @@ class EOClient : public Client
 		int GenUpcomingSequence();
 		void NewCreateID();
 
+		/**
+		 * Takes the next complete packet out of the receive buffer, if there is one.
+		 * @return false if a whole packet has not arrived yet
+		 */
+		bool ReadPacket(std::string &packet);
+
+		/**
+		 * Encodes a raw packet straight in to the send buffer, for use by the client's network thread.
+		 * @return false (and writes nothing) if there is not enough room
+		 */
+		bool SendEncoded(util::string_view raw, unsigned char emulti);
+
 		void Execute(const std::string &data);
 
+		/**
+		 * Checks the sequence of a decoded packet and queues it to be handled.
+		 */
+		void Dispatch(util::string_view decoded);
+
 		bool Upload(FileType type, int id, InitReply init_reply);
 		bool Upload(FileType type, const std::string &filename, InitReply init_reply);
 		virtual void Send(const PacketBuilder &packet);
+		virtual void Send(const SharedPacket &packet);
 
 		virtual ~EOClient();
 };
@@ -1,4 +1,3 @@
-
 /* $Id$
  * EOSERV is released under the zlib license.
  * See LICENSE.txt for more info.
@@ -7,9 +6,308 @@
 #ifndef EOSERV_CONFIG_HPP_INCLUDED
 #define EOSERV_CONFIG_HPP_INCLUDED
 
+#include "fwd/eoserv_config.hpp"
+
 #include "fwd/config.hpp"
 
+#include <string>
+#include <vector>
+
+/**
+ * Every key in the server config with the type it is read as and its default value.
+ * Expanded once for the defaults in eoserv_config_validate_config and once for the fields of ServerSettings.
+ * Durations are doubles parsed with util::tdparse, so "5m" and "300" are the same setting.
+ */
+#define EOSERV_CONFIG_SETTINGS(X) \
+	X(std::string, LogOut,                     "-") \
+	X(std::string, LogErr,                     "error.log") \
+	X(bool,        StyleConsole,               true) \
+	X(bool,        LogCommands,                true) \
+	X(int,         LogConnection,              0) \
+	X(std::string, Host,                       "0.0.0.0") \
+	X(int,         Port,                       8078) \
+	X(int,         MaxConnections,             300) \
+	X(int,         ListenBacklog,              50) \
+	X(int,         MaxPlayers,                 200) \
+	X(int,         MaxConnectionsPerIP,        3) \
+	X(double,      IPReconnectLimit,           10.0) \
+	X(int,         MaxConnectionsPerPC,        1) \
+	X(double,      HangupDelay,                10.0) \
+	X(bool,        QuietConnectionErrors,      false) \
+	X(int,         MaxLoginAttempts,           3) \
+	X(int,         LoginQueueSize,             10) \
+	X(std::string, SocketBackend,              "auto") \
+	X(int,         NetworkThreads,             0) \
+	X(bool,        CheckVersion,               true) \
+	X(int,         MinVersion,                 0) \
+	X(int,         MaxVersion,                 0) \
+	X(bool,        OldVersionCompat,           false) \
+	X(double,      TimedSave,                  "5m") \
+	X(bool,        AsyncSave,                  true) \
+	X(bool,        IgnoreHDID,                 false) \
+	X(std::string, ServerLanguage,             "./lang/en.ini") \
+	X(int,         PacketQueueMax,             40) \
+	X(double,      PingRate,                   60.0) \
+	X(bool,        EnforceSequence,            true) \
+	X(bool,        EnforceTimestamps,          true) \
+	X(bool,        EnforceSessions,            true) \
+	X(std::string, PasswordSalt,               "ChangeMe") \
+	X(int,         PasswordCurrentVersion,     2) \
+	X(int,         BcryptWorkload,             12) \
+	X(std::string, SeoseCompat,                "ChangeMe") \
+	X(std::string, SeoseCompatKey,             "D4q9_f30da%#q02#)8") \
+	X(std::string, DBType,                     "mysql") \
+	X(std::string, DBHost,                     "localhost") \
+	X(std::string, DBUser,                     "eoserv") \
+	X(std::string, DBPass,                     "eoserv") \
+	X(std::string, DBPassFile,                 "") \
+	X(std::string, DBName,                     "eoserv") \
+	X(int,         DBPort,                     0) \
+	X(int,         DBPoolSize,                 8) \
+	X(double,      DBPoolTimeout,              5.0) \
+	X(std::string, EIF,                        "./data/pub/dat001.eif") \
+	X(std::string, ENF,                        "./data/pub/dtn001.enf") \
+	X(std::string, ESF,                        "./data/pub/dsl001.esf") \
+	X(std::string, ECF,                        "./data/pub/dat001.ecf") \
+	X(std::string, NewsFile,                   "./data/news.txt") \
+	X(std::string, DropsFile,                  "./data/drops.ini") \
+	X(std::string, ShopsFile,                  "./data/shops.ini") \
+	X(std::string, ArenasFile,                 "./data/arenas.ini") \
+	X(std::string, FormulasFile,               "./data/formulas.ini") \
+	X(std::string, HomeFile,                   "./data/home.ini") \
+	X(std::string, SkillsFile,                 "./data/skills.ini") \
+	X(std::string, SpeechFile,                 "./data/speech.ini") \
+	X(std::string, MapDir,                     "./data/maps/") \
+	X(int,         Maps,                       278) \
+	X(std::string, QuestDir,                   "./data/quests/") \
+	X(int,         Quests,                     0) \
+	X(bool,        SLN,                        true) \
+	X(std::string, SLNURL,                     "http://eoserv.net/SLN/") \
+	X(std::string, SLNSite,                    "") \
+	X(std::string, ServerName,                 "Untitled Server") \
+	X(int,         SLNPeriod,                  600) \
+	X(std::string, SLNZone,                    "") \
+	X(std::string, SLNBind,                    "1") \
+	X(std::string, SLNClient,                  "") \
+	X(std::string, BotCharacters,              "") \
+	X(int,         GuildPrice,                 50000) \
+	X(int,         RecruitCost,                1000) \
+	X(int,         GuildMaxMembers,            5000) \
+	X(int,         GuildCreateMembers,         9) \
+	X(int,         GuildBankMax,               2000000000) \
+	X(std::string, GuildDefaultRanks,          "Leader,Recruiter,,,,,,,New Member") \
+	X(bool,        GuildShowRecruiters,        true) \
+	X(bool,        GuildCustomRanks,           false) \
+	X(int,         GuildEditRank,              1) \
+	X(int,         GuildKickRank,              1) \
+	X(int,         GuildPromoteRank,           1) \
+	X(int,         GuildPromoteSameRank,       1) \
+	X(int,         GuildDemoteRank,            1) \
+	X(int,         GuildRecruitRank,           2) \
+	X(int,         GuildDisbandRank,           0) \
+	X(bool,        GuildMultipleFounders,      true) \
+	X(bool,        GuildAnnounce,              true) \
+	X(std::string, GuildDateFormat,            "%Y/%m/%d") \
+	X(int,         GuildMinDeposit,            1000) \
+	X(int,         GuildMaxNameLength,         24) \
+	X(int,         GuildMaxDescLength,         240) \
+	X(int,         GuildMaxRankLength,         16) \
+	X(int,         GuildMaxWidth,              180) \
+	X(bool,        GlobalPK,                   false) \
+	X(std::string, PKExcept,                   "") \
+	X(int,         NPCChaseMode,               0) \
+	X(int,         NPCChaseDistance,           18) \
+	X(double,      NPCBoredTimer,              30) \
+	X(int,         NPCAdjustMaxDam,            3) \
+	X(int,         NPCThreads,                 0) \
+	X(int,         BoardMaxPosts,              20) \
+	X(int,         BoardMaxUserPosts,          6) \
+	X(int,         BoardMaxRecentPosts,        2) \
+	X(int,         BoardRecentPostTime,        1800) \
+	X(int,         BoardMaxSubjectLength,      32) \
+	X(int,         BoardMaxPostLength,         2048) \
+	X(bool,        BoardDatePosts,             true) \
+	X(int,         AdminBoard,                 8) \
+	X(int,         AdminBoardLimit,            100) \
+	X(bool,        FirstCharacterAdmin,        true) \
+	X(bool,        ShowLevel,                  false) \
+	X(bool,        WarpBubbles,                true) \
+	X(bool,        HideGlobal,                 false) \
+	X(int,         GlobalBuffer,               0) \
+	X(std::string, AdminPrefix,                "$") \
+	X(int,         StatPerLevel,               3) \
+	X(int,         SkillPerLevel,              3) \
+	X(int,         EnforceWeight,              2) \
+	X(int,         MaxWeight,                  250) \
+	X(int,         MaxLevel,                   250) \
+	X(int,         MaxExp,                     2000000000) \
+	X(int,         MaxStat,                    10000) \
+	X(int,         MaxSkillLevel,              100) \
+	X(int,         MaxSkills,                  48) \
+	X(int,         MaxCharacters,              3) \
+	X(int,         MaxShopBuy,                 4) \
+	X(double,      GhostTimer,                 4) \
+	X(double,      SpellCastCooldown,          0.6) \
+	X(double,      DropTimer,                  120) \
+	X(int,         DropAmount,                 15) \
+	X(double,      ProtectPlayerDrop,          5) \
+	X(double,      ProtectNPCDrop,             30) \
+	X(double,      ProtectPKDrop,              60) \
+	X(double,      ProtectDeathDrop,           300) \
+	X(int,         SeeDistance,                11) \
+	X(int,         DropDistance,               2) \
+	X(int,         RangedDistance,             5) \
+	X(bool,        ItemDespawn,                false) \
+	X(double,      ItemDespawnCheck,           60) \
+	X(double,      ItemDespawnRate,            600) \
+	X(double,      RecoverSpeed,               90) \
+	X(double,      NPCRecoverSpeed,            105) \
+	X(double,      HPRecoverRate,              0.1) \
+	X(double,      SitHPRecoverRate,           0.2) \
+	X(double,      TPRecoverRate,              0.1) \
+	X(double,      SitTPRecoverRate,           0.2) \
+	X(double,      NPCRecoverRate,             0.1) \
+	X(double,      SpikeTime,                  1.5) \
+	X(double,      SpikeDamage,                0.2) \
+	X(double,      DrainTime,                  15) \
+	X(double,      DrainHPDamage,              0.2) \
+	X(double,      DrainTPDamage,              0.1) \
+	X(double,      QuakeRate,                  5) \
+	X(std::string, Quake1,                     "4,12,0,1") \
+	X(std::string, Quake2,                     "6,12,0,2") \
+	X(std::string, Quake3,                     "2,10,3,5") \
+	X(std::string, Quake4,                     "1,4,6,8") \
+	X(int,         ChatLength,                 128) \
+	X(int,         ShareMode,                  2) \
+	X(int,         PartyShareMode,             2) \
+	X(int,         DropRateMode,               3) \
+	X(bool,        GhostNPC,                   false) \
+	X(bool,        GhostArena,                 false) \
+	X(bool,        AllowStats,                 true) \
+	X(int,         StartMap,                   0) \
+	X(int,         StartX,                     0) \
+	X(int,         StartY,                     0) \
+	X(int,         JailMap,                    76) \
+	X(int,         JailX,                      6) \
+	X(int,         JailY,                      7) \
+	X(int,         UnJailX,                    8) \
+	X(int,         UnJailY,                    11) \
+	X(std::string, StartItems,                 "") \
+	X(std::string, StartSpells,                "") \
+	X(std::string, StartEquipMale,             "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,") \
+	X(std::string, StartEquipFemale,           "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,") \
+	X(int,         WeddingRing,                374) \
+	X(int,         WeddingMinLevel,            5) \
+	X(int,         WeddingOutfitMale,          133) \
+	X(int,         WeddingOutfitFemale,        163) \
+	X(int,         WeddingMusic,               40) \
+	X(int,         MaxHairStyle,               20) \
+	X(int,         MaxHairColor,               9) \
+	X(int,         MaxSkin,                    6) \
+	X(int,         CreateMinHairStyle,         1) \
+	X(int,         CreateMaxHairStyle,         20) \
+	X(int,         CreateMinHairColor,         0) \
+	X(int,         CreateMaxHairColor,         9) \
+	X(int,         CreateMinSkin,              0) \
+	X(int,         CreateMaxSkin,              3) \
+	X(double,      DefaultBanLength,           "2h") \
+	X(bool,        LimitDamage,                true) \
+	X(double,      DeathRecover,               0.5) \
+	X(bool,        Deadly,                     false) \
+	X(double,      ExpRate,                    1.0) \
+	X(double,      DropRate,                   1.0) \
+	X(double,      MobRate,                    1.0) \
+	X(double,      PKRate,                     0.75) \
+	X(double,      CriticalRate,               0.00) \
+	X(bool,        CriticalFirstHit,           false) \
+	X(double,      SpawnRate,                  1.0) \
+	X(int,         BarberBase,                 0) \
+	X(int,         BarberStep,                 200) \
+	X(int,         BankUpgradeBase,            1000) \
+	X(int,         BankUpgradeStep,            1000) \
+	X(int,         JukeboxSongs,               20) \
+	X(int,         JukeboxPrice,               25) \
+	X(int,         JukeboxTimer,               90) \
+	X(bool,        RespawnBossChildren,        true) \
+	X(bool,        OldReports,                 false) \
+	X(double,      WarpSuck,                   15) \
+	X(int,         EvacuateSound,              51) \
+	X(double,      EvacuateLength,             30.0) \
+	X(double,      EvacuateStep,               10.0) \
+	X(double,      EvacuateTick,               2.0) \
+	X(bool,        UseClassFormulas,           false) \
+	X(bool,        UseAdjustedStats,           true) \
+	X(int,         BaseMinDamage,              0) \
+	X(int,         BaseMaxDamage,              1) \
+	X(bool,        BaseDamageAtZero,           true) \
+	X(bool,        SilentMute,                 true) \
+	X(bool,        CitizenSubscribeAnytime,    false) \
+	X(bool,        CitizenUnsubscribeAnywhere, false) \
+	X(int,         ClockMaxDelta,              1000) \
+	X(bool,        TradeAddQuantity,           false) \
+	X(bool,        LogReports,                 false) \
+	X(int,         ReportChatLogSize,          25) \
+	X(bool,        UseDutyAdmin,               false) \
+	X(int,         NoInteractDefault,          0) \
+	X(int,         NoInteractDefaultAdmin,     2) \
+	X(std::string, NPCMovementRate,            "0.9, 0.6, 1.3, 1.9, 3.7, 7.5, 15.0") \
+	X(std::string, SpawnNPCSpeed,              "0") \
+	X(double,      DoorTimer,                  3.0) \
+	X(int,         ChatMaxWidth,               1400) \
+	X(int,         AccountMinLength,           4) \
+	X(int,         AccountMaxLength,           16) \
+	X(int,         PasswordMinLength,          6) \
+	X(int,         PasswordMaxLength,          12) \
+	X(int,         RealNameMaxLength,          64) \
+	X(int,         LocationMaxLength,          64) \
+	X(int,         EmailMaxLength,             64) \
+	X(int,         ComputerNameLength,         64) \
+	X(int,         LimitAttack,                251) \
+	X(int,         MuteLength,                 90) \
+	X(std::string, InstrumentItems,            "49, 50") \
+	X(int,         MaxBankGold,                2000000000) \
+	X(int,         MaxItem,                    2000000000) \
+	X(int,         MaxDrop,                    10000000) \
+	X(int,         MaxChest,                   10000000) \
+	X(int,         ChestSlots,                 5) \
+	X(int,         MaxBank,                    200) \
+	X(int,         BaseBankSize,               25) \
+	X(int,         BankSizeStep,               5) \
+	X(int,         MaxBankUpgrades,            7) \
+	X(double,      PacketRateFace,             0.09) \
+	X(double,      PacketRateWalk,             0.46) \
+	X(double,      PacketRateAttack,           0.58) \
+	X(int,         MaxTile,                    8) \
+	X(int,         MaxMap,                     400) \
+	X(int,         MaxTrade,                   2000000000) \
+	X(std::string, IgnorePacketFamilies,       "*") \
+	X(std::string, PacketTraceFile,            "") \
+	X(bool,        InitLoginBan,               true) \
+	X(int,         ThreadPoolThreads,          0) \
+	X(int,         BackgroundQueueSize,        64) \
+	X(bool,        AutoCreateDatabase,         false) \
+	X(std::string, WorldDumpFile,              "./world.bak.json")
+
 void eoserv_config_validate_config(Config&);
 void eoserv_config_validate_admin(Config&);
 
+/**
+ * Parsed, strongly typed copy of the server config.
+ * Hot code reads these fields instead of looking keys up in Config by name on every call.
+ * World builds a new one whenever the config is (re)loaded, an existing snapshot never changes.
+ */
+struct ServerSettings
+{
+#define EOSERV_CONFIG_SETTING(type, key, value) type key;
+	EOSERV_CONFIG_SETTINGS(EOSERV_CONFIG_SETTING)
+#undef EOSERV_CONFIG_SETTING
+
+	/**
+	 * Map IDs from PKExcept.
+	 */
+	std::vector<int> PKExceptMaps;
+
+	explicit ServerSettings(Config& config);
+};
+
 #endif // EOSERV_CONFIG_HPP_INCLUDED
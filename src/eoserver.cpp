@@ -8,6 +8,8 @@
 
 #include "config.hpp"
 #include "eoclient.hpp"
+#include "eoserv_config.hpp"
+#include "netthread.hpp"
 #include "packet.hpp"
 #include "sln.hpp"
 #include "timer.hpp"
@@ -17,14 +19,19 @@
 #include "console.hpp"
 #include "socket.hpp"
 #include "util.hpp"
+#include "util/async.hpp"
+#include "util/threadpool.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cerrno>
+#include <chrono>
 #include <cstddef>
 #include <exception>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -87,9 +94,9 @@ void server_pump_queue(void *server_void)
 		if (!client->Connected())
 			continue;
 
-		std::size_t size = client->queue.queue.size();
+		std::size_t size = client->queue.Size();
 
-		if (size > std::size_t(int(server->world->config["PacketQueueMax"])))
+		if (size > std::size_t(server->world->settings->PacketQueueMax))
 		{
 			Console::Wrn("Client was disconnected for filling up the action queue: %s", static_cast<std::string>(client->GetRemoteAddr()).c_str());
 			client->AsyncOpPending(false);
@@ -99,8 +106,7 @@ void server_pump_queue(void *server_void)
 
 		if (size != 0 && client->queue.next <= now)
 		{
-			std::unique_ptr<ActionQueue_Action> action = std::move(client->queue.queue.front());
-			client->queue.queue.pop();
+			std::unique_ptr<ActionQueue_Action> action = client->queue.Pop();
 
 #ifndef DEBUG_EXCEPTIONS
 			try
@@ -153,6 +159,7 @@ void server_pump_queue(void *server_void)
 #endif // DEBUG_EXCEPTIONS
 
 			client->queue.next = now + action->time;
+			client->queue.Recycle(std::move(action));
 		}
 	}
 }
@@ -167,6 +174,29 @@ void EOServer::UpdateConfig()
 	this->HangupDelay = double(this->world->config["HangupDelay"]);
 
 	this->maxconn = unsigned(int(this->world->config["MaxConnections"]));
+
+	this->packet_trace.Configure(this->world->config["IgnorePacketFamilies"], this->world->config["PacketTraceFile"]);
+
+	// Clients belong to the network threads until shutdown
+	if (!this->net_threads.empty())
+		return;
+
+	std::string backend_name = util::lowercase(std::string(this->world->config["SocketBackend"]));
+	SocketBackend backend = SocketBackend::Auto;
+
+	if (backend_name == "select")
+		backend = SocketBackend::Select;
+	else if (backend_name == "poll")
+		backend = SocketBackend::Poll;
+	else if (backend_name == "epoll")
+		backend = SocketBackend::Epoll;
+	else if (backend_name != "auto")
+		Console::Wrn("Unknown SocketBackend '%s' - using auto", backend_name.c_str());
+
+	this->SetBackend(backend);
+
+	if (backend != SocketBackend::Auto && backend != this->Backend())
+		Console::Wrn("SocketBackend '%s' is not available on this system", backend_name.c_str());
 }
 
 void EOServer::Initialize(std::shared_ptr<DatabaseFactory> databaseFactory, const Config &eoserv_config, const Config &admin_config)
@@ -193,6 +223,89 @@ void EOServer::Initialize(std::shared_ptr<DatabaseFactory> databaseFactory, cons
 	this->start = Timer::GetTime();
 
 	this->UpdateConfig();
+	this->StartNetThreads();
+}
+
+void EOServer::StartNetThreads()
+{
+	int threads = int(this->world->config["NetworkThreads"]);
+
+	if (threads <= 0)
+		return;
+
+	if (!ClientPoller::Available())
+	{
+		Console::Wrn("NetworkThreads is not supported on this system - network I/O will be done on the main thread");
+		return;
+	}
+
+	for (int i = 0; i < threads; ++i)
+		this->net_threads.emplace_back(new NetThread);
+
+	this->SetBackend(SocketBackend::External);
+
+	Console::Out("Started %i network thread%s", threads, (threads == 1) ? "" : "s");
+}
+
+void EOServer::StopNetThreads()
+{
+	if (this->net_threads.empty())
+		return;
+
+	// Joins the threads, anything they had queued is left in the clients' send buffers
+	this->net_threads.clear();
+
+	UTIL_FOREACH(this->clients, rawclient)
+	{
+		EOClient *client = static_cast<EOClient *>(rawclient);
+		client->net_thread = nullptr;
+	}
+
+	this->SetBackend(SocketBackend::Auto);
+}
+
+void EOServer::PumpNetThreads()
+{
+	NetThread::Event event;
+
+	UTIL_FOREACH_CREF(this->net_threads, net_thread)
+	{
+		while (net_thread->Receive(event))
+		{
+			EOClient *client = event.client;
+
+			switch (event.type)
+			{
+				case NetThread::Event::Packet:
+					client->Dispatch(event.data);
+					std::fill(UTIL_RANGE(event.data), '\0');
+					net_thread->Recycle(std::move(event.data));
+					break;
+
+				case NetThread::Event::Disconnected:
+					client->Close(true);
+					break;
+
+				case NetThread::Event::Released:
+					// The network thread is done with the client, so it can be buried as soon as it is released here
+					client->net_thread = nullptr;
+					client->SetRecvBuffer(0);
+					client->SetSendBuffer(0);
+					break;
+			}
+		}
+	}
+
+	UTIL_FOREACH(this->clients, rawclient)
+	{
+		EOClient *client = static_cast<EOClient *>(rawclient);
+
+		if (client->net_thread && !client->net_released && !client->Connected() && !client->IsAsyncOpPending())
+		{
+			client->net_thread->Release(client);
+			client->net_released = true;
+		}
+	}
 }
 
 Client *EOServer::ClientFactory(const Socket &sock)
@@ -269,6 +382,21 @@ void EOServer::Tick()
 			connection_log[remote_addr].last_connection_time = Timer::GetTime();
 			Console::Out("New connection from %s (%i/%i connections)", std::string(remote_addr).c_str(), this->Connections(), this->MaxConnections());
 		}
+
+		if (!this->net_threads.empty())
+		{
+			if (newclient->Connected())
+			{
+				newclient->net_thread = this->net_threads[this->next_net_thread++ % this->net_threads.size()].get();
+				newclient->net_thread->Adopt(newclient);
+			}
+			else
+			{
+				// Rejected clients never reach a network thread, so there is nothing to wait for
+				newclient->SetRecvBuffer(0);
+				newclient->SetSendBuffer(0);
+			}
+		}
 	}
 
 	try
@@ -293,9 +421,27 @@ void EOServer::Tick()
 		active_clients->clear();
 	}
 
+	if (!this->net_threads.empty())
+		this->PumpNetThreads();
+
+	this->RunCompletions();
+
 	this->BuryTheDead();
 
 	this->world->timer.Tick();
+
+	// Everything the handlers sent this tick goes out together, once per client
+	if (this->net_threads.empty())
+	{
+		this->Flush();
+	}
+	else
+	{
+		UTIL_FOREACH_CREF(this->net_threads, net_thread)
+		{
+			net_thread->Notify();
+		}
+	}
 }
 
 void EOServer::RecordClientRejection(const IPAddress& ip, const char* reason)
@@ -312,8 +458,89 @@ void EOServer::RecordClientRejection(const IPAddress& ip, const char* reason)
 	}
 }
 
+void EOServer::Post(std::function<void()> continuation)
+{
+	this->completions.Push(std::move(continuation));
+}
+
+void EOServer::RunCompletions()
+{
+	std::function<void()> continuation;
+
+	while (this->completions.Pop(continuation))
+		continuation();
+}
+
+void EOServer::BeginWork()
+{
+	++this->outstanding_work;
+}
+
+void EOServer::EndWork()
+{
+	--this->outstanding_work;
+}
+
+void AsyncHooks::Claim(EOClient* client)
+{
+	if (client->IsAsyncOpPending())
+	{
+		throw std::runtime_error("Client attempted to do something asynchronously but is already running an async operation");
+	}
+
+	client->AsyncOpPending(true);
+}
+
+void AsyncHooks::Release(EOClient* client)
+{
+	client->AsyncOpPending(false);
+}
+
+void AsyncHooks::Dispatch(EOClient* client, std::function<void()> work, std::function<void(bool)> done)
+{
+	EOServer* server = client->server();
+
+	auto workerProc = [server, work, done](const void*)
+	{
+		try
+		{
+			work();
+		}
+		catch (std::exception&)
+		{
+			server->Post([done]() { done(false); });
+			server->EndWork();
+			throw;
+		}
+
+		server->Post([done]() { done(true); });
+		server->EndWork();
+	};
+
+	// Held until the result is posted, so the server isn't destroyed underneath the operation
+	server->BeginWork();
+	util::ThreadPool::Queue(workerProc, nullptr);
+}
+
+void AsyncHooks::ReportError(const std::exception& e)
+{
+	Console::Err("Exception in async operation callback: %s", e.what());
+}
+
 EOServer::~EOServer()
 {
+	this->StopNetThreads();
+
+	// Operations still on the thread pool will post back here and use the world, so they have to finish first
+	while (this->outstanding_work > 0)
+	{
+		this->RunCompletions();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	// Let them all reply before their clients are closed
+	this->RunCompletions();
+
 	// All clients must be fully closed before the world ends
 	UTIL_FOREACH(this->clients, client)
 	{
@@ -16,11 +16,20 @@
 #include "fwd/timer.hpp"
 #include "fwd/world.hpp"
 
+#include "netthread.hpp"
+#include "packettrace.hpp"
 #include "socket.hpp"
 
+#include "util/mpscqueue.hpp"
+
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 void server_ping_all(void *server_void);
 void server_pump_queue(void *server_void);
@@ -43,6 +52,30 @@ class EOServer : public Server
 
 		TimeEvent* ping_timer = nullptr;
 
+		/**
+		 * Threads doing network I/O for clients, if NetworkThreads is enabled.
+		 */
+		std::vector<std::unique_ptr<NetThread>> net_threads;
+		std::size_t next_net_thread = 0;
+
+		void StartNetThreads();
+		void StopNetThreads();
+
+		/**
+		 * Dispatches packets from the network threads and hands closed clients back to be buried.
+		 */
+		void PumpNetThreads();
+
+		/**
+		 * Continuations posted by worker threads, run on the game thread by Tick.
+		 */
+		util::MPSCQueue<std::function<void()>> completions;
+
+		/**
+		 * Work on other threads which has yet to post its last continuation, counted by BeginWork and EndWork.
+		 */
+		std::atomic<std::size_t> outstanding_work{0};
+
 	protected:
 		virtual Client *ClientFactory(const Socket &);
 
@@ -51,6 +84,8 @@ class EOServer : public Server
 		double start;
 		SLN *sln;
 
+		PacketTrace packet_trace;
+
 		bool QuietConnectionErrors = false;
 		double HangupDelay = 10.0;
 
@@ -63,6 +98,23 @@ class EOServer : public Server
 
 		void Tick();
 
+		/**
+		 * Queues a function to run on the game thread during the next Tick. Safe to call from any thread.
+		 */
+		void Post(std::function<void()> continuation);
+
+		/**
+		 * Runs every function posted so far. Game thread only.
+		 */
+		void RunCompletions();
+
+		/**
+		 * Marks work handed to another thread which will Post back to this server.
+		 * The destructor waits for a matching EndWork, called once the work has posted everything it is going to.
+		 */
+		void BeginWork();
+		void EndWork();
+
 		void RecordClientRejection(const IPAddress& ip, const char* reason);
 		void CleanupConnectionLog();
 
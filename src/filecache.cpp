@@ -0,0 +1,108 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#include "filecache.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+FileCache::ImagePtr FileCache::Load(const std::string &filename, Variant variant)
+{
+	std::FILE *fh = std::fopen(filename.c_str(), "rb");
+
+	if (!fh)
+		return nullptr;
+
+	std::shared_ptr<Image> image = std::make_shared<Image>();
+	std::string &data = image->data;
+	char buf[4096];
+	std::size_t read;
+
+	while ((read = std::fread(buf, 1, sizeof(buf), fh)) > 0)
+		data.append(buf, read);
+
+	bool error = std::ferror(fh);
+	std::fclose(fh);
+
+	if (error)
+		return nullptr;
+
+	if (variant == GlobalPK)
+	{
+		// Rewrite the bytes of the map header to enable PK
+		const std::pair<std::size_t, char> pk_bytes[] = {{0x03, char(0xFF)}, {0x04, char(0x01)}, {0x1F, char(0x04)}};
+
+		for (const auto &pk_byte : pk_bytes)
+		{
+			if (pk_byte.first < data.length())
+				data[pk_byte.first] = pk_byte.second;
+		}
+	}
+
+	image->rid.fill(0);
+	image->len.fill(0);
+
+	if (data.length() > 3)
+		std::copy_n(data.begin() + 3, std::min<std::size_t>(4, data.length() - 3), image->rid.begin());
+
+	if (data.length() > 7)
+		std::copy_n(data.begin() + 7, std::min<std::size_t>(2, data.length() - 7), image->len.begin());
+
+	return image;
+}
+
+FileCache::ImagePtr FileCache::Get(const std::string &filename, Variant variant)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		auto it = this->files[variant].find(filename);
+
+		if (it != this->files[variant].end())
+			return it->second;
+	}
+
+	ImagePtr image = FileCache::Load(filename, variant);
+
+	if (image)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		// Another caller may have got there first, keep whichever image was stored to avoid two copies
+		auto result = this->files[variant].insert(std::make_pair(filename, image));
+		image = result.first->second;
+	}
+
+	return image;
+}
+
+FileCache::ImagePtr FileCache::Reload(const std::string &filename)
+{
+	ImagePtr image = FileCache::Load(filename, Raw);
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	// Variants are derived from the raw file, so they are rebuilt the next time they are needed
+	for (auto &files : this->files)
+		files.erase(filename);
+
+	if (image)
+		this->files[Raw][filename] = image;
+
+	return image;
+}
+
+void FileCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	for (auto &files : this->files)
+		files.clear();
+}
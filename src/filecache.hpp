@@ -0,0 +1,92 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef FILECACHE_HPP_INCLUDED
+#define FILECACHE_HPP_INCLUDED
+
+#include "fwd/filecache.hpp"
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Keeps an in-memory image of each file sent to clients (maps and pub files).
+ * Images are immutable and shared, so any number of clients can stream the same one without copying it,
+ * and an image stays valid for clients still sending it after a newer version replaces it in the cache.
+ */
+class FileCache
+{
+	public:
+		enum Variant
+		{
+			/**
+			 * The file exactly as it is on disk.
+			 */
+			Raw,
+
+			/**
+			 * A map file rewritten to have PK enabled.
+			 */
+			GlobalPK
+		};
+
+		/**
+		 * Contents of a file along with the header fields clients use to check their copy is current.
+		 */
+		struct Image
+		{
+			std::string data;
+
+			/**
+			 * Revision ID stored at offset 3 of both EMF and pub files.
+			 */
+			std::array<unsigned char, 4> rid;
+
+			/**
+			 * Number of records, only meaningful for pub files.
+			 */
+			std::array<unsigned char, 2> len;
+
+			std::size_t Size() const { return this->data.length(); }
+		};
+
+		typedef std::shared_ptr<const Image> ImagePtr;
+
+	protected:
+		std::unordered_map<std::string, ImagePtr> files[2];
+		mutable std::mutex mutex;
+
+		static ImagePtr Load(const std::string &filename, Variant variant);
+
+	public:
+		/**
+		 * Returns the image of a file, reading it from disk if it is not cached yet.
+		 * @return nullptr if the file could not be read
+		 */
+		ImagePtr Get(const std::string &filename, Variant variant = Raw);
+
+		/**
+		 * Reads a file from disk again and replaces every cached image of it.
+		 * Clients part way through sending the old image will finish sending it unchanged.
+		 * @return The new raw image, or nullptr if the file could not be read (in which case it is dropped from the cache)
+		 */
+		ImagePtr Reload(const std::string &filename);
+
+		void Clear();
+
+		/**
+		 * Shares ownership of an image's data, for passing to Client::SendFile.
+		 */
+		static std::shared_ptr<const std::string> Data(const ImagePtr &image)
+		{
+			return std::shared_ptr<const std::string>(image, &image->data);
+		}
+};
+
+#endif // FILECACHE_HPP_INCLUDED
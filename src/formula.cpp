@@ -0,0 +1,108 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#include "formula.hpp"
+
+#include "config.hpp"
+
+#include "util.hpp"
+#include "util/rpn.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const char *const formula_var_names[] = {
+#define FORMULA_VAR_NAME(name) #name,
+	FORMULA_VARS(FORMULA_VAR_NAME)
+#undef FORMULA_VAR_NAME
+};
+
+const std::size_t FormulaValues::Self;
+const std::size_t FormulaValues::Target;
+
+int FormulaValues::Resolve(const std::string &name)
+{
+	static const std::unordered_map<std::string, int> slots = []()
+	{
+		std::unordered_map<std::string, int> slots;
+
+		for (std::size_t i = 0; i < VarCount; ++i)
+		{
+			slots[formula_var_names[i]] = int(Self + i);
+			slots[std::string("target_") + formula_var_names[i]] = int(Target + i);
+		}
+
+		slots["modifier"] = Modifier;
+		slots["damage"] = Damage;
+		slots["critical"] = Critical;
+
+		return slots;
+	}();
+
+	auto it = slots.find(name);
+	return (it != slots.end()) ? it->second : -1;
+}
+
+const char *FormulaValues::Name(Var var)
+{
+	return formula_var_names[var];
+}
+
+// Goes through Config::operator[] so environment overrides apply as they always have
+static util::rpn_formula formula_compile(Config &formulas_config, const std::string &key)
+{
+	return util::rpn_formula(static_cast<std::string>(formulas_config[key]), FormulaValues::Resolve);
+}
+
+Formulas::Formulas(Config &formulas_config)
+	: hp(formula_compile(formulas_config, "hp"))
+	, tp(formula_compile(formulas_config, "tp"))
+	, sp(formula_compile(formulas_config, "sp"))
+	, weight(formula_compile(formulas_config, "weight"))
+	, damage(formula_compile(formulas_config, "damage"))
+	, hit_rate(formula_compile(formulas_config, "hit_rate"))
+{
+	// Class formulas are keyed class.<type>.<stat>, find the highest type there is one for
+	int max_type = -1;
+
+	for (const auto &entry : formulas_config)
+	{
+		const std::string &key = entry.first;
+
+		if (key.compare(0, 6, "class.") != 0)
+			continue;
+
+		std::size_t dot = key.find('.', 6);
+
+		if (dot != std::string::npos)
+			max_type = std::max(max_type, std::min(util::to_int(key.substr(6, dot - 6)), 255));
+	}
+
+	this->classes.resize(max_type + 1);
+
+	for (int type = 0; type <= max_type; ++type)
+	{
+		std::string prefix = "class." + util::to_string(type) + ".";
+		Class &formulas = this->classes[type];
+
+		formulas.damage = formula_compile(formulas_config, prefix + "damage");
+		formulas.defence = formula_compile(formulas_config, prefix + "defence");
+		formulas.accuracy = formula_compile(formulas_config, prefix + "accuracy");
+		formulas.evade = formula_compile(formulas_config, prefix + "evade");
+	}
+}
+
+const Formulas::Class &Formulas::GetClass(int type) const
+{
+	static const Class none;
+
+	if (type < 0 || std::size_t(type) >= this->classes.size())
+		return none;
+
+	return this->classes[type];
+}
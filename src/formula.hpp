@@ -0,0 +1,113 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef FORMULA_HPP_INCLUDED
+#define FORMULA_HPP_INCLUDED
+
+#include "fwd/formula.hpp"
+
+#include "fwd/config.hpp"
+#include "util/rpn.hpp"
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Every variable a character or NPC provides to formulas, by the name formulas use.
+ * Characters leave "npc" at 0, NPCs leave anything they do not have at 0.
+ */
+#define FORMULA_VARS(X) \
+	X(level) X(experience) X(hp) X(maxhp) X(tp) X(maxtp) X(maxsp) \
+	X(weight) X(maxweight) X(karma) X(mindam) X(maxdam) \
+	X(str) X(int) X(wis) X(agi) X(con) X(cha) \
+	X(base_str) X(base_int) X(base_wis) X(base_agi) X(base_con) X(base_cha) \
+	X(display_str) X(display_int) X(display_wis) X(display_agi) X(display_con) X(display_cha) \
+	X(accuracy) X(evade) X(armor) X(admin) X(bot) X(usage) \
+	X(class) X(gender) X(race) X(hairstyle) X(haircolor) \
+	X(mapid) X(x) X(y) X(direction) X(sitting) X(hidden) X(whispers) X(goldbank) \
+	X(statpoints) X(skillpoints) \
+	X(npc)
+
+/**
+ * Values of every variable, in the slots compiled formulas read them from.
+ * Whoever is acting fills in the first set, and the target of an attack the second, which formulas see prefixed with "target_".
+ */
+struct FormulaValues
+{
+#define FORMULA_VAR_ENUM(name) Var_##name,
+	enum Var : std::size_t
+	{
+		FORMULA_VARS(FORMULA_VAR_ENUM)
+		VarCount
+	};
+#undef FORMULA_VAR_ENUM
+
+	static const std::size_t Self = 0;
+	static const std::size_t Target = VarCount;
+
+	enum Extra : std::size_t
+	{
+		Modifier = VarCount * 2,
+		Damage,
+		Critical,
+		Size
+	};
+
+	std::array<double, Size> values;
+
+	FormulaValues() { this->values.fill(0.0); }
+
+	double &operator [](std::size_t i) { return this->values[i]; }
+	double operator [](std::size_t i) const { return this->values[i]; }
+
+	const double *data() const { return this->values.data(); }
+
+	/**
+	 * Slot of a variable name, for util::rpn_formula
+	 * @return -1 if the name is not a variable
+	 */
+	static int Resolve(const std::string &name);
+
+	static const char *Name(Var var);
+};
+
+/**
+ * Every formula in the formulas config, compiled once on startup and rehash
+ */
+struct Formulas
+{
+	struct Class
+	{
+		util::rpn_formula damage;
+		util::rpn_formula defence;
+		util::rpn_formula accuracy;
+		util::rpn_formula evade;
+	};
+
+	util::rpn_formula hp;
+	util::rpn_formula tp;
+	util::rpn_formula sp;
+	util::rpn_formula weight;
+
+	util::rpn_formula damage;
+	util::rpn_formula hit_rate;
+
+	/**
+	 * Class formulas indexed by class type, see UseClassFormulas
+	 */
+	std::vector<Class> classes;
+
+	Formulas() { }
+	explicit Formulas(Config &formulas_config);
+
+	/**
+	 * @return Empty formulas if there are none for the type
+	 */
+	const Class &GetClass(int type) const;
+};
+
+#endif // FORMULA_HPP_INCLUDED
@@ -11,6 +11,8 @@ class Database;
 
 class Database_Result;
 
+struct Database_Query;
+
 class DatabaseFactory;
 
 #endif // FWD_DATABASE_HPP_INCLUDED
@@ -0,0 +1,11 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef FWD_EOSERV_CONFIG_HPP_INCLUDED
+#define FWD_EOSERV_CONFIG_HPP_INCLUDED
+
+struct ServerSettings;
+
+#endif // FWD_EOSERV_CONFIG_HPP_INCLUDED
@@ -0,0 +1,11 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef FWD_FILECACHE_HPP_INCLUDED
+#define FWD_FILECACHE_HPP_INCLUDED
+
+class FileCache;
+
+#endif // FWD_FILECACHE_HPP_INCLUDED
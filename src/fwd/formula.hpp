@@ -0,0 +1,12 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef FWD_FORMULA_HPP_INCLUDED
+#define FWD_FORMULA_HPP_INCLUDED
+
+struct FormulaValues;
+struct Formulas;
+
+#endif // FWD_FORMULA_HPP_INCLUDED
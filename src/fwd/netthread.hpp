@@ -0,0 +1,11 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef FWD_NETTHREAD_HPP_INCLUDED
+#define FWD_NETTHREAD_HPP_INCLUDED
+
+class NetThread;
+
+#endif // FWD_NETTHREAD_HPP_INCLUDED
@@ -10,6 +10,7 @@
 class PacketProcessor;
 class PacketReader;
 class PacketBuilder;
+class SharedPacket;
 
 enum PacketFamily : unsigned char
 {
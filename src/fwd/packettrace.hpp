@@ -0,0 +1,11 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef FWD_PACKETTRACE_HPP_INCLUDED
+#define FWD_PACKETTRACE_HPP_INCLUDED
+
+class PacketTrace;
+
+#endif // FWD_PACKETTRACE_HPP_INCLUDED
@@ -0,0 +1,11 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef FWD_PATHFINDER_HPP_INCLUDED
+#define FWD_PATHFINDER_HPP_INCLUDED
+
+class Pathfinder;
+
+#endif // FWD_PATHFINDER_HPP_INCLUDED
@@ -0,0 +1,13 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef FWD_PERSISTENCE_HPP_INCLUDED
+#define FWD_PERSISTENCE_HPP_INCLUDED
+
+struct Persistence_Batch;
+
+class Persistence;
+
+#endif // FWD_PERSISTENCE_HPP_INCLUDED
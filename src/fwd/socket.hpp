@@ -9,6 +9,7 @@
 
 class IPAddress;
 class Client;
+class ClientPoller;
 class Server;
 
 enum LogConnection : unsigned char
@@ -18,6 +19,22 @@ enum LogConnection : unsigned char
     FilterAll
 };
 
+/**
+ * Readiness notification mechanism used by Server::Select
+ */
+enum class SocketBackend : unsigned char
+{
+    Auto,
+    Select,
+    Poll,
+    Epoll,
+
+    /**
+     * Clients are serviced by ClientPollers on other threads, Select never reports any
+     */
+    External
+};
+
 /**
  * Return the OS last error message
  */
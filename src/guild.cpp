@@ -11,6 +11,7 @@
 #include "eoclient.hpp"
 #include "eoserver.hpp"
 #include "packet.hpp"
+#include "persistence.hpp"
 #include "player.hpp"
 #include "world.hpp"
 
@@ -112,6 +113,9 @@ std::shared_ptr<Guild> GuildManager::GetGuild(std::string tag)
 	}
 	else
 	{
+		// The last time it was unloaded may not be written yet
+		this->world->persistence->WaitForGuild(tag);
+
 		Database_Result res = this->world->db->Query("SELECT `tag`, `name`, `description`, `created`, `ranks`, `bank` FROM `guilds` WHERE `tag` = '$'", tag.c_str());
 
 		if (res.empty())
@@ -119,20 +123,24 @@ std::shared_ptr<Guild> GuildManager::GetGuild(std::string tag)
 			return std::shared_ptr<Guild>();
 		}
 
-		std::unordered_map<std::string, util::variant> row = res.front();
+		Database_Result::Row row = res.front();
 		std::shared_ptr<Guild> guild(new Guild(this));
-		guild->tag = static_cast<std::string>(row["tag"]);
-		guild->name = static_cast<std::string>(row["name"]);
-		guild->description = util::text_word_wrap(static_cast<std::string>(row["description"]), this->world->config["GuildMaxWidth"]);
-		guild->created = static_cast<int>(row["created"]);
-		guild->ranks = RankUnserialize(static_cast<std::string>(row["ranks"]));
-		guild->bank = static_cast<int>(row["bank"]);
+		guild->tag = row.GetString(res.Column("tag"));
+		guild->name = row.GetString(res.Column("name"));
+		guild->description = util::text_word_wrap(row.GetString(res.Column("description")), this->world->config["GuildMaxWidth"]);
+		guild->created = row.GetInt(res.Column("created"));
+		guild->ranks = RankUnserialize(row.GetString(res.Column("ranks")));
+		guild->bank = row.GetInt(res.Column("bank"));
+
+		Database_Result members = this->world->db->Query("SELECT `name`, `guild_rank`, `guild_rank_string` FROM `characters` WHERE `guild` = '$' ORDER BY `guild_rank` ASC, `name` ASC", tag.c_str());
 
-		res = this->world->db->Query("SELECT `name`, `guild_rank`, `guild_rank_string` FROM `characters` WHERE `guild` = '$' ORDER BY `guild_rank` ASC, `name` ASC", tag.c_str());
+		std::size_t name_column = members.Column("name");
+		std::size_t rank_column = members.Column("guild_rank");
+		std::size_t rank_string_column = members.Column("guild_rank_string");
 
-		UTIL_FOREACH_REF(res, row)
+		UTIL_FOREACH_CREF(members, member)
 		{
-			guild->members.push_back(std::make_shared<Guild_Member>(row["name"], row["guild_rank"], row["guild_rank_string"]));
+			guild->members.push_back(std::make_shared<Guild_Member>(member.GetString(name_column), member.GetInt(rank_column), member.GetString(rank_string_column)));
 		}
 
 		this->cache[guild->tag] = guild;
@@ -161,20 +169,29 @@ std::shared_ptr<Guild> GuildManager::GetGuildName(std::string name)
 			return std::shared_ptr<Guild>();
 		}
 
-		std::unordered_map<std::string, util::variant> row = res.front();
+		if (this->world->persistence->WaitForGuild(res.front().GetString(res.Column("tag"))))
+		{
+			return this->GetGuildName(name);
+		}
+
+		Database_Result::Row row = res.front();
 		std::shared_ptr<Guild> guild(new Guild(this));
-		guild->tag = static_cast<std::string>(row["tag"]);
-		guild->name = static_cast<std::string>(row["name"]);
-		guild->description = static_cast<std::string>(row["description"]);
-		guild->created = static_cast<int>(row["created"]);
-		guild->ranks = RankUnserialize(static_cast<std::string>(row["ranks"]));
-		guild->bank = static_cast<int>(row["bank"]);
+		guild->tag = row.GetString(res.Column("tag"));
+		guild->name = row.GetString(res.Column("name"));
+		guild->description = row.GetString(res.Column("description"));
+		guild->created = row.GetInt(res.Column("created"));
+		guild->ranks = RankUnserialize(row.GetString(res.Column("ranks")));
+		guild->bank = row.GetInt(res.Column("bank"));
 
-		res = this->world->db->Query("SELECT `name`, `guild_rank`, `guild_rank_string` FROM `characters` WHERE `guild` = '$' ORDER BY `guild_rank` ASC, `name` ASC", static_cast<std::string>(row["tag"]).c_str());
+		Database_Result members = this->world->db->Query("SELECT `name`, `guild_rank`, `guild_rank_string` FROM `characters` WHERE `guild` = '$' ORDER BY `guild_rank` ASC, `name` ASC", guild->tag.c_str());
 
-		UTIL_FOREACH_REF(res, row)
+		std::size_t name_column = members.Column("name");
+		std::size_t rank_column = members.Column("guild_rank");
+		std::size_t rank_string_column = members.Column("guild_rank_string");
+
+		UTIL_FOREACH_CREF(members, member)
 		{
-			guild->members.push_back(std::make_shared<Guild_Member>(row["name"], row["guild_rank"], row["guild_rank_string"]));
+			guild->members.push_back(std::make_shared<Guild_Member>(member.GetString(name_column), member.GetInt(rank_column), member.GetString(rank_string_column)));
 		}
 
 		this->cache[guild->tag] = guild;
@@ -245,14 +262,14 @@ std::shared_ptr<Guild> GuildManager::CreateGuild(std::shared_ptr<Guild_Create> c
 	return guild;
 }
 
-void GuildManager::SaveAll()
+void GuildManager::SaveAll(Persistence_Batch &batch)
 {
 	UTIL_FOREACH(this->cache, entry)
 	{
 		std::shared_ptr<Guild> guild(entry.second);
 
 		if (guild)
-			guild->Save();
+			guild->Save(batch);
 	}
 }
 
@@ -423,7 +440,7 @@ void Guild::DelMember(std::string kicked, Character *kicker, bool alert)
 		}
 	}
 
-	world->db->Query("UPDATE `characters` SET `guild` = NULL, `guild_rank` = NULL, `guild_rank_string` = NULL WHERE `name` = '$'", kicked.c_str());
+	world->UpdateCharacter(kicked, Database_Query{"UPDATE `characters` SET `guild` = NULL, `guild_rank` = NULL, `guild_rank_string` = NULL WHERE `name` = '$'", {kicked}});
 }
 
 void Guild::SetMemberRank(std::string name, int rank)
@@ -461,8 +478,8 @@ void Guild::SetMemberRank(std::string name, int rank)
 			}
 		}
 
-		world->db->Query("UPDATE `characters` SET `guild_rank` = #, `guild_rank_string` = '$' WHERE `name` = '$'",
-			rank, rank_str.c_str(), name.c_str());
+		world->UpdateCharacter(name, Database_Query{"UPDATE `characters` SET `guild_rank` = #, `guild_rank_string` = '$' WHERE `name` = '$'",
+			{util::to_string(rank), rank_str, name}});
 	}
 }
 
@@ -559,10 +576,19 @@ void Guild::Msg(Character *from, std::string message, bool echo)
 }
 
 void Guild::Save()
+{
+	Persistence_Batch batch;
+	this->Save(batch);
+	this->manager->world->persistence->Queue(std::move(batch));
+}
+
+void Guild::Save(Persistence_Batch &batch)
 {
 	if (this->needs_save)
 	{
-		this->manager->world->db->Query("UPDATE `guilds` SET `description` = '$', `ranks` = '$', `bank` = # WHERE tag = '$'", this->description.c_str(), RankSerialize(this->ranks).c_str(), this->bank, this->tag.c_str());
+		batch.queries.push_back(Database_Query{"UPDATE `guilds` SET `description` = '$', `ranks` = '$', `bank` = # WHERE tag = '$'",
+			{this->description, RankSerialize(this->ranks), util::to_string(this->bank), this->tag}});
+		batch.guilds.push_back(this->tag);
 		this->needs_save = false;
 	}
 }
@@ -588,7 +614,11 @@ Guild::~Guild()
 	}
 	else
 	{
-		this->manager->world->db->Query("UPDATE `characters` SET `guild` = NULL, `guild_rank` = NULL, `guild_rank_string` = NULL WHERE `guild` = '$'", this->tag.c_str());
-		this->manager->world->db->Query("DELETE FROM `guilds` WHERE tag = '$'", this->tag.c_str());
+		// Queued behind any saves still waiting to be written, which could otherwise bring the guild back
+		Persistence_Batch batch;
+		batch.queries.push_back(Database_Query{"UPDATE `characters` SET `guild` = NULL, `guild_rank` = NULL, `guild_rank_string` = NULL WHERE `guild` = '$'", {this->tag}});
+		batch.queries.push_back(Database_Query{"DELETE FROM `guilds` WHERE tag = '$'", {this->tag}});
+		batch.guilds.push_back(this->tag);
+		this->manager->world->persistence->Queue(std::move(batch));
 	}
 }
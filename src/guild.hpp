@@ -10,6 +10,7 @@
 #include "fwd/guild.hpp"
 
 #include "fwd/character.hpp"
+#include "fwd/persistence.hpp"
 #include "fwd/world.hpp"
 
 #include <algorithm>
@@ -88,7 +89,7 @@ class GuildManager
 		void CancelCreate(std::string);
 		std::shared_ptr<Guild> CreateGuild(std::shared_ptr<Guild_Create>, std::string description);
 
-		void SaveAll();
+		void SaveAll(Persistence_Batch &batch);
 
 		bool ValidName(std::string name);
 		bool ValidTag(std::string tag);
@@ -134,7 +135,11 @@ class Guild : public std::enable_shared_from_this<Guild>
 
 		void Msg(Character *from, std::string message, bool echo = true);
 
+		/**
+		 * Queues the guild to be written if it changed
+		 */
 		void Save();
+		void Save(Persistence_Batch &batch);
 
 		~Guild();
 };
@@ -8,6 +8,7 @@
 
 #include "../character.hpp"
 #include "../config.hpp"
+#include "../eoserv_config.hpp"
 #include "../map.hpp"
 #include "../packet.hpp"
 #include "../world.hpp"
@@ -23,7 +24,7 @@ void Attack_Use(Character *character, PacketReader &reader)
 
 	int ts_diff = timestamp - character->timestamp;
 
-	if (character->world->config["EnforceTimestamps"])
+	if (character->world->settings->EnforceTimestamps)
 	{
 		if (ts_diff < 48)
 		{
@@ -36,15 +37,15 @@ void Attack_Use(Character *character, PacketReader &reader)
 	if (character->sitting != SIT_STAND)
 		return;
 
-	if (int(character->world->config["EnforceWeight"]) >= 1 && character->weight > character->maxweight)
+	if (character->world->settings->EnforceWeight >= 1 && character->weight > character->maxweight)
 		return;
 
-	int limit_attack = character->world->config["LimitAttack"];
+	int limit_attack = character->world->settings->LimitAttack;
 
 	if (limit_attack != 0 && character->attacks >= limit_attack)
 		return;
 
-	if (!character->world->config["EnforceTimestamps"] || ts_diff >= 60)
+	if (!character->world->settings->EnforceTimestamps || ts_diff >= 60)
 	{
 		direction = character->direction;
 	}
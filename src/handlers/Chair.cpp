@@ -141,8 +141,7 @@ void Chair_Request(Character *character, PacketReader &reader)
 				return;
 		}
 
-		character->x = x;
-		character->y = y;
+		character->map->Reposition(character, x, y);
 
 		PacketBuilder reply(PACKET_CHAIR, PACKET_PLAYER, 6);
 		reply.AddShort(character->PlayerID());
@@ -155,22 +154,27 @@ void Chair_Request(Character *character, PacketReader &reader)
 	}
 	else if (character->sitting == SIT_CHAIR)
 	{
+		int x = character->x;
+		int y = character->y;
+
 		switch (character->direction)
 		{
 			case DIRECTION_UP:
-				--character->y;
+				--y;
 				break;
 			case DIRECTION_RIGHT:
-				++character->x;
+				++x;
 				break;
 			case DIRECTION_DOWN:
-				++character->y;
+				++y;
 				break;
 			case DIRECTION_LEFT:
-				--character->x;
+				--x;
 				break;
 		}
 
+		character->map->Reposition(character, x, y);
+
 		PacketBuilder reply(PACKET_CHAIR, PACKET_CLOSE, 4);
 		reply.AddShort(character->PlayerID());
 		reply.AddChar(character->x);
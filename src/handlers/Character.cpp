@@ -140,11 +140,10 @@ void Character_Remove(Player *player, PacketReader &reader)
 	}
 	else
 	{
-		player->world->db->Query(
+		player->world->UpdateCharacter(partner_name, Database_Query{
 			"UPDATE `characters` SET `partner` = '' WHERE `name` = '$' AND partner = '$'",
-			partner_name.c_str(),
-			(*it)->SourceName().c_str()
-		);
+			{partner_name, (*it)->SourceName()}
+		});
 	}
 
 	player->world->DeleteCharacter((*it)->real_name);
@@ -9,6 +9,7 @@
 #include "../character.hpp"
 #include "../config.hpp"
 #include "../eodata.hpp"
+#include "../eoserv_config.hpp"
 #include "../map.hpp"
 #include "../party.hpp"
 #include "../quest.hpp"
@@ -93,7 +94,7 @@ void Item_Use(Character *character, PacketReader &reader)
 				int hpgain = item.hp;
 				int tpgain = item.tp;
 
-				if (character->world->config["LimitDamage"])
+				if (character->world->settings->LimitDamage)
 				{
 					hpgain = std::min(hpgain, character->maxhp - character->hp);
 					tpgain = std::min(tpgain, character->maxtp - character->tp);
@@ -108,7 +109,7 @@ void Item_Use(Character *character, PacketReader &reader)
 				character->hp += hpgain;
 				character->tp += tpgain;
 
-				if (!character->world->config["LimitDamage"])
+				if (!character->world->settings->LimitDamage)
 				{
 					character->hp = std::min(character->hp, character->maxhp);
 					character->tp = std::min(character->tp, character->maxtp);
@@ -285,15 +286,15 @@ void Item_Use(Character *character, PacketReader &reader)
 
 				character->exp += item.expreward;
 
-				character->exp = std::min(character->exp, static_cast<int>(character->map->world->config["MaxExp"]));
+				character->exp = std::min(character->exp, character->map->world->settings->MaxExp);
 
-				while (character->level < static_cast<int>(character->map->world->config["MaxLevel"])
+				while (character->level < character->map->world->settings->MaxLevel
 				 && character->exp >= character->map->world->exp_table[character->level+1])
 				{
 					level_up = true;
 					++character->level;
-					character->statpoints += static_cast<int>(character->map->world->config["StatPerLevel"]);
-					character->skillpoints += static_cast<int>(character->map->world->config["SkillPerLevel"]);
+					character->statpoints += character->map->world->settings->StatPerLevel;
+					character->skillpoints += character->map->world->settings->SkillPerLevel;
 					character->CalculateStats();
 				}
 
@@ -384,7 +385,7 @@ void Item_Drop(Character *character, PacketReader &reader)
 
 	int distance = util::path_length(x, y, character->x, character->y);
 
-	if (distance > static_cast<int>(character->world->config["DropDistance"]))
+	if (distance > character->world->settings->DropDistance)
 	{
 		return;
 	}
@@ -394,14 +395,14 @@ void Item_Drop(Character *character, PacketReader &reader)
 		return;
 	}
 
-	if (character->HasItem(id) >= amount && character->mapid != static_cast<int>(character->world->config["JailMap"]))
+	if (character->HasItem(id) >= amount && character->mapid != character->world->settings->JailMap)
 	{
 		std::shared_ptr<Map_Item> item = character->map->AddItem(id, amount, x, y, character);
 
 		if (item)
 		{
 			item->owner = character->PlayerID();
-			item->unprotecttime = Timer::GetTime() + static_cast<double>(character->world->config["ProtectPlayerDrop"]);
+			item->unprotecttime = Timer::GetTime() + character->world->settings->ProtectPlayerDrop;
 			character->DelItem(id, amount);
 
 			PacketBuilder reply(PACKET_ITEM, PACKET_DROP, 15);
@@ -454,7 +455,7 @@ void Item_Get(Character *character, PacketReader &reader)
 	{
 		int distance = util::path_length(item->x, item->y, character->x, character->y);
 
-		if (distance > static_cast<int>(character->world->config["DropDistance"]))
+		if (distance > character->world->settings->DropDistance)
 		{
 			return;
 		}
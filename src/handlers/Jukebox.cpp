@@ -16,9 +16,6 @@
 
 #include "../util.hpp"
 
-#include <algorithm>
-#include <functional>
-
 namespace Handlers
 {
 
@@ -52,8 +49,6 @@ void Jukebox_Msg(Character *character, PacketReader &reader)
 {
 	if (character->trading) return;
 
-	using namespace std::placeholders;
-
 	reader.GetChar();
 	reader.GetChar();
 	short track = reader.GetShort();
@@ -77,7 +72,12 @@ void Jukebox_Msg(Character *character, PacketReader &reader)
 
 	PacketBuilder builder(PACKET_JUKEBOX, PACKET_USE, 2);
 	builder.AddShort(track + 1);
-	std::for_each(UTIL_CRANGE(character->map->characters), std::bind(&Character::Send, _1, builder));
+	SharedPacket packet(builder);
+
+	UTIL_FOREACH(character->map->characters, checkchar)
+	{
+		checkchar->Send(packet);
+	}
 }
 
 // Bard skill music
@@ -88,9 +88,11 @@ void Login_Request(EOClient *client, PacketReader &reader)
 		return;
 	}
 
-	auto successCallback = [username](EOClient* c)
+	std::shared_ptr<AccountCredentials> credentials(new AccountCredentials { username, std::move(password), HashFunc::NONE });
+
+	auto successCallback = [credentials](EOClient* c)
 	{
-		c->player = c->server()->world->PlayerFactory(username);
+		c->player = c->server()->world->PlayerFactory(*credentials);
 
 		// The client may disconnect if the password generation takes too long
 		if (!c->Connected())
@@ -98,7 +100,7 @@ void Login_Request(EOClient *client, PacketReader &reader)
 
 		if (!c->player)
 		{
-			// Someone deleted the account between checking it and logging in
+			// The login check did not read the account
 			PacketBuilder reply(PACKET_LOGIN, PACKET_REPLY, 2);
 			reply.AddShort(LOGIN_WRONG_USER);
 			c->Send(reply);
@@ -159,7 +161,7 @@ void Login_Request(EOClient *client, PacketReader &reader)
 	client->server()->world->CheckCredential(client)
 		->OnSuccess(successCallback)
 		->OnFailure(failureCallback)
-		->Execute(std::shared_ptr<AccountCredentials>(new AccountCredentials { username, std::move(password), HashFunc::NONE }));
+		->Execute(credentials);
 }
 
 PACKET_HANDLER_REGISTER(PACKET_LOGIN)
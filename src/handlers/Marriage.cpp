@@ -137,11 +137,10 @@ void Marriage_Request(Character *character, PacketReader &reader)
 			}
 			else
 			{
-				character->world->db->Query(
+				character->world->UpdateCharacter(name, Database_Query{
 					"UPDATE `characters` SET `partner` = '' WHERE `name` = '$' AND partner = '$'",
-					name.c_str(),
-					character->SourceName().c_str()
-				);
+					{name, character->SourceName()}
+				});
 			}
 
 			character->partner.clear();
@@ -9,6 +9,7 @@
 #include "../character.hpp"
 #include "../config.hpp"
 #include "../eodata.hpp"
+#include "../eoserv_config.hpp"
 #include "../map.hpp"
 #include "../npc.hpp"
 #include "../npc_data.hpp"
@@ -89,7 +90,7 @@ void Shop_Buy(Character *character, PacketReader &reader)
 			{
 				std::int_least64_t cost64 = std::int_least64_t(amount) * std::int_least64_t(checkitem->buy);
 
-				if (cost64 < 0 || cost64 > int(character->world->config["MaxItem"]))
+				if (cost64 < 0 || cost64 > character->world->settings->MaxItem)
 					break;
 
 				int cost = int(cost64);
@@ -123,7 +124,7 @@ void Shop_Sell(Character *character, PacketReader &reader)
 	int amount = reader.GetInt();
 	/*int shopid = reader.GetInt();*/
 
-	if (amount <= 0 || amount > static_cast<int>(character->world->config["MaxItem"])) return;
+	if (amount <= 0 || amount > character->world->settings->MaxItem) return;
 
 	if (character->npc_type == ENF::Shop)
 	{
@@ -133,7 +134,7 @@ void Shop_Sell(Character *character, PacketReader &reader)
 			{
 				std::int_least64_t owed64 = std::int_least64_t(amount) * std::int_least64_t(checkitem->sell);
 
-				if (owed64 < 0 || owed64 > (int(character->world->config["MaxItem"]) - character->HasItem(1)))
+				if (owed64 < 0 || owed64 > (character->world->settings->MaxItem - character->HasItem(1)))
 					break;
 
 				int owed = int(owed64);
@@ -9,6 +9,7 @@
 #include "../character.hpp"
 #include "../config.hpp"
 #include "../eodata.hpp"
+#include "../eoserv_config.hpp"
 #include "../map.hpp"
 #include "../packet.hpp"
 #include "../timer.hpp"
@@ -70,7 +71,7 @@ void Spell_Target_Self(Character *character, PacketReader &reader)
 	character->spell_target = Character::TargetSelf;
 	character->spell_target_id = 0;
 
-	if (character->world->config["EnforceTimestamps"])
+	if (character->world->settings->EnforceTimestamps)
 	{
 		const ESF_Data& spell = character->world->esf->Get(character->spell_id);
 
@@ -118,7 +119,7 @@ void Spell_Target_Other(Character *character, PacketReader &reader)
 			return;
 	}
 
-	if (character->world->config["EnforceTimestamps"])
+	if (character->world->settings->EnforceTimestamps)
 	{
 		const ESF_Data& spell = character->world->esf->Get(character->spell_id);
 
@@ -148,7 +149,7 @@ void Spell_Target_Group(Character *character, PacketReader &reader)
 	character->spell_target = Character::TargetGroup;
 	character->spell_target_id = 0;
 
-	if (character->world->config["EnforceTimestamps"])
+	if (character->world->settings->EnforceTimestamps)
 	{
 		const ESF_Data& spell = character->world->esf->Get(character->spell_id);
 
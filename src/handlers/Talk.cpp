@@ -8,6 +8,7 @@
 
 #include "../character.hpp"
 #include "../config.hpp"
+#include "../eoserv_config.hpp"
 #include "../guild.hpp"
 #include "../i18n.hpp"
 #include "../map.hpp"
@@ -64,7 +65,7 @@ void Talk_Msg(Character *character, PacketReader &reader)
 {
 	if (character->muted_until > time(0)) return;
 
-	if (character->mapid == static_cast<int>(character->world->config["JailMap"]))
+	if (character->mapid == character->world->settings->JailMap)
 	{
 		return;
 	}
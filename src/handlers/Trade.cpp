@@ -8,6 +8,7 @@
 
 #include "../character.hpp"
 #include "../eodata.hpp"
+#include "../eoserv_config.hpp"
 #include "../map.hpp"
 #include "../packet.hpp"
 #include "../world.hpp"
@@ -22,7 +23,7 @@ void Trade_Request(Character *character, PacketReader &reader)
 {
 	if (character->trading) return;
 	if (!character->CanInteractItems()) return;
-	if (character->mapid == int(character->world->config["JailMap"])) return;
+	if (character->mapid == character->world->settings->JailMap) return;
 
 	int something = reader.GetChar(); // ?
 	int victimid = reader.GetShort();
@@ -51,7 +52,7 @@ void Trade_Accept(Character *character, PacketReader &reader)
 {
 	if (character->trading) return;
 	if (!character->CanInteractItems()) return;
-	if (character->mapid == int(character->world->config["JailMap"])) return;
+	if (character->mapid == character->world->settings->JailMap) return;
 
 	/*int accept =*/ reader.GetChar();
 	int victimid = reader.GetShort();
@@ -9,6 +9,7 @@
 #include "../character.hpp"
 #include "../config.hpp"
 #include "../eodata.hpp"
+#include "../eoserv_config.hpp"
 #include "../npc.hpp"
 #include "../packet.hpp"
 #include "../world.hpp"
@@ -24,7 +25,7 @@ static void walk_common(Character *character, PacketReader &reader, Map::WalkRes
 	unsigned char y = reader.GetChar();
 	Map::WalkResult walk_result = Map::WalkFail;
 
-	if (character->world->config["EnforceTimestamps"])
+	if (character->world->settings->EnforceTimestamps)
 	{
 		if (timestamp - character->timestamp < 36)
 		{
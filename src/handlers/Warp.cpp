@@ -8,9 +8,11 @@
 
 #include "../character.hpp"
 #include "../eoclient.hpp"
+#include "../eoserv_config.hpp"
 #include "../map.hpp"
 #include "../npc.hpp"
 #include "../player.hpp"
+#include "../world.hpp"
 
 #include "../util.hpp"
 
@@ -44,29 +46,32 @@ void Warp_Accept(Character *character, PacketReader &reader)
 	std::vector<NPC *> updatenpcs;
 	std::vector<std::shared_ptr<Map_Item>> updateitems;
 
-	UTIL_FOREACH(character->map->characters, checkcharacter)
+	character->map->grid.ForEachCell(character->x, character->y, character->world->settings->SeeDistance, [&](const Map_Grid::Cell &cell)
 	{
-		if (checkcharacter->InRange(character))
+		UTIL_FOREACH(cell.characters, checkcharacter)
 		{
-			updatecharacters.push_back(checkcharacter);
+			if (checkcharacter->InRange(character))
+			{
+				updatecharacters.push_back(checkcharacter);
+			}
 		}
-	}
 
-	UTIL_FOREACH(character->map->npcs, npc)
-	{
-		if (character->InRange(npc) && npc->alive)
+		UTIL_FOREACH(cell.npcs, npc)
 		{
-			updatenpcs.push_back(npc);
+			if (character->InRange(npc) && npc->alive)
+			{
+				updatenpcs.push_back(npc);
+			}
 		}
-	}
 
-	UTIL_FOREACH(character->map->items, item)
-	{
-		if (character->InRange(*item))
+		UTIL_FOREACH(cell.items, item)
 		{
-			updateitems.push_back(item);
+			if (character->InRange(*item))
+			{
+				updateitems.push_back(item);
+			}
 		}
-	}
+	});
 
 	PacketBuilder reply(PACKET_WARP, PACKET_AGREE,
 		7 + updatecharacters.size() * 60 + updatenpcs.size() * 6 + updateitems.size() * 9);
@@ -9,6 +9,7 @@
 #include "../character.hpp"
 #include "../config.hpp"
 #include "../eoclient.hpp"
+#include "../eoserv_config.hpp"
 #include "../map.hpp"
 #include "../npc.hpp"
 #include "../packet.hpp"
@@ -59,7 +60,7 @@ void Welcome_Request(Player *player, PacketReader &reader)
 	reply.AddInt(player->character->id);
 	reply.AddShort(player->character->mapid); // Map ID
 
-	if (player->world->config["GlobalPK"] && !player->world->PKExcept(player->character->mapid))
+	if (player->world->settings->GlobalPK && !player->world->PKExcept(player->character->mapid))
 	{
 		reply.AddByte(0xFF);
 		reply.AddByte(0x01);
@@ -190,7 +191,7 @@ void Welcome_Request(Player *player, PacketReader &reader)
 		reply.AddChar(player->character->guild_rank);
 	}
 
-	reply.AddShort(static_cast<int>(player->world->config["JailMap"]));
+	reply.AddShort(player->world->settings->JailMap);
 	reply.AddShort(4); // Recover map
 	reply.AddChar(24); // Recover map x
 	reply.AddChar(24); // Recover map y
@@ -243,29 +244,34 @@ void Welcome_Msg(Player *player, PacketReader &reader)
 	std::vector<NPC *> updatenpcs;
 	std::vector<std::shared_ptr<Map_Item>> updateitems;
 
-	UTIL_FOREACH(player->character->map->characters, character)
+	Character *self = player->character;
+
+	self->map->grid.ForEachCell(self->x, self->y, player->world->settings->SeeDistance, [&](const Map_Grid::Cell &cell)
 	{
-		if (player->character->InRange(character))
+		UTIL_FOREACH(cell.characters, character)
 		{
-			updatecharacters.push_back(character);
+			if (self->InRange(character))
+			{
+				updatecharacters.push_back(character);
+			}
 		}
-	}
 
-	UTIL_FOREACH(player->character->map->npcs, npc)
-	{
-		if (player->character->InRange(npc))
+		UTIL_FOREACH(cell.npcs, npc)
 		{
-			updatenpcs.push_back(npc);
+			if (self->InRange(npc))
+			{
+				updatenpcs.push_back(npc);
+			}
 		}
-	}
 
-	UTIL_FOREACH(player->character->map->items, item)
-	{
-		if (player->character->InRange(*item))
+		UTIL_FOREACH(cell.items, item)
 		{
-			updateitems.push_back(item);
+			if (self->InRange(*item))
+			{
+				updateitems.push_back(item);
+			}
 		}
-	}
+	});
 
 	PacketBuilder reply(PACKET_WELCOME, PACKET_REPLY, 3 + 9);
 
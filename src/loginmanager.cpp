@@ -8,21 +8,31 @@
 
 #include "util/threadpool.hpp"
 
+#include "character.hpp"
+#include "console.hpp"
+#include "database.hpp"
 #include "loginmanager.hpp"
+#include "persistence.hpp"
 #include "player.hpp"
 #include "world.hpp"
 
-LoginManager::LoginManager(std::shared_ptr<DatabaseFactory> databaseFactory, Config& config, const std::unordered_map<HashFunc, std::shared_ptr<Hasher>>& passwordHashers)
+LoginManager::LoginManager(std::shared_ptr<DatabaseFactory> databaseFactory, Config& config, const std::unordered_map<HashFunc, std::shared_ptr<Hasher>>& passwordHashers, Persistence& persistence)
     : _databaseFactory(databaseFactory)
     , _config(config)
     , _passwordHashers(passwordHashers)
-    , _processCount(0)
+    , _persistence(persistence)
 {
 }
 
+bool LoginManager::LoginBusy() const
+{
+    // Logins and account changes share the interactive side of the thread pool, so its queue is the login queue
+    return util::ThreadPool::Pending(util::ThreadPool::Priority::Interactive) >= static_cast<size_t>(static_cast<int>(this->_config["LoginQueueSize"]));
+}
+
 bool LoginManager::CheckLogin(const std::string& username, util::secure_string&& password)
 {
-    auto res = this->_databaseFactory->CreateDatabase(this->_config)->Query("SELECT `password`, `password_version` FROM `accounts` WHERE `username` = '$'", username.c_str());
+    auto res = this->_databaseFactory->AcquireDatabase(this->_config)->Query("SELECT `password`, `password_version` FROM `accounts` WHERE `username` = '$'", username.c_str());
 
     if (!res.empty())
     {
@@ -43,7 +53,7 @@ void LoginManager::SetPassword(const std::string& username, util::secure_string&
     password = std::move(Hasher::SaltPassword(std::string(this->_config["PasswordSalt"]), username, std::move(password)));
     password = std::move(this->_passwordHashers[passwordVersion]->hash(password.str()));
 
-    this->_databaseFactory->CreateDatabase(this->_config)->Query("UPDATE `accounts` SET `password` = '$', `password_version` = # WHERE username = '$'",
+    this->_databaseFactory->AcquireDatabase(this->_config)->Query("UPDATE `accounts` SET `password` = '$', `password_version` = # WHERE username = '$'",
         password.str().c_str(),
         int(passwordVersion),
         username.c_str());
@@ -59,7 +69,7 @@ AsyncOperation<AccountCreateInfo, bool>* LoginManager::CreateAccountAsync(EOClie
         password = std::move(Hasher::SaltPassword(std::string(this->_config["PasswordSalt"]), accountCreateInfo->username, std::move(password)));
         password = std::move(this->_passwordHashers[passwordVersion]->hash(password.str()));
 
-        auto db_res = this->_databaseFactory->CreateDatabase(this->_config)->Query(
+        auto db_res = this->_databaseFactory->AcquireDatabase(this->_config)->Query(
             "INSERT INTO `accounts` (`username`, `password`, `fullname`, `location`, `email`, `computer`, `hdid`, `regip`, `created`, `password_version`)"
             " VALUES ('$','$','$','$','$','$',#,'$',#,#)",
             accountCreateInfo->username.c_str(),
@@ -114,15 +124,21 @@ void LoginManager::UpdatePasswordVersionInBackground(AccountCredentials&& accoun
             password = std::move(Hasher::SaltPassword(std::string(this->_config["PasswordSalt"]), username, std::move(password)));
             password = std::move(this->_passwordHashers[hashFunc]->hash(std::move(password.str())));
 
-            this->_databaseFactory->CreateDatabase(this->_config)->Query("UPDATE `accounts` SET `password` = '$', `password_version` = # WHERE `username` = '$'",
+            this->_databaseFactory->AcquireDatabase(this->_config)->Query("UPDATE `accounts` SET `password` = '$', `password_version` = # WHERE `username` = '$'",
                 password.str().c_str(),
                 hashFunc,
                 username.c_str());
         }
     };
 
-    auto state = static_cast<void*>(new AccountCredentials(std::move(accountCredentials)));
-    util::ThreadPool::Queue(updateThreadProc, state);
+    auto state = new AccountCredentials(std::move(accountCredentials));
+
+    // Rehashing can wait for the next login if the background queue is already full
+    if (!util::ThreadPool::TryQueue(updateThreadProc, state, util::ThreadPool::Priority::Background))
+    {
+        Console::Wrn("Background queue is full, password version update for %s skipped", state->username.c_str());
+        delete state;
+    }
 }
 
 AsyncOperation<AccountCredentials, LoginReply>* LoginManager::CheckLoginAsync(EOClient* client)
@@ -132,7 +148,7 @@ AsyncOperation<AccountCredentials, LoginReply>* LoginManager::CheckLoginAsync(EO
         auto username = updateState->username;
         auto password = std::move(updateState->password);
 
-        auto database = this->_databaseFactory->CreateDatabase(this->_config);
+        auto database = this->_databaseFactory->AcquireDatabase(this->_config);
         Database_Result res = database->Query("SELECT `password`, `password_version` FROM `accounts` WHERE `username` = '$'", username.c_str());
 
         if (!res.empty())
@@ -157,6 +173,16 @@ AsyncOperation<AccountCredentials, LoginReply>* LoginManager::CheckLoginAsync(EO
                     this->UpdatePasswordVersionInBackground(std::move(AccountCredentials { username, std::move(password), currentPasswordVersion }));
                 }
 
+                // The last session's saves may still be on their way, and waiting for them belongs here rather than on the game thread
+                Database_Result names = database->Query("SELECT `name` FROM `characters` WHERE `account` = '$'", username.c_str());
+
+                for (const auto& row : names)
+                    this->_persistence.WaitForCharacter(row.GetString(names.Column("name")));
+
+                updateState->characters = std::make_shared<Database_Result>(database->Query(
+                    (std::string("SELECT ") + Character::Columns + " FROM `characters` WHERE `account` = '$' ORDER BY `exp` DESC").c_str(),
+                    username.c_str()));
+
                 return LOGIN_OK;
             }
             else
@@ -170,8 +196,5 @@ AsyncOperation<AccountCredentials, LoginReply>* LoginManager::CheckLoginAsync(EO
         }
     };
 
-    this->_processCount++;
-
-    auto asyncOp = new AsyncOperation<AccountCredentials, LoginReply>(client, loginThreadProc, LOGIN_OK);
-    return asyncOp->OnComplete([this]() { this->_processCount--; });
+    return new AsyncOperation<AccountCredentials, LoginReply>(client, loginThreadProc, LOGIN_OK);
 }
@@ -16,6 +16,7 @@
 #include "hash.hpp"
 #include "fwd/config.hpp"
 #include "fwd/database.hpp"
+#include "fwd/persistence.hpp"
 #include "fwd/player.hpp"
 #include "fwd/world.hpp"
 #include "util/secure_string.hpp"
@@ -25,7 +26,7 @@
 class LoginManager
 {
 public:
-    LoginManager(std::shared_ptr<DatabaseFactory> databaseFactory, Config& config, const std::unordered_map<HashFunc, std::shared_ptr<Hasher>>& passwordHashers);
+    LoginManager(std::shared_ptr<DatabaseFactory> databaseFactory, Config& config, const std::unordered_map<HashFunc, std::shared_ptr<Hasher>>& passwordHashers, Persistence& persistence);
 
     bool CheckLogin(const std::string& username, util::secure_string&& password);
     void SetPassword(const std::string& username, util::secure_string&& password);
@@ -36,14 +37,12 @@ public:
 
     void UpdatePasswordVersionInBackground(AccountCredentials&& accountCredentials);
 
-    bool LoginBusy() const { return this->_processCount >= static_cast<int>(this->_config["LoginQueueSize"]); };
+    bool LoginBusy() const;
 
 private:
     std::shared_ptr<DatabaseFactory> _databaseFactory;
 
     Config& _config;
     std::unordered_map<HashFunc, std::shared_ptr<Hasher>> _passwordHashers;
-
-    // Count of the number of concurrent login requests
-    volatile std::atomic_int _processCount;
+    Persistence& _persistence;
 };
\ No newline at end of file
@@ -8,11 +8,13 @@
 #include "database.hpp"
 #include "eoserv_config.hpp"
 #include "eoserver.hpp"
+#include "packettrace.hpp"
 #include "world.hpp"
 
 #include "console.hpp"
 #include "socket.hpp"
 
+#include <algorithm>
 #include <array>
 #include <csignal>
 #include <cstdio>
@@ -154,6 +156,23 @@ int eoserv_main(int argc, char *argv[])
 
 	exception_test();
 
+	if (argc >= 3 && std::string(argv[1]) == "--decode-trace")
+	{
+		std::FILE *trace = std::fopen(argv[2], "rb");
+		bool ok = trace && PacketTrace::Dump(trace, stdout);
+
+		if (trace)
+			std::fclose(trace);
+
+		if (!ok)
+		{
+			Console::Err("Could not read packet trace file: %s", argv[2]);
+			return 1;
+		}
+
+		return 0;
+	}
+
 #ifdef WIN32
 	if (argc >= 2)
 	{
@@ -367,6 +386,7 @@ Julian Smythe  ╚══════╝   ╚═╝   ╚═╝  ╚═╝╚═
 		const auto threadPoolSize = static_cast<size_t>(static_cast<int>(config["ThreadPoolThreads"]));
 		Console::Out("Setting number of threadpool threads to %d", threadPoolSize);
 		util::ThreadPool::SetNumThreads(threadPoolSize);
+		util::ThreadPool::SetQueueLimit(util::ThreadPool::Priority::Background, static_cast<size_t>(std::max(0, static_cast<int>(config["BackgroundQueueSize"]))));
 
 		const auto databaseFactory = std::make_shared<DatabaseFactory>(DatabaseFactory());
 
@@ -11,10 +11,14 @@
 #include "config.hpp"
 #include "eoclient.hpp"
 #include "eodata.hpp"
+#include "eoserv_config.hpp"
+#include "filecache.hpp"
+#include "formula.hpp"
 #include "npc.hpp"
 #include "npc_data.hpp"
 #include "packet.hpp"
 #include "party.hpp"
+#include "pathfinder.hpp"
 #include "player.hpp"
 #include "quest.hpp"
 #include "timer.hpp"
@@ -23,12 +27,13 @@
 
 #include "console.hpp"
 #include "util.hpp"
-#include "util/rpn.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <iterator>
+#include <limits>
 #include <list>
 #include <memory>
 #include <set>
@@ -45,8 +50,40 @@ static void map_safe_fail(int line)
 	Console::Err("Invalid file / failed read/seek: %s -- %i", map_safe_fail_filename, line);
 }
 
-#define SAFE_SEEK(fh, offset, from) if (std::fseek(fh, offset, from) != 0) { std::fclose(fh); map_safe_fail(__LINE__); return false; }
-#define SAFE_READ(buf, size, count, fh) if (std::fread(buf, size, count, fh) != static_cast<int>(count)) {  std::fclose(fh); map_safe_fail(__LINE__);return false; }
+/**
+ * Reads a map file from its cached image with the same seek/read semantics as stdio.
+ */
+struct map_image_reader
+{
+	const std::string &data;
+	std::size_t pos;
+
+	map_image_reader(const std::string &data) : data(data), pos(0) { }
+
+	bool Seek(long offset, int from)
+	{
+		long base = (from == SEEK_CUR) ? long(this->pos) : (from == SEEK_END) ? long(this->data.length()) : 0;
+
+		if (base + offset < 0)
+			return false;
+
+		this->pos = std::size_t(base + offset);
+		return true;
+	}
+
+	bool Read(char *buf, std::size_t length)
+	{
+		if (this->pos > this->data.length() || this->data.length() - this->pos < length)
+			return false;
+
+		std::copy_n(this->data.begin() + this->pos, length, buf);
+		this->pos += length;
+		return true;
+	}
+};
+
+#define SAFE_SEEK(fh, offset, from) if (!fh.Seek(offset, from)) { map_safe_fail(__LINE__); return false; }
+#define SAFE_READ(buf, size, count, fh) if (!fh.Read(buf, (size) * (count))) { map_safe_fail(__LINE__); return false; }
 
 void map_spawn_chests(void *map_void)
 {
@@ -335,6 +372,197 @@ void Map_Chest::Update(Map *map, Character *exclude) const
 	}
 }
 
+template <class T> static bool map_swap_erase(std::vector<T> &entries, const T &entry)
+{
+	auto it = std::find(UTIL_RANGE(entries), entry);
+
+	if (it == entries.end())
+		return false;
+
+	*it = std::move(entries.back());
+	entries.pop_back();
+	return true;
+}
+
+// The half square ahead of a one tile step, which holds everything the step can bring in to view
+static void map_view_strip(int x, int y, Direction direction, int range, int &x1, int &y1, int &x2, int &y2)
+{
+	x1 = x - range;
+	y1 = y - range;
+	x2 = x + range;
+	y2 = y + range;
+
+	switch (direction)
+	{
+		case DIRECTION_UP: y2 = y; break;
+		case DIRECTION_RIGHT: x1 = x; break;
+		case DIRECTION_DOWN: y1 = y; break;
+		case DIRECTION_LEFT: x2 = x; break;
+	}
+}
+
+// One step changes the distance by exactly one, so this is only true on the far edge of the view
+static bool map_view_entered(int x, int y, int old_x, int old_y, int new_x, int new_y, int range)
+{
+	return util::path_length(x, y, new_x, new_y) <= range && util::path_length(x, y, old_x, old_y) > range;
+}
+
+Map_Grid::Map_Grid()
+{
+	this->Reset(0, 0, 1);
+}
+
+void Map_Grid::Reset(int width, int height, int cell_size)
+{
+	this->cell_size = std::max(cell_size, 1);
+	this->columns = std::max((width + this->cell_size - 1) / this->cell_size, 1);
+	this->rows = std::max((height + this->cell_size - 1) / this->cell_size, 1);
+
+	this->cells.clear();
+	this->cells.resize(this->columns * this->rows);
+}
+
+void Map_Grid::Clear()
+{
+	UTIL_FOREACH_REF(this->cells, cell)
+	{
+		cell.characters.clear();
+		cell.npcs.clear();
+		cell.items.clear();
+	}
+}
+
+void Map_Grid::Add(Character *character, int x, int y)
+{
+	this->At(x, y).characters.push_back(character);
+}
+
+void Map_Grid::Remove(Character *character, int x, int y)
+{
+	if (map_swap_erase(this->At(x, y).characters, character))
+		return;
+
+	// Should not happen, but a missed move must not leave a dangling pointer behind
+	UTIL_FOREACH_REF(this->cells, cell)
+	{
+		if (map_swap_erase(cell.characters, character))
+			return;
+	}
+}
+
+void Map_Grid::Move(Character *character, int from_x, int from_y, int to_x, int to_y)
+{
+	if (&this->At(from_x, from_y) == &this->At(to_x, to_y))
+		return;
+
+	this->Remove(character, from_x, from_y);
+	this->Add(character, to_x, to_y);
+}
+
+void Map_Grid::Add(NPC *npc, int x, int y)
+{
+	this->At(x, y).npcs.push_back(npc);
+}
+
+void Map_Grid::Remove(NPC *npc, int x, int y)
+{
+	if (map_swap_erase(this->At(x, y).npcs, npc))
+		return;
+
+	UTIL_FOREACH_REF(this->cells, cell)
+	{
+		if (map_swap_erase(cell.npcs, npc))
+			return;
+	}
+}
+
+void Map_Grid::Move(NPC *npc, int from_x, int from_y, int to_x, int to_y)
+{
+	if (&this->At(from_x, from_y) == &this->At(to_x, to_y))
+		return;
+
+	this->Remove(npc, from_x, from_y);
+	this->Add(npc, to_x, to_y);
+}
+
+void Map_Grid::Add(const std::shared_ptr<Map_Item> &item)
+{
+	this->At(item->x, item->y).items.push_back(item);
+}
+
+void Map_Grid::Remove(const Map_Item *item)
+{
+	auto &items = this->At(item->x, item->y).items;
+	auto it = std::find_if(UTIL_RANGE(items), [item](const std::shared_ptr<Map_Item> &entry) { return entry.get() == item; });
+
+	if (it != items.end())
+	{
+		*it = std::move(items.back());
+		items.pop_back();
+	}
+}
+
+void Map_NPCSchedule::Add(NPC *npc, Event event, double time)
+{
+	if (time >= npc->scheduled[event])
+		return;
+
+	npc->scheduled[event] = time;
+
+	auto &queue = this->queues[event];
+	queue.push_back(Entry{time, npc});
+	std::push_heap(UTIL_RANGE(queue), Later);
+}
+
+void Map_NPCSchedule::TakeDue(Event event, double now, std::vector<NPC *> &due)
+{
+	auto &queue = this->queues[event];
+	due.clear();
+
+	while (!queue.empty() && queue.front().time < now)
+	{
+		std::pop_heap(UTIL_RANGE(queue), Later);
+		Entry entry = queue.back();
+		queue.pop_back();
+
+		// Superseded by an earlier entry, or already taken
+		if (entry.npc->scheduled[event] != entry.time)
+			continue;
+
+		entry.npc->scheduled[event] = std::numeric_limits<double>::infinity();
+		due.push_back(entry.npc);
+	}
+}
+
+void Map_NPCSchedule::Remove(NPC *npc)
+{
+	UTIL_FOREACH_REF(this->queues, queue)
+	{
+		auto it = std::remove_if(UTIL_RANGE(queue), [npc](const Entry &entry) { return entry.npc == npc; });
+
+		if (it != queue.end())
+		{
+			queue.erase(it, queue.end());
+			std::make_heap(UTIL_RANGE(queue), Later);
+		}
+	}
+
+	npc->scheduled.fill(std::numeric_limits<double>::infinity());
+}
+
+void Map_NPCSchedule::Clear()
+{
+	UTIL_FOREACH_REF(this->queues, queue)
+	{
+		UTIL_FOREACH_CREF(queue, entry)
+		{
+			entry.npc->scheduled.fill(std::numeric_limits<double>::infinity());
+		}
+
+		queue.clear();
+	}
+}
+
 Map::Map(int id, World *world)
 {
 	this->id = id;
@@ -345,6 +573,9 @@ Map::Map(int id, World *world)
 	this->wedding = nullptr;
 	this->evacuate_lock = false;
 	this->has_timed_spikes = false;
+	this->npc_random.seed(std::minstd_rand::result_type(util::rand(1, 0x7FFFFFFE)));
+	this->awake = false;
+	this->asleep_since = Timer::GetTime();
 
 	this->Load();
 
@@ -475,15 +706,17 @@ bool Map::Load()
 
 	map_safe_fail_filename = filename.c_str();
 
-	std::FILE *fh = std::fopen(filename.c_str(), "rb");
+	FileCache::ImagePtr image = this->world->file_cache.Get(filename);
 
-	if (!fh)
+	if (!image)
 		return false;
 
+	map_image_reader fh(image->data);
+
 	this->has_timed_spikes = false;
 
-	SAFE_SEEK(fh, 0x03, SEEK_SET);
-	SAFE_READ(this->rid, sizeof(char), 4, fh);
+	std::copy(UTIL_RANGE(image->rid), this->rid);
+	this->filesize = image->Size();
 
 	char buf[12];
 	unsigned char outersize;
@@ -501,6 +734,19 @@ bool Map::Load()
 
 	this->tiles.resize(this->height * this->width);
 
+	// Cells about the size of the view distance keep range checks to a handful of cells
+	this->grid.Reset(this->width, this->height, std::max(this->world->settings->SeeDistance, 4));
+
+	UTIL_FOREACH(this->characters, character)
+	{
+		this->grid.Add(character, character->x, character->y);
+	}
+
+	UTIL_FOREACH(this->items, item)
+	{
+		this->grid.Add(item);
+	}
+
 	SAFE_SEEK(fh, 0x2A, SEEK_SET);
 	SAFE_READ(buf, sizeof(char), 3, fh);
 	this->scroll = PacketProcessor::Number(buf[0]);
@@ -598,7 +844,6 @@ bool Map::Load()
 			}
 			catch (...)
 			{
-				std::fclose(fh);
 				map_safe_fail(__LINE__);
 				return false;
 			}
@@ -634,6 +879,7 @@ bool Map::Load()
 
 			NPC *newnpc = new NPC(this, npc_id, x, y, spawntype, spawntime, index++);
 			this->npcs.push_back(newnpc);
+			this->grid.Add(newnpc, newnpc->x, newnpc->y);
 
 			newnpc->Spawn();
 		}
@@ -685,10 +931,10 @@ bool Map::Load()
 		;
 	}
 
-	SAFE_SEEK(fh, 0x00, SEEK_END);
-	this->filesize = std::ftell(fh);
-
-	std::fclose(fh);
+	this->pathfinder.Reset(this->width, this->height, [this](int x, int y)
+	{
+		return this->GetTile(x, y).Walkable(true);
+	});
 
 	this->exists = true;
 
@@ -699,6 +945,9 @@ void Map::Unload()
 {
 	this->exists = false;
 
+	this->npc_schedule.Clear();
+	this->npcs_due.clear();
+
 	UTIL_FOREACH(this->npcs, npc)
 	{
 		UTIL_FOREACH_CREF(npc->damagelist, opponent)
@@ -713,6 +962,12 @@ void Map::Unload()
 	}
 
 	this->npcs.clear();
+	this->grid.Clear();
+
+	UTIL_FOREACH(this->characters, character)
+	{
+		character->view_npcs.clear();
+	}
 
 	if (this->arena)
 	{
@@ -765,7 +1020,14 @@ unsigned char Map::GenerateNPCIndex() const
 
 void Map::Enter(Character *character, WarpAnimation animation)
 {
+	if (!this->awake)
+	{
+		this->Wake();
+	}
+
 	this->characters.push_back(character);
+	this->grid.Add(character, character->x, character->y);
+	this->TrackView(character);
 	character->map = this;
 	character->last_walk = Timer::GetTime();
 	character->attacks = 0;
@@ -800,15 +1062,7 @@ void Map::Enter(Character *character, WarpAnimation animation)
 	builder.AddByte(255);
 	builder.AddChar(1); // 0 = NPC, 1 = player
 
-	UTIL_FOREACH(this->characters, checkcharacter)
-	{
-		if (checkcharacter == character || !character->InRange(checkcharacter))
-		{
-			continue;
-		}
-
-		checkcharacter->Send(builder);
-	}
+	this->world->Broadcast(builder, character->view_characters);
 
 	character->CheckQuestRules();
 }
@@ -825,15 +1079,7 @@ void Map::Leave(Character *character, WarpAnimation animation, bool silent)
 			builder.AddChar(animation);
 		}
 
-		UTIL_FOREACH(this->characters, checkcharacter)
-		{
-			if (checkcharacter == character || !character->InRange(checkcharacter))
-			{
-				continue;
-			}
-
-			checkcharacter->Send(builder);
-		}
+		this->world->Broadcast(builder, character->view_characters);
 	}
 
 	if (this->wedding)
@@ -846,34 +1092,231 @@ void Map::Leave(Character *character, WarpAnimation animation, bool silent)
 		this->characters.end()
 	);
 
+	this->UntrackView(character);
+	this->grid.Remove(character, character->x, character->y);
+	this->pathfinder.Forget(character->PlayerID());
+
 	character->map = 0;
+
+	if (this->characters.empty())
+	{
+		this->Sleep();
+	}
+}
+
+void Map::TrackView(Character *character)
+{
+	int seedistance = this->world->settings->SeeDistance;
+
+	this->grid.ForEachCell(character->x, character->y, seedistance, [&](const Map_Grid::Cell &cell)
+	{
+		UTIL_FOREACH(cell.characters, checkchar)
+		{
+			if (checkchar != character && util::path_length(checkchar->x, checkchar->y, character->x, character->y) <= seedistance)
+			{
+				character->view_characters.push_back(checkchar);
+				checkchar->view_characters.push_back(character);
+			}
+		}
+
+		UTIL_FOREACH(cell.npcs, checknpc)
+		{
+			if (checknpc->alive && util::path_length(checknpc->x, checknpc->y, character->x, character->y) <= seedistance)
+			{
+				character->view_npcs.push_back(checknpc);
+				checknpc->viewers.push_back(character);
+			}
+		}
+	});
+}
+
+void Map::TrackView(NPC *npc)
+{
+	if (!npc->alive)
+		return;
+
+	int seedistance = this->world->settings->SeeDistance;
+
+	this->grid.ForEachCharacter(npc->x, npc->y, seedistance, [&](Character *character)
+	{
+		if (util::path_length(character->x, character->y, npc->x, npc->y) <= seedistance)
+		{
+			npc->viewers.push_back(character);
+			character->view_npcs.push_back(npc);
+		}
+	});
+}
+
+void Map::UntrackView(Character *character)
+{
+	UTIL_FOREACH(character->view_characters, checkchar)
+	{
+		map_swap_erase(checkchar->view_characters, character);
+	}
+
+	UTIL_FOREACH(character->view_npcs, checknpc)
+	{
+		map_swap_erase(checknpc->viewers, character);
+	}
+
+	character->view_characters.clear();
+	character->view_npcs.clear();
+}
+
+void Map::UntrackView(NPC *npc)
+{
+	UTIL_FOREACH(npc->viewers, character)
+	{
+		map_swap_erase(character->view_npcs, npc);
+	}
+
+	npc->viewers.clear();
+}
+
+void Map::ResetViews()
+{
+	int seedistance = this->world->settings->SeeDistance;
+
+	UTIL_FOREACH(this->characters, character)
+	{
+		character->view_characters.clear();
+		character->view_npcs.clear();
+	}
+
+	UTIL_FOREACH(this->npcs, npc)
+	{
+		npc->viewers.clear();
+		this->TrackView(npc);
+	}
+
+	// Every character fills in its own set, so each pair is only linked once from each side
+	UTIL_FOREACH(this->characters, character)
+	{
+		this->grid.ForEachCharacter(character->x, character->y, seedistance, [&](Character *checkchar)
+		{
+			if (checkchar != character && util::path_length(checkchar->x, checkchar->y, character->x, character->y) <= seedistance)
+				character->view_characters.push_back(checkchar);
+		});
+	}
+}
+
+void Map::Wake()
+{
+	double now = Timer::GetTime();
+	double asleep = now - this->asleep_since;
+
+	this->awake = true;
+
+	double recover_speed = this->world->settings->NPCRecoverSpeed;
+	double recover_rate = this->world->settings->NPCRecoverRate;
+	double recovers = (recover_speed > 0.0) ? std::floor(asleep / recover_speed) : 0.0;
+
+	UTIL_FOREACH(this->npcs, npc)
+	{
+		if (npc->alive)
+		{
+			int maxhp = npc->ENF().hp;
+
+			if (recovers > 0.0 && npc->hp < maxhp)
+			{
+				double hp = npc->hp + recovers * static_cast<int>(maxhp * recover_rate);
+				npc->hp = static_cast<int>(std::min(hp, double(maxhp)));
+			}
+
+			// Spread out NPCs that would all be overdue, so they don't all move on the same tick
+			if (npc->last_act + npc->act_speed < now)
+				npc->last_act = now - npc->act_speed * util::rand(0.0, 1.0);
+
+			double talk_speed = npc->Data().talk_speed;
+
+			if (npc->last_talk + talk_speed < now)
+				npc->last_talk = now - talk_speed * util::rand(0.0, 1.0);
+		}
+		else if (npc->RespawnTime() < now)
+		{
+			npc->Spawn();
+		}
+	}
+
+	this->RescheduleNPCs();
+}
+
+void Map::Sleep()
+{
+	this->awake = false;
+	this->asleep_since = Timer::GetTime();
+	this->npc_schedule.Clear();
+}
+
+void Map::ScheduleNPC(NPC *npc)
+{
+	if (!this->awake)
+		return;
+
+	if (npc->alive)
+	{
+		this->npc_schedule.Add(npc, Map_NPCSchedule::Act, npc->last_act + npc->act_speed);
+
+		const NPC_Data &data = npc->Data();
+
+		if (!data.talk_phrases.empty())
+			this->npc_schedule.Add(npc, Map_NPCSchedule::Talk, npc->last_talk + data.talk_speed);
+	}
+	else
+	{
+		double respawn = npc->RespawnTime();
+
+		if (respawn != std::numeric_limits<double>::infinity())
+			this->npc_schedule.Add(npc, Map_NPCSchedule::Spawn, respawn);
+	}
+}
+
+void Map::RescheduleNPCs()
+{
+	this->npc_schedule.Clear();
+
+	UTIL_FOREACH(this->npcs, npc)
+	{
+		this->ScheduleNPC(npc);
+	}
+}
+
+void Map::Reposition(Character *character, unsigned char x, unsigned char y)
+{
+	this->UntrackView(character);
+	this->grid.Move(character, character->x, character->y, x, y);
+
+	character->x = x;
+	character->y = y;
+
+	this->TrackView(character);
 }
 
 void Map::Msg(Character *from, std::string message, bool echo)
 {
-	message = util::text_cap(message, static_cast<int>(this->world->config["ChatMaxWidth"]) - util::text_width(util::ucfirst(from->SourceName()) + "  "));
+	message = util::text_cap(message, this->world->settings->ChatMaxWidth - util::text_width(util::ucfirst(from->SourceName()) + "  "));
 
 	PacketBuilder builder(PACKET_TALK, PACKET_PLAYER, 2 + message.length());
 	builder.AddShort(from->PlayerID());
 	builder.AddString(message);
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(from->x, from->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (!from->InRange(character))
-			continue;
+			return;
 
 		character->AddChatLog("", from->SourceName(), message);
 
 		if (!echo && character == from)
-			continue;
+			return;
 
 		character->Send(builder);
-	}
+	});
 }
 
 void Map::Msg(NPC *from, std::string message)
 {
-	message = util::text_cap(message, static_cast<int>(this->world->config["ChatMaxWidth"]) - util::text_width(util::ucfirst(from->ENF().name) + "  "));
+	message = util::text_cap(message, this->world->settings->ChatMaxWidth - util::text_width(util::ucfirst(from->ENF().name) + "  "));
 
 	PacketBuilder builder(PACKET_NPC, PACKET_PLAYER, 4 + message.length());
 	builder.AddByte(255);
@@ -882,18 +1325,18 @@ void Map::Msg(NPC *from, std::string message)
 	builder.AddChar(static_cast<unsigned char>(message.length()));
 	builder.AddString(message);
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(from->x, from->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (!character->InRange(from))
-			continue;
+			return;
 
 		character->Send(builder);
-	}
+	});
 }
 
 Map::WalkResult Map::Walk(Character *from, Direction direction, bool admin)
 {
-	int seedistance = this->world->config["SeeDistance"];
+	int seedistance = this->world->settings->SeeDistance;
 
 	unsigned char target_x = from->x;
 	unsigned char target_y = from->y;
@@ -949,7 +1392,7 @@ Map::WalkResult Map::Walk(Character *from, Direction direction, bool admin)
 		if (!this->Walkable(target_x, target_y))
 			return WalkFail;
 
-		if (this->Occupied(target_x, target_y, PlayerOnly) && (from->last_walk + double(this->world->config["GhostTimer"]) > Timer::GetTime()))
+		if (this->Occupied(target_x, target_y, PlayerOnly) && (from->last_walk + this->world->settings->GhostTimer > Timer::GetTime()))
 			return WalkFail;
 	}
 
@@ -983,239 +1426,185 @@ Map::WalkResult Map::Walk(Character *from, Direction direction, bool admin)
 
 	from->direction = direction;
 
+	int old_x = from->x;
+	int old_y = from->y;
+
 	from->x = target_x;
 	from->y = target_y;
 
-	int newx;
-	int newy;
-	int oldx;
-	int oldy;
+	this->grid.Move(from, old_x, old_y, target_x, target_y);
 
-	std::vector<std::pair<int, int>> newcoords;
-	std::vector<std::pair<int, int>> oldcoords;
+	// Everything in view before the step is already known, so only those leaving need checking
+	auto leaving_chars = std::partition(UTIL_RANGE(from->view_characters), [&](Character *character)
+	{
+		return util::path_length(character->x, character->y, target_x, target_y) <= seedistance;
+	});
 
-	std::vector<Character *> newchars;
-	std::vector<Character *> oldchars;
-	std::vector<NPC *> newnpcs;
-	std::vector<NPC *> oldnpcs;
-	std::vector<std::shared_ptr<Map_Item>> newitems;
+	auto leaving_npcs = std::partition(UTIL_RANGE(from->view_npcs), [&](NPC *npc)
+	{
+		return util::path_length(npc->x, npc->y, target_x, target_y) <= seedistance;
+	});
 
-	switch (direction)
+	if (leaving_chars != from->view_characters.end())
 	{
-		case DIRECTION_UP:
-			for (int i = -seedistance; i <= seedistance; ++i)
-			{
-				newy = from->y - seedistance + std::abs(i);
-				newx = from->x + i;
-				oldy = from->y + seedistance + 1 - std::abs(i);
-				oldx = from->x + i;
+		PacketBuilder builder(PACKET_AVATAR, PACKET_REMOVE, 2);
+		builder.AddShort(from->PlayerID());
+		SharedPacket remove_packet(builder);
 
-				newcoords.push_back(std::make_pair(newx, newy));
-				oldcoords.push_back(std::make_pair(oldx, oldy));
-			}
-			break;
+		for (auto it = leaving_chars; it != from->view_characters.end(); ++it)
+		{
+			Character *character = *it;
 
-		case DIRECTION_RIGHT:
-			for (int i = -seedistance; i <= seedistance; ++i)
-			{
-				newx = from->x + seedistance - std::abs(i);
-				newy = from->y + i;
-				oldx = from->x - seedistance - 1 + std::abs(i);
-				oldy = from->y + i;
+			PacketBuilder rbuilder(PACKET_AVATAR, PACKET_REMOVE, 2);
+			rbuilder.AddShort(character->PlayerID());
+			from->Send(rbuilder);
 
-				newcoords.push_back(std::make_pair(newx, newy));
-				oldcoords.push_back(std::make_pair(oldx, oldy));
-			}
-			break;
+			character->Send(remove_packet);
+			map_swap_erase(character->view_characters, from);
+		}
 
-		case DIRECTION_DOWN:
-			for (int i = -seedistance; i <= seedistance; ++i)
-			{
-				newy = from->y + seedistance - std::abs(i);
-				newx = from->x + i;
-				oldy = from->y - seedistance - 1 + std::abs(i);
-				oldx = from->x + i;
+		from->view_characters.erase(leaving_chars, from->view_characters.end());
+	}
 
-				newcoords.push_back(std::make_pair(newx, newy));
-				oldcoords.push_back(std::make_pair(oldx, oldy));
-			}
-			break;
+	for (auto it = leaving_npcs; it != from->view_npcs.end(); ++it)
+	{
+		map_swap_erase((*it)->viewers, from);
+		(*it)->RemoveFromView(from);
+	}
 
-		case DIRECTION_LEFT:
-			for (int i = -seedistance; i <= seedistance; ++i)
-			{
-				newx = from->x - seedistance + std::abs(i);
-				newy = from->y + i;
-				oldx = from->x + seedistance + 1 - std::abs(i);
-				oldy = from->y + i;
+	from->view_npcs.erase(leaving_npcs, from->view_npcs.end());
 
-				newcoords.push_back(std::make_pair(newx, newy));
-				oldcoords.push_back(std::make_pair(oldx, oldy));
-			}
-			break;
+	// Anything coming in to view is appended to the view sets, the new entries are sent below
+	std::size_t first_new_char = from->view_characters.size();
+	std::size_t first_new_npc = from->view_npcs.size();
 
-	}
+	PacketBuilder items_builder(PACKET_WALK, PACKET_REPLY, 2);
+	items_builder.AddByte(255);
+	items_builder.AddByte(255);
 
-	UTIL_FOREACH(this->characters, checkchar)
-	{
-		if (checkchar == from)
-		{
-			continue;
-		}
+	int strip_x1, strip_y1, strip_x2, strip_y2;
+	map_view_strip(target_x, target_y, direction, seedistance, strip_x1, strip_y1, strip_x2, strip_y2);
 
-		for (std::size_t i = 0; i < oldcoords.size(); ++i)
+	this->grid.ForEachCellIn(strip_x1, strip_y1, strip_x2, strip_y2, [&](const Map_Grid::Cell &cell)
+	{
+		UTIL_FOREACH(cell.characters, checkchar)
 		{
-			if (checkchar->x == oldcoords[i].first && checkchar->y == oldcoords[i].second)
+			if (checkchar != from && map_view_entered(checkchar->x, checkchar->y, old_x, old_y, target_x, target_y, seedistance))
 			{
-				oldchars.push_back(checkchar);
+				from->view_characters.push_back(checkchar);
+				checkchar->view_characters.push_back(from);
 			}
-			else if (checkchar->x == newcoords[i].first && checkchar->y == newcoords[i].second)
-			{
-				newchars.push_back(checkchar);
-			}
-		}
-	}
-
-	UTIL_FOREACH(this->npcs, checknpc)
-	{
-		if (!checknpc->alive)
-		{
-			continue;
 		}
 
-		for (std::size_t i = 0; i < oldcoords.size(); ++i)
+		UTIL_FOREACH(cell.npcs, checknpc)
 		{
-			if (checknpc->x == oldcoords[i].first && checknpc->y == oldcoords[i].second)
-			{
-				oldnpcs.push_back(checknpc);
-			}
-			else if (checknpc->x == newcoords[i].first && checknpc->y == newcoords[i].second)
+			if (checknpc->alive && map_view_entered(checknpc->x, checknpc->y, old_x, old_y, target_x, target_y, seedistance))
 			{
-				newnpcs.push_back(checknpc);
+				from->view_npcs.push_back(checknpc);
+				checknpc->viewers.push_back(from);
 			}
 		}
-	}
 
-	UTIL_FOREACH(this->items, checkitem)
-	{
-		for (std::size_t i = 0; i < oldcoords.size(); ++i)
+		UTIL_FOREACH_CREF(cell.items, checkitem)
 		{
-			if (checkitem->x == newcoords[i].first && checkitem->y == newcoords[i].second)
+			if (map_view_entered(checkitem->x, checkitem->y, old_x, old_y, target_x, target_y, seedistance))
 			{
-				newitems.push_back(checkitem);
+				items_builder.AddShort(checkitem->uid);
+				items_builder.AddShort(checkitem->id);
+				items_builder.AddChar(checkitem->x);
+				items_builder.AddChar(checkitem->y);
+				items_builder.AddThree(checkitem->amount);
 			}
 		}
-	}
+	});
 
-	PacketBuilder builder(PACKET_AVATAR, PACKET_REMOVE, 2);
-	builder.AddShort(from->PlayerID());
-
-	UTIL_FOREACH(oldchars, character)
+	if (first_new_char != from->view_characters.size())
 	{
-		PacketBuilder rbuilder(PACKET_AVATAR, PACKET_REMOVE, 2);
-		rbuilder.AddShort(character->PlayerID());
-
-		character->Send(builder);
-		from->Send(rbuilder);
-	}
-
-	builder.Reset(62);
-	builder.SetID(PACKET_PLAYERS, PACKET_AGREE);
-
-	builder.AddByte(255);
-	builder.AddBreakString(from->SourceName());
-	builder.AddShort(from->PlayerID());
-	builder.AddShort(from->mapid);
-	builder.AddShort(from->x);
-	builder.AddShort(from->y);
-	builder.AddChar(from->direction);
-	builder.AddChar(6); // ?
-	builder.AddString(from->PaddedGuildTag());
-	builder.AddChar(from->level);
-	builder.AddChar(from->gender);
-	builder.AddChar(from->hairstyle);
-	builder.AddChar(from->haircolor);
-	builder.AddChar(from->race);
-	builder.AddShort(from->maxhp);
-	builder.AddShort(from->hp);
-	builder.AddShort(from->maxtp);
-	builder.AddShort(from->tp);
-	// equipment
-	from->AddPaperdollData(builder, "B000A0HSW");
-	builder.AddChar(from->sitting);
-	builder.AddChar(from->IsHideInvisible());
-	builder.AddByte(255);
-	builder.AddChar(1); // 0 = NPC, 1 = player
-
-	UTIL_FOREACH(newchars, character)
-	{
-		PacketBuilder rbuilder(PACKET_PLAYERS, PACKET_AGREE, 62);
-		rbuilder.AddByte(255);
-		rbuilder.AddBreakString(character->SourceName());
-		rbuilder.AddShort(character->PlayerID());
-		rbuilder.AddShort(character->mapid);
-		rbuilder.AddShort(character->x);
-		rbuilder.AddShort(character->y);
-		rbuilder.AddChar(character->direction);
-		rbuilder.AddChar(6); // ?
-		rbuilder.AddString(character->PaddedGuildTag());
-		rbuilder.AddChar(character->level);
-		rbuilder.AddChar(character->gender);
-		rbuilder.AddChar(character->hairstyle);
-		rbuilder.AddChar(character->haircolor);
-		rbuilder.AddChar(character->race);
-		rbuilder.AddShort(character->maxhp);
-		rbuilder.AddShort(character->hp);
-		rbuilder.AddShort(character->maxtp);
-		rbuilder.AddShort(character->tp);
+		PacketBuilder builder(PACKET_PLAYERS, PACKET_AGREE, 62);
+		builder.AddByte(255);
+		builder.AddBreakString(from->SourceName());
+		builder.AddShort(from->PlayerID());
+		builder.AddShort(from->mapid);
+		builder.AddShort(from->x);
+		builder.AddShort(from->y);
+		builder.AddChar(from->direction);
+		builder.AddChar(6); // ?
+		builder.AddString(from->PaddedGuildTag());
+		builder.AddChar(from->level);
+		builder.AddChar(from->gender);
+		builder.AddChar(from->hairstyle);
+		builder.AddChar(from->haircolor);
+		builder.AddChar(from->race);
+		builder.AddShort(from->maxhp);
+		builder.AddShort(from->hp);
+		builder.AddShort(from->maxtp);
+		builder.AddShort(from->tp);
 		// equipment
-		character->AddPaperdollData(rbuilder, "B000A0HSW");
-
-		rbuilder.AddChar(character->sitting);
-		rbuilder.AddChar(character->IsHideInvisible());
-		rbuilder.AddByte(255);
-		rbuilder.AddChar(1); // 0 = NPC, 1 = player
-
-		character->Send(builder);
-		from->Send(rbuilder);
-	}
-
-	builder.Reset(5);
-	builder.SetID(PACKET_WALK, PACKET_PLAYER);
-
+		from->AddPaperdollData(builder, "B000A0HSW");
+		builder.AddChar(from->sitting);
+		builder.AddChar(from->IsHideInvisible());
+		builder.AddByte(255);
+		builder.AddChar(1); // 0 = NPC, 1 = player
+
+		SharedPacket agree_packet(builder);
+
+		for (std::size_t i = first_new_char; i < from->view_characters.size(); ++i)
+		{
+			Character *character = from->view_characters[i];
+
+			PacketBuilder rbuilder(PACKET_PLAYERS, PACKET_AGREE, 62);
+			rbuilder.AddByte(255);
+			rbuilder.AddBreakString(character->SourceName());
+			rbuilder.AddShort(character->PlayerID());
+			rbuilder.AddShort(character->mapid);
+			rbuilder.AddShort(character->x);
+			rbuilder.AddShort(character->y);
+			rbuilder.AddChar(character->direction);
+			rbuilder.AddChar(6); // ?
+			rbuilder.AddString(character->PaddedGuildTag());
+			rbuilder.AddChar(character->level);
+			rbuilder.AddChar(character->gender);
+			rbuilder.AddChar(character->hairstyle);
+			rbuilder.AddChar(character->haircolor);
+			rbuilder.AddChar(character->race);
+			rbuilder.AddShort(character->maxhp);
+			rbuilder.AddShort(character->hp);
+			rbuilder.AddShort(character->maxtp);
+			rbuilder.AddShort(character->tp);
+			// equipment
+			character->AddPaperdollData(rbuilder, "B000A0HSW");
+
+			rbuilder.AddChar(character->sitting);
+			rbuilder.AddChar(character->IsHideInvisible());
+			rbuilder.AddByte(255);
+			rbuilder.AddChar(1); // 0 = NPC, 1 = player
+
+			from->Send(rbuilder);
+			character->Send(agree_packet);
+		}
+	}
+
+	PacketBuilder builder(PACKET_WALK, PACKET_PLAYER, 5);
 	builder.AddShort(from->PlayerID());
 	builder.AddChar(direction);
 	builder.AddChar(from->x);
 	builder.AddChar(from->y);
 
-	UTIL_FOREACH(this->characters, character)
-	{
-		if (character == from || !from->InRange(character))
-		{
-			continue;
-		}
-
-		character->Send(builder);
-	}
+	SharedPacket walk_packet(builder);
 
-	builder.Reset(2 + newitems.size() * 9);
-	builder.SetID(PACKET_WALK, PACKET_REPLY);
-
-	builder.AddByte(255);
-	builder.AddByte(255);
-	UTIL_FOREACH(newitems, item)
+	UTIL_FOREACH(from->view_characters, character)
 	{
-		builder.AddShort(item->uid);
-		builder.AddShort(item->id);
-		builder.AddChar(item->x);
-		builder.AddChar(item->y);
-		builder.AddThree(item->amount);
+		character->Send(walk_packet);
 	}
-	from->Send(builder);
+
+	from->Send(items_builder);
 
 	builder.SetID(PACKET_APPEAR, PACKET_REPLY);
-	UTIL_FOREACH(newnpcs, npc)
+
+	for (std::size_t i = first_new_npc; i < from->view_npcs.size(); ++i)
 	{
+		NPC *npc = from->view_npcs[i];
+
 		builder.Reset(8);
 		builder.AddChar(0);
 		builder.AddByte(255);
@@ -1228,16 +1617,11 @@ Map::WalkResult Map::Walk(Character *from, Direction direction, bool admin)
 		from->Send(builder);
 	}
 
-	UTIL_FOREACH(oldnpcs, npc)
-	{
-		npc->RemoveFromView(from);
-	}
-
 	from->CheckQuestRules();
 
 	Map_Tile::TileSpec spec = this->GetSpec(from->x, from->y);
 
-	double spike_damage = this->world->config["SpikeDamage"];
+	double spike_damage = this->world->settings->SpikeDamage;
 
 	if (spike_damage > 0.0 && (spec == Map_Tile::Spikes2 || spec == Map_Tile::Spikes3) && !from->IsHideInvisible())
 	{
@@ -1257,7 +1641,7 @@ Map::WalkResult Map::Walk(Character *from, Direction direction, bool admin)
 
 Map::WalkResult Map::Walk(NPC *from, Direction direction)
 {
-	int seedistance = this->world->config["SeeDistance"];
+	int seedistance = this->world->settings->SeeDistance;
 
 	unsigned char target_x = from->x;
 	unsigned char target_y = from->y;
@@ -1312,92 +1696,44 @@ Map::WalkResult Map::Walk(NPC *from, Direction direction)
 		return WalkFail;
 	}
 
+	int old_x = from->x;
+	int old_y = from->y;
+
 	from->x = target_x;
 	from->y = target_y;
+	from->direction = direction;
 
-	int newx;
-	int newy;
-	int oldx;
-	int oldy;
-
-	std::vector<std::pair<int, int>> newcoords;
-	std::vector<std::pair<int, int>> oldcoords;
-
-	std::vector<Character *> newchars;
-	std::vector<Character *> oldchars;
+	this->grid.Move(from, old_x, old_y, target_x, target_y);
 
-	switch (direction)
+	auto leaving = std::partition(UTIL_RANGE(from->viewers), [&](Character *character)
 	{
-		case DIRECTION_UP:
-			for (int i = -seedistance; i <= seedistance; ++i)
-			{
-				newy = from->y - seedistance + std::abs(i);
-				newx = from->x + i;
-				oldy = from->y + seedistance + 1 - std::abs(i);
-				oldx = from->x + i;
+		return util::path_length(character->x, character->y, target_x, target_y) <= seedistance;
+	});
 
-				newcoords.push_back(std::make_pair(newx, newy));
-				oldcoords.push_back(std::make_pair(oldx, oldy));
-			}
-			break;
-
-		case DIRECTION_RIGHT:
-			for (int i = -seedistance; i <= seedistance; ++i)
-			{
-				newx = from->x + seedistance - std::abs(i);
-				newy = from->y + i;
-				oldx = from->x - seedistance - 1 + std::abs(i);
-				oldy = from->y + i;
-
-				newcoords.push_back(std::make_pair(newx, newy));
-				oldcoords.push_back(std::make_pair(oldx, oldy));
-			}
-			break;
-
-		case DIRECTION_DOWN:
-			for (int i = -seedistance; i <= seedistance; ++i)
-			{
-				newy = from->y + seedistance - std::abs(i);
-				newx = from->x + i;
-				oldy = from->y - seedistance - 1 + std::abs(i);
-				oldx = from->x + i;
-
-				newcoords.push_back(std::make_pair(newx, newy));
-				oldcoords.push_back(std::make_pair(oldx, oldy));
-			}
-			break;
-
-		case DIRECTION_LEFT:
-			for (int i = -seedistance; i <= seedistance; ++i)
-			{
-				newx = from->x - seedistance + std::abs(i);
-				newy = from->y + i;
-				oldx = from->x + seedistance + 1 - std::abs(i);
-				oldy = from->y + i;
+	for (auto it = leaving; it != from->viewers.end(); ++it)
+	{
+		map_swap_erase((*it)->view_npcs, from);
+		from->RemoveFromView(*it);
+	}
 
-				newcoords.push_back(std::make_pair(newx, newy));
-				oldcoords.push_back(std::make_pair(oldx, oldy));
-			}
-			break;
+	from->viewers.erase(leaving, from->viewers.end());
 
-	}
+	std::size_t first_new = from->viewers.size();
 
-	from->direction = direction;
+	int strip_x1, strip_y1, strip_x2, strip_y2;
+	map_view_strip(target_x, target_y, direction, seedistance, strip_x1, strip_y1, strip_x2, strip_y2);
 
-	UTIL_FOREACH(this->characters, checkchar)
+	this->grid.ForEachCellIn(strip_x1, strip_y1, strip_x2, strip_y2, [&](const Map_Grid::Cell &cell)
 	{
-		for (std::size_t i = 0; i < oldcoords.size(); ++i)
+		UTIL_FOREACH(cell.characters, checkchar)
 		{
-			if (checkchar->x == oldcoords[i].first && checkchar->y == oldcoords[i].second)
-			{
-				oldchars.push_back(checkchar);
-			}
-			else if (checkchar->x == newcoords[i].first && checkchar->y == newcoords[i].second)
+			if (map_view_entered(checkchar->x, checkchar->y, old_x, old_y, target_x, target_y, seedistance))
 			{
-				newchars.push_back(checkchar);
+				from->viewers.push_back(checkchar);
+				checkchar->view_npcs.push_back(from);
 			}
 		}
-	}
+	});
 
 	PacketBuilder builder(PACKET_APPEAR, PACKET_REPLY, 8);
 	builder.AddChar(0);
@@ -1408,9 +1744,9 @@ Map::WalkResult Map::Walk(NPC *from, Direction direction)
 	builder.AddChar(from->y);
 	builder.AddChar(from->direction);
 
-	UTIL_FOREACH(newchars, character)
+	for (std::size_t i = first_new; i < from->viewers.size(); ++i)
 	{
-		character->Send(builder);
+		from->viewers[i]->Send(builder);
 	}
 
 	builder.Reset(7);
@@ -1424,19 +1760,11 @@ Map::WalkResult Map::Walk(NPC *from, Direction direction)
 	builder.AddByte(255);
 	builder.AddByte(255);
 
-	UTIL_FOREACH(this->characters, character)
-	{
-		if (!character->InRange(from))
-		{
-			continue;
-		}
-
-		character->Send(builder);
-	}
+	SharedPacket walk_packet(builder);
 
-	UTIL_FOREACH(oldchars, character)
+	UTIL_FOREACH(from->viewers, character)
 	{
-		from->RemoveFromView(character);
+		character->Send(walk_packet);
 	}
 
 	return WalkOK;
@@ -1470,7 +1798,7 @@ void Map::Attack(Character *from, Direction direction)
 	int wep_graphic = wepdata.dollgraphic;
 	bool is_instrument = (wep_graphic != 0 && this->world->IsInstrument(wep_graphic));
 
-	if (!is_instrument && (this->pk || (this->world->config["GlobalPK"] && !this->world->PKExcept(this->id))))
+	if (!is_instrument && (this->pk || (this->world->settings->GlobalPK && !this->world->PKExcept(this->id))))
 	{
 		if (this->AttackPK(from, direction))
 		{
@@ -1482,15 +1810,15 @@ void Map::Attack(Character *from, Direction direction)
 	builder.AddShort(from->PlayerID());
 	builder.AddChar(direction);
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(from->x, from->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (character == from || !from->InRange(character))
 		{
-			continue;
+			return;
 		}
 
 		character->Send(builder);
-	}
+	});
 
 	if (is_instrument)
 		return;
@@ -1505,7 +1833,7 @@ void Map::Attack(Character *from, Direction direction)
 
 	if (wepdata.subtype == EIF::Ranged)
 	{
-		range = static_cast<int>(this->world->config["RangedDistance"]);
+		range = this->world->settings->RangedDistance;
 	}
 
 	for (int i = 0; i < range; ++i)
@@ -1529,7 +1857,7 @@ void Map::Attack(Character *from, Direction direction)
 				break;
 		}
 
-		UTIL_FOREACH(this->npcs, npc)
+		UTIL_FOREACH(this->grid.At(target_x, target_y).npcs, npc)
 		{
 			if ((npc->ENF().type == ENF::Passive || npc->ENF().type == ENF::Aggressive || from->SourceDutyAccess() >= static_cast<int>(this->world->admin_config["killnpc"]))
 			 && npc->alive && npc->x == target_x && npc->y == target_y)
@@ -1537,21 +1865,21 @@ void Map::Attack(Character *from, Direction direction)
 				int amount = util::rand(from->mindam, from->maxdam);
 				double rand = util::rand(0.0, 1.0);
 				// Checks if target is facing you
-				bool critical = std::abs(int(npc->direction) - from->direction) != 2 || rand < static_cast<double>(this->world->config["CriticalRate"]);
+				bool critical = std::abs(int(npc->direction) - from->direction) != 2 || rand < this->world->settings->CriticalRate;
 
-				if (this->world->config["CriticalFirstHit"] && npc->hp == npc->ENF().hp)
+				if (this->world->settings->CriticalFirstHit && npc->hp == npc->ENF().hp)
 					critical = true;
 
-				std::unordered_map<std::string, double> formula_vars;
+				FormulaValues formula_vars;
 
 				from->FormulaVars(formula_vars);
-				npc->FormulaVars(formula_vars, "target_");
-				formula_vars["modifier"] = this->world->config["MobRate"];
-				formula_vars["damage"] = amount;
-				formula_vars["critical"] = critical;
+				npc->FormulaVars(formula_vars, FormulaValues::Target);
+				formula_vars[FormulaValues::Modifier] = this->world->settings->MobRate;
+				formula_vars[FormulaValues::Damage] = amount;
+				formula_vars[FormulaValues::Critical] = critical;
 
-				amount = static_cast<int>(rpn_eval(rpn_parse(this->world->formulas_config["damage"]), formula_vars));
-				double hit_rate = rpn_eval(rpn_parse(this->world->formulas_config["hit_rate"]), formula_vars);
+				amount = static_cast<int>(this->world->formulas->damage.eval(formula_vars.data()));
+				double hit_rate = this->world->formulas->hit_rate.eval(formula_vars.data());
 
 				if (rand > hit_rate)
 				{
@@ -1562,7 +1890,7 @@ void Map::Attack(Character *from, Direction direction)
 
 				int limitamount = std::min(amount, int(npc->hp));
 
-				if (this->world->config["LimitDamage"])
+				if (this->world->settings->LimitDamage)
 				{
 					amount = limitamount;
 				}
@@ -1595,7 +1923,7 @@ bool Map::AttackPK(Character *from, Direction direction)
 
 	if (this->world->eif->Get(from->paperdoll[Character::Weapon]).subtype == EIF::Ranged)
 	{
-		range = static_cast<int>(this->world->config["RangedDistance"]);
+		range = this->world->settings->RangedDistance;
 	}
 
 	for (int i = 0; i < range; ++i)
@@ -1619,25 +1947,25 @@ bool Map::AttackPK(Character *from, Direction direction)
 				break;
 		}
 
-		UTIL_FOREACH(this->characters, character)
+		UTIL_FOREACH(this->grid.At(target_x, target_y).characters, character)
 		{
 			if (character->mapid == this->id && !character->nowhere && character->x == target_x && character->y == target_y)
 			{
 				int amount = util::rand(from->mindam, from->maxdam);
 				double rand = util::rand(0.0, 1.0);
 				// Checks if target is facing you
-				bool critical = std::abs(int(character->direction) - from->direction) != 2 || rand < static_cast<double>(this->world->config["CriticalRate"]);
+				bool critical = std::abs(int(character->direction) - from->direction) != 2 || rand < this->world->settings->CriticalRate;
 
-				std::unordered_map<std::string, double> formula_vars;
+				FormulaValues formula_vars;
 
 				from->FormulaVars(formula_vars);
-				character->FormulaVars(formula_vars, "target_");
-				formula_vars["modifier"] = this->world->config["PKRate"];
-				formula_vars["damage"] = amount;
-				formula_vars["critical"] = critical;
+				character->FormulaVars(formula_vars, FormulaValues::Target);
+				formula_vars[FormulaValues::Modifier] = this->world->settings->PKRate;
+				formula_vars[FormulaValues::Damage] = amount;
+				formula_vars[FormulaValues::Critical] = critical;
 
-				amount = static_cast<int>(rpn_eval(rpn_parse(this->world->formulas_config["damage"]), formula_vars));
-				double hit_rate = rpn_eval(rpn_parse(this->world->formulas_config["hit_rate"]), formula_vars);
+				amount = static_cast<int>(this->world->formulas->damage.eval(formula_vars.data()));
+				double hit_rate = this->world->formulas->hit_rate.eval(formula_vars.data());
 
 				if (rand > hit_rate)
 				{
@@ -1648,7 +1976,7 @@ bool Map::AttackPK(Character *from, Direction direction)
 
 				int limitamount = std::min(amount, int(character->hp));
 
-				if (this->world->config["LimitDamage"])
+				if (this->world->settings->LimitDamage)
 				{
 					amount = limitamount;
 				}
@@ -1673,13 +2001,13 @@ bool Map::AttackPK(Character *from, Direction direction)
 
 				from->Send(from_builder);
 
-				UTIL_FOREACH(this->characters, checkchar)
+				this->grid.ForEachCharacter(character->x, character->y, this->world->settings->SeeDistance, [&](Character *checkchar)
 				{
 					if (from != checkchar && character->InRange(checkchar))
 					{
 						checkchar->Send(builder);
 					}
-				}
+				});
 
 				if (character->hp == 0)
 				{
@@ -1724,15 +2052,15 @@ void Map::Face(Character *from, Direction direction)
 	builder.AddShort(from->PlayerID());
 	builder.AddChar(direction);
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(from->x, from->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (character == from || !from->InRange(character))
 		{
-			continue;
+			return;
 		}
 
 		character->Send(builder);
-	}
+	});
 }
 
 void Map::Sit(Character *from, SitState sit_type)
@@ -1748,15 +2076,15 @@ void Map::Sit(Character *from, SitState sit_type)
 	builder.AddChar(from->direction);
 	builder.AddChar(0); // ?
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(from->x, from->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (character == from || !from->InRange(character))
 		{
-			continue;
+			return;
 		}
 
 		character->Send(builder);
-	}
+	});
 }
 
 void Map::Stand(Character *from)
@@ -1770,15 +2098,15 @@ void Map::Stand(Character *from)
 	builder.AddChar(from->x);
 	builder.AddChar(from->y);
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(from->x, from->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (character == from || !from->InRange(character))
 		{
-			continue;
+			return;
 		}
 
 		character->Send(builder);
-	}
+	});
 }
 
 void Map::Emote(Character *from, enum Emote emote, bool echo)
@@ -1787,15 +2115,15 @@ void Map::Emote(Character *from, enum Emote emote, bool echo)
 	builder.AddShort(from->PlayerID());
 	builder.AddChar(emote);
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(from->x, from->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (!echo && (character == from || !from->InRange(character)))
 		{
-			continue;
+			return;
 		}
 
 		character->Send(builder);
-	}
+	});
 }
 
 bool Map::Occupied(unsigned char x, unsigned char y, Map::OccupiedTarget target, bool adminghost) const
@@ -1805,9 +2133,11 @@ bool Map::Occupied(unsigned char x, unsigned char y, Map::OccupiedTarget target,
 		return false;
 	}
 
+	const Map_Grid::Cell &cell = this->grid.At(x, y);
+
 	if (target != Map::NPCOnly)
 	{
-		UTIL_FOREACH(this->characters, character)
+		UTIL_FOREACH(cell.characters, character)
 		{
 			bool ghost = adminghost && (!character->CanInteractCombat() || character->IsHideNpc());
 
@@ -1820,7 +2150,7 @@ bool Map::Occupied(unsigned char x, unsigned char y, Map::OccupiedTarget target,
 
 	if (target != Map::PlayerOnly)
 	{
-		UTIL_FOREACH(this->npcs, npc)
+		UTIL_FOREACH(cell.npcs, npc)
 		{
 			if (npc->alive && npc->x == x && npc->y == y)
 			{
@@ -1864,15 +2194,16 @@ bool Map::OpenDoor(Character *from, unsigned char x, unsigned char y)
 		builder.AddChar(x);
 		builder.AddShort(y);
 
-		UTIL_FOREACH(this->characters, character)
+		this->grid.ForEachCharacter(x, y, this->world->settings->SeeDistance, [&](Character *character)
 		{
 			if (character->InRange(x, y))
 			{
 				character->Send(builder);
 			}
-		}
+		});
 
 		warp.open = true;
+		this->pathfinder.Invalidate();
 
 		map_close_door_struct *close = new map_close_door_struct;
 		close->map = this;
@@ -1901,6 +2232,7 @@ void Map::CloseDoor(unsigned char x, unsigned char y)
 		}
 
 		warp.open = false;
+		this->pathfinder.Invalidate();
 	}
 }
 
@@ -1915,7 +2247,7 @@ void Map::SpellSelf(Character *from, unsigned short spell_id)
 
 	int hpgain = spell.hp;
 
-	if (this->world->config["LimitDamage"])
+	if (this->world->settings->LimitDamage)
 		hpgain = std::min(hpgain, from->maxhp - from->hp);
 
 	hpgain = std::max(hpgain, 0);
@@ -1930,11 +2262,11 @@ void Map::SpellSelf(Character *from, unsigned short spell_id)
 	builder.AddInt(spell.hp);
 	builder.AddChar(static_cast<unsigned char>(util::clamp<int>(static_cast<int>(double(from->hp) / double(from->maxhp) * 100.0), 0, 100)));
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(from->x, from->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (character != from && from->InRange(character))
 			character->Send(builder);
-	}
+	});
 
 	builder.AddShort(from->hp);
 	builder.AddShort(from->tp);
@@ -1960,18 +2292,18 @@ void Map::SpellAttack(Character *from, NPC *npc, unsigned short spell_id)
 		int amount = util::rand(from->mindam + spell.mindam, from->maxdam + spell.maxdam);
 		double rand = util::rand(0.0, 1.0);
 
-		bool critical = rand < static_cast<double>(this->world->config["CriticalRate"]);
+		bool critical = rand < this->world->settings->CriticalRate;
 
-		std::unordered_map<std::string, double> formula_vars;
+		FormulaValues formula_vars;
 
 		from->FormulaVars(formula_vars);
-		npc->FormulaVars(formula_vars, "target_");
-		formula_vars["modifier"] = this->world->config["MobRate"];
-		formula_vars["damage"] = amount;
-		formula_vars["critical"] = critical;
+		npc->FormulaVars(formula_vars, FormulaValues::Target);
+		formula_vars[FormulaValues::Modifier] = this->world->settings->MobRate;
+		formula_vars[FormulaValues::Damage] = amount;
+		formula_vars[FormulaValues::Critical] = critical;
 
-		amount = static_cast<int>(rpn_eval(rpn_parse(this->world->formulas_config["damage"]), formula_vars));
-		double hit_rate = rpn_eval(rpn_parse(this->world->formulas_config["hit_rate"]), formula_vars);
+		amount = static_cast<int>(this->world->formulas->damage.eval(formula_vars.data()));
+		double hit_rate = this->world->formulas->hit_rate.eval(formula_vars.data());
 
 		if (rand > hit_rate)
 		{
@@ -1982,7 +2314,7 @@ void Map::SpellAttack(Character *from, NPC *npc, unsigned short spell_id)
 
 		int limitamount = std::min(amount, int(npc->hp));
 
-		if (this->world->config["LimitDamage"])
+		if (this->world->settings->LimitDamage)
 		{
 			amount = limitamount;
 		}
@@ -1999,7 +2331,7 @@ void Map::SpellAttackPK(Character *from, Character *victim, unsigned short spell
 	if (!spell || (spell.type != ESF::Heal && spell.type != ESF::Damage) || from->tp < spell.tp)
 		return;
 
-	if (spell.type == ESF::Damage && (from->map->pk || (this->world->config["GlobalPK"] && !this->world->PKExcept(this->id))))
+	if (spell.type == ESF::Damage && (from->map->pk || (this->world->settings->GlobalPK && !this->world->PKExcept(this->id))))
 	{
 		if (!from->CanInteractPKCombat())
 			return;
@@ -2009,18 +2341,18 @@ void Map::SpellAttackPK(Character *from, Character *victim, unsigned short spell
 		int amount = util::rand(from->mindam + spell.mindam, from->maxdam + spell.maxdam);
 		double rand = util::rand(0.0, 1.0);
 
-		bool critical = rand < static_cast<double>(this->world->config["CriticalRate"]);
+		bool critical = rand < this->world->settings->CriticalRate;
 
-		std::unordered_map<std::string, double> formula_vars;
+		FormulaValues formula_vars;
 
 		from->FormulaVars(formula_vars);
-		victim->FormulaVars(formula_vars, "target_");
-		formula_vars["modifier"] = this->world->config["PKRate"];
-		formula_vars["damage"] = amount;
-		formula_vars["critical"] = critical;
+		victim->FormulaVars(formula_vars, FormulaValues::Target);
+		formula_vars[FormulaValues::Modifier] = this->world->settings->PKRate;
+		formula_vars[FormulaValues::Damage] = amount;
+		formula_vars[FormulaValues::Critical] = critical;
 
-		amount = static_cast<int>(rpn_eval(rpn_parse(this->world->formulas_config["damage"]), formula_vars));
-		double hit_rate = rpn_eval(rpn_parse(this->world->formulas_config["hit_rate"]), formula_vars);
+		amount = static_cast<int>(this->world->formulas->damage.eval(formula_vars.data()));
+		double hit_rate = this->world->formulas->hit_rate.eval(formula_vars.data());
 
 		if (rand > hit_rate)
 		{
@@ -2031,7 +2363,7 @@ void Map::SpellAttackPK(Character *from, Character *victim, unsigned short spell
 
 		int limitamount = std::min(amount, int(victim->hp));
 
-		if (this->world->config["LimitDamage"])
+		if (this->world->settings->LimitDamage)
 		{
 			amount = limitamount;
 		}
@@ -2047,11 +2379,11 @@ void Map::SpellAttackPK(Character *from, Character *victim, unsigned short spell
 		builder.AddChar(victim->hp == 0);
 		builder.AddShort(spell_id);
 
-		UTIL_FOREACH(this->characters, character)
+		this->grid.ForEachCharacter(victim->x, victim->y, this->world->settings->SeeDistance, [&](Character *character)
 		{
 			if (victim->InRange(character))
 				character->Send(builder);
-		}
+		});
 
 		if (victim->hp == 0)
 		{
@@ -2085,19 +2417,19 @@ void Map::SpellAttackPK(Character *from, Character *victim, unsigned short spell
 		int displayhp = spell.hp;
 		int hpgain = spell.hp;
 
-		if (this->world->config["LimitDamage"])
+		if (this->world->settings->LimitDamage)
 			hpgain = std::min(hpgain, victim->maxhp - victim->hp);
 
 		hpgain = std::max(hpgain, 0);
 
-		if (!from->CanInteractCombat() && from != victim && !(from->CanInteractPKCombat() && (from->map->pk || (this->world->config["GlobalPK"] && !this->world->PKExcept(this->id)))))
+		if (!from->CanInteractCombat() && from != victim && !(from->CanInteractPKCombat() && (from->map->pk || (this->world->settings->GlobalPK && !this->world->PKExcept(this->id)))))
 		{
 			displayhp = hpgain = std::min(hpgain, 1);
 		}
 
 		victim->hp += hpgain;
 
-		if (!this->world->config["LimitDamage"])
+		if (!this->world->settings->LimitDamage)
 			victim->hp = std::min(victim->hp, victim->maxhp);
 
 		PacketBuilder builder(PACKET_SPELL, PACKET_TARGET_OTHER, 18);
@@ -2108,11 +2440,11 @@ void Map::SpellAttackPK(Character *from, Character *victim, unsigned short spell
 		builder.AddInt(displayhp);
 		builder.AddChar(static_cast<unsigned char>(util::clamp<int>(static_cast<int>(double(victim->hp) / double(victim->maxhp) * 100.0), 0, 100)));
 
-		UTIL_FOREACH(this->characters, character)
+		this->grid.ForEachCharacter(victim->x, victim->y, this->world->settings->SeeDistance, [&](Character *character)
 		{
 			if (character != victim && victim->InRange(character))
 				character->Send(builder);
-		}
+		});
 
 		builder.AddShort(victim->hp);
 
@@ -2141,7 +2473,7 @@ void Map::SpellGroup(Character *from, unsigned short spell_id)
 
 	int displayhp = spell.hp;
 
-	if (!from->CanInteractCombat() && !(from->CanInteractPKCombat() && (from->map->pk || (this->world->config["GlobalPK"] && !this->world->PKExcept(this->id)))))
+	if (!from->CanInteractCombat() && !(from->CanInteractPKCombat() && (from->map->pk || (this->world->settings->GlobalPK && !this->world->PKExcept(this->id)))))
 	{
 		displayhp = std::min(displayhp, 1);
 	}
@@ -2161,17 +2493,17 @@ void Map::SpellGroup(Character *from, unsigned short spell_id)
 
 		int hpgain = spell.hp;
 
-		if (this->world->config["LimitDamage"])
+		if (this->world->settings->LimitDamage)
 			hpgain = std::min(hpgain, member->maxhp - member->hp);
 
 		hpgain = std::max(hpgain, 0);
 
-		if (!from->CanInteractCombat() && !(from->CanInteractPKCombat() && (from->map->pk || (this->world->config["GlobalPK"] && !this->world->PKExcept(this->id)))))
+		if (!from->CanInteractCombat() && !(from->CanInteractPKCombat() && (from->map->pk || (this->world->settings->GlobalPK && !this->world->PKExcept(this->id)))))
 			hpgain = std::min(hpgain, 1);
 
 		member->hp += hpgain;
 
-		if (!this->world->config["LimitDamage"])
+		if (!this->world->settings->LimitDamage)
 			member->hp = std::min(member->hp, member->maxhp);
 
 		// wat?
@@ -2185,11 +2517,11 @@ void Map::SpellGroup(Character *from, unsigned short spell_id)
 		builder.AddChar(static_cast<unsigned char>(util::clamp<int>(static_cast<int>(double(member->hp) / double(member->maxhp) * 100.0), 0, 100)));
 		builder.AddShort(member->hp);
 
-		UTIL_FOREACH(this->characters, character)
+		this->grid.ForEachCharacter(member->x, member->y, this->world->settings->SeeDistance, [&](Character *character)
 		{
 			if (member->InRange(character))
 				in_range.insert(character);
-		}
+		});
 	}
 
 	UTIL_FOREACH(in_range, character)
@@ -2216,7 +2548,7 @@ std::shared_ptr<Map_Item> Map::AddItem(short id, int amount, unsigned char x, un
 			}
 		}
 
-		if (ontile >= static_cast<int>(this->world->config["MaxTile"]) || onmap >= static_cast<int>(this->world->config["MaxMap"]))
+		if (ontile >= this->world->settings->MaxTile || onmap >= this->world->settings->MaxMap)
 		{
 			return newitem;
 		}
@@ -2231,17 +2563,18 @@ std::shared_ptr<Map_Item> Map::AddItem(short id, int amount, unsigned char x, un
 	builder.AddChar(x);
 	builder.AddChar(y);
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(newitem->x, newitem->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if ((from && character == from) || !character->InRange(*newitem))
 		{
-			continue;
+			return;
 		}
 
 		character->Send(builder);
-	}
+	});
 
 	this->items.push_back(newitem);
+	this->grid.Add(newitem);
 	return newitem;
 }
 
@@ -2288,16 +2621,17 @@ std::list<std::shared_ptr<Map_Item>>::iterator Map::DelItem(std::list<std::share
 	PacketBuilder builder(PACKET_ITEM, PACKET_REMOVE, 2);
 	builder.AddShort((*it)->uid);
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter((*it)->x, (*it)->y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if ((from && character == from) || !character->InRange(**it))
 		{
-			continue;
+			return;
 		}
 
 		character->Send(builder);
-	}
+	});
 
+	this->grid.Remove(it->get());
 	return this->items.erase(it);
 }
 
@@ -2317,15 +2651,15 @@ void Map::DelSomeItem(short uid, int amount, Character *from)
 				PacketBuilder builder(PACKET_ITEM, PACKET_REMOVE, 2);
 				builder.AddShort((*it)->uid);
 
-				UTIL_FOREACH(this->characters, character)
+				this->grid.ForEachCharacter((*it)->x, (*it)->y, this->world->settings->SeeDistance, [&](Character *character)
 				{
 					if ((from && character == from) || !character->InRange(**it))
 					{
-						continue;
+						return;
 					}
 
 					character->Send(builder);
-				}
+				});
 
 				builder.Reset(9);
 				builder.SetID(PACKET_ITEM, PACKET_ADD);
@@ -2335,13 +2669,13 @@ void Map::DelSomeItem(short uid, int amount, Character *from)
 				builder.AddChar((*it)->x);
 				builder.AddChar((*it)->y);
 
-				UTIL_FOREACH(this->characters, character)
+				this->grid.ForEachCharacter((*it)->x, (*it)->y, this->world->settings->SeeDistance, [&](Character *character)
 				{
 					if (!character->InRange(**it))
-						continue;
+						return;
 
 					character->Send(builder);
-				}
+				});
 			}
 			else
 			{
@@ -2363,7 +2697,7 @@ bool Map::Walkable(unsigned char x, unsigned char y, bool npc) const
 	if (!InBounds(x, y) || !this->GetTile(x, y).Walkable(npc))
 		return false;
 
-	if (this->world->config["GhostArena"] && this->GetTile(x, y).tilespec == Map_Tile::Arena && this->Occupied(x, y, PlayerAndNPC))
+	if (this->world->settings->GhostArena && this->GetTile(x, y).tilespec == Map_Tile::Arena && this->Occupied(x, y, PlayerAndNPC))
 		return false;
 
 	return true;
@@ -2407,11 +2741,11 @@ std::vector<Character *> Map::CharactersInRange(unsigned char x, unsigned char y
 {
 	std::vector<Character *> characters;
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(x, y, range, [&](Character *character)
 	{
 		if (util::path_length(character->x, character->y, x, y) <= range)
 			characters.push_back(character);
-	}
+	});
 
 	return characters;
 }
@@ -2420,11 +2754,11 @@ std::vector<NPC *> Map::NPCsInRange(unsigned char x, unsigned char y, unsigned c
 {
 	std::vector<NPC *> npcs;
 
-	UTIL_FOREACH(this->npcs, npc)
+	this->grid.ForEachNPC(x, y, range, [&](NPC *npc)
 	{
 		if (util::path_length(npc->x, npc->y, x, y) <= range)
 			npcs.push_back(npc);
-	}
+	});
 
 	return npcs;
 }
@@ -2448,11 +2782,11 @@ void Map::TileEffect(unsigned char x, unsigned char y, unsigned short effect)
 	builder.AddChar(y);
 	builder.AddShort(effect);
 
-	UTIL_FOREACH(this->characters, character)
+	this->grid.ForEachCharacter(x, y, this->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (character->InRange(x, y))
 			character->Send(builder);
-	}
+	});
 }
 
 bool Map::Evacuate()
@@ -2480,28 +2814,22 @@ bool Map::Evacuate()
 bool Map::Reload()
 {
 	char namebuf[7];
-	char checkrid[4];
 
 	std::string filename = this->world->config["MapDir"];
 	std::sprintf(namebuf, "%05i", this->id);
 	filename.append(namebuf);
 	filename.append(".emf");
 
-	std::FILE *fh = std::fopen(filename.c_str(), "rb");
+	// Swap in the new image first so players re-downloading the map get the new version
+	FileCache::ImagePtr image = this->world->file_cache.Reload(filename);
 
-	if (!fh)
+	if (!image)
 	{
 		Console::Err("Could not load file: %s", filename.c_str());
 		return false;
 	}
 
-	SAFE_SEEK(fh, 0x03, SEEK_SET);
-	SAFE_READ(checkrid, sizeof(char), 4, fh);
-
-	std::fclose(fh);
-
-	if (this->rid[0] == checkrid[0] && this->rid[1] == checkrid[1]
-	 && this->rid[2] == checkrid[2] && this->rid[3] == checkrid[3])
+	if (std::equal(UTIL_RANGE(image->rid), reinterpret_cast<const unsigned char *>(this->rid)))
 	{
 		return true;
 	}
@@ -2539,7 +2867,7 @@ void Map::TimedSpikes()
 	PacketBuilder builder(PACKET_EFFECT, PACKET_REPORT, 1);
 	builder.AddByte(83); // S
 
-	double spike_damage = this->world->config["SpikeDamage"];
+	double spike_damage = this->world->settings->SpikeDamage;
 
 	std::vector<Character*> killed;
 
@@ -2575,7 +2903,7 @@ void Map::TimedDrains()
 {
 	if (this->effect == EffectHPDrain)
 	{
-		double hpdrain_damage = this->world->config["DrainHPDamage"];
+		double hpdrain_damage = this->world->settings->DrainHPDamage;
 
 		std::vector<int> damage_map;
 		damage_map.resize(this->characters.size());
@@ -2634,7 +2962,7 @@ void Map::TimedDrains()
 
 	if (this->effect == EffectTPDrain)
 	{
-		double tpdrain_damage = this->world->config["DrainTPDamage"];
+		double tpdrain_damage = this->world->settings->DrainTPDamage;
 
 		for (Character* character : this->characters)
 		{
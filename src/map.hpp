@@ -14,9 +14,13 @@
 #include "fwd/npc.hpp"
 #include "fwd/wedding.hpp"
 #include "fwd/world.hpp"
+#include "pathfinder.hpp"
 
+#include <algorithm>
+#include <array>
 #include <list>
 #include <memory>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -203,6 +207,156 @@ struct Map_Chest
 	void Update(Map *map, Character *exclude = 0) const;
 };
 
+/**
+ * Buckets the characters, NPCs and items on a map in to square cells, so range and occupancy checks only look at nearby cells
+ * Entries are filed under the position they were added or last moved to, so every change of position has to be passed on
+ */
+class Map_Grid
+{
+	public:
+		struct Cell
+		{
+			std::vector<Character *> characters;
+			std::vector<NPC *> npcs;
+			std::vector<std::shared_ptr<Map_Item>> items;
+		};
+
+	private:
+		int cell_size;
+		int columns;
+		int rows;
+		std::vector<Cell> cells;
+
+		// Positions outside of the map are filed in the nearest edge cell
+		int Column(int x) const { return std::min(std::max(x, 0) / this->cell_size, this->columns - 1); }
+		int Row(int y) const { return std::min(std::max(y, 0) / this->cell_size, this->rows - 1); }
+
+	public:
+		Map_Grid();
+
+		/**
+		 * Resizes the grid to cover a map and empties it
+		 */
+		void Reset(int width, int height, int cell_size);
+
+		/**
+		 * Empties every cell
+		 */
+		void Clear();
+
+		Cell &At(int x, int y) { return this->cells[this->Row(y) * this->columns + this->Column(x)]; }
+		const Cell &At(int x, int y) const { return this->cells[this->Row(y) * this->columns + this->Column(x)]; }
+
+		void Add(Character *character, int x, int y);
+		void Remove(Character *character, int x, int y);
+		void Move(Character *character, int from_x, int from_y, int to_x, int to_y);
+
+		void Add(NPC *npc, int x, int y);
+		void Remove(NPC *npc, int x, int y);
+		void Move(NPC *npc, int from_x, int from_y, int to_x, int to_y);
+
+		void Add(const std::shared_ptr<Map_Item> &item);
+		void Remove(const Map_Item *item);
+
+		/**
+		 * Calls f with every cell that could hold something within range of x,y
+		 * The cells must not be modified until the call returns
+		 */
+		template <class F> void ForEachCell(int x, int y, int range, F f) const
+		{
+			this->ForEachCellIn(x - range, y - range, x + range, y + range, f);
+		}
+
+		/**
+		 * Calls f with every cell overlapping the tiles from x1,y1 to x2,y2 inclusive
+		 */
+		template <class F> void ForEachCellIn(int x1, int y1, int x2, int y2, F f) const
+		{
+			int first_column = this->Column(x1);
+			int last_column = this->Column(x2);
+			int first_row = this->Row(y1);
+			int last_row = this->Row(y2);
+
+			for (int row = first_row; row <= last_row; ++row)
+			{
+				for (int column = first_column; column <= last_column; ++column)
+				{
+					f(this->cells[row * this->columns + column]);
+				}
+			}
+		}
+
+		/**
+		 * Calls f with every character in a cell near x,y, callers still need to check the exact distance
+		 */
+		template <class F> void ForEachCharacter(int x, int y, int range, F f) const
+		{
+			this->ForEachCell(x, y, range, [&f](const Cell &cell)
+			{
+				for (Character *character : cell.characters)
+					f(character);
+			});
+		}
+
+		/**
+		 * Calls f with every NPC in a cell near x,y, callers still need to check the exact distance
+		 */
+		template <class F> void ForEachNPC(int x, int y, int range, F f) const
+		{
+			this->ForEachCell(x, y, range, [&f](const Cell &cell)
+			{
+				for (NPC *npc : cell.npcs)
+					f(npc);
+			});
+		}
+};
+
+/**
+ * When each NPC on a map next needs to act, talk or respawn, soonest first
+ * Every NPC has at most one live entry per event, the time of which it keeps in NPC::scheduled.
+ * Entries whose time no longer matches are dropped as they come up, so an NPC only ever needs rescheduling when its time moves earlier.
+ */
+class Map_NPCSchedule
+{
+	public:
+		enum Event
+		{
+			Act,
+			Talk,
+			Spawn,
+			EventCount
+		};
+
+	private:
+		struct Entry
+		{
+			double time;
+			NPC *npc;
+		};
+
+		static bool Later(const Entry &a, const Entry &b) { return a.time > b.time; }
+
+		std::array<std::vector<Entry>, EventCount> queues;
+
+	public:
+		/**
+		 * Schedules an event for an NPC, unless it already has one at or before time
+		 */
+		void Add(NPC *npc, Event event, double time);
+
+		/**
+		 * Takes every event due strictly before now off the schedule
+		 */
+		void TakeDue(Event event, double now, std::vector<NPC *> &due);
+
+		/**
+		 * Drops every entry for an NPC which is being deleted
+		 */
+		void Remove(NPC *npc);
+
+		void Clear();
+};
+
 /**
  * Contains all information about a map, holds reference to contained Characters and manages NPCs on it
  */
@@ -247,6 +401,39 @@ class Map
 		std::vector<std::shared_ptr<Map_Chest>> chests;
 		std::list<std::shared_ptr<Map_Item>> items;
 		std::vector<Map_Tile> tiles;
+
+		/**
+		 * Index of characters, npcs and items by position, kept in step with the lists above
+		 */
+		Map_Grid grid;
+
+		/**
+		 * Paths for chasing NPCs, built from tiles when the map loads
+		 */
+		Pathfinder pathfinder;
+
+		/**
+		 * Random numbers for NPCs deciding what to do, so maps can decide in parallel
+		 */
+		std::minstd_rand npc_random;
+
+		/**
+		 * Upcoming NPC events, only kept while the map is awake
+		 */
+		Map_NPCSchedule npc_schedule;
+
+		/**
+		 * NPCs whose turn to act came up this tick
+		 * Left alone by Sleep(), as the tick may still be walking it
+		 */
+		std::vector<NPC *> npcs_due;
+
+		/**
+		 * Maps with nobody on them are asleep, and their NPCs neither act, talk nor respawn
+		 */
+		bool awake;
+		double asleep_since;
+
 		bool exists;
 		double jukebox_protect;
 		std::string jukebox_player;
@@ -268,6 +455,44 @@ class Map
 		void Enter(Character *, WarpAnimation animation = WARP_ANIMATION_NONE);
 		void Leave(Character *, WarpAnimation animation = WARP_ANIMATION_NONE, bool silent = false);
 
+		/**
+		 * Links a character or live NPC with everything in view range of it, see Character::view_characters
+		 */
+		void TrackView(Character *character);
+		void TrackView(NPC *npc);
+
+		/**
+		 * Unlinks a character or NPC from everything that could see it
+		 */
+		void UntrackView(Character *character);
+		void UntrackView(NPC *npc);
+
+		/**
+		 * Rebuilds every view set on the map, for when SeeDistance changes
+		 */
+		void ResetViews();
+
+		/**
+		 * Catches NPCs up on what they missed while the map was asleep and starts scheduling them again
+		 */
+		void Wake();
+		void Sleep();
+
+		/**
+		 * Schedules whatever an NPC will do next, see Map_NPCSchedule
+		 */
+		void ScheduleNPC(NPC *npc);
+
+		/**
+		 * Rebuilds the schedule, for when the times NPCs go by change
+		 */
+		void RescheduleNPCs();
+
+		/**
+		 * Moves a character to another tile without walking there or telling anyone
+		 */
+		void Reposition(Character *character, unsigned char x, unsigned char y);
+
 		void Msg(Character *from, std::string message, bool echo = true);
 		void Msg(NPC *from, std::string message);
 		WalkResult Walk(Character *from, Direction direction, bool admin = false);
@@ -0,0 +1,397 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#include "netthread.hpp"
+
+#include "eoclient.hpp"
+#include "packet.hpp"
+
+#include "platform.h"
+#include "socket.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+
+#ifdef WIN32
+#include <malloc.h>
+#endif // WIN32
+
+// Closed clients get as long to flush their output as Server::BuryTheDead would give them
+static const std::chrono::seconds netthread_release_timeout(2);
+
+NetThread::NetThread()
+	: running(true)
+{
+	this->thread = std::thread([this]() { this->Run(); });
+}
+
+void *NetThread::operator new(std::size_t size)
+{
+	void *ptr;
+
+#ifdef WIN32
+	ptr = _aligned_malloc(size, alignof(NetThread));
+#else // WIN32
+	if (posix_memalign(&ptr, alignof(NetThread), size) != 0)
+		ptr = nullptr;
+#endif // WIN32
+
+	if (!ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void NetThread::operator delete(void *ptr)
+{
+#ifdef WIN32
+	_aligned_free(ptr);
+#else // WIN32
+	std::free(ptr);
+#endif // WIN32
+}
+
+void NetThread::Push(Command command)
+{
+	this->commands.Push(std::move(command));
+	this->wake_pending = true;
+}
+
+void NetThread::Adopt(EOClient *client)
+{
+	Command command;
+	command.type = Command::Adopt;
+	command.client = client;
+	this->Push(std::move(command));
+}
+
+void NetThread::Send(EOClient *client, std::shared_ptr<const std::string> raw, unsigned char emulti)
+{
+	Command command;
+	command.type = Command::Packet;
+	command.client = client;
+	command.data = std::move(raw);
+	command.emulti = emulti;
+	this->Push(std::move(command));
+}
+
+void NetThread::Send(EOClient *client, util::string_view raw, unsigned char emulti)
+{
+	Command command;
+	command.type = Command::Packet;
+	command.client = client;
+	this->spent_commands.Pop(command.buffer);
+	command.buffer.assign(raw.data(), raw.length());
+	command.emulti = emulti;
+	this->Push(std::move(command));
+}
+
+void NetThread::SendFile(EOClient *client, std::shared_ptr<const std::string> data)
+{
+	Command command;
+	command.type = Command::File;
+	command.client = client;
+	command.data = std::move(data);
+	this->Push(std::move(command));
+}
+
+void NetThread::Release(EOClient *client)
+{
+	Command command;
+	command.type = Command::Release;
+	command.client = client;
+	this->Push(std::move(command));
+}
+
+void NetThread::Notify()
+{
+	if (this->wake_pending)
+	{
+		this->wake_pending = false;
+		this->poller.Wake();
+	}
+}
+
+bool NetThread::Receive(Event &event)
+{
+	return this->events.Pop(event);
+}
+
+void NetThread::Recycle(std::string &&data)
+{
+	this->spent_events.Push(std::move(data));
+}
+
+void NetThread::Run()
+{
+	Command command;
+
+	while (this->running.load(std::memory_order_acquire))
+	{
+		// Flushing clients have to be checked for their deadline even if nothing happens on their socket
+		const double timeout = this->releasing.empty() ? 1.0 : 0.1;
+
+		for (Client *rawclient : this->poller.Wait(timeout))
+		{
+			EOClient *client = static_cast<EOClient *>(rawclient);
+			auto it = this->clients.find(client);
+
+			if (it != this->clients.end())
+				this->Service(client, it->second);
+		}
+
+		// Clients are serviced once after all of their queued packets are in, rather than once per packet
+		while (this->commands.Pop(command))
+		{
+			EOClient *client = command.client;
+
+			if (this->Process(command))
+			{
+				ClientState &state = this->clients[client];
+
+				if (!state.touched)
+				{
+					state.touched = true;
+					this->touched.push_back(client);
+				}
+			}
+		}
+
+		for (EOClient *client : this->touched)
+		{
+			ClientState &state = this->clients[client];
+			state.touched = false;
+			this->Service(client, state);
+		}
+
+		this->touched.clear();
+
+		const auto now = std::chrono::steady_clock::now();
+
+		for (auto it = this->releasing.begin(); it != this->releasing.end(); )
+		{
+			EOClient *client = *it;
+			ClientState &state = this->clients[client];
+
+			if (state.dead || (state.backlog.empty() && !client->SendPending()) || now >= state.release_deadline)
+			{
+				this->poller.Remove(client);
+				this->clients.erase(client);
+
+				Event event;
+				event.type = Event::Released;
+				event.client = client;
+				this->events.Push(std::move(event));
+
+				it = this->releasing.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	this->Finish();
+}
+
+bool NetThread::Process(Command &command)
+{
+	EOClient *client = command.client;
+
+	if (command.type == Command::Adopt)
+	{
+		ClientState &state = this->clients[client];
+		state.backlog_limit = client->SendBufferRemaining();
+
+		if (!this->poller.Add(client))
+		{
+			this->Kill(client, state);
+			return false;
+		}
+
+		return true;
+	}
+
+	auto it = this->clients.find(client);
+
+	// Anything queued for a client after it was released is dropped
+	if (it == this->clients.end())
+		return false;
+
+	ClientState &state = it->second;
+
+	if (state.dead && command.type != Command::Release)
+		return false;
+
+	switch (command.type)
+	{
+		case Command::Packet:
+			// Nothing is waiting ahead of the packet, so it can go straight in to the send buffer
+			if (state.backlog.empty() && !client->SendingFile() && client->SendEncoded(command.Raw(), command.emulti))
+			{
+				this->Spend(command);
+				return true;
+			}
+
+			state.backlog_size += command.Raw().length();
+
+			// Same limit as a client being sent to faster than it reads on the game thread
+			if (state.backlog_size > state.backlog_limit)
+			{
+				this->Kill(client, state);
+				return false;
+			}
+			// fall through
+
+		case Command::File:
+			state.backlog.push_back(std::move(command));
+			return true;
+
+		case Command::Release:
+			if (!state.releasing)
+			{
+				state.releasing = true;
+				state.release_deadline = std::chrono::steady_clock::now() + netthread_release_timeout;
+				this->releasing.push_back(client);
+			}
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+void NetThread::Spend(Command &command)
+{
+	if (!command.data)
+		this->spent_commands.Push(std::move(command.buffer));
+}
+
+bool NetThread::Flush(EOClient *client, ClientState &state)
+{
+	bool progress = false;
+
+	// Nothing can be added to the send buffer until a file in progress has gone out
+	while (!state.backlog.empty() && !client->SendingFile())
+	{
+		Command &command = state.backlog.front();
+
+		if (command.type == Command::File)
+		{
+			client->SendFile(command.data);
+		}
+		else if (client->SendEncoded(command.Raw(), command.emulti))
+		{
+			state.backlog_size -= command.Raw().length();
+			this->Spend(command);
+		}
+		else
+		{
+			break;
+		}
+
+		state.backlog.pop_front();
+		progress = true;
+	}
+
+	return progress;
+}
+
+void NetThread::Service(EOClient *client, ClientState &state)
+{
+	bool progress = true;
+
+	while (progress && !state.dead)
+	{
+		progress = this->Flush(client, state);
+
+		const std::size_t send_remaining = client->SendBufferRemaining();
+
+		if (!ClientPoller::Service(client))
+		{
+			this->Kill(client, state);
+			break;
+		}
+
+		// Space freed in the send buffer may let more of the backlog in
+		if (client->SendBufferRemaining() > send_remaining && !state.backlog.empty())
+			progress = true;
+
+		// Closed clients are only being flushed, the game thread would ignore their packets anyway
+		if (state.releasing)
+			continue;
+
+		// A full receive buffer means the socket may still have more to read once it is drained
+		if (client->RecvBufferRemaining() == 0)
+			progress = true;
+
+		std::string &packet = client->received;
+
+		while (client->ReadPacket(packet))
+		{
+			if (packet.length() >= 2)
+			{
+				Event event;
+				event.type = Event::Packet;
+				event.client = client;
+				this->spent_events.Pop(event.data);
+				event.data.resize(packet.length());
+				client->processor.Decode(packet.data(), packet.length(), &event.data[0]);
+				this->events.Push(std::move(event));
+			}
+
+			std::fill(packet.begin(), packet.end(), '\0');
+		}
+	}
+}
+
+void NetThread::Kill(EOClient *client, ClientState &state)
+{
+	if (state.dead)
+		return;
+
+	state.dead = true;
+	state.backlog.clear();
+	state.backlog_size = 0;
+
+	Event event;
+	event.type = Event::Disconnected;
+	event.client = client;
+	this->events.Push(std::move(event));
+}
+
+void NetThread::Finish()
+{
+	Command command;
+
+	while (this->commands.Pop(command))
+		this->Process(command);
+
+	// Whatever is left has to fit in the clients' own buffers for the server to send it
+	for (auto &entry : this->clients)
+	{
+		if (!entry.second.dead)
+			this->Flush(entry.first, entry.second);
+
+		this->poller.Remove(entry.first);
+	}
+
+	this->clients.clear();
+	this->releasing.clear();
+}
+
+NetThread::~NetThread()
+{
+	this->running.store(false, std::memory_order_release);
+	this->poller.Wake();
+	this->thread.join();
+}
@@ -0,0 +1,215 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef NETTHREAD_HPP_INCLUDED
+#define NETTHREAD_HPP_INCLUDED
+
+#include "fwd/netthread.hpp"
+
+#include "fwd/eoclient.hpp"
+
+#include "socket.hpp"
+#include "util/spscqueue.hpp"
+#include "util/string_view.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Moves socket I/O, packet framing, decoding and encoding for a set of clients off the game thread.
+ * The game thread hands clients over with Adopt and keeps ownership of them; packets are passed
+ * each way through single-consumer queues, so handlers, sequence checks and world state are still
+ * only ever touched by the game thread.
+ */
+class NetThread
+{
+	public:
+		/**
+		 * Something that happened to a client on the network thread, returned by Receive.
+		 */
+		struct Event
+		{
+			enum Type
+			{
+				/**
+				 * A decoded packet for EOClient::Dispatch.
+				 */
+				Packet,
+
+				/**
+				 * The connection failed or was closed by the remote side.
+				 */
+				Disconnected,
+
+				/**
+				 * The network thread has finished with a client passed to Release.
+				 */
+				Released
+			};
+
+			Type type = Packet;
+			EOClient *client = nullptr;
+
+			/**
+			 * Hand this back through Recycle once the packet is dispatched, so its buffer is used again.
+			 */
+			std::string data;
+		};
+
+	private:
+		struct Command
+		{
+			enum Type
+			{
+				Adopt,
+				Packet,
+				File,
+				Release
+			};
+
+			Type type = Packet;
+			EOClient *client = nullptr;
+
+			/**
+			 * Files and packets shared between clients, otherwise a packet is copied in to buffer.
+			 */
+			std::shared_ptr<const std::string> data;
+			std::string buffer;
+
+			unsigned char emulti = 0;
+
+			util::string_view Raw() const { return this->data ? util::string_view(*this->data) : util::string_view(this->buffer); }
+		};
+
+		/**
+		 * Per-client state only touched by the network thread.
+		 */
+		struct ClientState
+		{
+			/**
+			 * Packets and files which have not fit in to the send buffer yet.
+			 */
+			std::deque<Command> backlog;
+
+			/**
+			 * Bytes of packets in the backlog, the client is disconnected if this passes backlog_limit.
+			 */
+			std::size_t backlog_size = 0;
+			std::size_t backlog_limit = 0;
+
+			bool touched = false;
+
+			bool dead = false;
+			bool releasing = false;
+			std::chrono::steady_clock::time_point release_deadline;
+		};
+
+		ClientPoller poller;
+
+		util::SPSCQueue<Command> commands;
+		util::SPSCQueue<Event> events;
+
+		/**
+		 * Buffers going back the other way once they are done with, so packets don't need allocating once these have filled.
+		 * Sent packets' buffers go back to the game thread for Send, and dispatched packets' to the network thread.
+		 */
+		util::SPSCQueue<std::string> spent_commands;
+		util::SPSCQueue<std::string> spent_events;
+
+		/**
+		 * Commands only come from the game thread, async operations post their callbacks back to it before anything is sent.
+		 */
+		bool wake_pending = false;
+
+		std::unordered_map<EOClient *, ClientState> clients;
+		std::vector<EOClient *> releasing;
+		std::vector<EOClient *> touched;
+
+		std::atomic<bool> running;
+		std::thread thread;
+
+		void Push(Command command);
+		void Run();
+		bool Process(Command &command);
+		void Spend(Command &command);
+		void Service(EOClient *client, ClientState &state);
+		void Kill(EOClient *client, ClientState &state);
+		bool Flush(EOClient *client, ClientState &state);
+		void Finish();
+
+	public:
+		/**
+		 * Starts the network thread.
+		 * @throw Socket_InitFailed if there is no ClientPoller on this platform
+		 */
+		NetThread();
+
+		NetThread(const NetThread &) = delete;
+		NetThread &operator =(const NetThread &) = delete;
+
+		/**
+		 * The queues are kept on their own cache lines, which the global operator new doesn't honour before C++17.
+		 */
+		static void *operator new(std::size_t size);
+		static void operator delete(void *ptr);
+
+		/**
+		 * Hands a connected client over to the network thread.
+		 * The client's socket must not be serviced by the server until it is released.
+		 */
+		void Adopt(EOClient *client);
+
+		/**
+		 * Queues a raw packet to be encoded with the given multiplier and sent.
+		 */
+		void Send(EOClient *client, std::shared_ptr<const std::string> raw, unsigned char emulti);
+
+		/**
+		 * Queues a copy of a raw packet, made in a buffer a previous packet has finished with.
+		 */
+		void Send(EOClient *client, util::string_view raw, unsigned char emulti);
+
+		/**
+		 * Queues a file image to be sent after any packets already queued for the client.
+		 */
+		void SendFile(EOClient *client, std::shared_ptr<const std::string> data);
+
+		/**
+		 * Asks the network thread to flush and stop servicing a closed client.
+		 * A Released event is returned once it is safe to bury the client.
+		 */
+		void Release(EOClient *client);
+
+		/**
+		 * Wakes the network thread if anything was queued since the last call.
+		 */
+		void Notify();
+
+		/**
+		 * Takes the next event, only to be called from the game thread.
+		 * @return false if there are no events waiting
+		 */
+		bool Receive(Event &event);
+
+		/**
+		 * Hands the data of a received packet back to the network thread, only to be called from the game thread.
+		 */
+		void Recycle(std::string &&data);
+
+		/**
+		 * Stops and joins the network thread.
+		 * Queued packets are moved in to the clients' own send buffers where they fit, so the server can finish sending them.
+		 */
+		~NetThread();
+};
+
+#endif // NETTHREAD_HPP_INCLUDED
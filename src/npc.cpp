@@ -9,6 +9,8 @@
 #include "character.hpp"
 #include "config.hpp"
 #include "eodata.hpp"
+#include "eoserv_config.hpp"
+#include "formula.hpp"
 #include "map.hpp"
 #include "npc_data.hpp"
 #include "packet.hpp"
@@ -19,12 +21,12 @@
 
 #include "console.hpp"
 #include "util.hpp"
-#include "util/rpn.hpp"
 
 #include <algorithm>
 #include <array>
 #include <cmath>
 #include <cstdio>
+#include <limits>
 #include <list>
 #include <memory>
 #include <set>
@@ -76,6 +78,7 @@ NPC::NPC(Map *map, short id, unsigned char x, unsigned char y, unsigned char spa
 	}
 
 	this->parent = 0;
+	this->scheduled.fill(std::numeric_limits<double>::infinity());
 }
 
 const NPC_Data& NPC::Data() const
@@ -109,6 +112,9 @@ void NPC::Spawn(NPC *parent)
 		this->parent = parent;
 	}
 
+	int old_x = this->x;
+	int old_y = this->y;
+
 	if (this->spawn_type < 7)
 	{
 		bool found = false;
@@ -157,7 +163,10 @@ void NPC::Spawn(NPC *parent)
 		}
 	}
 
+	this->map->grid.Move(this, old_x, old_y, this->x, this->y);
+
 	this->alive = true;
+	this->map->TrackView(this);
 	this->hp = this->ENF().hp;
 	this->last_act = Timer::GetTime();
 	this->last_talk = Timer::GetTime();
@@ -172,17 +181,40 @@ void NPC::Spawn(NPC *parent)
 	builder.AddChar(this->y);
 	builder.AddChar(this->direction);
 
-	UTIL_FOREACH(this->map->characters, character)
-	{
-		if (character->InRange(this))
-		{
-			character->Send(builder);
-		}
-	}
+	this->map->world->Broadcast(builder, this->viewers);
+
+	this->map->ScheduleNPC(this);
+}
+
+double NPC::RespawnTime() const
+{
+	const World *world = this->map->world;
+
+	if (this->alive || this->temporary)
+		return std::numeric_limits<double>::infinity();
+
+	// Boss children only come back with their boss, unless configured otherwise
+	if (this->ENF().child && !(this->parent && this->parent->alive && world->settings->RespawnBossChildren))
+		return std::numeric_limits<double>::infinity();
+
+	return this->dead_since + double(this->spawn_time) * world->settings->SpawnRate;
 }
 
 void NPC::Act()
 {
+	this->Decide(Timer::GetTime(), this->map->npc_random);
+	this->Apply();
+}
+
+void NPC::Decide(double current_time, std::minstd_rand &random)
+{
+	auto rand = [&random](int min, int max)
+	{
+		return std::uniform_int_distribution<int>(min, max)(random);
+	};
+
+	this->intent = Intent();
+
 	// Needed for the server startup spawn to work properly
 	if (this->ENF().child && !this->parent)
 	{
@@ -196,7 +228,7 @@ void NPC::Act()
 		}
 	}
 
-	this->last_act += double(util::rand(int(this->act_speed * 750.0), int(this->act_speed * 1250.0))) / 1000.0;
+	this->last_act += double(rand(int(this->act_speed * 750.0), int(this->act_speed * 1250.0))) / 1000.0;
 
 	if (this->spawn_type == 7)
 	{
@@ -204,14 +236,14 @@ void NPC::Act()
 	}
 
 	Character *attacker = 0;
-	unsigned char attacker_distance = static_cast<int>(this->map->world->config["NPCChaseDistance"]);
+	unsigned char attacker_distance = this->map->world->settings->NPCChaseDistance;
 	unsigned short attacker_damage = 0;
 
 	if (this->ENF().type == ENF::Passive || this->ENF().type == ENF::Aggressive)
 	{
 		UTIL_FOREACH_CREF(this->damagelist, opponent)
 		{
-			if (opponent->attacker->map != this->map || opponent->attacker->nowhere || opponent->last_hit < Timer::GetTime() - static_cast<double>(this->map->world->config["NPCBoredTimer"]))
+			if (opponent->attacker->map != this->map || opponent->attacker->nowhere || opponent->last_hit < current_time - this->map->world->settings->NPCBoredTimer)
 			{
 				continue;
 			}
@@ -233,7 +265,7 @@ void NPC::Act()
 		{
 			UTIL_FOREACH_CREF(this->parent->damagelist, opponent)
 			{
-				if (opponent->attacker->map != this->map || opponent->attacker->nowhere || opponent->last_hit < Timer::GetTime() - static_cast<double>(this->map->world->config["NPCBoredTimer"]))
+				if (opponent->attacker->map != this->map || opponent->attacker->nowhere || opponent->last_hit < current_time - this->map->world->settings->NPCBoredTimer)
 				{
 					continue;
 				}
@@ -256,7 +288,7 @@ void NPC::Act()
 	if (this->ENF().type == ENF::Aggressive || (this->parent && attacker))
 	{
 		Character *closest = 0;
-		unsigned char closest_distance = static_cast<int>(this->map->world->config["NPCChaseDistance"]);
+		unsigned char closest_distance = this->map->world->settings->NPCChaseDistance;
 
 		if (attacker)
 		{
@@ -264,10 +296,10 @@ void NPC::Act()
 			closest_distance = std::min(closest_distance, attacker_distance);
 		}
 
-		UTIL_FOREACH(this->map->characters, character)
+		this->map->grid.ForEachCharacter(this->x, this->y, closest_distance, [&](Character *character)
 		{
 			if (character->IsHideNpc() || !character->CanInteractCombat())
-				continue;
+				return;
 
 			int distance = util::path_length(character->x, character->y, this->x, this->y);
 
@@ -279,7 +311,7 @@ void NPC::Act()
 				closest = character;
 				closest_distance = distance;
 			}
-		}
+		});
 
 		if (closest)
 		{
@@ -294,53 +326,18 @@ void NPC::Act()
 		int absxdiff = std::abs(xdiff);
 		int absydiff = std::abs(ydiff);
 
+		this->intent.target = attacker;
+
 		if ((absxdiff == 1 && absydiff == 0) || (absxdiff == 0 && absydiff == 1) || (absxdiff == 0 && absydiff == 0))
 		{
-			this->Attack(attacker);
+			this->intent.action = Intent::Attack;
 			return;
 		}
-		else if (absxdiff > absydiff)
-		{
-			if (xdiff < 0)
-			{
-				this->direction = DIRECTION_RIGHT;
-			}
-			else
-			{
-				this->direction = DIRECTION_LEFT;
-			}
-		}
-		else
-		{
-			if (ydiff < 0)
-			{
-				this->direction = DIRECTION_DOWN;
-			}
-			else
-			{
-				this->direction = DIRECTION_UP;
-			}
-		}
 
-		if (this->Walk(this->direction) == Map::WalkFail)
-		{
-			if (this->direction == DIRECTION_UP || this->direction == DIRECTION_DOWN)
-			{
-				if (xdiff < 0)
-				{
-					this->direction = DIRECTION_RIGHT;
-				}
-				else
-				{
-					this->direction = DIRECTION_LEFT;
-				}
-			}
+		this->intent.action = Intent::Chase;
 
-			if (this->Walk(static_cast<Direction>(this->direction)) == Map::WalkFail)
-			{
-				this->Walk(static_cast<Direction>(util::rand(0,3)));
-			}
-		}
+		if (this->map->world->settings->NPCChaseMode != 0)
+			this->intent.step = this->ChaseStep(attacker, this->intent.direction);
 	}
 	else
 	{
@@ -349,7 +346,7 @@ void NPC::Act()
 		int act;
 		if (this->walk_idle_for == 0)
 		{
-			act = util::rand(1,10);
+			act = rand(1,10);
 		}
 		else
 		{
@@ -359,17 +356,129 @@ void NPC::Act()
 
 		if (act >= 1 && act <= 6) // 60% chance walk foward
 		{
-			this->Walk(this->direction);
+			this->intent.action = Intent::Walk;
+			this->intent.direction = this->direction;
 		}
 
 		if (act >= 7 && act <= 9) // 30% change direction
 		{
-			this->Walk(static_cast<Direction>(util::rand(0,3)));
+			this->intent.action = Intent::Walk;
+			this->intent.direction = static_cast<Direction>(rand(0,3));
 		}
 
 		if (act == 10) // 10% take a break
 		{
-			this->walk_idle_for = util::rand(1,4);
+			this->walk_idle_for = rand(1,4);
+		}
+	}
+}
+
+void NPC::Apply()
+{
+	Intent intent = this->intent;
+	this->intent = Intent();
+
+	if (!this->alive || intent.action == Intent::None)
+		return;
+
+	if (intent.action == Intent::Walk)
+	{
+		this->Walk(intent.direction);
+		return;
+	}
+
+	// Others may have acted on the target since the NPC decided
+	Character *target = intent.target;
+
+	if (target->map != this->map || target->nowhere)
+		return;
+
+	if (intent.action == Intent::Attack)
+	{
+		if (util::path_length(this->x, this->y, target->x, target->y) <= 1)
+			this->Attack(target);
+
+		return;
+	}
+
+	if (this->map->world->settings->NPCChaseMode == 0)
+	{
+		this->ChaseDirectly(target);
+	}
+	else if (intent.step && this->Walk(intent.direction) == Map::WalkFail)
+	{
+		// With no way through, wait for the target or the way to change rather than walking in to walls
+		this->chase_path.Clear();
+	}
+}
+
+bool NPC::ChaseStep(Character *target, Direction &direction)
+{
+	bool adminghost = (this->ENF().type == ENF::Aggressive || this->parent);
+	int range = this->map->world->settings->NPCChaseDistance * 2;
+	Pathfinder &pathfinder = this->map->pathfinder;
+
+	auto occupied = [this, adminghost](int x, int y)
+	{
+		return this->map->Occupied(x, y, Map::PlayerAndNPC, adminghost);
+	};
+
+	if (this->map->world->settings->NPCChaseMode == 2)
+	{
+		const Pathfinder::FlowField &field = pathfinder.Field(target->PlayerID(), target->x, target->y, range);
+		return pathfinder.FlowStep(field, this->x, this->y, occupied, direction);
+	}
+
+	return pathfinder.NextStep(this->chase_path, this->x, this->y, target->x, target->y, range, occupied, direction);
+}
+
+void NPC::ChaseDirectly(Character *target)
+{
+	int xdiff = this->x - target->x;
+	int ydiff = this->y - target->y;
+	int absxdiff = std::abs(xdiff);
+	int absydiff = std::abs(ydiff);
+
+	if (absxdiff > absydiff)
+	{
+		if (xdiff < 0)
+		{
+			this->direction = DIRECTION_RIGHT;
+		}
+		else
+		{
+			this->direction = DIRECTION_LEFT;
+		}
+	}
+	else
+	{
+		if (ydiff < 0)
+		{
+			this->direction = DIRECTION_DOWN;
+		}
+		else
+		{
+			this->direction = DIRECTION_UP;
+		}
+	}
+
+	if (this->Walk(this->direction) == Map::WalkFail)
+	{
+		if (this->direction == DIRECTION_UP || this->direction == DIRECTION_DOWN)
+		{
+			if (xdiff < 0)
+			{
+				this->direction = DIRECTION_RIGHT;
+			}
+			else
+			{
+				this->direction = DIRECTION_LEFT;
+			}
+		}
+
+		if (this->Walk(static_cast<Direction>(this->direction)) == Map::WalkFail)
+		{
+			this->Walk(static_cast<Direction>(util::rand(0,3)));
 		}
 	}
 }
@@ -415,14 +524,7 @@ void NPC::Talk()
 
 bool NPC::InCharacterRange()
 {
-	UTIL_FOREACH(this->map->characters, character)
-	{
-		if (character->InRange(this))
-		{
-			return true;
-		}
-	}
-	return false;
+	return !this->viewers.empty();
 }
 
 bool NPC::Walk(Direction direction)
@@ -434,7 +536,7 @@ void NPC::Damage(Character *from, int amount, int spell_id)
 {
 	int limitamount = std::min(this->hp, amount);
 
-	if (this->map->world->config["LimitDamage"])
+	if (this->map->world->settings->LimitDamage)
 	{
 		amount = limitamount;
 	}
@@ -495,13 +597,13 @@ void NPC::Damage(Character *from, int amount, int spell_id)
 		else
 			builder.AddChar(1); // ?
 
-		UTIL_FOREACH(this->map->characters, character)
+		this->map->grid.ForEachCharacter(this->x, this->y, this->map->world->settings->SeeDistance, [&](Character *character)
 		{
 			if (character->InRange(this))
 			{
 				character->Send(builder);
 			}
-		}
+		});
 	}
 	else
 	{
@@ -549,11 +651,11 @@ void NPC::RemoveFromView(Character *target)
 
 void NPC::Killed(Character *from, int amount, int spell_id)
 {
-	double droprate = this->map->world->config["DropRate"];
-	double exprate = this->map->world->config["ExpRate"];
-	int sharemode = this->map->world->config["ShareMode"];
-	int partysharemode = this->map->world->config["PartyShareMode"];
-	int dropratemode = this->map->world->config["DropRateMode"];
+	double droprate = this->map->world->settings->DropRate;
+	double exprate = this->map->world->settings->ExpRate;
+	int sharemode = this->map->world->settings->ShareMode;
+	int partysharemode = this->map->world->settings->PartyShareMode;
+	int dropratemode = this->map->world->settings->DropRateMode;
 	std::set<Party *> parties;
 
 	int most_damage_counter = 0;
@@ -561,9 +663,15 @@ void NPC::Killed(Character *from, int amount, int spell_id)
 	NPC_Drop *drop = nullptr;
 
 	this->alive = false;
+	this->map->UntrackView(this);
 
 	this->dead_since = int(Timer::GetTime());
 
+	if (!this->temporary)
+	{
+		this->map->ScheduleNPC(this);
+	}
+
 	if (dropratemode == 1)
 	{
 		std::vector<NPC_Drop *> drops;
@@ -626,15 +734,16 @@ void NPC::Killed(Character *from, int amount, int spell_id)
 	if (drop)
 	{
 		dropid = drop->id;
-		dropamount = std::min<int>(util::rand(drop->min, drop->max), this->map->world->config["MaxItem"]);
+		dropamount = std::min<int>(util::rand(drop->min, drop->max), this->map->world->settings->MaxItem);
 
 		if (dropid <= 0 || static_cast<std::size_t>(dropid) >= this->map->world->eif->data.size() || dropamount <= 0)
 			goto abort_drop;
 
 		dropuid = this->map->GenerateItemID();
 
-		std::shared_ptr<Map_Item> newitem(std::make_shared<Map_Item>(dropuid, dropid, dropamount, this->x, this->y, from->PlayerID(), Timer::GetTime() + static_cast<int>(this->map->world->config["ProtectNPCDrop"])));
+		std::shared_ptr<Map_Item> newitem(std::make_shared<Map_Item>(dropuid, dropid, dropamount, this->x, this->y, from->PlayerID(), Timer::GetTime() + static_cast<int>(this->map->world->settings->ProtectNPCDrop)));
 		this->map->items.push_back(newitem);
+		this->map->grid.Add(newitem);
 
 		// Selects a random number between 0 and maxhp, and decides the winner based on that
 		switch (sharemode)
@@ -809,14 +918,14 @@ void NPC::Killed(Character *from, int amount, int spell_id)
 							break;
 					}
 
-					character->exp = std::min(character->exp, static_cast<int>(this->map->world->config["MaxExp"]));
+					character->exp = std::min(character->exp, this->map->world->settings->MaxExp);
 
-					while (character->level < static_cast<int>(this->map->world->config["MaxLevel"]) && character->exp >= this->map->world->exp_table[character->level+1])
+					while (character->level < this->map->world->settings->MaxLevel && character->exp >= this->map->world->exp_table[character->level+1])
 					{
 						level_up = true;
 						++character->level;
-						character->statpoints += static_cast<int>(this->map->world->config["StatPerLevel"]);
-						character->skillpoints += static_cast<int>(this->map->world->config["SkillPerLevel"]);
+						character->statpoints += this->map->world->settings->StatPerLevel;
+						character->skillpoints += this->map->world->settings->SkillPerLevel;
 						character->CalculateStats();
 					}
 
@@ -936,6 +1045,8 @@ void NPC::Killed(Character *from, int amount, int spell_id)
 			std::remove(this->map->npcs.begin(), this->map->npcs.end(), this),
 			this->map->npcs.end()
 		);
+
+		this->map->grid.Remove(this, this->x, this->y);
 	}
 
 	UTIL_FOREACH(from->quests, q)
@@ -959,9 +1070,15 @@ void NPC::Die(bool show)
 		return;
 
 	this->alive = false;
+	this->map->UntrackView(this);
 	this->parent = 0;
 	this->dead_since = int(Timer::GetTime());
 
+	if (!this->temporary)
+	{
+		this->map->ScheduleNPC(this);
+	}
+
 	UTIL_FOREACH_CREF(this->damagelist, opponent)
 	{
 		opponent->attacker->unregister_npc.erase(
@@ -1002,27 +1119,29 @@ void NPC::Die(bool show)
 			this->map->npcs.end()
 		);
 
+		this->map->grid.Remove(this, this->x, this->y);
+
 		delete this;
 	}
 }
 
 void NPC::Attack(Character *target)
 {
-	int amount = util::rand(this->ENF().mindam, this->ENF().maxdam + static_cast<int>(this->map->world->config["NPCAdjustMaxDam"]));
+	int amount = util::rand(this->ENF().mindam, this->ENF().maxdam + this->map->world->settings->NPCAdjustMaxDam);
 	double rand = util::rand(0.0, 1.0);
 	// Checks if target is facing you
-	bool critical = std::abs(int(target->direction) - this->direction) != 2 || rand < static_cast<double>(this->map->world->config["CriticalRate"]);
+	bool critical = std::abs(int(target->direction) - this->direction) != 2 || rand < this->map->world->settings->CriticalRate;
 
-	std::unordered_map<std::string, double> formula_vars;
+	FormulaValues formula_vars;
 
 	this->FormulaVars(formula_vars);
-	target->FormulaVars(formula_vars, "target_");
-	formula_vars["modifier"] = 1.0 / static_cast<double>(this->map->world->config["MobRate"]);
-	formula_vars["damage"] = amount;
-	formula_vars["critical"] = critical;
+	target->FormulaVars(formula_vars, FormulaValues::Target);
+	formula_vars[FormulaValues::Modifier] = 1.0 / this->map->world->settings->MobRate;
+	formula_vars[FormulaValues::Damage] = amount;
+	formula_vars[FormulaValues::Critical] = critical;
 
-	amount = static_cast<int>(rpn_eval(rpn_parse(this->map->world->formulas_config["damage"]), formula_vars));
-	double hit_rate = rpn_eval(rpn_parse(this->map->world->formulas_config["hit_rate"]), formula_vars);
+	amount = static_cast<int>(this->map->world->formulas->damage.eval(formula_vars.data()));
+	double hit_rate = this->map->world->formulas->hit_rate.eval(formula_vars.data());
 
 	if (rand > hit_rate)
 	{
@@ -1033,7 +1152,7 @@ void NPC::Attack(Character *target)
 
 	int limitamount = std::min(amount, int(target->hp));
 
-	if (this->map->world->config["LimitDamage"])
+	if (this->map->world->settings->LimitDamage)
 	{
 		amount = limitamount;
 	}
@@ -1081,15 +1200,15 @@ void NPC::Attack(Character *target)
 	builder.AddByte(255);
 	builder.AddByte(255);
 
-	UTIL_FOREACH(this->map->characters, character)
+	this->map->grid.ForEachCharacter(target->x, target->y, this->map->world->settings->SeeDistance, [&](Character *character)
 	{
 		if (character == target || !character->InRange(target))
 		{
-			continue;
+			return;
 		}
 
 		character->Send(builder);
-	}
+	});
 
 	if (target->hp == 0)
 	{
@@ -1107,17 +1226,26 @@ void NPC::Say(const std::string& message)
 	this->map->Msg(this, message);
 }
 
-#define v(x) vars[prefix + #x] = x;
-#define vv(x, n) vars[prefix + n] = x;
-#define vd(x) vars[prefix + #x] = data.x;
-
 void NPC::FormulaVars(std::unordered_map<std::string, double> &vars, std::string prefix)
+{
+	FormulaValues values;
+	this->FormulaVars(values);
+
+	for (std::size_t i = 0; i < FormulaValues::VarCount; ++i)
+		vars[prefix + FormulaValues::Name(FormulaValues::Var(i))] = values[i];
+}
+
+#define v(x) vars[offset + FormulaValues::Var_##x] = x;
+#define vv(x, n) vars[offset + FormulaValues::Var_##n] = x;
+#define vd(x) vars[offset + FormulaValues::Var_##x] = data.x;
+
+void NPC::FormulaVars(FormulaValues &vars, std::size_t offset)
 {
 	const ENF_Data& data = this->ENF();
-	vv(1, "npc") v(hp) vv(data.hp, "maxhp")
+	vv(1, npc) v(hp) vv(data.hp, maxhp)
 	vd(mindam) vd(maxdam)
 	vd(accuracy) vd(evade) vd(armor)
-	v(x) v(y) v(direction) vv(map->id, "mapid")
+	v(x) v(y) v(direction) vv(map->id, mapid)
 }
 
 #undef vd
@@ -1126,6 +1254,9 @@ void NPC::FormulaVars(std::unordered_map<std::string, double> &vars, std::string
 
 NPC::~NPC()
 {
+	// Stale entries can outlive the NPC's own schedule, so always look
+	this->map->npc_schedule.Remove(this);
+
 	UTIL_FOREACH(this->map->characters, character)
 	{
 		if (character->npc == this)
@@ -11,12 +11,15 @@
 
 #include "fwd/character.hpp"
 #include "fwd/eodata.hpp"
+#include "fwd/formula.hpp"
 #include "fwd/map.hpp"
 #include "fwd/npc_data.hpp"
+#include "pathfinder.hpp"
 
 #include <array>
 #include <list>
 #include <memory>
+#include <random>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -53,6 +56,47 @@ class NPC
 		std::list<std::unique_ptr<NPC_Opponent>> damagelist;
 
 		Map *map;
+
+		/**
+		 * Characters within SeeDistance of a live NPC, kept up to date by the map
+		 */
+		std::vector<Character *> viewers;
+
+		/**
+		 * Path to whoever the NPC is chasing, kept between steps
+		 */
+		Pathfinder::Path chase_path;
+
+		/**
+		 * What the NPC decided to do on its turn, before it is done
+		 */
+		struct Intent
+		{
+			enum Action
+			{
+				None,
+				Attack,
+				Chase,
+				Walk
+			};
+
+			Action action = None;
+			Character *target = nullptr;
+			Direction direction = DIRECTION_DOWN;
+
+			/**
+			 * Whether direction is the next step of a path when chasing
+			 */
+			bool step = false;
+		};
+
+		Intent intent;
+
+		/**
+		 * Times of the NPC's entries in its map's schedule, by Map_NPCSchedule::Event, or infinity for none
+		 */
+		std::array<double, 3> scheduled;
+
 		unsigned char index;
 		unsigned char spawn_type;
 		short spawn_time;
@@ -68,11 +112,43 @@ class NPC
 		const ENF_Data& ENF() const;
 
 		void Spawn(NPC *parent = 0);
+
+		/**
+		 * When the NPC is due to respawn, or infinity if it is alive, temporary or waiting on its boss
+		 */
+		double RespawnTime() const;
+
+		/**
+		 * Decides and acts in one go
+		 */
 		void Act();
+
+		/**
+		 * Picks a target and a way to it and stores it in intent
+		 * Only changes the NPC and its map's pathfinder, so NPCs on different maps can decide at the same time
+		 */
+		void Decide(double current_time, std::minstd_rand &random);
+
+		/**
+		 * Carries out intent, checking it still makes sense first
+		 */
+		void Apply();
+
 		void Talk();
 
 		bool InCharacterRange();
 
+		/**
+		 * Finds the next step towards a target which is not next to the NPC, for the NPCChaseModes which search for a way
+		 * @return false if there is no way to take a step along
+		 */
+		bool ChaseStep(Character *target, Direction &direction);
+
+		/**
+		 * Walks straight towards a target, trying other directions if the way is blocked (NPCChaseMode 0)
+		 */
+		void ChaseDirectly(Character *target);
+
 		bool Walk(Direction);
 		void Damage(Character *from, int amount, int spell_id = -1);
 		void RemoveFromView(Character *target);
@@ -85,6 +161,12 @@ class NPC
 
 		void FormulaVars(std::unordered_map<std::string, double> &vars, std::string prefix = "");
 
+		/**
+		 * Fills in one set of slots for compiled formulas
+		 * @param offset FormulaValues::Self or FormulaValues::Target
+		 */
+		void FormulaVars(FormulaValues &vars, std::size_t offset = 0);
+
 		~NPC();
 };
 
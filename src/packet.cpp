@@ -14,8 +14,17 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
 
 PacketProcessor::PacketProcessor()
 	: emulti_e(0)
@@ -128,145 +137,433 @@ std::string PacketProcessor::GetActionName(PacketAction action)
 	}
 }
 
-std::string PacketProcessor::Decode(const std::string &str)
+// The client's encoding interleaves each packet: the first half of the bytes lands on the even offsets
+// counting up and the second half on the odd offsets counting down from the last one. Every byte also
+// has its high bit flipped, except 0 and 128 which are left alone. Both steps are a fixed permutation
+// plus a per-byte map, so they are done together by one kernel per direction.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PACKET_SSE2
+#if defined(__GNUC__)
+#define PACKET_AVX2
+#endif // defined(__GNUC__)
+#endif // defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+static inline unsigned char packet_flip(unsigned char c)
 {
-	if (emulti_d == 0 || ((unsigned char)str[0] == PACKET_A_INIT && (unsigned char)str[1] == PACKET_F_INIT))
-		return str;
+	return (c & 0x7F) ? (c ^ 0x80) : c;
+}
 
-	std::string newstr;
-	int length = str.length();
-	int i = 0;
-	int ii = 0;
+/**
+ * Shape of the interleave for a span of m bytes.
+ */
+struct packet_layout
+{
+	std::size_t evens;
+	std::size_t odds;
+	std::size_t last_odd;
+
+	explicit packet_layout(std::size_t m)
+		: evens((m + 1) / 2)
+		, odds(m / 2)
+		, last_odd((m % 2) ? m - 2 : m - 1)
+	{ }
+};
+
+// out[k] = in[2k] for the evens, then out[evens + j] = in[last_odd - 2j], starting from output offsets k0 and j0
+static void packet_deinterleave_scalar(const unsigned char *in, unsigned char *out, std::size_t m, std::size_t k0 = 0, std::size_t j0 = 0)
+{
+	const packet_layout layout(m);
 
-	newstr.resize(length);
+	for (std::size_t k = k0; k < layout.evens; ++k)
+		out[k] = packet_flip(in[k * 2]);
 
-	while (i < length)
+	for (std::size_t j = j0; j < layout.odds; ++j)
+		out[layout.evens + j] = packet_flip(in[layout.last_odd - j * 2]);
+}
+
+// Inverse of packet_deinterleave_scalar, writing output offsets from p0 onwards
+static void packet_interleave_scalar(const unsigned char *in, unsigned char *out, std::size_t m, std::size_t p0 = 0)
+{
+	const packet_layout layout(m);
+
+	for (std::size_t p = p0; p < m; ++p)
 	{
-		newstr[ii++] = (unsigned char)str[i] ^ 0x80;
-		i += 2;
+		if (p % 2 == 0)
+			out[p] = packet_flip(in[p / 2]);
+		else
+			out[p] = packet_flip(in[layout.evens + (layout.last_odd - p) / 2]);
 	}
+}
+
+#ifdef PACKET_SSE2
+static inline __m128i packet_flip_sse2(__m128i x)
+{
+	const __m128i low = _mm_and_si128(x, _mm_set1_epi8(0x7F));
+	const __m128i keep = _mm_cmpeq_epi8(low, _mm_setzero_si128());
+	return _mm_xor_si128(x, _mm_andnot_si128(keep, _mm_set1_epi8(char(0x80))));
+}
 
-	--i;
+static inline __m128i packet_reverse_sse2(__m128i x)
+{
+	x = _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 1, 2, 3));
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+	x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static void packet_deinterleave_sse2(const unsigned char *in, unsigned char *out, std::size_t m)
+{
+	const packet_layout layout(m);
+	const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+	std::size_t k = 0;
+	std::size_t j = 0;
 
-	if (length % 2)
+	for (; k * 2 + 32 <= m; k += 16)
 	{
-		i -= 2;
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k * 2));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k * 2 + 16));
+		const __m128i evens = _mm_packus_epi16(_mm_and_si128(a, low_bytes), _mm_and_si128(b, low_bytes));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), packet_flip_sse2(evens));
 	}
 
-	do
+	// Each block of odd bytes is read in ascending order then reversed
+	for (; layout.last_odd >= j * 2 + 31 && j + 16 <= layout.odds; j += 16)
 	{
-		newstr[ii++] = (unsigned char)str[i] ^ 0x80;
-		i -= 2;
-	} while (i >= 0);
+		const unsigned char *base = in + layout.last_odd - j * 2 - 31;
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + 16));
+		const __m128i odds = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + layout.evens + j), packet_flip_sse2(packet_reverse_sse2(odds)));
+	}
 
-	for (int i = 2; i < length; ++i)
+	packet_deinterleave_scalar(in, out, m, k, j);
+}
+
+static void packet_interleave_sse2(const unsigned char *in, unsigned char *out, std::size_t m)
+{
+	const packet_layout layout(m);
+	std::size_t k = 0;
+
+	// Output bytes 2k+1 onwards come from the odd half counting down from in[evens + (last_odd - 2k - 1) / 2]
+	for (; m >= 1 && k * 2 + 32 <= layout.last_odd + 1; k += 16)
 	{
-		if (static_cast<unsigned char>(newstr[i]) == 128)
-		{
-			newstr[i] = 0;
-		}
-		else if (newstr[i] == 0)
-		{
-			newstr[i] = (char)128;
-		}
+		const std::size_t top = layout.evens + (layout.last_odd - k * 2 - 1) / 2;
+		const __m128i evens = packet_flip_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k)));
+		const __m128i odds = packet_flip_sse2(packet_reverse_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + top - 15))));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k * 2), _mm_unpacklo_epi8(evens, odds));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k * 2 + 16), _mm_unpackhi_epi8(evens, odds));
 	}
 
-	return this->DickWinderD(newstr);
+	packet_interleave_scalar(in, out, m, k * 2);
 }
+#endif // PACKET_SSE2
 
-std::string PacketProcessor::Encode(const std::string &rawstr)
+#ifdef PACKET_AVX2
+__attribute__((target("avx2"))) static inline __m256i packet_flip_avx2(__m256i x)
+{
+	const __m256i low = _mm256_and_si256(x, _mm256_set1_epi8(0x7F));
+	const __m256i keep = _mm256_cmpeq_epi8(low, _mm256_setzero_si256());
+	return _mm256_xor_si256(x, _mm256_andnot_si256(keep, _mm256_set1_epi8(char(0x80))));
+}
+
+__attribute__((target("avx2"))) static inline __m256i packet_reverse_avx2(__m256i x)
+{
+	const __m256i reverse_lanes = _mm256_setr_epi8(
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+	return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(x, reverse_lanes), _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("avx2"))) static void packet_deinterleave_avx2(const unsigned char *in, unsigned char *out, std::size_t m)
 {
-	if (emulti_e == 0 || ((unsigned char)rawstr[2] == PACKET_A_INIT && (unsigned char)rawstr[3] == PACKET_F_INIT))
-		return rawstr;
+	const packet_layout layout(m);
+	const __m256i low_bytes = _mm256_set1_epi16(0x00FF);
+	std::size_t k = 0;
+	std::size_t j = 0;
+
+	// packus works within 128-bit lanes, the permute puts the halves back in order
+	for (; k * 2 + 64 <= m; k += 32)
+	{
+		const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + k * 2));
+		const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + k * 2 + 32));
+		const __m256i evens = _mm256_packus_epi16(_mm256_and_si256(a, low_bytes), _mm256_and_si256(b, low_bytes));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + k), packet_flip_avx2(_mm256_permute4x64_epi64(evens, _MM_SHUFFLE(3, 1, 2, 0))));
+	}
 
-	std::string str = this->DickWinderE(rawstr);
-	std::string newstr;
-	int length = str.length();
-	int i = 2;
-	int ii = 2;
+	for (; layout.last_odd >= j * 2 + 63 && j + 32 <= layout.odds; j += 32)
+	{
+		const unsigned char *base = in + layout.last_odd - j * 2 - 63;
+		const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base));
+		const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base + 32));
+		const __m256i odds = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + layout.evens + j), packet_flip_avx2(packet_reverse_avx2(odds)));
+	}
 
-	newstr.resize(length);
+	packet_deinterleave_scalar(in, out, m, k, j);
+}
 
-	newstr[0] = str[0];
-	newstr[1] = str[1];
+__attribute__((target("avx2"))) static void packet_interleave_avx2(const unsigned char *in, unsigned char *out, std::size_t m)
+{
+	const packet_layout layout(m);
+	std::size_t k = 0;
 
-	while (i < length)
+	for (; m >= 1 && k * 2 + 64 <= layout.last_odd + 1; k += 32)
 	{
-		newstr[i] = (unsigned char)str[ii++] ^ 0x80;
-		i += 2;
+		const std::size_t top = layout.evens + (layout.last_odd - k * 2 - 1) / 2;
+		const __m256i evens = packet_flip_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + k)));
+		const __m256i odds = packet_flip_avx2(packet_reverse_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + top - 31))));
+
+		// unpack also works within lanes, so the low and high results each hold one half of both outputs
+		const __m256i lo = _mm256_unpacklo_epi8(evens, odds);
+		const __m256i hi = _mm256_unpackhi_epi8(evens, odds);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + k * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + k * 2 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
 	}
 
-	i = length - 1;
+	packet_interleave_scalar(in, out, m, k * 2);
+}
+#endif // PACKET_AVX2
+
+struct packet_kernel
+{
+	void (*deinterleave)(const unsigned char *in, unsigned char *out, std::size_t m);
+	void (*interleave)(const unsigned char *in, unsigned char *out, std::size_t m);
+};
 
-	if (length % 2)
+static packet_kernel packet_get_kernel(PacketProcessor::Kernel kernel)
+{
+	switch (kernel)
 	{
-		--i;
+#ifdef PACKET_AVX2
+		case PacketProcessor::Kernel::AVX2: return {packet_deinterleave_avx2, packet_interleave_avx2};
+#endif // PACKET_AVX2
+#ifdef PACKET_SSE2
+		case PacketProcessor::Kernel::SSE2: return {packet_deinterleave_sse2, packet_interleave_sse2};
+#endif // PACKET_SSE2
+		default: return {[](const unsigned char *in, unsigned char *out, std::size_t m) { packet_deinterleave_scalar(in, out, m); },
+		                 [](const unsigned char *in, unsigned char *out, std::size_t m) { packet_interleave_scalar(in, out, m); }};
 	}
+}
 
-	while (i >= 2)
+static bool packet_kernel_supported(PacketProcessor::Kernel kernel)
+{
+	switch (kernel)
 	{
-		newstr[i] = (unsigned char)str[ii++] ^ 0x80;
-		i -= 2;
+		case PacketProcessor::Kernel::Scalar: return true;
+#ifdef PACKET_SSE2
+		case PacketProcessor::Kernel::SSE2: return true;
+#endif // PACKET_SSE2
+#ifdef PACKET_AVX2
+		case PacketProcessor::Kernel::AVX2:
+			// May be called during static initialization, before the CPU model is otherwise set up
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif // PACKET_AVX2
+		default: return false;
 	}
+}
 
-	for (int i = 2; i < length; ++i)
+static PacketProcessor::Kernel packet_best_kernel()
+{
+	if (packet_kernel_supported(PacketProcessor::Kernel::AVX2))
+		return PacketProcessor::Kernel::AVX2;
+
+	if (packet_kernel_supported(PacketProcessor::Kernel::SSE2))
+		return PacketProcessor::Kernel::SSE2;
+
+	return PacketProcessor::Kernel::Scalar;
+}
+
+static std::atomic<PacketProcessor::Kernel> packet_active_kernel(packet_best_kernel());
+
+/**
+ * Calls f(start, end) for each run of 2 or more consecutive bytes divisible by emulti.
+ */
+template <class F> static void packet_for_each_run(const char *data, std::size_t length, unsigned char emulti, F f)
+{
+	if (emulti == 1)
 	{
-		if (static_cast<unsigned char>(newstr[i]) == 128)
-		{
-			newstr[i] = 0;
-		}
-		else if (newstr[i] == 0)
+		if (length >= 2)
+			f(std::size_t(0), length);
+
+		return;
+	}
+
+	// Divisibility test by multiplication, exact for 8-bit values (Lemire et al., "Faster Remainder by Direct Computation")
+	const std::uint32_t m = UINT32_C(0xFFFFFFFF) / emulti + 1;
+
+	auto divisible = [m](char c)
+	{
+		return std::uint32_t(static_cast<unsigned char>(c) * m) < m;
+	};
+
+	std::size_t i = 0;
+
+	while (i < length)
+	{
+		if (!divisible(data[i]))
 		{
-			newstr[i] = (char)128;
+			++i;
+			continue;
 		}
+
+		const std::size_t start = i;
+
+		while (++i < length && divisible(data[i])) { }
+
+		if (i - start >= 2)
+			f(start, i);
 	}
+}
+
+PacketProcessor::Kernel PacketProcessor::ActiveKernel()
+{
+	return packet_active_kernel.load(std::memory_order_relaxed);
+}
+
+bool PacketProcessor::SetKernel(Kernel kernel)
+{
+	if (!packet_kernel_supported(kernel))
+		return false;
+
+	packet_active_kernel.store(kernel, std::memory_order_relaxed);
+	return true;
+}
+
+std::string PacketProcessor::Decode(const std::string &str)
+{
+	std::string newstr(str.length(), char());
+
+	if (!str.empty())
+		this->Decode(str.data(), str.length(), &newstr[0]);
 
 	return newstr;
 }
 
-std::string PacketProcessor::DickWinder(const std::string &str, unsigned char emulti)
+void PacketProcessor::Decode(const char *data, std::size_t length, char *out) const
 {
-	std::string newstr;
-	int length = str.length();
-	std::string buffer;
-	unsigned char c;
+	PacketProcessor::Decode(data, length, out, this->emulti_d);
+}
 
-	if (emulti == 0)
+void PacketProcessor::Decode(const char *data, std::size_t length, char *out, unsigned char emulti_d)
+{
+	if (emulti_d == 0 || length < 2 || ((unsigned char)data[0] == PACKET_A_INIT && (unsigned char)data[1] == PACKET_F_INIT))
 	{
-		return str;
+		std::copy(data, data + length, out);
+		return;
 	}
 
-	newstr.reserve(length);
+	unsigned char *uout = reinterpret_cast<unsigned char *>(out);
+
+	packet_get_kernel(PacketProcessor::ActiveKernel()).deinterleave(reinterpret_cast<const unsigned char *>(data), uout, length);
 
-	for (int i = 0; i < length; ++i)
+	// The family and action only have their high bit flipped
+	for (int i = 0; i < 2; ++i)
 	{
-		c = str[i];
+		if ((uout[i] & 0x7F) == 0)
+			uout[i] ^= 0x80;
+	}
 
-		if (c % emulti == 0)
-		{
-			buffer += c;
-		}
+	PacketProcessor::DickWinder(out, length, emulti_d);
+}
+
+std::string PacketProcessor::Encode(const std::string &rawstr)
+{
+	std::string newstr(rawstr.length(), char());
+
+	if (!newstr.empty())
+		this->Encode(rawstr.data(), rawstr.length(), {{{&newstr[0], newstr.length()}, {nullptr, 0}}});
+
+	return newstr;
+}
+
+void PacketProcessor::Encode(const char *rawstr, std::size_t length, const util::RingBuffer::Segments &out) const
+{
+	PacketProcessor::Encode(rawstr, length, out, this->emulti_e);
+}
+
+void PacketProcessor::Encode(const char *rawstr, std::size_t length, const util::RingBuffer::Segments &out, unsigned char emulti_e)
+{
+	const std::size_t split = out[0].length;
+
+	auto put = [&](std::size_t pos, unsigned char c)
+	{
+		if (pos < split)
+			out[0].data[pos] = c;
 		else
-		{
-			if (buffer.length() > 0)
-			{
-				std::reverse(buffer.begin(), buffer.end());
-				newstr += buffer;
-				buffer.clear();
-			}
-			newstr += c;
-		}
+			out[1].data[pos - split] = c;
+	};
+
+	if (emulti_e == 0 || length < 4 || ((unsigned char)rawstr[2] == PACKET_A_INIT && (unsigned char)rawstr[3] == PACKET_F_INIT))
+	{
+		const std::size_t first = std::min(split, length);
+
+		std::copy(rawstr, rawstr + first, out[0].data);
+		std::copy(rawstr + first, rawstr + length, out[1].data);
+
+		return;
 	}
 
-	if (buffer.length() > 0)
+	const packet_layout layout(length - 2);
+
+	// Where raw byte ii ends up, ignoring the length bytes at the start
+	auto emit = [&](std::size_t ii, unsigned char c)
+	{
+		if (ii < 2)
+			put(ii, c);
+		else if (ii - 2 < layout.evens)
+			put(2 + (ii - 2) * 2, packet_flip(c));
+		else
+			put(2 + layout.last_odd - (ii - 2 - layout.evens) * 2, packet_flip(c));
+	};
+
+	if (split >= length)
 	{
-		std::reverse(buffer.begin(), buffer.end());
-		newstr += buffer;
+		unsigned char *dst = reinterpret_cast<unsigned char *>(out[0].data);
+
+		dst[0] = rawstr[0];
+		dst[1] = rawstr[1];
+
+		packet_get_kernel(PacketProcessor::ActiveKernel()).interleave(reinterpret_cast<const unsigned char *>(rawstr) + 2, dst + 2, length - 2);
+	}
+	else
+	{
+		// Output wrapping around the end of a ring buffer is rare enough to place byte by byte
+		for (std::size_t ii = 0; ii < length; ++ii)
+			emit(ii, rawstr[ii]);
 	}
 
+	// DickWinder reverses runs of bytes divisible by emulti_e, which only moves the bytes within those runs
+	packet_for_each_run(rawstr, length, emulti_e, [&](std::size_t start, std::size_t end)
+	{
+		for (std::size_t ii = start; ii < end; ++ii)
+			emit(start + (end - 1 - ii), rawstr[ii]);
+	});
+}
+
+std::string PacketProcessor::DickWinder(const std::string &str, unsigned char emulti)
+{
+	std::string newstr(str);
+
+	if (!newstr.empty())
+		PacketProcessor::DickWinder(&newstr[0], newstr.length(), emulti);
+
 	return newstr;
 }
 
+void PacketProcessor::DickWinder(char *data, std::size_t length, unsigned char emulti)
+{
+	if (emulti == 0)
+		return;
+
+	packet_for_each_run(data, length, emulti, [data](std::size_t start, std::size_t end)
+	{
+		std::reverse(data + start, data + end);
+	});
+}
+
 std::string PacketProcessor::DickWinderE(const std::string &str)
 {
 	return PacketProcessor::DickWinder(str, this->emulti_e);
@@ -364,9 +661,9 @@ std::array<unsigned char, 2> PacketProcessor::EPID(unsigned short pid)
 	return b;
 }
 
-PacketReader::PacketReader(const std::string &data)
+PacketReader::PacketReader(util::string_view data, std::size_t pos)
 	: data(data)
-	, pos(2)
+	, pos(std::min(pos, data.length()))
 { }
 
 std::size_t PacketReader::Length() const
@@ -400,7 +697,7 @@ unsigned int PacketReader::GetNumber(std::size_t length)
 	std::array<unsigned char, 4> bytes{{254, 254, 254, 254}};
 
 	size_t read_len = std::min(length, this->Remaining());
-	std::copy_n(util::cbegin(this->data) + this->pos, read_len, util::begin(bytes));
+	std::copy_n(this->data.begin() + this->pos, read_len, util::begin(bytes));
 
 	this->pos += read_len;
 
@@ -438,40 +735,117 @@ unsigned int PacketReader::GetInt()
 	return GetNumber(4);
 }
 
-std::string PacketReader::GetFixedString(std::size_t length)
+util::string_view PacketReader::GetFixedStringView(std::size_t length)
 {
 	if (this->Remaining() < length)
-		return "";
+		return util::string_view();
 
-	std::string ret = this->data.substr(this->pos, length);
+	util::string_view ret = this->data.substr(this->pos, length);
 	this->pos += ret.length();
 
 	return ret;
 }
 
-std::string PacketReader::GetBreakString(unsigned char breakchar)
+util::string_view PacketReader::GetBreakStringView(unsigned char breakchar)
 {
-	std::string ret = GetFixedString(this->data.find_first_of(breakchar, this->pos) - this->pos);
+	util::string_view ret = GetFixedStringView(this->data.find(char(breakchar), this->pos) - this->pos);
 	++this->pos;
 	return ret;
 }
 
+util::string_view PacketReader::GetEndStringView()
+{
+	return GetFixedStringView(this->Remaining());
+}
+
+std::string PacketReader::GetFixedString(std::size_t length)
+{
+	return this->GetFixedStringView(length).to_string();
+}
+
+std::string PacketReader::GetBreakString(unsigned char breakchar)
+{
+	return this->GetBreakStringView(breakchar).to_string();
+}
+
 std::string PacketReader::GetEndString()
 {
-	return GetFixedString(this->Remaining());
+	return this->GetEndStringView().to_string();
 }
 
-PacketReader::~PacketReader()
+// Buffers of destroyed PacketBuilders, so that building a packet doesn't need an allocation in steady state
+static thread_local std::vector<std::string> packet_buffer_pool;
+
+static const std::size_t packet_buffer_pool_size = 64;
+
+// Buffers grown past this by something like a large list reply are freed rather than hoarded
+static const std::size_t packet_buffer_max_capacity = 4096;
+
+static std::string packet_acquire_buffer(std::size_t capacity)
 {
-	std::fill(UTIL_RANGE(this->data), '\0');
+	std::string buffer;
+
+	if (!packet_buffer_pool.empty())
+	{
+		buffer.swap(packet_buffer_pool.back());
+		packet_buffer_pool.pop_back();
+	}
+
+	buffer.reserve(capacity);
+	return buffer;
+}
+
+static void packet_release_buffer(std::string &buffer)
+{
+	std::fill(UTIL_RANGE(buffer), '\0');
+
+	if (buffer.capacity() <= packet_buffer_max_capacity && packet_buffer_pool.size() < packet_buffer_pool_size)
+	{
+		buffer.clear();
+		packet_buffer_pool.push_back(std::move(buffer));
+	}
 }
 
 PacketBuilder::PacketBuilder(PacketFamily family, PacketAction action, std::size_t size_guess)
-	: add_size(0)
+	: data(packet_acquire_buffer(PacketBuilder::HeaderSize + size_guess))
+	, add_size(0)
 {
 	this->SetID(family, action);
 
-	this->data.reserve(size_guess);
+	this->data.assign(PacketBuilder::HeaderSize, char());
+}
+
+PacketBuilder::PacketBuilder(const PacketBuilder &other)
+	: id(other.id)
+	, data(packet_acquire_buffer(other.data.length()))
+	, add_size(other.add_size)
+{
+	this->data.assign(other.data);
+}
+
+PacketBuilder::PacketBuilder(PacketBuilder &&other) noexcept
+	: id(other.id)
+	, add_size(other.add_size)
+{
+	this->data.swap(other.data);
+	other.data.assign(PacketBuilder::HeaderSize, char());
+	other.add_size = 0;
+}
+
+PacketBuilder &PacketBuilder::operator =(const PacketBuilder &other)
+{
+	this->id = other.id;
+	this->data.assign(other.data);
+	this->add_size = other.add_size;
+	return *this;
+}
+
+PacketBuilder &PacketBuilder::operator =(PacketBuilder &&other) noexcept
+{
+	this->id = other.id;
+	this->data.swap(other.data);
+	this->add_size = other.add_size;
+	return *this;
 }
 
 unsigned short PacketBuilder::SetID(unsigned short id)
@@ -498,12 +872,12 @@ unsigned short PacketBuilder::GetID() const
 
 std::size_t PacketBuilder::Length() const
 {
-	return this->data.length();
+	return this->data.length() - PacketBuilder::HeaderSize;
 }
 
 std::size_t PacketBuilder::Capacity() const
 {
-	return this->data.capacity();
+	return this->data.capacity() - PacketBuilder::HeaderSize;
 }
 
 void PacketBuilder::ReserveMore(std::size_t size_guess)
@@ -511,7 +885,7 @@ void PacketBuilder::ReserveMore(std::size_t size_guess)
 	size_guess += this->Length();
 
 	if (size_guess > this->Capacity())
-		this->data.reserve(size_guess);
+		this->data.reserve(PacketBuilder::HeaderSize + size_guess);
 }
 
 #ifdef DEBUG
@@ -537,7 +911,7 @@ PacketBuilder &PacketBuilder::AddByte(unsigned char byte)
 	this->data += byte;
 
 #ifdef DEBUG
-	if (this->data.length() > capacity_before)
+	if (this->Length() > capacity_before)
 		debug_packetbuilder_overflow(this, capacity_before);
 #endif
 
@@ -553,7 +927,7 @@ PacketBuilder &PacketBuilder::AddChar(unsigned char num)
 	this->data += PacketProcessor::ENumber(num)[0];
 
 #ifdef DEBUG
-	if (this->data.length() > capacity_before)
+	if (this->Length() > capacity_before)
 		debug_packetbuilder_overflow(this, capacity_before);
 #endif
 
@@ -569,7 +943,7 @@ PacketBuilder &PacketBuilder::AddShort(unsigned short num)
 	this->data.append((char *)PacketProcessor::ENumber(num).data(), 2);
 
 #ifdef DEBUG
-	if (this->data.length() > capacity_before)
+	if (this->Length() > capacity_before)
 		debug_packetbuilder_overflow(this, capacity_before);
 #endif
 
@@ -585,7 +959,7 @@ PacketBuilder &PacketBuilder::AddThree(unsigned int num)
 	this->data.append((char *)PacketProcessor::ENumber(num).data(), 3);
 
 #ifdef DEBUG
-	if (this->data.length() > capacity_before)
+	if (this->Length() > capacity_before)
 		debug_packetbuilder_overflow(this, capacity_before);
 #endif
 
@@ -601,7 +975,7 @@ PacketBuilder &PacketBuilder::AddInt(unsigned int num)
 	this->data.append((char *)PacketProcessor::ENumber(num).data(), 4);
 
 #ifdef DEBUG
-	if (this->data.length() > capacity_before)
+	if (this->Length() > capacity_before)
 		debug_packetbuilder_overflow(this, capacity_before);
 #endif
 
@@ -622,43 +996,38 @@ PacketBuilder &PacketBuilder::AddVar(int min, int max, unsigned int num)
 	return *this;
 }
 
-PacketBuilder &PacketBuilder::AddString(const std::string &str)
+PacketBuilder &PacketBuilder::AddString(util::string_view str)
 {
 #ifdef DEBUG
 	std::size_t capacity_before = this->Capacity();
 #endif
 
-	this->data += str;
+	this->data.append(str.data(), str.length());
 
 #ifdef DEBUG
-	if (this->data.length() > capacity_before)
+	if (this->Length() > capacity_before)
 		debug_packetbuilder_overflow(this, capacity_before);
 #endif
 
 	return *this;
 }
 
-PacketBuilder &PacketBuilder::AddBreakString(const std::string &str, unsigned char breakchar)
+PacketBuilder &PacketBuilder::AddBreakString(util::string_view str, unsigned char breakchar)
 {
 #ifdef DEBUG
 	std::size_t capacity_before = this->Capacity();
 #endif
 
-	std::string tempstr(str);
-	std::size_t breakin = tempstr.find_first_of(breakchar);
+	std::size_t start = this->data.length();
+	this->data.append(str.data(), str.length());
 
-	while (breakin != std::string::npos)
-	{
-		tempstr[breakin] = 'y';
-		breakin = tempstr.find_first_of(breakchar, breakin+1);
-	}
+	// Break characters in the string itself would cut it short
+	std::replace(this->data.begin() + start, this->data.end(), char(breakchar), 'y');
 
-	this->data += tempstr;
 	this->data += breakchar;
 
-
 #ifdef DEBUG
-	if (this->data.length() > capacity_before)
+	if (this->Length() > capacity_before)
 		debug_packetbuilder_overflow(this, capacity_before);
 #endif
 
@@ -672,24 +1041,27 @@ void PacketBuilder::AddSize(std::size_t size)
 
 void PacketBuilder::Reset(std::size_t size_guess)
 {
-	this->data.erase();
-	this->data.reserve(size_guess);
+	std::fill(UTIL_RANGE(this->data), '\0');
+	this->data.resize(PacketBuilder::HeaderSize);
+	this->data.reserve(PacketBuilder::HeaderSize + size_guess);
 }
 
-std::string PacketBuilder::Get() const
+util::string_view PacketBuilder::Raw() const
 {
-	std::string retdata;
-	retdata.reserve(4 + this->data.length());
 	std::array<unsigned char, 2> id = PacketProcessor::EPID(this->id);
-	std::array<unsigned char, 4> length = PacketProcessor::ENumber(this->data.length() + 2 + this->add_size);
+	std::array<unsigned char, 4> length = PacketProcessor::ENumber(this->Length() + 2 + this->add_size);
+
+	this->data[0] = length[0];
+	this->data[1] = length[1];
+	this->data[2] = id[0];
+	this->data[3] = id[1];
 
-	retdata += length[0];
-	retdata += length[1];
-	retdata += id[0];
-	retdata += id[1];
-	retdata += this->data;
+	return this->data;
+}
 
-	return retdata;
+std::string PacketBuilder::Get() const
+{
+	return this->Raw().to_string();
 }
 
 PacketBuilder::operator std::string() const
@@ -699,10 +1071,16 @@ PacketBuilder::operator std::string() const
 
 bool PacketBuilder::operator==(const PacketBuilder& rhs) const
 {
-	return this->Get() == rhs.Get();
+	return this->Raw() == rhs.Raw();
 }
 
 PacketBuilder::~PacketBuilder()
 {
-	std::fill(UTIL_RANGE(this->data), '\0');
+	packet_release_buffer(this->data);
 }
+
+SharedPacket::SharedPacket(const PacketBuilder &builder)
+	: data(std::make_shared<const std::string>(builder.Get()))
+	, id(builder.GetID())
+	, length(builder.Length())
+{ }
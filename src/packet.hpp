@@ -9,8 +9,13 @@
 
 #include "fwd/packet.hpp"
 
+#include "util/ringbuffer.hpp"
+#include "util/string_view.hpp"
+
 #include <array>
+#include <atomic>
 #include <cstddef>
+#include <memory>
 #include <string>
 
 /**
@@ -22,13 +27,14 @@ class PacketProcessor
 	protected:
 		/**
 		 * "EMulti" variable for Encoding.
+		 * Atomic as packets may be encoded and decoded on a network thread (see NetThread).
 		 */
-		unsigned char emulti_e;
+		std::atomic<unsigned char> emulti_e;
 
 		/**
 		 * "EMulti" variable for Decoding.
 		 */
-		unsigned char emulti_d;
+		std::atomic<unsigned char> emulti_d;
 
 	public:
 		/**
@@ -58,14 +64,55 @@ class PacketProcessor
 		 */
 		static std::string GetActionName(PacketAction action);
 
+		/**
+		 * Instruction sets the encoding kernels can use.
+		 */
+		enum class Kernel
+		{
+			Scalar,
+			SSE2,
+			AVX2
+		};
+
+		/**
+		 * Kernel used by Encode and Decode, the best one the CPU supports unless changed with SetKernel.
+		 */
+		static Kernel ActiveKernel();
+
+		/**
+		 * Switches the kernel used by every PacketProcessor, mainly for testing and benchmarking.
+		 * @return false (and changes nothing) if the CPU or build does not support it
+		 */
+		static bool SetKernel(Kernel kernel);
+
 		std::string Decode(const std::string &);
 		std::string Encode(const std::string &);
+
+		/**
+		 * Decodes a packet (without its length bytes) in to out without allocating.
+		 * out must have room for length bytes and must not overlap data.
+		 */
+		void Decode(const char *data, std::size_t length, char *out) const;
+		static void Decode(const char *data, std::size_t length, char *out, unsigned char emulti_d);
+
+		/**
+		 * Encodes a raw packet directly in to a pair of output regions without any intermediate copies.
+		 * The output regions must have room for length bytes in total.
+		 */
+		void Encode(const char *raw, std::size_t length, const util::RingBuffer::Segments &out) const;
+		static void Encode(const char *raw, std::size_t length, const util::RingBuffer::Segments &out, unsigned char emulti_e);
+
 		static std::string DickWinder(const std::string &, unsigned char emulti);
+
+		/**
+		 * Reverses each run of bytes divisible by emulti, in place.
+		 */
+		static void DickWinder(char *data, std::size_t length, unsigned char emulti);
 		std::string DickWinderE(const std::string &);
 		std::string DickWinderD(const std::string &);
 
 		void SetEMulti(unsigned char emulti_e, unsigned char emulti_d);
-		std::pair<unsigned char, unsigned char> GetEMulti() const { return std::make_pair(this->emulti_e, this->emulti_d); }
+		std::pair<unsigned char, unsigned char> GetEMulti() const { return std::make_pair(this->emulti_e.load(), this->emulti_d.load()); }
 
 		static unsigned int Number(unsigned char, unsigned char = 254, unsigned char = 254, unsigned char = 254);
 		static std::array<unsigned char, 4> ENumber(unsigned int);
@@ -75,17 +122,35 @@ class PacketProcessor
 		static std::array<unsigned char, 2> EPID(unsigned short id);
 };
 
+/**
+ * Reads values out of a decoded packet without copying it.
+ * The packet data is only referenced, so it must outlive the reader.
+ */
 class PacketReader
 {
 	protected:
-		std::string data;
+		util::string_view data;
 		std::size_t pos;
 
 	public:
-		PacketReader(const std::string &);
+		/**
+		 * @param pos Read position, by default just past the family/action bytes
+		 */
+		PacketReader(util::string_view data, std::size_t pos = 2);
+
+		/**
+		 * A reader of a temporary string would be left dangling.
+		 */
+		PacketReader(std::string &&, std::size_t pos = 2) = delete;
 
 		std::size_t Length() const;
 		std::size_t Remaining() const;
+		std::size_t Position() const { return this->pos; }
+
+		/**
+		 * The whole packet the reader refers to.
+		 */
+		util::string_view Data() const { return this->data; }
 
 		PacketAction Action() const;
 		PacketFamily Family() const;
@@ -98,23 +163,44 @@ class PacketReader
 		unsigned int GetThree();
 		unsigned int GetInt();
 
+		/**
+		 * Views in to the packet data, valid for as long as the packet data is.
+		 */
+		util::string_view GetFixedStringView(std::size_t length);
+		util::string_view GetBreakStringView(unsigned char breakchar = 0xFF);
+		util::string_view GetEndStringView();
+
 		std::string GetFixedString(std::size_t length);
 		std::string GetBreakString(unsigned char breakchar = 0xFF);
 		std::string GetEndString();
-
-		~PacketReader();
 };
 
+/**
+ * Builds a packet in place behind space reserved for its header, so it can be sent without being copied.
+ * Buffers are recycled through a per-thread pool when the builder is destroyed.
+ */
 class PacketBuilder
 {
 	protected:
 		unsigned short id;
-		std::string data;
+
+		/**
+		 * Packet data preceded by HeaderSize bytes filled in by Raw.
+		 */
+		mutable std::string data;
+
 		std::size_t add_size;
 
 	public:
+		static const std::size_t HeaderSize = 4;
+
 		PacketBuilder(PacketFamily family = PACKET_F_INIT, PacketAction action = PACKET_A_INIT, std::size_t size_guess = 0);
 
+		PacketBuilder(const PacketBuilder &);
+		PacketBuilder(PacketBuilder &&) noexcept;
+		PacketBuilder &operator =(const PacketBuilder &);
+		PacketBuilder &operator =(PacketBuilder &&) noexcept;
+
 		unsigned short SetID(unsigned short id);
 		unsigned short SetID(PacketFamily family, PacketAction action);
 
@@ -132,13 +218,21 @@ class PacketBuilder
 		PacketBuilder &AddInt(unsigned int);
 		PacketBuilder &AddVar(int min, int max, unsigned int);
 
-		PacketBuilder &AddString(const std::string &);
-		PacketBuilder &AddBreakString(const std::string &, unsigned char breakchar = 0xFF);
+		PacketBuilder &AddString(util::string_view);
+		PacketBuilder &AddBreakString(util::string_view, unsigned char breakchar = 0xFF);
 
 		void AddSize(std::size_t size);
 
 		void Reset(std::size_t size_guess = 0);
 
+		/**
+		 * Raw packet data including the length and ID header, valid until the builder is next modified.
+		 */
+		util::string_view Raw() const;
+
+		/**
+		 * Copy of Raw.
+		 */
 		std::string Get() const;
 
 		operator std::string() const;
@@ -147,4 +241,36 @@ class PacketBuilder
 		~PacketBuilder();
 };
 
+/**
+ * An immutable serialized packet which can be sent to any number of clients.
+ * The payload is only built once, each client applies its own encoding while copying it to its send buffer.
+ */
+class SharedPacket
+{
+	protected:
+		std::shared_ptr<const std::string> data;
+		unsigned short id;
+		std::size_t length;
+
+	public:
+		explicit SharedPacket(const PacketBuilder &);
+
+		unsigned short GetID() const { return this->id; }
+
+		/**
+		 * Length of the payload, as returned by PacketBuilder::Length.
+		 */
+		std::size_t Length() const { return this->length; }
+
+		/**
+		 * Raw packet data including the length and ID header.
+		 */
+		const std::string &Get() const { return *this->data; }
+
+		/**
+		 * The shared raw packet data, for holding on to after the SharedPacket is gone.
+		 */
+		const std::shared_ptr<const std::string> &Data() const { return this->data; }
+};
+
 #endif // PACKET_HPP_INCLUDED
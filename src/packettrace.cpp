@@ -0,0 +1,337 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#include "packettrace.hpp"
+
+#include "packet.hpp"
+
+#include "console.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+
+const char PacketTrace::Magic[8] = {'E', 'O', 'T', 'R', 'A', 'C', 'E', '\x01'};
+
+// Enough for several seconds of busy traffic between writer passes
+static const std::size_t packet_trace_queue_size = 16384;
+
+static const std::chrono::milliseconds packet_trace_interval(100);
+
+static const char *packet_trace_direction_name(PacketTrace::Direction direction)
+{
+	switch (direction)
+	{
+		case PacketTrace::Recv: return "RECV";
+		case PacketTrace::Send: return "SEND";
+		case PacketTrace::Upload: return "UPLD";
+		default: return "????";
+	}
+}
+
+// Clears the bits of every pair named in the ignore list
+static void packet_trace_apply_ignore(std::array<std::uint64_t, 65536 / 64> &bits, const std::string &ignore)
+{
+	std::array<std::string, 256> family_names;
+	std::array<std::string, 256> action_names;
+
+	for (int i = 0; i < 256; ++i)
+	{
+		family_names[i] = util::lowercase(PacketProcessor::GetFamilyName(PacketFamily(i)));
+		action_names[i] = util::lowercase(PacketProcessor::GetActionName(PacketAction(i)));
+	}
+
+	auto clear = [&bits](int family, int action)
+	{
+		std::size_t i = (std::size_t(family) << 8) | std::size_t(action);
+		bits[i >> 6] &= ~(std::uint64_t(1) << (i & 63));
+	};
+
+	std::size_t pos = 0;
+
+	while (pos < ignore.length())
+	{
+		std::size_t end = ignore.find_first_of(" \t,;", pos);
+
+		if (end == std::string::npos)
+			end = ignore.length();
+
+		std::string token = util::lowercase(ignore.substr(pos, end - pos));
+		pos = end + 1;
+
+		if (token.empty())
+			continue;
+
+		std::size_t colon = token.find(':');
+		std::string family = token.substr(0, colon);
+		std::string action = (colon == std::string::npos) ? std::string() : token.substr(colon + 1);
+		bool found = false;
+
+		for (int f = 0; f < 256; ++f)
+		{
+			if (family_names[f] != family)
+				continue;
+
+			for (int a = 0; a < 256; ++a)
+			{
+				if (action.empty() || action_names[a] == action)
+				{
+					clear(f, a);
+					found = true;
+				}
+			}
+		}
+
+		if (!found)
+			Console::Wrn("Unknown packet in IgnorePacketFamilies: %s", token.c_str());
+	}
+}
+
+PacketTrace::PacketTrace()
+	: records(packet_trace_queue_size)
+	, dropped(0)
+	, file(nullptr)
+	, active(false)
+	, dropped_reported(0)
+	, stopping(false)
+{
+	for (std::atomic<std::uint64_t> &word : this->mask)
+		word.store(0, std::memory_order_relaxed);
+}
+
+void PacketTrace::Configure(const std::string &ignore, const std::string &filename)
+{
+	std::array<std::uint64_t, 65536 / 64> bits;
+	bits.fill(0);
+
+#ifndef NO_PACKET_TRACE
+	if (ignore != "*")
+	{
+		bits.fill(~std::uint64_t(0));
+		packet_trace_apply_ignore(bits, ignore);
+	}
+#endif // NO_PACKET_TRACE
+
+	bool active = std::any_of(UTIL_RANGE(bits), [](std::uint64_t word) { return word != 0; });
+
+	{
+		std::lock_guard<std::mutex> lock(this->output_mutex);
+
+		// Records traced under the old settings go to the old output
+		this->Drain();
+
+		if (this->file)
+		{
+			std::fclose(this->file);
+			this->file = nullptr;
+		}
+
+		if (active && !filename.empty())
+		{
+			this->file = std::fopen(filename.c_str(), "ab");
+
+			if (!this->file)
+			{
+				Console::Err("Could not open packet trace file: %s", filename.c_str());
+				bits.fill(0);
+				active = false;
+			}
+			else if (std::ftell(this->file) == 0)
+			{
+				std::fwrite(PacketTrace::Magic, 1, sizeof PacketTrace::Magic, this->file);
+			}
+		}
+
+		this->active = active;
+	}
+
+	for (std::size_t i = 0; i < bits.size(); ++i)
+		this->mask[i].store(bits[i], std::memory_order_relaxed);
+
+	if (active && !this->writer.joinable())
+		this->writer = std::thread([this]() { this->Run(); });
+}
+
+void PacketTrace::Trace(unsigned int client, PacketFamily family, PacketAction action, std::size_t length, Direction direction, const char *name)
+{
+	Record record;
+	record.time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	record.client = client;
+	record.length = std::uint32_t(length);
+	record.family = family;
+	record.action = action;
+	record.direction = direction;
+	record.name.fill('\0');
+
+	if (name)
+		std::strncpy(record.name.data(), name, record.name.size() - 1);
+
+	if (!this->records.TryPush(record))
+		this->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PacketTrace::Run()
+{
+	std::unique_lock<std::mutex> wake_lock(this->wake_mutex);
+
+	while (!this->stopping)
+	{
+		this->wake.wait_for(wake_lock, packet_trace_interval);
+
+		std::lock_guard<std::mutex> lock(this->output_mutex);
+		this->Drain();
+	}
+}
+
+void PacketTrace::Drain()
+{
+	Record record;
+	bool wrote = false;
+
+	while (this->records.TryPop(record))
+	{
+		if (this->active)
+		{
+			this->Write(record);
+			wrote = true;
+		}
+	}
+
+	if (wrote && this->file)
+		std::fflush(this->file);
+
+	std::size_t dropped = this->dropped.load(std::memory_order_relaxed);
+
+	if (dropped != this->dropped_reported)
+	{
+		Console::Wrn("Packet trace could not keep up, %i records were lost", int(dropped - this->dropped_reported));
+		this->dropped_reported = dropped;
+	}
+}
+
+void PacketTrace::Write(const Record &record)
+{
+	if (this->file)
+	{
+		unsigned char buffer[PacketTrace::RecordSize];
+		PacketTrace::EncodeRecord(record, buffer);
+		std::fwrite(buffer, 1, sizeof buffer, this->file);
+	}
+	else
+	{
+		Console::Out("%s", PacketTrace::Format(record).c_str());
+	}
+}
+
+void PacketTrace::Flush()
+{
+	std::lock_guard<std::mutex> lock(this->output_mutex);
+	this->Drain();
+}
+
+void PacketTrace::EncodeRecord(const Record &record, unsigned char *out)
+{
+	for (int i = 0; i < 8; ++i)
+		out[i] = (unsigned char)(record.time >> (i * 8));
+
+	for (int i = 0; i < 4; ++i)
+	{
+		out[8 + i] = (unsigned char)(record.client >> (i * 8));
+		out[12 + i] = (unsigned char)(record.length >> (i * 8));
+	}
+
+	out[16] = record.family;
+	out[17] = record.action;
+	out[18] = record.direction;
+	std::memcpy(out + 19, record.name.data(), record.name.size());
+}
+
+PacketTrace::Record PacketTrace::DecodeRecord(const unsigned char *in)
+{
+	Record record{};
+
+	for (int i = 0; i < 8; ++i)
+		record.time |= std::uint64_t(in[i]) << (i * 8);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		record.client |= std::uint32_t(in[8 + i]) << (i * 8);
+		record.length |= std::uint32_t(in[12 + i]) << (i * 8);
+	}
+
+	record.family = PacketFamily(in[16]);
+	record.action = PacketAction(in[17]);
+	record.direction = Direction(in[18]);
+	std::memcpy(record.name.data(), in + 19, record.name.size());
+	record.name.back() = '\0';
+
+	return record;
+}
+
+std::string PacketTrace::Format(const Record &record)
+{
+	std::time_t rawtime = std::time_t(record.time / 1000000);
+	const std::tm *timeinfo = std::localtime(&rawtime);
+
+	std::string family = PacketProcessor::GetFamilyName(record.family);
+	std::string action = PacketProcessor::GetActionName(record.action);
+
+	char buffer[160];
+	std::snprintf(buffer, sizeof buffer, "%02d/%02d/%04d - %02d:%02d:%02d | %-12s | %4s Family: %-15s | Action: %-15s | SIZE=%u",
+		timeinfo->tm_mon + 1,
+		timeinfo->tm_mday,
+		timeinfo->tm_year + 1900,
+		timeinfo->tm_hour,
+		timeinfo->tm_min,
+		timeinfo->tm_sec,
+		record.name[0] ? record.name.data() : "no char",
+		packet_trace_direction_name(record.direction),
+		family.c_str(),
+		action.c_str(),
+		unsigned(record.length));
+
+	return buffer;
+}
+
+bool PacketTrace::Dump(std::FILE *in, std::FILE *out)
+{
+	char magic[sizeof PacketTrace::Magic];
+
+	if (std::fread(magic, 1, sizeof magic, in) != sizeof magic || std::memcmp(magic, PacketTrace::Magic, sizeof magic) != 0)
+		return false;
+
+	unsigned char buffer[PacketTrace::RecordSize];
+
+	while (std::fread(buffer, 1, sizeof buffer, in) == sizeof buffer)
+		std::fprintf(out, "%s\n", PacketTrace::Format(PacketTrace::DecodeRecord(buffer)).c_str());
+
+	return true;
+}
+
+PacketTrace::~PacketTrace()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->wake_mutex);
+		this->stopping = true;
+	}
+
+	this->wake.notify_all();
+
+	if (this->writer.joinable())
+		this->writer.join();
+
+	std::lock_guard<std::mutex> lock(this->output_mutex);
+	this->Drain();
+
+	if (this->file)
+		std::fclose(this->file);
+}
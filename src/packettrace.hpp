@@ -0,0 +1,152 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef PACKETTRACE_HPP_INCLUDED
+#define PACKETTRACE_HPP_INCLUDED
+
+#include "fwd/packettrace.hpp"
+
+#include "fwd/packet.hpp"
+
+#include "util/boundedqueue.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Records packets sent and received by clients, either to the console or to a binary trace file.
+ * Whether a family/action pair is traced is a single bit lookup, so tracing costs one load per packet while it is off.
+ * Records are passed through a lock-free queue to a background thread which does the formatting and writing.
+ * Building with NO_PACKET_TRACE defined (EOSERV_PACKET_TRACE=OFF) compiles tracing out entirely.
+ */
+class PacketTrace
+{
+	public:
+		enum Direction : unsigned char
+		{
+			Recv,
+			Send,
+			Upload
+		};
+
+		/**
+		 * A traced packet. Trace files are the Magic bytes followed by records of RecordSize little-endian bytes each.
+		 */
+		struct Record
+		{
+			/**
+			 * Microseconds since the epoch.
+			 */
+			std::uint64_t time;
+
+			std::uint32_t client;
+			std::uint32_t length;
+			PacketFamily family;
+			PacketAction action;
+			Direction direction;
+
+			/**
+			 * Name of the client's character, NUL padded.
+			 */
+			std::array<char, 13> name;
+		};
+
+		static const std::size_t RecordSize = 32;
+		static const char Magic[8];
+
+	protected:
+		/**
+		 * One bit per family/action pair, indexed by family * 256 + action.
+		 */
+		std::array<std::atomic<std::uint64_t>, 65536 / 64> mask;
+
+		util::BoundedQueue<Record> records;
+		std::atomic<std::size_t> dropped;
+
+		/**
+		 * Guards the output, which is only written by the writer thread and by Configure.
+		 */
+		std::mutex output_mutex;
+		std::FILE *file;
+		bool active;
+		std::size_t dropped_reported;
+
+		std::mutex wake_mutex;
+		std::condition_variable wake;
+		bool stopping;
+		std::thread writer;
+
+		void Run();
+
+		/**
+		 * Writes out everything queued so far. output_mutex must be held.
+		 */
+		void Drain();
+
+		void Write(const Record &record);
+
+	public:
+		PacketTrace();
+
+		/**
+		 * Sets which packets are traced and where they go, may be called again on rehash.
+		 * @param ignore Families ("Walk") or family:action pairs ("Walk:Player") to leave out, separated by spaces or commas. "*" turns tracing off.
+		 * @param filename Binary trace file to append to, or empty to print to the console
+		 */
+		void Configure(const std::string &ignore, const std::string &filename);
+
+		bool Enabled(PacketFamily family, PacketAction action) const
+		{
+#ifdef NO_PACKET_TRACE
+			(void)family;
+			(void)action;
+			return false;
+#else // NO_PACKET_TRACE
+			std::size_t i = (std::size_t(family) << 8) | std::size_t(action);
+			return (this->mask[i >> 6].load(std::memory_order_relaxed) >> (i & 63)) & 1;
+#endif // NO_PACKET_TRACE
+		}
+
+		/**
+		 * Queues a record of a packet, callers should check Enabled first. Safe to call from any thread.
+		 * @param name Character name, may be null
+		 */
+		void Trace(unsigned int client, PacketFamily family, PacketAction action, std::size_t length, Direction direction, const char *name);
+
+		/**
+		 * Waits until everything traced so far has been written out.
+		 */
+		void Flush();
+
+		/**
+		 * Number of records lost because the writer thread could not keep up.
+		 */
+		std::size_t Dropped() const { return this->dropped.load(std::memory_order_relaxed); }
+
+		static void EncodeRecord(const Record &record, unsigned char *out);
+		static Record DecodeRecord(const unsigned char *in);
+
+		/**
+		 * Formats a record the way it is printed to the console.
+		 */
+		static std::string Format(const Record &record);
+
+		/**
+		 * Prints a binary trace file in the console format, for the --decode-trace command line option.
+		 * @return false if the input is not a trace file
+		 */
+		static bool Dump(std::FILE *in, std::FILE *out);
+
+		~PacketTrace();
+};
+
+#endif // PACKETTRACE_HPP_INCLUDED
@@ -0,0 +1,339 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#include "pathfinder.hpp"
+
+#include "character.hpp"
+
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+const unsigned short Pathfinder::Unreachable;
+const int Pathfinder::OccupiedRange;
+const int Pathfinder::FailedRetry;
+
+static const Direction pathfinder_directions[4] = {DIRECTION_DOWN, DIRECTION_LEFT, DIRECTION_UP, DIRECTION_RIGHT};
+
+static void pathfinder_offset(Direction direction, int &dx, int &dy)
+{
+	dx = 0;
+	dy = 0;
+
+	switch (direction)
+	{
+		case DIRECTION_DOWN: dy = 1; break;
+		case DIRECTION_LEFT: dx = -1; break;
+		case DIRECTION_UP: dy = -1; break;
+		case DIRECTION_RIGHT: dx = 1; break;
+	}
+}
+
+Pathfinder::Pathfinder()
+	: width(0)
+	, height(0)
+	, revision(1)
+	, visit_stamp(0)
+{ }
+
+void Pathfinder::Reset(int width, int height, const std::function<bool(int x, int y)> &walkable)
+{
+	this->width = width;
+	this->height = height;
+	++this->revision;
+
+	std::size_t tiles = std::size_t(width) * std::size_t(height);
+
+	this->walkable.assign((tiles + 63) / 64, 0);
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			if (walkable(x, y))
+			{
+				std::size_t i = std::size_t(y) * width + x;
+				this->walkable[i >> 6] |= std::uint64_t(1) << (i & 63);
+			}
+		}
+	}
+
+	this->fields.clear();
+
+	this->visited.assign(tiles, 0);
+	this->cost.assign(tiles, 0);
+	this->came_from.assign(tiles, DIRECTION_DOWN);
+	this->visit_stamp = 0;
+}
+
+void Pathfinder::SetWalkable(int x, int y, bool walkable)
+{
+	if (!this->InBounds(x, y) || this->Walkable(x, y) == walkable)
+		return;
+
+	std::size_t i = std::size_t(y) * this->width + x;
+	this->walkable[i >> 6] ^= std::uint64_t(1) << (i & 63);
+	++this->revision;
+}
+
+bool Pathfinder::Walkable(int x, int y) const
+{
+	if (!this->InBounds(x, y))
+		return false;
+
+	std::size_t i = std::size_t(y) * this->width + x;
+	return (this->walkable[i >> 6] >> (i & 63)) & 1;
+}
+
+bool Pathfinder::FindPath(int from_x, int from_y, int to_x, int to_y, int max_length, const OccupiedFunction &occupied, std::vector<Direction> &steps)
+{
+	steps.clear();
+
+	if (!this->InBounds(from_x, from_y) || !this->InBounds(to_x, to_y))
+		return false;
+
+	if (from_x == to_x && from_y == to_y)
+		return true;
+
+	if (util::path_length(from_x, from_y, to_x, to_y) > max_length)
+		return false;
+
+	// Stamps mark which tiles this search has visited, so nothing needs clearing in between
+	if (++this->visit_stamp == 0)
+	{
+		std::fill(UTIL_RANGE(this->visited), 0);
+		this->visit_stamp = 1;
+	}
+
+	// Best node first, breaking ties towards whichever has come furthest
+	auto worse = [](const Node &a, const Node &b)
+	{
+		return a.estimate > b.estimate || (a.estimate == b.estimate && a.cost < b.cost);
+	};
+
+	int start = from_y * this->width + from_x;
+	int goal = to_y * this->width + to_x;
+
+	this->open.clear();
+	this->visited[start] = this->visit_stamp;
+	this->cost[start] = 0;
+	this->open.push_back(Node{static_cast<unsigned short>(util::path_length(from_x, from_y, to_x, to_y)), 0, start});
+
+	while (!this->open.empty())
+	{
+		std::pop_heap(UTIL_RANGE(this->open), worse);
+		Node node = this->open.back();
+		this->open.pop_back();
+
+		// Superseded by a cheaper way to the same tile
+		if (node.cost != this->cost[node.index])
+			continue;
+
+		if (node.index == goal)
+		{
+			for (int i = goal; i != start; )
+			{
+				Direction direction = this->came_from[i];
+				int dx, dy;
+				pathfinder_offset(direction, dx, dy);
+
+				steps.push_back(direction);
+				i -= dy * this->width + dx;
+			}
+
+			return true;
+		}
+
+		int x = node.index % this->width;
+		int y = node.index / this->width;
+
+		for (Direction direction : pathfinder_directions)
+		{
+			int dx, dy;
+			pathfinder_offset(direction, dx, dy);
+
+			int next_x = x + dx;
+			int next_y = y + dy;
+
+			if (!this->InBounds(next_x, next_y))
+				continue;
+
+			int next = next_y * this->width + next_x;
+
+			if (next != goal)
+			{
+				if (!this->Walkable(next_x, next_y))
+					continue;
+
+				if (util::path_length(from_x, from_y, next_x, next_y) <= OccupiedRange && occupied && occupied(next_x, next_y))
+					continue;
+			}
+
+			unsigned short next_cost = node.cost + 1;
+			int estimate = next_cost + util::path_length(next_x, next_y, to_x, to_y);
+
+			if (estimate > max_length)
+				continue;
+
+			if (this->visited[next] == this->visit_stamp && this->cost[next] <= next_cost)
+				continue;
+
+			this->visited[next] = this->visit_stamp;
+			this->cost[next] = next_cost;
+			this->came_from[next] = direction;
+
+			this->open.push_back(Node{static_cast<unsigned short>(estimate), next_cost, next});
+			std::push_heap(UTIL_RANGE(this->open), worse);
+		}
+	}
+
+	return false;
+}
+
+bool Pathfinder::NextStep(Path &path, int from_x, int from_y, int to_x, int to_y, int max_length, const OccupiedFunction &occupied, Direction &direction)
+{
+	bool same = path.revision == this->revision
+	         && path.from_x == from_x && path.from_y == from_y
+	         && path.to_x == to_x && path.to_y == to_y;
+
+	if (same && !path.found && path.retry > 0)
+	{
+		--path.retry;
+		return false;
+	}
+
+	bool stale = !same || !path.found || path.steps.empty();
+
+	if (!stale)
+	{
+		int dx, dy;
+		pathfinder_offset(path.steps.back(), dx, dy);
+
+		int next_x = from_x + dx;
+		int next_y = from_y + dy;
+
+		stale = !(next_x == to_x && next_y == to_y) && occupied && occupied(next_x, next_y);
+	}
+
+	if (stale)
+	{
+		path.found = this->FindPath(from_x, from_y, to_x, to_y, max_length, occupied, path.steps) && !path.steps.empty();
+		path.revision = this->revision;
+		path.from_x = from_x;
+		path.from_y = from_y;
+		path.to_x = to_x;
+		path.to_y = to_y;
+
+		if (!path.found)
+		{
+			path.retry = FailedRetry;
+			return false;
+		}
+	}
+
+	direction = path.steps.back();
+	path.steps.pop_back();
+
+	// Assume the step is taken, callers clear the path if it is not
+	int dx, dy;
+	pathfinder_offset(direction, dx, dy);
+	path.from_x = from_x + dx;
+	path.from_y = from_y + dy;
+
+	return true;
+}
+
+const Pathfinder::FlowField &Pathfinder::Field(unsigned int id, int x, int y, int range)
+{
+	FlowField &field = this->fields[id];
+
+	if (field.revision == this->revision && field.target_x == x && field.target_y == y && field.range == range)
+		return field;
+
+	field.target_x = x;
+	field.target_y = y;
+	field.range = range;
+	field.revision = this->revision;
+
+	field.left = std::max(x - range, 0);
+	field.top = std::max(y - range, 0);
+	field.width = std::max(std::min(x + range + 1, this->width) - field.left, 0);
+	field.height = std::max(std::min(y + range + 1, this->height) - field.top, 0);
+	field.distance.assign(std::size_t(field.width) * field.height, Unreachable);
+
+	if (!this->InBounds(x, y))
+		return field;
+
+	// Breadth first out from the target, every step costs the same
+	this->queue.clear();
+	this->queue.push_back((y - field.top) * field.width + (x - field.left));
+	field.distance[this->queue.back()] = 0;
+
+	for (std::size_t i = 0; i < this->queue.size(); ++i)
+	{
+		int index = this->queue[i];
+		int local_x = index % field.width;
+		int local_y = index / field.width;
+		unsigned short next_distance = field.distance[index] + 1;
+
+		for (Direction direction : pathfinder_directions)
+		{
+			int dx, dy;
+			pathfinder_offset(direction, dx, dy);
+
+			int next_x = local_x + dx;
+			int next_y = local_y + dy;
+
+			if (next_x < 0 || next_y < 0 || next_x >= field.width || next_y >= field.height)
+				continue;
+
+			int next = next_y * field.width + next_x;
+
+			if (field.distance[next] != Unreachable || !this->Walkable(next_x + field.left, next_y + field.top))
+				continue;
+
+			field.distance[next] = next_distance;
+			this->queue.push_back(next);
+		}
+	}
+
+	return field;
+}
+
+bool Pathfinder::FlowStep(const FlowField &field, int x, int y, const OccupiedFunction &occupied, Direction &direction) const
+{
+	unsigned short best = field.At(x, y);
+	bool found = false;
+
+	for (Direction check : pathfinder_directions)
+	{
+		int dx, dy;
+		pathfinder_offset(check, dx, dy);
+
+		unsigned short distance = field.At(x + dx, y + dy);
+
+		// Stepping on to the target itself is never wanted, anything next to it attacks instead
+		if (distance >= best || distance == 0)
+			continue;
+
+		if (occupied && occupied(x + dx, y + dy))
+			continue;
+
+		best = distance;
+		direction = check;
+		found = true;
+	}
+
+	return found;
+}
+
+void Pathfinder::Forget(unsigned int id)
+{
+	this->fields.erase(id);
+}
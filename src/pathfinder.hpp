@@ -0,0 +1,173 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef PATHFINDER_HPP_INCLUDED
+#define PATHFINDER_HPP_INCLUDED
+
+#include "fwd/pathfinder.hpp"
+
+#include "fwd/character.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Finds ways around walls for NPCs chasing someone, see NPCChaseMode.
+ * Works on a bitmap of which tiles NPCs can walk on, built when the map loads.
+ * Characters and NPCs standing in the way are only checked near the start of a path, as they will have moved by the time anyone gets further.
+ */
+class Pathfinder
+{
+	public:
+		static const unsigned short Unreachable = 0xFFFF;
+
+		/**
+		 * Occupied tiles up to this many steps from the start of a path are treated as walls
+		 */
+		static const int OccupiedRange = 2;
+
+		/**
+		 * Number of times a failed search is reused before trying again anyway
+		 */
+		static const int FailedRetry = 4;
+
+		typedef std::function<bool(int x, int y)> OccupiedFunction;
+
+		/**
+		 * A path cached between steps, see NextStep
+		 */
+		struct Path
+		{
+			/**
+			 * Steps still to take, the next one last
+			 */
+			std::vector<Direction> steps;
+
+			int from_x, from_y;
+			int to_x, to_y;
+			unsigned int revision;
+			bool found;
+			int retry;
+
+			Path() : from_x(-1), from_y(-1), to_x(-1), to_y(-1), revision(0), found(false), retry(0) { }
+
+			void Clear() { this->steps.clear(); this->revision = 0; }
+		};
+
+		/**
+		 * Number of steps to a target from each tile around it, shared by everything chasing that target
+		 */
+		struct FlowField
+		{
+			int target_x, target_y;
+			int range;
+			unsigned int revision;
+
+			int left, top, width, height;
+			std::vector<unsigned short> distance;
+
+			FlowField() : target_x(-1), target_y(-1), range(0), revision(0), left(0), top(0), width(0), height(0) { }
+
+			unsigned short At(int x, int y) const
+			{
+				x -= this->left;
+				y -= this->top;
+
+				if (x < 0 || y < 0 || x >= this->width || y >= this->height)
+					return Unreachable;
+
+				return this->distance[y * this->width + x];
+			}
+		};
+
+	protected:
+		struct Node
+		{
+			unsigned short estimate;
+			unsigned short cost;
+			int index;
+		};
+
+		int width;
+		int height;
+
+		/**
+		 * One bit per tile, set if NPCs can walk on it
+		 */
+		std::vector<std::uint64_t> walkable;
+
+		/**
+		 * Changed whenever walkable does, cached paths and fields from another revision are rebuilt
+		 */
+		unsigned int revision;
+
+		std::unordered_map<unsigned int, FlowField> fields;
+
+		// Search state, kept between searches to save allocating it each time
+		std::vector<unsigned int> visited;
+		std::vector<unsigned short> cost;
+		std::vector<Direction> came_from;
+		std::vector<Node> open;
+		std::vector<int> queue;
+		unsigned int visit_stamp;
+
+		bool InBounds(int x, int y) const { return x >= 0 && y >= 0 && x < this->width && y < this->height; }
+
+	public:
+		Pathfinder();
+
+		/**
+		 * Rebuilds the walkable bitmap, dropping everything cached
+		 * @param walkable Called once for every tile
+		 */
+		void Reset(int width, int height, const std::function<bool(int x, int y)> &walkable);
+
+		void SetWalkable(int x, int y, bool walkable);
+		bool Walkable(int x, int y) const;
+
+		unsigned int Revision() const { return this->revision; }
+
+		/**
+		 * Marks every cached path and flow field stale, for changes the walkable bitmap doesn't hold such as doors opening
+		 */
+		void Invalidate() { ++this->revision; }
+
+		/**
+		 * A* search for the shortest path. The goal tile is allowed to be occupied or unwalkable, as it is usually where the target is standing.
+		 * @param max_length Paths longer than this are not searched for, which also bounds the work when there is no path
+		 * @param steps Receives the path with the first step last
+		 * @return false if there is no path
+		 */
+		bool FindPath(int from_x, int from_y, int to_x, int to_y, int max_length, const OccupiedFunction &occupied, std::vector<Direction> &steps);
+
+		/**
+		 * Picks the next step along a cached path, searching again only once the path goes stale.
+		 * A path is stale when either end moved unexpectedly, the map changed, or the next step is blocked.
+		 * @return false if there is no way there, which is remembered for a few calls
+		 */
+		bool NextStep(Path &path, int from_x, int from_y, int to_x, int to_y, int max_length, const OccupiedFunction &occupied, Direction &direction);
+
+		/**
+		 * Gets the flow field leading to a target, rebuilding it if the target moved
+		 * @param id Key the field is shared under, such as the target's player ID
+		 * @param range How far from the target the field reaches
+		 */
+		const FlowField &Field(unsigned int id, int x, int y, int range);
+
+		/**
+		 * Picks the unoccupied neighbour closest to a flow field's target
+		 * @return false if no neighbour gets closer
+		 */
+		bool FlowStep(const FlowField &field, int x, int y, const OccupiedFunction &occupied, Direction &direction) const;
+
+		/**
+		 * Drops the flow field of a target that has gone
+		 */
+		void Forget(unsigned int id);
+};
+
+#endif // PATHFINDER_HPP_INCLUDED
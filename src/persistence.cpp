@@ -0,0 +1,237 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#include "persistence.hpp"
+
+#include "console.hpp"
+#include "util.hpp"
+
+#include <string>
+#include <utility>
+
+const int Persistence::Attempts = 5;
+const int Persistence::Retries = 2;
+
+Persistence::Persistence(std::shared_ptr<Database> db, bool threaded, double retry_delay)
+	: db(db)
+	, busy(false)
+	, terminating(false)
+	, retry_delay(retry_delay)
+{
+	if (threaded)
+	{
+		this->thread = std::thread([this]() { this->ThreadProc(); });
+	}
+}
+
+void Persistence::Queue(Persistence_Batch &&batch)
+{
+	if (batch.Empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+
+		UTIL_FOREACH_CREF(batch.characters, name)
+		{
+			++this->pending_characters[name];
+		}
+
+		UTIL_FOREACH_CREF(batch.guilds, tag)
+		{
+			++this->pending_guilds[tag];
+		}
+
+		if (this->Threaded())
+		{
+			this->queue.push_back(std::move(batch));
+			this->work_ready.notify_one();
+			return;
+		}
+	}
+
+	// Any retrying here would hold up the game, so only try once
+	this->Finish(batch, this->Apply(batch, 1));
+}
+
+bool Persistence::Apply(const Persistence_Batch &batch, int attempts)
+{
+	for (int attempt = 1; ; ++attempt)
+	{
+		// Without a thread of its own, the batch may be running as part of a larger transaction
+		bool own_transaction = false;
+
+		try
+		{
+			own_transaction = this->db->BeginTransaction();
+
+			UTIL_FOREACH_CREF(batch.queries, query)
+			{
+				this->db->QueryValues(query.format.c_str(), query.args);
+			}
+
+			if (own_transaction)
+				this->db->Commit();
+
+			return true;
+		}
+		catch (Database_Exception &e)
+		{
+			try
+			{
+				if (own_transaction && this->db->Pending())
+					this->db->Rollback();
+			}
+			catch (Database_Exception &)
+			{
+
+			}
+
+			if (attempt >= attempts)
+			{
+				Console::Err("Saving to the database failed: %s", e.error());
+				return false;
+			}
+
+			Console::Wrn("Saving to the database failed, trying again... (Attempt %i / %i): %s", attempt + 1, attempts, e.error());
+			util::sleep(this->retry_delay * attempt);
+		}
+	}
+}
+
+void Persistence::Finish(Persistence_Batch &batch, bool success)
+{
+	std::lock_guard<std::mutex> guard(this->lock);
+
+	auto release = [](std::unordered_map<std::string, int> &pending, const std::string &key)
+	{
+		auto it = pending.find(key);
+
+		if (it != pending.end() && --it->second <= 0)
+			pending.erase(it);
+	};
+
+	UTIL_FOREACH_CREF(batch.characters, name)
+	{
+		release(this->pending_characters, name);
+	}
+
+	UTIL_FOREACH_CREF(batch.guilds, tag)
+	{
+		release(this->pending_guilds, tag);
+	}
+
+	if (!success)
+	{
+		this->failures.push_back(std::move(batch));
+	}
+
+	this->work_done.notify_all();
+}
+
+void Persistence::ThreadProc()
+{
+	for (;;)
+	{
+		Persistence_Batch batch;
+
+		{
+			std::unique_lock<std::mutex> guard(this->lock);
+			this->work_ready.wait(guard, [this]() { return this->terminating || !this->queue.empty(); });
+
+			// Whatever is left is still written before stopping
+			if (this->queue.empty())
+				return;
+
+			batch = std::move(this->queue.front());
+			this->queue.pop_front();
+			this->busy = true;
+		}
+
+		bool success = this->Apply(batch, Attempts);
+
+		// Later batches may save the same rows, so nothing else is written until this one succeeds or is given up on
+		for (int retry = 1; !success && retry <= Retries; ++retry)
+		{
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+
+				if (this->terminating)
+					break;
+			}
+
+			Console::Wrn("Saving to the database still failing, starting over... (Round %i / %i)", retry + 1, Retries + 1);
+			success = this->Apply(batch, Attempts);
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			this->busy = false;
+		}
+
+		this->Finish(batch, success);
+	}
+}
+
+std::size_t Persistence::Pending() const
+{
+	std::lock_guard<std::mutex> guard(this->lock);
+	return this->queue.size() + (this->busy ? 1 : 0);
+}
+
+void Persistence::Drain()
+{
+	std::unique_lock<std::mutex> guard(this->lock);
+	this->work_done.wait(guard, [this]() { return this->queue.empty() && !this->busy; });
+}
+
+bool Persistence::WaitFor(const std::unordered_map<std::string, int> &pending, const std::string &key)
+{
+	std::unique_lock<std::mutex> guard(this->lock);
+
+	if (pending.find(key) == pending.end())
+		return false;
+
+	this->work_done.wait(guard, [&]() { return pending.find(key) == pending.end(); });
+
+	return true;
+}
+
+bool Persistence::WaitForCharacter(const std::string &name)
+{
+	return this->WaitFor(this->pending_characters, name);
+}
+
+bool Persistence::WaitForGuild(const std::string &tag)
+{
+	return this->WaitFor(this->pending_guilds, tag);
+}
+
+bool Persistence::TakeFailures(std::vector<Persistence_Batch> &failed)
+{
+	std::lock_guard<std::mutex> guard(this->lock);
+
+	if (this->failures.empty())
+		return false;
+
+	failed.clear();
+	failed.swap(this->failures);
+
+	return true;
+}
+
+Persistence::~Persistence()
+{
+	if (this->Threaded())
+	{
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			this->terminating = true;
+		}
+
+		this->work_ready.notify_one();
+		this->thread.join();
+	}
+}
@@ -0,0 +1,127 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef PERSISTENCE_HPP_INCLUDED
+#define PERSISTENCE_HPP_INCLUDED
+
+#include "fwd/persistence.hpp"
+
+#include "database.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Queries which are written together in one transaction, and what they save
+ */
+struct Persistence_Batch
+{
+	std::vector<Database_Query> queries;
+
+	/**
+	 * Names of the characters and tags of the guilds the queries save, so they can be saved again if the batch fails
+	 */
+	std::vector<std::string> characters;
+	std::vector<std::string> guilds;
+
+	bool Empty() const { return this->queries.empty(); }
+};
+
+/**
+ * Writes saves to the database behind the game thread's back.
+ * The game thread queues batches built from what changed, and a thread of its own applies them in order on its own connection.
+ * A failing batch is retried before anything queued after it, so a later save never lands ahead of an earlier one, and whoever
+ * it saves stays pending until it is done. Batches which still fail are dropped and handed back whole through TakeFailures.
+ * Without a thread, batches are written as soon as they are queued, as saves always used to be.
+ */
+class Persistence
+{
+	private:
+		std::shared_ptr<Database> db;
+
+		mutable std::mutex lock;
+		std::condition_variable work_ready;
+		std::condition_variable work_done;
+
+		std::deque<Persistence_Batch> queue;
+		bool busy;
+		bool terminating;
+
+		/**
+		 * Seconds to wait after the first failed attempt, each attempt after waits longer
+		 */
+		double retry_delay;
+
+		/**
+		 * Number of queued or running batches saving each character and guild
+		 */
+		std::unordered_map<std::string, int> pending_characters;
+		std::unordered_map<std::string, int> pending_guilds;
+
+		std::vector<Persistence_Batch> failures;
+
+		std::thread thread;
+
+		bool Apply(const Persistence_Batch &batch, int attempts);
+		void Finish(Persistence_Batch &batch, bool success);
+		void ThreadProc();
+
+		bool WaitFor(const std::unordered_map<std::string, int> &pending, const std::string &key);
+
+	public:
+		/**
+		 * Attempts at writing a batch on the persistence thread before giving up on it
+		 */
+		static const int Attempts;
+
+		/**
+		 * Further rounds of attempts a batch gets on the persistence thread before it is dropped
+		 */
+		static const int Retries;
+
+		Persistence(std::shared_ptr<Database> db, bool threaded, double retry_delay = 1.0);
+		Persistence(const Persistence &) = delete;
+		Persistence &operator=(const Persistence &) = delete;
+
+		bool Threaded() const { return this->thread.joinable(); }
+
+		void Queue(Persistence_Batch &&batch);
+
+		/**
+		 * Number of batches which are not written yet
+		 */
+		std::size_t Pending() const;
+
+		/**
+		 * Waits until every queued batch is written
+		 */
+		void Drain();
+
+		/**
+		 * Waits until nothing queued saves a character or guild, before loading it back from the database
+		 * @return Whether there was anything to wait for
+		 */
+		bool WaitForCharacter(const std::string &name);
+		bool WaitForGuild(const std::string &tag);
+
+		/**
+		 * Collects the batches which failed since the last call, returns false if nothing failed
+		 */
+		bool TakeFailures(std::vector<Persistence_Batch> &failed);
+
+		/**
+		 * Writes everything still queued before returning
+		 */
+		~Persistence();
+};
+
+#endif // PERSISTENCE_HPP_INCLUDED
@@ -19,7 +19,6 @@
 
 #include <algorithm>
 #include <ctime>
-#include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -34,31 +33,19 @@ Player::Player(const std::string& username)
 	this->char_op_id = 0;
 }
 
-Player::Player(const std::string& username, World * world, Database * database)
+Player::Player(const std::string& username, World * world, const Database_Result &characters)
+	: username(username)
 {
 	this->world = world;
 
-	auto dbPointer = database ? database : this->world->db.get();
-
-	Database_Result res = dbPointer->Query("SELECT `username`, `password` FROM `accounts` WHERE `username` = '$'", username.c_str());
-	if (res.empty())
-	{
-		throw std::runtime_error("Player not found (" + username + ")");
-	}
-	std::unordered_map<std::string, util::variant> row = res.front();
-
 	this->login_time = static_cast<int>(std::time(0));
 
 	this->online = true;
 	this->character = nullptr;
 
-	this->username = static_cast<std::string>(row["username"]);
-
-	res = dbPointer->Query("SELECT `name` FROM `characters` WHERE `account` = '$' ORDER BY `exp` DESC", username.c_str());
-
-	UTIL_FOREACH_REF(res, row)
+	for (std::size_t i = 0; i < characters.size(); ++i)
 	{
-		Character *newchar = new Character(row["name"], world);
+		Character *newchar = new Character(world, characters, i);
 		newchar->player = this;
 		this->characters.push_back(newchar);
 	}
@@ -130,6 +117,11 @@ void Player::Send(const PacketBuilder &builder)
 	this->client->Send(builder);
 }
 
+void Player::Send(const SharedPacket &packet)
+{
+	this->client->Send(packet);
+}
+
 void Player::Logout()
 {
 	UTIL_FOREACH(this->characters, character)
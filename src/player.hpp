@@ -20,6 +20,7 @@
 #include "hash.hpp"
 #include "socket.hpp"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -54,6 +55,11 @@ struct AccountCredentials
 	util::secure_string password;
 	HashFunc hashFunc;
 
+	/**
+	 * Character rows read by a successful login, so the game thread can build the Player without a query
+	 */
+	std::shared_ptr<Database_Result> characters;
+
 	AccountCredentials()
 		: username(""), password(""), hashFunc(NONE) { }
 
@@ -76,7 +82,7 @@ class Player
 		std::string dutylast;
 
 		Player(const std::string& username);
-		Player(const std::string& username, World *, Database * = nullptr);
+		Player(const std::string& username, World *, const Database_Result &characters);
 
 		std::vector<Character *> characters;
 		Character *character;
@@ -89,6 +95,7 @@ class Player
 		AdminLevel Admin() const;
 
 		void Send(const PacketBuilder &);
+		void Send(const SharedPacket &);
 
 		void Logout();
 
@@ -13,12 +13,18 @@
 #include "util.hpp"
 
 #include <algorithm>
+#include <array>
 #include <cerrno>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <ctime>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "platform.h"
@@ -74,6 +80,112 @@ const char *OSErrorString()
 }
 #endif // WIN32
 
+/**
+ * Returns true if the last socket call failed only because it would have blocked.
+ */
+static bool socket_would_block()
+{
+#ifdef WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else // WIN32
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif // WIN32
+}
+
+/**
+ * Receives directly in to (up to two) ring buffer segments with a single call.
+ */
+static int socket_recv_segments(SOCKET sock, const util::RingBuffer::Segments &segments)
+{
+#ifdef WIN32
+	WSABUF bufs[2];
+	DWORD count = 0;
+	DWORD recieved = 0;
+	DWORD flags = 0;
+
+	for (const util::RingBuffer::Segment &segment : segments)
+	{
+		if (segment.length == 0)
+			break;
+
+		bufs[count].buf = segment.data;
+		bufs[count].len = ULONG(segment.length);
+		++count;
+	}
+
+	if (WSARecv(sock, bufs, count, &recieved, &flags, 0, 0) == SOCKET_ERROR)
+		return SOCKET_ERROR;
+
+	return int(recieved);
+#else // WIN32
+	iovec iov[2];
+	int count = 0;
+
+	for (const util::RingBuffer::Segment &segment : segments)
+	{
+		if (segment.length == 0)
+			break;
+
+		iov[count].iov_base = segment.data;
+		iov[count].iov_len = segment.length;
+		++count;
+	}
+
+	return int(readv(sock, iov, count));
+#endif // WIN32
+}
+
+/**
+ * Sends a number of buffer segments with a single call, empty segments are skipped.
+ */
+template <std::size_t N> static int socket_send_segments(SOCKET sock, const std::array<util::RingBuffer::Segment, N> &segments)
+{
+#ifdef WIN32
+	WSABUF bufs[N];
+	DWORD count = 0;
+	DWORD written = 0;
+
+	for (const util::RingBuffer::Segment &segment : segments)
+	{
+		if (segment.length == 0)
+			continue;
+
+		bufs[count].buf = segment.data;
+		bufs[count].len = ULONG(segment.length);
+		++count;
+	}
+
+	if (WSASend(sock, bufs, count, &written, 0, 0, 0) == SOCKET_ERROR)
+		return SOCKET_ERROR;
+
+	return int(written);
+#else // WIN32
+	iovec iov[N];
+	int count = 0;
+
+	for (const util::RingBuffer::Segment &segment : segments)
+	{
+		if (segment.length == 0)
+			continue;
+
+		iov[count].iov_base = segment.data;
+		iov[count].iov_len = segment.length;
+		++count;
+	}
+
+	// MSG_NOSIGNAL stops a dead peer from raising SIGPIPE
+	msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+
+#ifdef MSG_NOSIGNAL
+	return int(sendmsg(sock, &msg, MSG_NOSIGNAL));
+#else // MSG_NOSIGNAL
+	return int(sendmsg(sock, &msg, 0));
+#endif // MSG_NOSIGNAL
+#endif // WIN32
+}
+
 void Socket_Init::init()
 {
 #ifdef WIN32
@@ -225,9 +337,17 @@ struct Client::impl_
 	SOCKET sock;
 	sockaddr_in sin;
 
+	// Edge-triggered readiness state, only maintained by SocketBackend::Epoll
+	bool readable;
+	bool writable;
+	bool queued;
+
 	impl_(const SOCKET &sock = SOCKET(), const sockaddr_in &sin = sockaddr_in())
 		: sock(sock)
 		, sin(sin)
+		, readable(false)
+		, writable(false)
+		, queued(false)
 	{ }
 };
 
@@ -237,12 +357,6 @@ Client::Client()
 	, server(0)
 	, connected(false)
 	, connect_time(0)
-	, recv_buffer_gpos(0)
-	, recv_buffer_ppos(0)
-	, recv_buffer_used(0)
-	, send_buffer_gpos(0)
-	, send_buffer_ppos(0)
-	, send_buffer_used(0)
 { }
 
 Client::Client(const IPAddress &addr, uint16_t port)
@@ -251,12 +365,6 @@ Client::Client(const IPAddress &addr, uint16_t port)
 	, server(0)
 	, connected(false)
 	, connect_time(0)
-	, recv_buffer_gpos(0)
-	, recv_buffer_ppos(0)
-	, recv_buffer_used(0)
-	, send_buffer_gpos(0)
-	, send_buffer_ppos(0)
-	, send_buffer_used(0)
 {
 	this->Connect(addr, port);
 }
@@ -267,12 +375,6 @@ Client::Client(Server *server)
 	, server(server)
 	, connected(false)
 	, connect_time(0)
-	, recv_buffer_gpos(0)
-	, recv_buffer_ppos(0)
-	, recv_buffer_used(0)
-	, send_buffer_gpos(0)
-	, send_buffer_ppos(0)
-	, send_buffer_used(0)
 { }
 
 Client::Client(const Socket &sock, Server *server)
@@ -281,35 +383,16 @@ Client::Client(const Socket &sock, Server *server)
 	, server(server)
 	, connected(true)
 	, connect_time(std::time(0))
-	, recv_buffer_gpos(0)
-	, recv_buffer_ppos(0)
-	, recv_buffer_used(0)
-	, send_buffer_gpos(0)
-	, send_buffer_ppos(0)
-	, send_buffer_used(0)
 { }
 
-inline void assert_power_of_two(std::size_t size)
-{
-	while ((size & 1) == 0)
-	{
-		size >>= 1;
-	}
-
-	if (size > 1)
-		throw std::runtime_error("Buffer size must be a power of two");
-}
-
 void Client::SetRecvBuffer(std::size_t size)
 {
-	assert_power_of_two(size);
-	this->recv_buffer.resize(size);
+	this->recv_buffer.Reset(size);
 }
 
 void Client::SetSendBuffer(std::size_t size)
 {
-	assert_power_of_two(size);
-	this->send_buffer.resize(size);
+	this->send_buffer.Reset(size);
 }
 
 bool Client::Connect(const IPAddress &addr, uint16_t port)
@@ -356,64 +439,73 @@ void Client::Bind(const IPAddress &addr, uint16_t port)
 
 std::string Client::Recv(std::size_t length)
 {
-	length = std::min(length, this->recv_buffer_used);
-
-	std::string ret(length, char());
-
-	const std::size_t mask = this->recv_buffer.length() - 1;
-
-	for (std::size_t i = 0; i < length; ++i)
-	{
-		this->recv_buffer_gpos = (this->recv_buffer_gpos + 1) & mask;
-		ret[i] = this->recv_buffer[this->recv_buffer_gpos];
-	}
-
-	this->recv_buffer_used -= length;
+	return this->recv_buffer.Read(length);
+}
 
-	return ret;
+std::size_t Client::Recv(char *out, std::size_t length)
+{
+	return this->recv_buffer.Read(out, length);
 }
 
 void Client::Send(const std::string &data)
 {
-	if (data.length() > this->send_buffer.length() - this->send_buffer_used)
+	if (!this->send_buffer.Write(data))
 	{
 		this->Close(true);
 		return;
 	}
 
-	const std::size_t mask = this->send_buffer.length() - 1;
+	if (this->server)
+		this->server->QueueClient(this);
+}
 
-	for (std::size_t i = 0; i < data.length(); ++i)
-	{
-		this->send_buffer_ppos = (this->send_buffer_ppos + 1) & mask;
-		this->send_buffer[this->send_buffer_ppos] = data[i];
-	}
+void Client::SendFile(std::shared_ptr<const std::string> data)
+{
+	if (this->send_file)
+		throw std::runtime_error("Already sending a file");
+
+	if (!data || data->empty())
+		return;
 
-	this->send_buffer_used += data.length();
+	this->send_file = std::move(data);
+	this->send_file_pos = 0;
+
+	if (this->server)
+		this->server->QueueClient(this);
 }
 
-bool Client::DoRecv()
+void Client::CommitSend(std::size_t length)
 {
-	char buf[8192];
+	this->send_buffer.Commit(length);
 
-	const int to_recv = std::min(this->recv_buffer.length() - this->recv_buffer_used, sizeof(buf));
+	if (this->server)
+		this->server->QueueClient(this);
+}
+
+bool Client::DoRecv()
+{
+	util::RingBuffer::Segments segments = this->recv_buffer.WritableSegments();
+	const std::size_t to_recv = this->recv_buffer.Remaining();
 
 	if (to_recv == 0)
 		return false;
 
-	const int recieved = recv(this->impl->sock, buf, to_recv, 0);
+	const int recieved = socket_recv_segments(this->impl->sock, segments);
+
+	this->io_stats.recv_calls.fetch_add(1, std::memory_order_relaxed);
 
 	if (recieved > 0)
 	{
-		const std::size_t mask = this->recv_buffer.length() - 1;
-
-		for (int i = 0; i < recieved; ++i)
-		{
-			this->recv_buffer_ppos = (this->recv_buffer_ppos + 1) & mask;
-			this->recv_buffer[this->recv_buffer_ppos] = buf[i];
-		}
+		this->io_stats.bytes_received.fetch_add(std::uint64_t(recieved), std::memory_order_relaxed);
+		this->recv_buffer.Commit(recieved);
 
-		this->recv_buffer_used += recieved;
+		// A short read means the kernel buffer was drained, so the next edge will report new data
+		if (std::size_t(recieved) < to_recv)
+			this->impl->readable = false;
+	}
+	else if (recieved == SOCKET_ERROR && socket_would_block())
+	{
+		this->impl->readable = false;
 	}
 	else
 	{
@@ -425,25 +517,50 @@ bool Client::DoRecv()
 
 bool Client::DoSend()
 {
-	char buf[8192];
+	const util::RingBuffer::Segments ring_segments = this->send_buffer.ReadableSegments();
+	const std::size_t ring_used = this->send_buffer.Used();
+	const std::size_t file_remaining = this->send_file ? this->send_file->length() - this->send_file_pos : 0;
+	const std::size_t to_send = ring_used + file_remaining;
+
+	// The file image is never written to, the cast is only needed to share the segment type
+	const std::array<util::RingBuffer::Segment, 3> segments{{
+		ring_segments[0],
+		ring_segments[1],
+		{file_remaining ? const_cast<char *>(this->send_file->data()) + this->send_file_pos : nullptr, file_remaining}
+	}};
+
+	const int written = socket_send_segments(this->impl->sock, segments);
 
-	const std::size_t mask = this->send_buffer.length() - 1;
-	const std::size_t gpos = this->send_buffer_gpos;
+	this->io_stats.send_calls.fetch_add(1, std::memory_order_relaxed);
 
-	std::size_t to_send;
-	for (to_send = 0; to_send < std::min(this->send_buffer_used, sizeof(buf)); ++to_send)
+	if (written == SOCKET_ERROR && socket_would_block())
 	{
-		this->send_buffer_gpos = (this->send_buffer_gpos + 1) & mask;
-		buf[to_send] = this->send_buffer[this->send_buffer_gpos];
+		this->impl->writable = false;
+		return true;
 	}
 
-	const int written = send(this->impl->sock, buf, to_send, 0);
-
 	if (written < 0 || written == SOCKET_ERROR)
 		return false;
 
-	this->send_buffer_gpos = (gpos + written) & mask;
-	this->send_buffer_used -= written;
+	this->io_stats.bytes_sent.fetch_add(std::uint64_t(written), std::memory_order_relaxed);
+
+	const std::size_t from_ring = std::min(std::size_t(written), ring_used);
+	this->send_buffer.Consume(from_ring);
+
+	if (file_remaining > 0)
+	{
+		this->send_file_pos += std::size_t(written) - from_ring;
+
+		if (this->send_file_pos == this->send_file->length())
+		{
+			this->send_file.reset();
+			this->send_file_pos = 0;
+		}
+	}
+
+	// A short write means the kernel buffer is full, the next edge will report free space
+	if (std::size_t(written) < to_send)
+		this->impl->writable = false;
 
 	return true;
 }
@@ -456,7 +573,7 @@ bool Client::Select(double timeout)
 	fd.fd = this->impl->sock;
 	fd.events = POLLIN;
 
-	if (this->send_buffer.length() > 0)
+	if (this->send_buffer.Capacity() > 0)
 	{
 		fd.events |= POLLOUT;
 	}
@@ -510,12 +627,12 @@ bool Client::Select(double timeout)
 	FD_ZERO(&write_fds);
 	FD_ZERO(&except_fds);
 
-	if (this->recv_buffer_used != this->recv_buffer.length())
+	if (!this->recv_buffer.Full())
 	{
 		FD_SET(this->impl->sock, &read_fds);
 	}
 
-	if (this->send_buffer_used > 0)
+	if (this->SendPending())
 	{
 		FD_SET(this->impl->sock, &write_fds);
 	}
@@ -605,6 +722,179 @@ Client::~Client()
 	this->Close(true);
 }
 
+struct ClientPoller::impl_
+{
+	// Clients added since the last Wait, and clients returned by it
+	std::vector<Client *> added;
+	std::vector<Client *> ready;
+
+#ifdef SOCKET_EPOLL
+	int epoll_fd;
+	int wake_fd;
+	std::array<epoll_event, 256> events;
+
+	impl_()
+		: epoll_fd(-1)
+		, wake_fd(-1)
+	{ }
+#endif // SOCKET_EPOLL
+};
+
+ClientPoller::ClientPoller()
+	: impl(new impl_)
+{
+#ifdef SOCKET_EPOLL
+	this->impl->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (this->impl->epoll_fd == -1)
+		throw Socket_InitFailed(OSErrorString());
+
+	this->impl->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.ptr = nullptr;
+
+	if (this->impl->wake_fd == -1 || epoll_ctl(this->impl->epoll_fd, EPOLL_CTL_ADD, this->impl->wake_fd, &ev) != 0)
+	{
+		const char *error = OSErrorString();
+
+		if (this->impl->wake_fd != -1)
+			close(this->impl->wake_fd);
+
+		close(this->impl->epoll_fd);
+		throw Socket_InitFailed(error);
+	}
+#else // SOCKET_EPOLL
+	throw Socket_InitFailed("ClientPoller is not supported on this platform");
+#endif // SOCKET_EPOLL
+}
+
+bool ClientPoller::Available()
+{
+#ifdef SOCKET_EPOLL
+	return true;
+#else // SOCKET_EPOLL
+	return false;
+#endif // SOCKET_EPOLL
+}
+
+bool ClientPoller::Add(Client *client)
+{
+#ifdef SOCKET_EPOLL
+	fcntl(client->impl->sock, F_SETFL, fcntl(client->impl->sock, F_GETFL) | O_NONBLOCK);
+
+	epoll_event ev;
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	ev.data.ptr = client;
+
+	client->impl->readable = false;
+	client->impl->writable = false;
+
+	if (epoll_ctl(this->impl->epoll_fd, EPOLL_CTL_ADD, client->impl->sock, &ev) != 0)
+		return false;
+
+	// Pick up any data that arrived before the client was added
+	this->impl->added.push_back(client);
+	client->impl->readable = true;
+
+	return true;
+#else // SOCKET_EPOLL
+	(void)client;
+	return false;
+#endif // SOCKET_EPOLL
+}
+
+void ClientPoller::Remove(Client *client)
+{
+#ifdef SOCKET_EPOLL
+	epoll_event ev = {};
+	epoll_ctl(this->impl->epoll_fd, EPOLL_CTL_DEL, client->impl->sock, &ev);
+#endif // SOCKET_EPOLL
+
+	this->impl->added.erase(std::remove(UTIL_RANGE(this->impl->added), client), this->impl->added.end());
+	this->impl->ready.erase(std::remove(UTIL_RANGE(this->impl->ready), client), this->impl->ready.end());
+}
+
+const std::vector<Client *> &ClientPoller::Wait(double timeout)
+{
+	std::vector<Client *> &ready = this->impl->ready;
+
+	ready.clear();
+	ready.swap(this->impl->added);
+
+#ifdef SOCKET_EPOLL
+	// Newly added clients are returned without waiting
+	const int timeout_ms = ready.empty() ? int(timeout * 1000) : 0;
+
+	int result = epoll_wait(this->impl->epoll_fd, this->impl->events.data(), this->impl->events.size(), timeout_ms);
+
+	if (result == -1 && errno != EINTR)
+		throw Socket_SelectFailed(OSErrorString());
+
+	for (int i = 0; i < result; ++i)
+	{
+		const epoll_event &ev = this->impl->events[i];
+		Client *client = static_cast<Client *>(ev.data.ptr);
+
+		if (!client)
+		{
+			std::uint64_t value;
+
+			while (read(this->impl->wake_fd, &value, sizeof(value)) > 0) { }
+
+			continue;
+		}
+
+		// Errors are picked up by the next recv or send
+		if (ev.events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			client->impl->readable = true;
+
+		if (ev.events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+			client->impl->writable = true;
+
+		ready.push_back(client);
+	}
+#else // SOCKET_EPOLL
+	(void)timeout;
+#endif // SOCKET_EPOLL
+
+	return ready;
+}
+
+void ClientPoller::Wake()
+{
+#ifdef SOCKET_EPOLL
+	const std::uint64_t value = 1;
+
+	if (write(this->impl->wake_fd, &value, sizeof(value)) < 0)
+	{
+		// The counter can only overflow if Wait is not being called, nothing to do
+	}
+#endif // SOCKET_EPOLL
+}
+
+bool ClientPoller::Service(Client *client)
+{
+	bool ok = true;
+
+	while (ok && client->impl->readable && !client->recv_buffer.Full())
+		ok = client->DoRecv();
+
+	while (ok && client->impl->writable && client->SendPending())
+		ok = client->DoSend();
+
+	return ok;
+}
+
+ClientPoller::~ClientPoller()
+{
+#ifdef SOCKET_EPOLL
+	close(this->impl->wake_fd);
+	close(this->impl->epoll_fd);
+#endif // SOCKET_EPOLL
+}
+
 struct Server::impl_
 {
 	fd_set read_fds;
@@ -612,18 +902,56 @@ struct Server::impl_
 	fd_set except_fds;
 	SOCKET sock;
 
+	SocketBackend backend;
+
+	// Clients that need servicing on the next Select regardless of new events
+	std::vector<Client *> pending;
+	std::vector<Client *> working;
+
+#ifdef SOCKET_EPOLL
+	int epoll_fd;
+	std::array<epoll_event, 256> events;
+#endif // SOCKET_EPOLL
+
 	impl_(const SOCKET &sock = INVALID_SOCKET)
 		: sock(sock)
+		, backend(SocketBackend::Select)
+#ifdef SOCKET_EPOLL
+		, epoll_fd(-1)
+#endif // SOCKET_EPOLL
 	{ }
 };
 
+static SocketBackend socket_resolve_backend(SocketBackend backend)
+{
+	if (backend == SocketBackend::External)
+		return backend;
+
+#ifdef WIN32
+	(void)backend;
+	return SocketBackend::Select;
+#else // WIN32
+#ifdef SOCKET_EPOLL
+	if (backend == SocketBackend::Auto)
+		return SocketBackend::Epoll;
+#else // SOCKET_EPOLL
+	if (backend == SocketBackend::Auto || backend == SocketBackend::Epoll)
+		return SocketBackend::Poll;
+#endif // SOCKET_EPOLL
+
+	return backend;
+#endif // WIN32
+}
+
 Server::Server()
 	: impl(new impl_(socket(AF_INET, SOCK_STREAM, 0)))
 	, state(Created)
 	, recv_buffer_max(32 * 1024)
 	, send_buffer_max(32 * 1024)
 	, maxconn(0)
-{ }
+{
+	this->SetBackend(SocketBackend::Auto);
+}
 
 Server::Server(const IPAddress &addr, uint16_t port)
 	: impl(new impl_(socket(AF_INET, SOCK_STREAM, 0)))
@@ -632,9 +960,106 @@ Server::Server(const IPAddress &addr, uint16_t port)
 	, send_buffer_max(32 * 1024)
 	, maxconn(0)
 {
+	this->SetBackend(SocketBackend::Auto);
 	this->Bind(addr, port);
 }
 
+void Server::SetBackend(SocketBackend backend)
+{
+	backend = socket_resolve_backend(backend);
+
+	if (backend == this->impl->backend)
+		return;
+
+#ifdef SOCKET_EPOLL
+	if (this->impl->backend == SocketBackend::Epoll)
+	{
+		UTIL_FOREACH(this->clients, client)
+		{
+			this->UnregisterClient(client);
+		}
+
+		close(this->impl->epoll_fd);
+		this->impl->epoll_fd = -1;
+	}
+
+	if (backend == SocketBackend::Epoll)
+	{
+		this->impl->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+		if (this->impl->epoll_fd == -1)
+			backend = SocketBackend::Poll;
+	}
+#endif // SOCKET_EPOLL
+
+	this->impl->backend = backend;
+
+	UTIL_FOREACH(this->clients, client)
+	{
+		this->RegisterClient(client);
+	}
+}
+
+SocketBackend Server::Backend() const
+{
+	return this->impl->backend;
+}
+
+void Server::RegisterClient(Client *client)
+{
+#ifdef SOCKET_EPOLL
+	if (this->impl->backend != SocketBackend::Epoll)
+		return;
+
+	// Edge-triggered notifications require draining sockets without blocking
+	fcntl(client->impl->sock, F_SETFL, fcntl(client->impl->sock, F_GETFL) | O_NONBLOCK);
+
+	epoll_event ev;
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	ev.data.ptr = client;
+
+	client->impl->readable = false;
+	client->impl->writable = false;
+
+	if (epoll_ctl(this->impl->epoll_fd, EPOLL_CTL_ADD, client->impl->sock, &ev) != 0)
+	{
+		client->Close(true);
+		return;
+	}
+
+	// Pick up any data that was buffered before the client was registered
+	this->QueueClient(client);
+#else // SOCKET_EPOLL
+	(void)client;
+#endif // SOCKET_EPOLL
+}
+
+void Server::UnregisterClient(Client *client)
+{
+#ifdef SOCKET_EPOLL
+	if (this->impl->backend == SocketBackend::Epoll)
+	{
+		epoll_event ev = {};
+		epoll_ctl(this->impl->epoll_fd, EPOLL_CTL_DEL, client->impl->sock, &ev);
+	}
+#endif // SOCKET_EPOLL
+
+	if (client->impl->queued)
+	{
+		client->impl->queued = false;
+		this->impl->pending.erase(std::remove(UTIL_RANGE(this->impl->pending), client), this->impl->pending.end());
+	}
+}
+
+void Server::QueueClient(Client *client)
+{
+	if (this->impl->backend != SocketBackend::Epoll || client->impl->queued)
+		return;
+
+	client->impl->queued = true;
+	this->impl->pending.push_back(client);
+}
+
 void Server::Bind(const IPAddress &addr, uint16_t port)
 {
 	sockaddr_in sin;
@@ -736,6 +1161,12 @@ Client *Server::Poll()
 			if (!client->accepted)
 			{
 				client->Close(true);
+
+				// Another thread may still be using the client, it will be released through BuryTheDead
+				if (this->impl->backend == SocketBackend::External)
+					continue;
+
+				this->UnregisterClient(client);
 #ifdef WIN32
 				closesocket(client->impl->sock);
 #else // WIN32
@@ -765,12 +1196,132 @@ Client *Server::Poll()
 	newclient->SetSendBuffer(this->send_buffer_max);
 
 	this->clients.push_back(newclient);
+	this->RegisterClient(newclient);
 
 	return newclient;
 }
 
-#if defined(SOCKET_POLL) && !defined(WIN32)
 std::vector<Client *> *Server::Select(double timeout)
+{
+	static std::vector<Client *> none;
+
+	switch (this->impl->backend)
+	{
+		case SocketBackend::Epoll: return this->SelectEpoll(timeout);
+		case SocketBackend::Poll: return this->SelectPoll(timeout);
+		case SocketBackend::External:
+			// Nothing to wait on here, but callers rely on Select to pace their loop
+			std::this_thread::sleep_for(std::chrono::duration<double>(timeout));
+			return &none;
+
+		default: return this->SelectFdSet(timeout);
+	}
+}
+
+#ifdef SOCKET_EPOLL
+std::vector<Client *> *Server::SelectEpoll(double timeout)
+{
+	static std::vector<Client *> selected;
+	int result;
+
+	// Queued clients still have work to do, so don't wait around for new events
+	const int timeout_ms = this->impl->pending.empty() ? int(timeout * 1000) : 0;
+
+	result = epoll_wait(this->impl->epoll_fd, this->impl->events.data(), this->impl->events.size(), timeout_ms);
+
+	if (result == -1)
+	{
+		throw Socket_SelectFailed(OSErrorString());
+	}
+
+	for (int i = 0; i < result; ++i)
+	{
+		const epoll_event &ev = this->impl->events[i];
+		Client *client = static_cast<Client *>(ev.data.ptr);
+
+		if (ev.events & (EPOLLERR | EPOLLHUP))
+		{
+			client->Close(true);
+			continue;
+		}
+
+		if (ev.events & EPOLLIN)
+			client->impl->readable = true;
+
+		if (ev.events & EPOLLOUT)
+			client->impl->writable = true;
+
+		this->QueueClient(client);
+	}
+
+	using std::swap;
+	swap(this->impl->pending, this->impl->working);
+
+	UTIL_FOREACH(this->impl->working, client)
+	{
+		client->impl->queued = false;
+
+		if (!ClientPoller::Service(client))
+		{
+			client->Close(true);
+			continue;
+		}
+
+		if (!client->recv_buffer.Empty() || client->NeedTick())
+		{
+			selected.push_back(client);
+
+			// Ticking the client may leave it with more data to process or send
+			this->QueueClient(client);
+		}
+	}
+
+	this->impl->working.clear();
+
+	return &selected;
+}
+#else // SOCKET_EPOLL
+std::vector<Client *> *Server::SelectEpoll(double timeout)
+{
+	return this->SelectPoll(timeout);
+}
+#endif // SOCKET_EPOLL
+
+void Server::Flush()
+{
+	// Only epoll clients are non-blocking, the other backends send from Select once the socket is writable
+	if (this->impl->backend != SocketBackend::Epoll)
+		return;
+
+	std::vector<Client *> &pending = this->impl->pending;
+	auto keep = pending.begin();
+
+	UTIL_FOREACH(pending, client)
+	{
+		bool ok = true;
+
+		while (ok && client->impl->writable && client->SendPending())
+			ok = client->DoSend();
+
+		if (!ok)
+		{
+			client->Close(true);
+			client->impl->queued = false;
+			continue;
+		}
+
+		// Clients which were only queued to send have nothing left for Select to do until their next event
+		if (client->impl->readable || !client->recv_buffer.Empty() || client->NeedTick() || (client->impl->writable && client->SendPending()))
+			*keep++ = client;
+		else
+			client->impl->queued = false;
+	}
+
+	pending.erase(keep, pending.end());
+}
+
+#ifndef WIN32
+std::vector<Client *> *Server::SelectPoll(double timeout)
 {
 	static std::vector<Client *> selected;
 	std::vector<pollfd> fds;
@@ -789,12 +1340,12 @@ std::vector<Client *> *Server::Select(double timeout)
 
 		fd.events = 0;
 
-		if (client->recv_buffer_used != client->recv_buffer.length())
+		if (!client->recv_buffer.Full())
 		{
 			fd.events |= POLLIN;
 		}
 
-		if (client->send_buffer_used > 0)
+		if (client->SendPending())
 		{
 			fd.events |= POLLOUT;
 		}
@@ -811,7 +1362,7 @@ std::vector<Client *> *Server::Select(double timeout)
 
 	if (result > 0)
 	{
-		if (fds[0].revents & POLLERR == POLLERR)
+		if (fds[0].revents & POLLERR)
 		{
 			throw Socket_Exception("There was an exception on the listening socket.");
 		}
@@ -848,7 +1399,7 @@ std::vector<Client *> *Server::Select(double timeout)
 
 	UTIL_FOREACH(this->clients, client)
 	{
-		if (client->recv_buffer_used > 0 || client->NeedTick())
+		if (!client->recv_buffer.Empty() || client->NeedTick())
 		{
 			selected.push_back(client);
 		}
@@ -856,8 +1407,14 @@ std::vector<Client *> *Server::Select(double timeout)
 
 	return &selected;
 }
-#else // defined(SOCKET_POLL) && !defined(WIN32)
-std::vector<Client *> *Server::Select(double timeout)
+#else // WIN32
+std::vector<Client *> *Server::SelectPoll(double timeout)
+{
+	return this->SelectFdSet(timeout);
+}
+#endif // WIN32
+
+std::vector<Client *> *Server::SelectFdSet(double timeout)
 {
 	long tsecs = long(timeout);
 	timeval timeout_val = {tsecs, long((timeout - double(tsecs))*1000000)};
@@ -871,12 +1428,12 @@ std::vector<Client *> *Server::Select(double timeout)
 
 	UTIL_FOREACH(this->clients, client)
 	{
-		if (client->recv_buffer_used != client->recv_buffer.length())
+		if (!client->recv_buffer.Full())
 		{
 			FD_SET(client->impl->sock, &this->impl->read_fds);
 		}
 
-		if (client->send_buffer_used > 0)
+		if (client->SendPending())
 		{
 			FD_SET(client->impl->sock, &this->impl->write_fds);
 		}
@@ -935,7 +1492,7 @@ std::vector<Client *> *Server::Select(double timeout)
 
 	UTIL_FOREACH(this->clients, client)
 	{
-		if (client->recv_buffer_used > 0 || client->NeedTick())
+		if (!client->recv_buffer.Empty() || client->NeedTick())
 		{
 			selected.push_back(client);
 		}
@@ -943,7 +1500,6 @@ std::vector<Client *> *Server::Select(double timeout)
 
 	return &selected;
 }
-#endif // defined(SOCKET_POLL) && !defined(WIN32)
 
 void Server::BuryTheDead()
 {
@@ -951,8 +1507,14 @@ void Server::BuryTheDead()
 	{
 		Client *client = *it;
 
-		if (!client->Connected() && !client->IsAsyncOpPending() && ((client->send_buffer.length() == 0 && client->recv_buffer.length() == 0) || client->closed_time + 2 < std::time(0)))
+		const bool released = (client->send_buffer.Capacity() == 0 && client->recv_buffer.Capacity() == 0);
+
+		// Externally serviced clients hand their buffers back once their thread is done with them
+		const bool timed_out = this->impl->backend != SocketBackend::External && client->closed_time + 2 < std::time(0);
+
+		if (!client->Connected() && !client->IsAsyncOpPending() && (released || timed_out))
 		{
+			this->UnregisterClient(client);
 #ifdef WIN32
 			closesocket(client->impl->sock);
 #else // WIN32
@@ -970,6 +1532,7 @@ Server::~Server()
 {
 	UTIL_FOREACH(this->clients, client)
 	{
+		this->UnregisterClient(client);
 #ifdef WIN32
 		closesocket(client->impl->sock);
 #else // WIN32
@@ -984,5 +1547,10 @@ Server::~Server()
 	close(this->impl->sock);
 #endif // WIN32
 
+#ifdef SOCKET_EPOLL
+	if (this->impl->epoll_fd != -1)
+		close(this->impl->epoll_fd);
+#endif // SOCKET_EPOLL
+
 	delete this->impl;
 }
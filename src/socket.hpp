@@ -9,6 +9,9 @@
 
 #include "fwd/socket.hpp"
 
+#include "util/ringbuffer.hpp"
+
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
@@ -220,12 +223,27 @@ struct Socket;
  */
 class Client
 {
+	public:
+		/**
+		 * Running totals of a client's socket traffic.
+		 * Updated by whichever thread services the client, so they may be read from any thread.
+		 */
+		struct IOStats
+		{
+			std::atomic<std::uint64_t> bytes_sent{0};
+			std::atomic<std::uint64_t> send_calls{0};
+			std::atomic<std::uint64_t> bytes_received{0};
+			std::atomic<std::uint64_t> recv_calls{0};
+		};
+
 	private:
 		struct impl_;
 		std::unique_ptr<impl_> impl;
 
 		volatile bool async_op_pending;
 
+		IOStats io_stats;
+
 	protected:
 		Server *server;
 		bool connected;
@@ -233,15 +251,19 @@ class Client
 		std::time_t closed_time;
 		std::time_t connect_time;
 
-		std::string recv_buffer;
-		std::size_t recv_buffer_gpos;
-		std::size_t recv_buffer_ppos;
-		std::size_t recv_buffer_used;
+		util::RingBuffer recv_buffer;
+		util::RingBuffer send_buffer;
 
-		std::string send_buffer;
-		std::size_t send_buffer_gpos;
-		std::size_t send_buffer_ppos;
-		std::size_t send_buffer_used;
+		/**
+		 * Shared file image sent directly after the contents of send_buffer.
+		 */
+		std::shared_ptr<const std::string> send_file;
+		std::size_t send_file_pos = 0;
+
+		/**
+		 * Marks bytes written directly in to send_buffer's free space as ready to be sent.
+		 */
+		void CommitSend(std::size_t length);
 
 	public:
 		Client();
@@ -257,15 +279,42 @@ class Client
 		bool Connect(const IPAddress &addr, std::uint16_t port);
 		void Bind(const IPAddress &addr, std::uint16_t port);
 
-		std::size_t RecvBufferRemaining() { return this->recv_buffer.length() - this->recv_buffer_used; }
-		std::size_t SendBufferRemaining() { return this->send_buffer.length() - this->send_buffer_used; }
+		std::size_t RecvBufferRemaining() { return this->recv_buffer.Remaining(); }
+		std::size_t SendBufferRemaining() { return this->send_buffer.Remaining(); }
 
 		std::string Recv(std::size_t length);
+
+		/**
+		 * Removes up to length bytes from the receive buffer.
+		 * @return Number of bytes copied to out
+		 */
+		std::size_t Recv(char *out, std::size_t length);
+
 		void Send(const std::string &data);
 
+		/**
+		 * Queues a shared buffer to be sent after any data already in the send buffer, without copying it.
+		 * Data passed to Send before the file has finished would be sent ahead of the rest of it,
+		 * so it must be held back until SendPending returns false.
+		 * @throw std::runtime_error if a file is already being sent
+		 */
+		void SendFile(std::shared_ptr<const std::string> data);
+
+		/**
+		 * Returns true if there is buffered data or a file waiting to be sent.
+		 */
+		bool SendPending() const { return !this->send_buffer.Empty() || this->send_file; }
+
+		/**
+		 * Returns true if a file passed to SendFile has not been completely sent yet.
+		 */
+		bool SendingFile() const { return bool(this->send_file); }
+
 		bool DoRecv();
 		bool DoSend();
 
+		const IOStats &Stats() const { return this->io_stats; }
+
 		bool Select(double timeout);
 
 		bool Accepted() const { return accepted; }
@@ -285,6 +334,58 @@ class Client
 
 	// TODO: Separate Socket type
 	friend class Server;
+	friend class ClientPoller;
+};
+
+/**
+ * Edge-triggered readiness tracking for a set of clients, independent of any Server.
+ * Lets clients be serviced by a thread other than the one calling Server::Select.
+ * Every method except Wake must be called from the same thread.
+ * Only available where epoll is, see Available.
+ */
+class ClientPoller
+{
+	private:
+		struct impl_;
+		std::unique_ptr<impl_> impl;
+
+	public:
+		ClientPoller();
+
+		ClientPoller(const ClientPoller &) = delete;
+		ClientPoller &operator =(const ClientPoller &) = delete;
+
+		static bool Available();
+
+		/**
+		 * Starts watching a client. The client's socket is made non-blocking.
+		 * @return false if the client could not be added
+		 */
+		bool Add(Client *client);
+
+		/**
+		 * Stops watching a client, it will not be returned by Wait again.
+		 */
+		void Remove(Client *client);
+
+		/**
+		 * Waits for clients to become readable or writable.
+		 * @return Clients with new events, valid until the next call
+		 */
+		const std::vector<Client *> &Wait(double timeout);
+
+		/**
+		 * Interrupts a call to Wait from any thread.
+		 */
+		void Wake();
+
+		/**
+		 * Receives and sends as much as the socket currently allows.
+		 * @return false if the connection failed or was closed by the remote side
+		 */
+		static bool Service(Client *client);
+
+		~ClientPoller();
 };
 
 /**
@@ -321,6 +422,26 @@ class Server
 
 		impl_ *impl;
 
+		std::vector<Client *> *SelectFdSet(double timeout);
+		std::vector<Client *> *SelectPoll(double timeout);
+		std::vector<Client *> *SelectEpoll(double timeout);
+
+		/**
+		 * Adds a client to the readiness backend's interest list.
+		 */
+		void RegisterClient(Client *client);
+
+		/**
+		 * Removes a client from the readiness backend before it is destroyed.
+		 */
+		void UnregisterClient(Client *client);
+
+		/**
+		 * Marks a client as needing attention on the next call to Select.
+		 * Only used by backends which do not scan every client each call.
+		 */
+		void QueueClient(Client *client);
+
 	protected:
 		virtual Client *ClientFactory(const Socket &sock) { return new Client(sock, this); }
 
@@ -416,6 +537,25 @@ class Server
 		 */
 		std::vector<Client *> *Select(double timeout);
 
+		/**
+		 * Sends everything buffered for clients since the last call, with one writev per client.
+		 * Clients the backend cannot write to without blocking are left for Select.
+		 */
+		void Flush();
+
+		/**
+		 * Changes the readiness notification mechanism used by Select.
+		 * Existing clients are migrated to the new backend.
+		 * Backends not supported by the platform fall back to the best available one.
+		 * @param backend Backend to use, SocketBackend::Auto picks the best available
+		 */
+		void SetBackend(SocketBackend backend);
+
+		/**
+		 * Returns the readiness notification mechanism currently in use.
+		 */
+		SocketBackend Backend() const;
+
 		/**
 		 * Destroys any dead clients, should be called periodically.
 		 * All pointers to Client objects from this Server should be considered invalid after execution.
@@ -438,6 +578,8 @@ class Server
 		}
 
 		virtual ~Server();
+
+	friend class Client;
 };
 
 
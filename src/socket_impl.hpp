@@ -39,10 +39,14 @@ typedef int socklen_t;
 #ifndef DOXYGEN
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/select.h>
-#ifdef SOCKET_POLL
 #include <sys/poll.h>
-#endif // SOCKET_POLL
+#if defined(__linux__) && !defined(SOCKET_NO_EPOLL)
+#define SOCKET_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif // defined(__linux__) && !defined(SOCKET_NO_EPOLL)
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "character.hpp"
+#include "database.hpp"
+#include "util.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef DATABASE_SQLITE
+
+// Saves every column of 200 characters 50 times over, one statement per character, the way a timed save of
+// a busy server does, and looks each player up once per save. The legacy run escapes each value in to the
+// query text and has SQLite parse it every time, as Database::Query did before statements were cached.
+
+static const int BenchmarkCharacters = 200;
+static const int BenchmarkRounds = 50;
+
+namespace
+{
+    // Runs formatted queries through the escaping path rather than the statement cache
+    class LegacyDatabase : public Database
+    {
+    public:
+        LegacyDatabase() : Database(Database::SQLite, ":memory:", 0, "", "") { }
+
+        Database_Result QueryValues(const char *format, const std::vector<std::string> &args) override
+        {
+            std::size_t next = 0;
+
+            QueryParameterPair queryState = this->ParseQuery(format,
+                [&]() { return util::to_int(args[next++]); },
+                [&]() { return args[next++].c_str(); });
+
+            return this->ExecuteQuery(queryState);
+        }
+    };
+
+    void CreateCharacters(Database& db)
+    {
+        std::string create = "CREATE TABLE characters (name TEXT PRIMARY KEY";
+
+        for (const auto& column : Character::SaveColumns)
+            create += std::string(", ") + column.name + (column.text ? " TEXT" : " INTEGER");
+
+        db.RawQuery((create + ")").c_str());
+        db.RawQuery("CREATE TABLE accounts (username TEXT PRIMARY KEY, password TEXT)");
+
+        for (int i = 0; i < BenchmarkCharacters; ++i)
+        {
+            std::string name = "character" + std::to_string(i);
+            db.QueryValues("INSERT INTO characters (name) VALUES ('$')", {name});
+            db.QueryValues("INSERT INTO accounts (username, password) VALUES ('$', 'hash')", {name});
+        }
+    }
+
+    std::vector<Character_SaveDelta> FullSaves(int round)
+    {
+        std::vector<Character_SaveDelta> deltas;
+
+        for (int i = 0; i < BenchmarkCharacters; ++i)
+        {
+            Character_SaveDelta delta;
+            delta.character = nullptr;
+            delta.name = "character" + std::to_string(i);
+
+            for (std::size_t column = 0; column < Character::SaveColumns.size(); ++column)
+            {
+                if (Character::SaveColumns[column].text)
+                    delta.columns.emplace_back(column, "1,2;3,4;it's round " + std::to_string(round) + ";");
+                else
+                    delta.columns.emplace_back(column, std::to_string(round + i));
+            }
+
+            deltas.push_back(std::move(delta));
+        }
+
+        return deltas;
+    }
+
+    void RunSaves(const char* name, Database& db)
+    {
+        CreateCharacters(db);
+
+        std::vector<std::vector<Character_SaveDelta>> rounds;
+
+        for (int round = 0; round < BenchmarkRounds; ++round)
+            rounds.push_back(FullSaves(round));
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (const auto& deltas : rounds)
+        {
+            db.BeginTransaction();
+
+            for (const auto& delta : deltas)
+            {
+                db.QueryValues("SELECT `username`, `password` FROM `accounts` WHERE `username` = '$'", {delta.name});
+
+                std::vector<Database_Query> queries;
+                Character::SaveQueries({delta}, queries);
+
+                for (const auto& query : queries)
+                    db.QueryValues(query.format.c_str(), query.args);
+            }
+
+            db.Commit();
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        int saves = BenchmarkCharacters * BenchmarkRounds;
+        std::printf("[  BENCH   ] %-8s %8.1f ms for %d saves (%8.0f saves/s)\n", name, seconds * 1000.0, saves, saves / seconds);
+
+        Database_Result row = db.QueryValues("SELECT hp, inventory FROM characters WHERE name = '$'", {"character7"});
+        ASSERT_EQ(1u, row.size());
+        EXPECT_EQ(BenchmarkRounds - 1 + 7, row[0]["hp"].GetInt());
+        EXPECT_EQ("1,2;3,4;it's round " + std::to_string(BenchmarkRounds - 1) + ";", row[0]["inventory"].GetString());
+    }
+}
+
+GTEST_TEST(DatabaseBenchmark, CharacterSaves)
+{
+    {
+        LegacyDatabase db;
+        RunSaves("escaped", db);
+    }
+
+    {
+        Database db(Database::SQLite, ":memory:", 0, "", "");
+        RunSaves("prepared", db);
+    }
+}
+
+#endif // DATABASE_SQLITE
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "config.hpp"
+#include "formula.hpp"
+#include "util/rpn.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+// Compares evaluating the default damage and hit rate formulas the way attacks used to,
+// parsing the config string and building a map of named variables every time,
+// against the formulas compiled once and fed a FormulaValues.
+
+static const int BenchmarkAttacks = 200000;
+
+GTEST_TEST(FormulaBenchmark, DamageAndHitRate)
+{
+    Config config;
+    config["damage"] = "2 2 target_armor * damage / pow damage * damage 2 target_armor * damage >= ? 1 max  1 1.5 critical ? *";
+    config["hit_rate"] = "2 target_evade * accuracy / 0.5 0 accuracy target_evade + = ? 0.2 max 0.8 min 1.0 target_sitting ?";
+
+    const Formulas formulas(config);
+
+    auto report = [](const char *name, std::chrono::steady_clock::duration elapsed)
+    {
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count() / BenchmarkAttacks;
+        std::printf("[  BENCH   ] %-8s %8.1f ns/attack (%10.0f attacks/s)\n", name, ns, 1e9 / ns);
+    };
+
+    double legacy_total = 0.0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < BenchmarkAttacks; ++i)
+    {
+        std::unordered_map<std::string, double> vars;
+
+        FormulaValues values;
+        for (std::size_t v = 0; v < FormulaValues::VarCount; ++v)
+        {
+            vars[FormulaValues::Name(FormulaValues::Var(v))] = values[v] + (i & 7);
+            vars[std::string("target_") + FormulaValues::Name(FormulaValues::Var(v))] = values[v] + (i & 3);
+        }
+
+        vars["modifier"] = 1.0;
+        vars["damage"] = i % 50;
+        vars["critical"] = i & 1;
+
+        legacy_total += util::rpn_eval(util::rpn_parse(config["damage"]), vars);
+        legacy_total += util::rpn_eval(util::rpn_parse(config["hit_rate"]), vars);
+    }
+
+    report("legacy", std::chrono::steady_clock::now() - start);
+
+    double compiled_total = 0.0;
+    start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < BenchmarkAttacks; ++i)
+    {
+        FormulaValues values;
+
+        for (std::size_t v = 0; v < FormulaValues::VarCount; ++v)
+        {
+            values[FormulaValues::Self + v] = i & 7;
+            values[FormulaValues::Target + v] = i & 3;
+        }
+
+        values[FormulaValues::Modifier] = 1.0;
+        values[FormulaValues::Damage] = i % 50;
+        values[FormulaValues::Critical] = i & 1;
+
+        compiled_total += formulas.damage.eval(values.data());
+        compiled_total += formulas.hit_rate.eval(values.data());
+    }
+
+    report("compiled", std::chrono::steady_clock::now() - start);
+
+    // Also keeps the work from being optimized away
+    EXPECT_DOUBLE_EQ(legacy_total, compiled_total);
+}
@@ -0,0 +1,230 @@
+#include <gtest/gtest.h>
+
+#include "packet.hpp"
+#include "util/ringbuffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// Compares the packet encoding kernels against the original copy-based implementation,
+// over a mix of packet sizes resembling live traffic: mostly walk/face/attack sized packets,
+// some chat and refresh packets and the occasional large list.
+
+static const int BenchmarkRounds = 200;
+
+namespace
+{
+    std::string LegacyDickWinder(const std::string& str, unsigned char emulti)
+    {
+        std::string newstr;
+        std::string buffer;
+
+        newstr.reserve(str.length());
+
+        for (char c : str)
+        {
+            if ((unsigned char)c % emulti == 0)
+            {
+                buffer += c;
+            }
+            else
+            {
+                if (buffer.length() > 0)
+                {
+                    std::reverse(buffer.begin(), buffer.end());
+                    newstr += buffer;
+                    buffer.clear();
+                }
+                newstr += c;
+            }
+        }
+
+        if (buffer.length() > 0)
+        {
+            std::reverse(buffer.begin(), buffer.end());
+            newstr += buffer;
+        }
+
+        return newstr;
+    }
+
+    std::string LegacyEncode(const std::string& rawstr, unsigned char emulti)
+    {
+        std::string str = LegacyDickWinder(rawstr, emulti);
+        int length = str.length();
+        std::string newstr(length, char());
+
+        newstr[0] = str[0];
+        newstr[1] = str[1];
+
+        int i = 2;
+        int ii = 2;
+
+        for (; i < length; i += 2)
+            newstr[i] = (unsigned char)str[ii++] ^ 0x80;
+
+        i = length - 1;
+
+        if (length % 2)
+            --i;
+
+        for (; i >= 2; i -= 2)
+            newstr[i] = (unsigned char)str[ii++] ^ 0x80;
+
+        for (int i = 2; i < length; ++i)
+        {
+            if (static_cast<unsigned char>(newstr[i]) == 128)
+                newstr[i] = 0;
+            else if (newstr[i] == 0)
+                newstr[i] = (char)128;
+        }
+
+        return newstr;
+    }
+
+    std::string LegacyDecode(const std::string& str, unsigned char emulti)
+    {
+        std::string newstr;
+        int length = str.length();
+        int i = 0;
+        int ii = 0;
+
+        newstr.resize(length);
+
+        while (i < length)
+        {
+            newstr[ii++] = (unsigned char)str[i] ^ 0x80;
+            i += 2;
+        }
+
+        --i;
+
+        if (length % 2)
+            i -= 2;
+
+        do
+        {
+            newstr[ii++] = (unsigned char)str[i] ^ 0x80;
+            i -= 2;
+        } while (i >= 0);
+
+        for (int i = 2; i < length; ++i)
+        {
+            if (static_cast<unsigned char>(newstr[i]) == 128)
+                newstr[i] = 0;
+            else if (newstr[i] == 0)
+                newstr[i] = (char)128;
+        }
+
+        return LegacyDickWinder(newstr, emulti);
+    }
+
+    std::vector<std::string> MakePackets(std::size_t count)
+    {
+        std::mt19937 rng(2024);
+        std::uniform_int_distribution<int> byte(1, 252);
+        std::uniform_int_distribution<int> percent(0, 99);
+        std::vector<std::string> packets;
+
+        packets.reserve(count);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const int p = percent(rng);
+            const std::size_t length = (p < 60) ? std::uniform_int_distribution<std::size_t>(4, 16)(rng)
+                                     : (p < 85) ? std::uniform_int_distribution<std::size_t>(16, 64)(rng)
+                                     : (p < 97) ? std::uniform_int_distribution<std::size_t>(64, 512)(rng)
+                                     :            std::uniform_int_distribution<std::size_t>(512, 4096)(rng);
+
+            std::string packet(length, char());
+
+            for (char& c : packet)
+                c = char(byte(rng));
+
+            packet[2] = char(PACKET_REPLY);
+            packet[3] = char(PACKET_TALK);
+            packets.push_back(std::move(packet));
+        }
+
+        return packets;
+    }
+
+    template <class F> double Measure(const std::vector<std::string>& packets, F f)
+    {
+        std::size_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (int round = 0; round < BenchmarkRounds; ++round)
+        {
+            for (const std::string& packet : packets)
+                checksum += f(packet);
+        }
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        // Keeps the work from being optimized away
+        EXPECT_NE(checksum, std::size_t(-1));
+
+        return std::chrono::duration<double, std::nano>(elapsed).count() / (double(BenchmarkRounds) * packets.size());
+    }
+}
+
+GTEST_TEST(PacketBenchmark, EncodeDecode)
+{
+    const unsigned char emulti = 9;
+    const std::vector<std::string> packets = MakePackets(10000);
+
+    std::size_t bytes = 0;
+    for (const std::string& packet : packets)
+        bytes += packet.length();
+
+    const double avg = double(bytes) / packets.size();
+
+    PacketProcessor processor;
+    processor.SetEMulti(emulti, emulti);
+
+    util::RingBuffer ring(8192);
+    std::string decoded(8192, char());
+
+    auto report = [&](const char *name, double encode_ns, double decode_ns)
+    {
+        std::printf("[  BENCH   ] %-7s encode %7.1f ns/packet (%6.0f MB/s)  decode %7.1f ns/packet (%6.0f MB/s)\n",
+            name, encode_ns, avg / encode_ns * 1000.0, decode_ns, avg / decode_ns * 1000.0);
+    };
+
+    report("legacy",
+        Measure(packets, [&](const std::string& p) { return std::size_t(LegacyEncode(p, emulti)[2]); }),
+        Measure(packets, [&](const std::string& p) { return std::size_t(LegacyDecode(p, emulti)[0]); }));
+
+    const PacketProcessor::Kernel original = PacketProcessor::ActiveKernel();
+    const struct { PacketProcessor::Kernel kernel; const char *name; } kernels[] = {
+        { PacketProcessor::Kernel::Scalar, "scalar" },
+        { PacketProcessor::Kernel::SSE2, "sse2" },
+        { PacketProcessor::Kernel::AVX2, "avx2" },
+    };
+
+    for (const auto& k : kernels)
+    {
+        if (!PacketProcessor::SetKernel(k.kernel))
+            continue;
+
+        // Encodes in to a ring buffer and decodes in to a reused buffer, as the server does
+        report(k.name,
+            Measure(packets, [&](const std::string& p)
+            {
+                processor.Encode(p.data(), p.length(), ring.WritableSegments());
+                return std::size_t(ring.WritableSegments()[0].data[2]);
+            }),
+            Measure(packets, [&](const std::string& p)
+            {
+                processor.Decode(p.data(), p.length(), &decoded[0]);
+                return std::size_t(decoded[0]);
+            }));
+    }
+
+    PacketProcessor::SetKernel(original);
+}
@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+
+#include "util/semaphore.hpp"
+#include "util/threadpool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Pushes short jobs through the work-stealing pool and through a copy of the single mutex-guarded queue it
+// replaced. The flat run queues every job from the test thread, as logins arriving from the game loop do.
+// The nested run queues a batch of root jobs that each queue more work from inside the pool.
+// The login run queues a backlog of slow background jobs, as a burst of password rehashes would, then times
+// how long logins queued behind it wait to start.
+
+static const int BenchmarkJobs = 200000;
+static const int BenchmarkRoots = 2000;
+static const int BenchmarkChildren = 100;
+static const int BenchmarkBackground = 2000;
+static const int BenchmarkLogins = 50;
+
+namespace
+{
+    std::atomic<int> done(0);
+
+    void Work(const void*)
+    {
+        ++done;
+    }
+
+    // The previous ThreadPool, less resizing and exception handling
+    class LegacyThreadPool
+    {
+    public:
+        explicit LegacyThreadPool(size_t numThreads)
+            : _terminating(false)
+            , _workReady(0)
+        {
+            for (size_t i = 0; i < numThreads; ++i)
+                _threads.emplace_back([this]() { this->WorkerProc(); });
+        }
+
+        ~LegacyThreadPool()
+        {
+            _terminating = true;
+            _workReady.Release(_threads.size());
+
+            for (auto& thread : _threads)
+                thread.join();
+        }
+
+        void Queue(const util::ThreadPool::WorkFunc& func, const void* state, util::ThreadPool::Priority = util::ThreadPool::Priority::Interactive)
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _work.emplace(func, state);
+            _workReady.Release();
+        }
+
+    private:
+        void WorkerProc()
+        {
+            while (!_terminating)
+            {
+                _workReady.Wait();
+
+                if (_terminating)
+                    break;
+
+                std::pair<util::ThreadPool::WorkFunc, const void*> work;
+
+                {
+                    std::lock_guard<std::mutex> guard(_lock);
+                    work = std::move(_work.front());
+                    _work.pop();
+                }
+
+                work.first(work.second);
+            }
+        }
+
+        volatile bool _terminating;
+        util::Semaphore _workReady;
+        std::mutex _lock;
+        std::queue<std::pair<util::ThreadPool::WorkFunc, const void*>> _work;
+        std::vector<std::thread> _threads;
+    };
+
+    class BenchThreadPool : public util::ThreadPool
+    {
+    public:
+        explicit BenchThreadPool(size_t numThreads) : ThreadPool(numThreads) { }
+
+        void Queue(const util::ThreadPool::WorkFunc& func, const void* state, Priority priority = Priority::Interactive)
+        {
+            this->queueInternal(func, state, priority, nullptr);
+        }
+
+        util::ThreadPoolStats Stats() const { return this->statsInternal(); }
+    };
+
+    void WaitFor(int jobs)
+    {
+        while (done < jobs)
+            std::this_thread::yield();
+    }
+
+    void Report(const char* name, const char* run, std::chrono::steady_clock::duration elapsed, int jobs)
+    {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        std::printf("[  BENCH   ] %-8s %-6s %8.1f ms for %d jobs (%9.0f jobs/s)\n", name, run, seconds * 1000.0, jobs, jobs / seconds);
+    }
+
+    template <class Pool>
+    void RunFlat(const char* name, Pool& pool)
+    {
+        done = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < BenchmarkJobs; ++i)
+            pool.Queue(Work, nullptr);
+
+        WaitFor(BenchmarkJobs);
+        Report(name, "flat", std::chrono::steady_clock::now() - start, BenchmarkJobs);
+    }
+
+    template <class Pool>
+    void RunNested(const char* name, Pool& pool)
+    {
+        const int jobs = BenchmarkRoots * (BenchmarkChildren + 1);
+
+        done = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        auto root = [&pool](const void*)
+        {
+            for (int i = 0; i < BenchmarkChildren; ++i)
+                pool.Queue(Work, nullptr);
+
+            ++done;
+        };
+
+        for (int i = 0; i < BenchmarkRoots; ++i)
+            pool.Queue(root, nullptr);
+
+        WaitFor(jobs);
+        Report(name, "nested", std::chrono::steady_clock::now() - start, jobs);
+    }
+
+    template <class Pool>
+    void RunLogins(const char* name, Pool& pool)
+    {
+        const int jobs = BenchmarkBackground + BenchmarkLogins;
+
+        done = 0;
+        std::atomic<long long> waited(0);
+
+        auto background = [](const void*)
+        {
+            auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+
+            while (std::chrono::steady_clock::now() < until) { }
+
+            ++done;
+        };
+
+        auto login = [&waited](const void* state)
+        {
+            auto queued = static_cast<const std::chrono::steady_clock::time_point*>(state);
+            waited += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - *queued).count();
+            ++done;
+        };
+
+        for (int i = 0; i < BenchmarkBackground; ++i)
+            pool.Queue(background, nullptr, util::ThreadPool::Priority::Background);
+
+        std::vector<std::chrono::steady_clock::time_point> queued(BenchmarkLogins);
+
+        for (int i = 0; i < BenchmarkLogins; ++i)
+        {
+            queued[i] = std::chrono::steady_clock::now();
+            pool.Queue(login, &queued[i], util::ThreadPool::Priority::Interactive);
+        }
+
+        WaitFor(jobs);
+        std::printf("[  BENCH   ] %-8s %-6s %8.2f ms average wait for %d logins behind %d background jobs\n", name, "login",
+            waited / 1000.0 / BenchmarkLogins, BenchmarkLogins, BenchmarkBackground);
+    }
+}
+
+GTEST_TEST(ThreadPoolBenchmark, Throughput)
+{
+    const size_t threads = util::ThreadPool::DEFAULT_THREADS;
+
+    {
+        LegacyThreadPool pool(threads);
+        RunFlat("legacy", pool);
+        RunNested("legacy", pool);
+        RunLogins("legacy", pool);
+    }
+
+    {
+        BenchThreadPool pool(threads);
+        RunFlat("stealing", pool);
+        RunNested("stealing", pool);
+        RunLogins("stealing", pool);
+
+        const util::ThreadPoolStats poolStats = pool.Stats();
+        const util::ThreadPoolStats::Class& stats = poolStats.classes[static_cast<size_t>(util::ThreadPool::Priority::Interactive)];
+        std::printf("[  BENCH   ] stealing %llu stolen, max pending %zu, wait p50 <%d ms, p99 <%d ms\n", stats.stolen, stats.max_pending,
+            util::ThreadPoolStats::Class::Percentile(stats.wait_latency, 0.5), util::ThreadPoolStats::Class::Percentile(stats.wait_latency, 0.99));
+
+        EXPECT_EQ(static_cast<unsigned long long>(BenchmarkJobs + BenchmarkRoots * (BenchmarkChildren + 1) + BenchmarkLogins), stats.completed);
+    }
+}
@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+
+#include "timer.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+
+// Churns 100k short-lived timers, the way door closes, spell casts and arena spawns do,
+// through the timing wheel and through a copy of the std::set based Timer it replaced.
+// A third of the timers are cancelled before they fire.
+
+static const int BenchmarkTimers = 100000;
+
+namespace
+{
+    int fired = 0;
+
+    void Fire(void*)
+    {
+        ++fired;
+    }
+
+    // The previous Timer::Tick, less its locking and exception handling
+    struct LegacyTimer
+    {
+        std::set<TimeEvent*> timers;
+        std::set<TimeEvent*> execlist;
+        bool changed = true;
+
+        void Register(TimeEvent* timer, double now)
+        {
+            timer->lasttime = now;
+            changed = true;
+            timers.insert(timer);
+        }
+
+        void Unregister(TimeEvent* timer)
+        {
+            changed = true;
+            timers.erase(timer);
+        }
+
+        void Tick(double now)
+        {
+            if (changed)
+            {
+                execlist = timers;
+                changed = false;
+            }
+
+            for (TimeEvent* timer : execlist)
+            {
+                if (timers.find(timer) == timers.end())
+                    continue;
+
+                if (timer->lasttime + timer->speed < now)
+                {
+                    timer->lasttime += timer->speed;
+
+                    if (--timer->lifetime == 0)
+                        Unregister(timer);
+
+                    timer->callback(timer->param);
+
+                    if (timer->lifetime == 0)
+                        delete timer;
+                }
+            }
+        }
+    };
+
+    struct Schedule
+    {
+        std::vector<double> speeds;
+        std::vector<bool> cancelled;
+
+        Schedule()
+        {
+            std::mt19937 rng(1234);
+            std::uniform_real_distribution<double> speed(0.05, 2.0);
+
+            for (int i = 0; i < BenchmarkTimers; ++i)
+            {
+                speeds.push_back(speed(rng));
+                cancelled.push_back(i % 3 == 0);
+            }
+        }
+    };
+
+    void Report(const char* name, std::chrono::steady_clock::duration elapsed)
+    {
+        double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+        std::printf("[  BENCH   ] %-6s %9.1f ms for %d timers (%8.0f ns/timer)\n", name, ms, BenchmarkTimers, ms * 1e6 / BenchmarkTimers);
+    }
+}
+
+GTEST_TEST(TimerBenchmark, ShortLivedTimers)
+{
+    const Schedule schedule;
+
+    // Timers are registered 100 per simulated millisecond, and Tick is called every millisecond, as the server loop does.
+    // Both register at the real time, so the simulated clock running ahead only shortens every timer alike.
+    const int per_tick = 100;
+    const double step = 0.001;
+
+    {
+        LegacyTimer timer;
+        fired = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        double now = Timer::GetTime();
+
+        for (int i = 0; i < BenchmarkTimers || !timer.timers.empty(); )
+        {
+            for (int n = 0; n < per_tick && i < BenchmarkTimers; ++n, ++i)
+            {
+                TimeEvent* event = new TimeEvent(Fire, nullptr, schedule.speeds[i], 1);
+                timer.Register(event, Timer::GetTime());
+
+                if (schedule.cancelled[i])
+                {
+                    timer.Unregister(event);
+                    event->manager = nullptr;
+                    delete event;
+                }
+            }
+
+            now += step;
+            timer.Tick(now);
+        }
+
+        Report("legacy", std::chrono::steady_clock::now() - start);
+        EXPECT_EQ(BenchmarkTimers - (BenchmarkTimers + 2) / 3, fired);
+    }
+
+    {
+        Timer timer;
+        fired = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        double now = Timer::GetTime();
+
+        for (int i = 0; i < BenchmarkTimers || timer.Count() > 0; )
+        {
+            for (int n = 0; n < per_tick && i < BenchmarkTimers; ++n, ++i)
+            {
+                TimeEvent* event = new TimeEvent(Fire, nullptr, schedule.speeds[i], 1);
+                timer.Register(event);
+
+                if (schedule.cancelled[i])
+                    delete event;
+            }
+
+            now += step;
+            timer.Tick(now);
+        }
+
+        Report("wheel", std::chrono::steady_clock::now() - start);
+        EXPECT_EQ(BenchmarkTimers - (BenchmarkTimers + 2) / 3, fired);
+    }
+}
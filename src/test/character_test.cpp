@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include "character.hpp"
+#include "database.hpp"
+
+#include <string>
+#include <vector>
+
+#ifdef DATABASE_SQLITE
+
+namespace
+{
+    std::size_t Column(const std::string& name)
+    {
+        for (std::size_t i = 0; i < Character::SaveColumns.size(); ++i)
+        {
+            if (name == Character::SaveColumns[i].name)
+                return i;
+        }
+
+        return Character::SaveColumns.size();
+    }
+
+    class CharacterSaveTest : public testing::Test
+    {
+    public:
+        CharacterSaveTest()
+            : db(Database::SQLite, ":memory:", 0, "", "")
+        {
+            db.RawQuery("CREATE TABLE characters (name TEXT, title TEXT, hp INTEGER, inventory TEXT)");
+        }
+
+    protected:
+        Database db;
+
+        void CreateRow(const std::string& name)
+        {
+            db.Query("INSERT INTO characters (name, title, hp, inventory) VALUES ('$', 'none', 10, '')", name.c_str());
+        }
+
+        std::unordered_map<std::string, util::variant> Row(const std::string& name)
+        {
+            return db.Query("SELECT title, hp, inventory FROM characters WHERE name = '$'", name.c_str()).front();
+        }
+
+        void Save(const std::vector<Character_SaveDelta>& deltas)
+        {
+            std::vector<Database_Query> queries;
+            Character::SaveQueries(deltas, queries);
+
+            for (const auto& query : queries)
+                db.QueryValues(query.format.c_str(), query.args);
+        }
+
+        static Character_SaveDelta Delta(const std::string& name, std::vector<std::pair<std::size_t, std::string>> columns)
+        {
+            Character_SaveDelta delta;
+            delta.character = nullptr;
+            delta.name = name;
+            delta.columns = std::move(columns);
+            return delta;
+        }
+    };
+}
+
+TEST_F(CharacterSaveTest, OneCharacterOnlyWritesChangedColumns)
+{
+    CreateRow("alice");
+
+    Save({Delta("alice", {{Column("hp"), "25"}})});
+
+    auto row = Row("alice");
+    ASSERT_EQ(25, static_cast<int>(row["hp"]));
+    ASSERT_EQ("none", static_cast<std::string>(row["title"]));
+}
+
+TEST_F(CharacterSaveTest, BatchLeavesColumnsOthersChangedAlone)
+{
+    CreateRow("alice");
+    CreateRow("bob");
+    CreateRow("carol");
+
+    Save({
+        Delta("alice", {{Column("title"), "It's $5 # @"}, {Column("hp"), "20"}}),
+        Delta("bob", {{Column("inventory"), "1,5;"}})
+    });
+
+    auto alice = Row("alice");
+    ASSERT_EQ("It's $5 # @", static_cast<std::string>(alice["title"]));
+    ASSERT_EQ(20, static_cast<int>(alice["hp"]));
+    ASSERT_EQ("", static_cast<std::string>(alice["inventory"]));
+
+    auto bob = Row("bob");
+    ASSERT_EQ("none", static_cast<std::string>(bob["title"]));
+    ASSERT_EQ(10, static_cast<int>(bob["hp"]));
+    ASSERT_EQ("1,5;", static_cast<std::string>(bob["inventory"]));
+
+    auto carol = Row("carol");
+    ASSERT_EQ("none", static_cast<std::string>(carol["title"]));
+    ASSERT_EQ(10, static_cast<int>(carol["hp"]));
+}
+
+TEST_F(CharacterSaveTest, LargeSavesAreSplitInToSeveralStatements)
+{
+    std::vector<Character_SaveDelta> deltas;
+
+    for (int i = 0; i < 40; ++i)
+    {
+        std::string name = "char" + std::to_string(i);
+        CreateRow(name);
+        deltas.push_back(Delta(name, {{Column("hp"), std::to_string(100 + i)}}));
+    }
+
+    std::vector<Database_Query> queries;
+    Character::SaveQueries(deltas, queries);
+    ASSERT_EQ(3u, queries.size());
+
+    Save(deltas);
+
+    for (int i = 0; i < 40; ++i)
+        ASSERT_EQ(100 + i, static_cast<int>(Row("char" + std::to_string(i))["hp"])) << i;
+}
+
+#endif // DATABASE_SQLITE
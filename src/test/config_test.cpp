@@ -18,3 +18,42 @@ GTEST_TEST(ConfigTests, EoservConfig_ValueFromEnvironmentVariable_OverridesFileV
 
     ASSERT_EQ(config["Port"].GetInt(), 12345);
 }
+
+GTEST_TEST(ConfigTests, ServerSettings_ParsesTypedValues)
+{
+    Console::SuppressOutput(true);
+
+    Config config;
+    eoserv_config_validate_config(config);
+    config["SeeDistance"] = "14";
+    config["GlobalPK"] = "yes";
+    config["ExpRate"] = "2.5";
+    config["TimedSave"] = "2m";
+    config["DefaultBanLength"] = "1h";
+    config["PKExcept"] = "5, 7,,9";
+
+    ServerSettings settings(config);
+
+    ASSERT_EQ(settings.SeeDistance, 14);
+    ASSERT_TRUE(settings.GlobalPK);
+    ASSERT_DOUBLE_EQ(settings.ExpRate, 2.5);
+    ASSERT_DOUBLE_EQ(settings.TimedSave, 120.0);
+    ASSERT_DOUBLE_EQ(settings.DefaultBanLength, 3600.0);
+    ASSERT_EQ(settings.PKExceptMaps, std::vector<int>({5, 7, 9}));
+    ASSERT_EQ(settings.PacketQueueMax, 40);
+}
+
+GTEST_TEST(ConfigTests, ServerSettings_IsASnapshot)
+{
+    Console::SuppressOutput(true);
+
+    Config config;
+    eoserv_config_validate_config(config);
+
+    ServerSettings before(config);
+    config["SeeDistance"] = 20;
+    ServerSettings after(config);
+
+    ASSERT_EQ(before.SeeDistance, 11);
+    ASSERT_EQ(after.SeeDistance, 20);
+}
@@ -0,0 +1,252 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "testhelper/mocks.hpp"
+
+#include "config.hpp"
+#include "database.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+    class DatabasePoolTest : public testing::Test
+    {
+    public:
+        DatabasePoolTest()
+            : created(0)
+        {
+            config["DBType"] = "mysql";
+            config["DBPoolSize"] = 2;
+            config["DBPoolTimeout"] = 0;
+
+            EXPECT_CALL(factory, CreateDatabase(_, _))
+                .WillRepeatedly(Invoke([this](Unused, Unused)
+                {
+                    ++created;
+                    auto db = std::make_shared<NiceMock<MockDatabase>>(Database::MySQL);
+                    ON_CALL(*db, Pending()).WillByDefault(Return(false));
+                    return std::shared_ptr<Database>(db);
+                }));
+        }
+
+    protected:
+        Config config;
+        MockDatabaseFactory factory;
+        int created;
+    };
+}
+
+TEST_F(DatabasePoolTest, ReleasedConnectionsAreReused)
+{
+    Database* first;
+
+    {
+        auto db = factory.AcquireDatabase(config);
+        first = db.get();
+        ASSERT_EQ(1u, factory.PoolStats().in_use);
+    }
+
+    ASSERT_EQ(0u, factory.PoolStats().in_use);
+
+    auto db = factory.AcquireDatabase(config);
+    ASSERT_EQ(first, db.get());
+    ASSERT_EQ(1, created);
+    ASSERT_EQ(1u, factory.PoolStats().open);
+    ASSERT_EQ(2ull, factory.PoolStats().acquired);
+}
+
+TEST_F(DatabasePoolTest, ExhaustedPoolFailsAfterTimeout)
+{
+    auto a = factory.AcquireDatabase(config);
+    auto b = factory.AcquireDatabase(config);
+    ASSERT_NE(a.get(), b.get());
+
+    ASSERT_THROW(factory.AcquireDatabase(config), Database_OpenFailed);
+    ASSERT_EQ(2, created);
+    ASSERT_EQ(1ull, factory.PoolStats().timeouts);
+}
+
+TEST_F(DatabasePoolTest, WaiterReceivesReturnedConnection)
+{
+    config["DBPoolSize"] = 1;
+    config["DBPoolTimeout"] = 10;
+
+    auto held = factory.AcquireDatabase(config);
+    Database* expected = held.get();
+
+    std::thread releaser([&held]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        held.reset();
+    });
+
+    auto db = factory.AcquireDatabase(config);
+    releaser.join();
+
+    ASSERT_EQ(expected, db.get());
+    ASSERT_EQ(1, created);
+
+    DatabasePoolStats stats = factory.PoolStats();
+    ASSERT_EQ(1ull, stats.waited);
+    ASSERT_GT(stats.max_wait, 0.0);
+}
+
+TEST_F(DatabasePoolTest, OpenTransactionIsRolledBackOnRelease)
+{
+    Database* first;
+
+    {
+        auto db = factory.AcquireDatabase(config);
+        first = db.get();
+
+        auto mock = dynamic_cast<MockDatabase*>(first);
+        EXPECT_CALL(*mock, Pending()).WillOnce(Return(true)).WillRepeatedly(Return(false));
+        EXPECT_CALL(*mock, Rollback()).Times(1);
+    }
+
+    auto db = factory.AcquireDatabase(config);
+    ASSERT_EQ(first, db.get());
+}
+
+#ifdef DATABASE_SQLITE
+
+GTEST_TEST(DatabasePreparedTest, BoundValuesRoundTrip)
+{
+    Database db(Database::SQLite, ":memory:", 0, "", "");
+    db.RawQuery("CREATE TABLE t (name TEXT, n INTEGER)");
+
+    // Quotes, tokens and SQL in values are bound rather than spliced in to the query
+    const char *names[] = {"plain", "it's", "#$@", "'); DROP TABLE t; --"};
+
+    for (int i = 0; i < 4; ++i)
+    {
+        Database_Result res = db.Query("INSERT INTO t (name, n) VALUES ('$', #)", names[i], i);
+        ASSERT_EQ(1, res.AffectedRows());
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        Database_Result res = db.Query("SELECT name, n FROM t WHERE name = '$'", names[i]);
+        ASSERT_EQ(1u, res.size());
+        ASSERT_EQ(std::string(names[i]), res[0]["name"].GetString());
+        ASSERT_EQ(i, res[0]["n"].GetInt());
+    }
+}
+
+GTEST_TEST(DatabasePreparedTest, UnbindableQueriesFallBackToEscaping)
+{
+    Database db(Database::SQLite, ":memory:", 0, "", "");
+    db.RawQuery("CREATE TABLE t (name TEXT)");
+
+    // A value in the middle of a literal, and more than one statement, run the way they always have
+    db.Query("INSERT INTO t (name) VALUES ('x$x')", "'");
+    db.Query("INSERT INTO t (name) VALUES ('$'); INSERT INTO t (name) VALUES ('$')", "a", "b");
+
+    Database_Result res = db.Query("SELECT name FROM t WHERE name LIKE '%@%' ORDER BY name", "");
+    ASSERT_EQ(3u, res.size());
+    ASSERT_EQ("a", res[0]["name"].GetString());
+    ASSERT_EQ("b", res[1]["name"].GetString());
+    ASSERT_EQ("x'x", res[2]["name"].GetString());
+}
+
+GTEST_TEST(DatabasePoolFailureTest, FailedConnectionsAreClosedNotReused)
+{
+    Config config;
+    config["DBType"] = "mysql";
+    config["DBPoolSize"] = 1;
+    config["DBPoolTimeout"] = 0;
+
+    // Real connections, so the failure is recorded the way a broken server connection's would be
+    MockDatabaseFactory factory;
+    int created = 0;
+
+    EXPECT_CALL(factory, CreateDatabase(_, _))
+        .WillRepeatedly(Invoke([&created](Unused, Unused)
+        {
+            ++created;
+            return std::make_shared<Database>(Database::SQLite, ":memory:", 0, "", "");
+        }));
+
+    {
+        auto db = factory.AcquireDatabase(config);
+        ASSERT_THROW(db->Query("SELECT * FROM missing_table"), Database_QueryFailed);
+        ASSERT_TRUE(db->Failed());
+    }
+
+    DatabasePoolStats stats = factory.PoolStats();
+    ASSERT_EQ(0u, stats.open);
+    ASSERT_EQ(0u, stats.in_use);
+
+    auto db = factory.AcquireDatabase(config);
+    ASSERT_FALSE(db->Failed());
+    ASSERT_EQ(2, created);
+}
+
+#endif // DATABASE_SQLITE
+
+GTEST_TEST(DatabaseResultTest, CellsAreReadByColumnIndex)
+{
+    Database_Result result;
+    result.AddColumn("name");
+    result.AddColumn("level");
+
+    const char *names[] = {"alice", "bob", "carol"};
+
+    for (int i = 0; i < 3; ++i)
+    {
+        result.AddRow();
+        result.AddText(names[i], std::strlen(names[i]));
+        result.AddInt(i * 10);
+    }
+
+    ASSERT_EQ(3u, result.size());
+
+    std::size_t name = result.Column("name");
+    std::size_t level = result.Column("level");
+    ASSERT_EQ(Database_Result::npos, result.Column("missing"));
+
+    int i = 0;
+
+    for (const auto& row : result)
+    {
+        ASSERT_EQ(names[i], row.GetString(name));
+        ASSERT_EQ(i * 10, row.GetInt(level));
+        ASSERT_EQ(std::to_string(i * 10), row.GetString(level));
+        ASSERT_EQ(0, row.GetInt(Database_Result::npos));
+        ++i;
+    }
+
+    // The name based accessors still work for code which hasn't moved to column indexes
+    ASSERT_EQ("bob", static_cast<std::string>(result[1]["name"]));
+    ASSERT_EQ(20, static_cast<int>(result[2]["level"]));
+}
+
+GTEST_TEST(DatabaseResultTest, MapRowsAddMissingColumns)
+{
+    Database_Result result;
+
+    std::unordered_map<std::string, util::variant> first;
+    first["a"] = 1;
+    result.push_back(first);
+
+    std::unordered_map<std::string, util::variant> second;
+    second["a"] = 2;
+    second["b"] = "two";
+    result.push_back(second);
+
+    ASSERT_EQ(2u, result.size());
+    ASSERT_EQ(1, result[0]["a"].GetInt());
+    ASSERT_EQ("", result[0]["b"].GetString());
+    ASSERT_EQ(2, result[1]["a"].GetInt());
+    ASSERT_EQ("two", result[1]["b"].GetString());
+
+    std::unordered_map<std::string, util::variant> copy = result[1];
+    ASSERT_EQ(2u, copy.size());
+    ASSERT_EQ("two", copy["b"].GetString());
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include "filecache.hpp"
+
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+
+namespace
+{
+    const char* TestFile = "filecache_test.bin";
+
+    void WriteTestFile(const std::string& contents)
+    {
+        std::ofstream out(TestFile, std::ios::binary | std::ios::trunc);
+        out << contents;
+    }
+
+    const std::string Version1("EIF\x01\x02\x03\x04\x05\x06", 9);
+    const std::string Version2("EIF\x0A\x0B\x0C\x0D\x05\x06\x07", 10);
+}
+
+GTEST_TEST(FileCacheTests, GetLoadsContentsAndHeader)
+{
+    WriteTestFile(Version1);
+
+    FileCache cache;
+    FileCache::ImagePtr image = cache.Get(TestFile);
+
+    ASSERT_NE(nullptr, image);
+    ASSERT_EQ(Version1, image->data);
+    ASSERT_EQ(Version1.length(), image->Size());
+    ASSERT_EQ((std::array<unsigned char, 4>{{1, 2, 3, 4}}), image->rid);
+    ASSERT_EQ((std::array<unsigned char, 2>{{5, 6}}), image->len);
+
+    ASSERT_EQ(image, cache.Get(TestFile));
+
+    std::remove(TestFile);
+}
+
+GTEST_TEST(FileCacheTests, MissingFileReturnsNull)
+{
+    FileCache cache;
+    ASSERT_EQ(nullptr, cache.Get("filecache_test_missing.bin"));
+}
+
+GTEST_TEST(FileCacheTests, ReloadSwapsImageWithoutChangingOldOne)
+{
+    WriteTestFile(Version1);
+
+    FileCache cache;
+    FileCache::ImagePtr old_image = cache.Get(TestFile);
+    std::shared_ptr<const std::string> in_flight = FileCache::Data(old_image);
+    old_image.reset();
+
+    WriteTestFile(Version2);
+    ASSERT_EQ(Version1, cache.Get(TestFile)->data);
+
+    FileCache::ImagePtr new_image = cache.Reload(TestFile);
+
+    ASSERT_NE(nullptr, new_image);
+    ASSERT_EQ(Version2, new_image->data);
+    ASSERT_EQ(new_image, cache.Get(TestFile));
+    ASSERT_EQ(Version1, *in_flight);
+
+    std::remove(TestFile);
+}
+
+GTEST_TEST(FileCacheTests, GlobalPKVariantPatchesMapHeader)
+{
+    std::string map(0x30, '\x01');
+    WriteTestFile(map);
+
+    FileCache cache;
+    FileCache::ImagePtr raw = cache.Get(TestFile);
+    FileCache::ImagePtr pk = cache.Get(TestFile, FileCache::GlobalPK);
+
+    ASSERT_EQ(map, raw->data);
+    ASSERT_EQ(char(0xFF), pk->data[0x03]);
+    ASSERT_EQ(char(0x01), pk->data[0x04]);
+    ASSERT_EQ(char(0x04), pk->data[0x1F]);
+    ASSERT_EQ(0xFF, pk->rid[0]);
+
+    std::remove(TestFile);
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include "config.hpp"
+#include "formula.hpp"
+#include "util/rpn.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+static const char *const DamageFormula = "2 2 target_armor * damage / pow damage * damage 2 target_armor * damage >= ? 1 max  1 1.5 critical ? *";
+static const char *const HitRateFormula = "2 target_evade * accuracy / 0.5 0 accuracy target_evade + = ? 0.2 max 0.8 min 1.0 target_sitting ?";
+
+static std::unordered_map<std::string, double> NamedValues(const FormulaValues& values)
+{
+    std::unordered_map<std::string, double> vars;
+
+    for (std::size_t i = 0; i < FormulaValues::VarCount; ++i)
+    {
+        vars[FormulaValues::Name(FormulaValues::Var(i))] = values[FormulaValues::Self + i];
+        vars[std::string("target_") + FormulaValues::Name(FormulaValues::Var(i))] = values[FormulaValues::Target + i];
+    }
+
+    vars["modifier"] = values[FormulaValues::Modifier];
+    vars["damage"] = values[FormulaValues::Damage];
+    vars["critical"] = values[FormulaValues::Critical];
+
+    return vars;
+}
+
+GTEST_TEST(FormulaTests, CompiledFormulasMatchRpnEval)
+{
+    for (int armor : {0, 5, 40, 200})
+    {
+        for (int damage : {1, 10, 90})
+        {
+            for (int critical : {0, 1})
+            {
+                FormulaValues values;
+                values[FormulaValues::Self + FormulaValues::Var_accuracy] = armor / 2 + damage;
+                values[FormulaValues::Target + FormulaValues::Var_armor] = armor;
+                values[FormulaValues::Target + FormulaValues::Var_evade] = armor;
+                values[FormulaValues::Target + FormulaValues::Var_sitting] = critical;
+                values[FormulaValues::Damage] = damage;
+                values[FormulaValues::Critical] = critical;
+
+                std::unordered_map<std::string, double> vars = NamedValues(values);
+
+                for (const char *expr : {DamageFormula, HitRateFormula})
+                {
+                    util::rpn_formula formula(expr, FormulaValues::Resolve);
+                    ASSERT_DOUBLE_EQ(util::rpn_eval(util::rpn_parse(expr), vars), formula.eval(values.data())) << expr;
+                }
+            }
+        }
+    }
+}
+
+GTEST_TEST(FormulaTests, UnknownNamesAreZero)
+{
+    FormulaValues values;
+    util::rpn_formula formula("3 nonsense +", FormulaValues::Resolve);
+
+    ASSERT_DOUBLE_EQ(3.0, formula.eval(values.data()));
+}
+
+GTEST_TEST(FormulaTests, StackUnderflowThrowsWhenEvaluated)
+{
+    FormulaValues values;
+    util::rpn_formula formula("1 +", FormulaValues::Resolve);
+
+    ASSERT_THROW(formula.eval(values.data()), std::runtime_error);
+}
+
+GTEST_TEST(FormulaTests, ClassFormulasAreCompiledByType)
+{
+    Config config;
+    config["hp"] = "10 level +";
+    config["class.0.damage"] = "3 str /";
+    config["class.2.evade"] = "4 agi /";
+
+    Formulas formulas(config);
+
+    FormulaValues values;
+    values[FormulaValues::Var_level] = 5;
+    values[FormulaValues::Var_str] = 9;
+    values[FormulaValues::Var_agi] = 8;
+
+    ASSERT_DOUBLE_EQ(15.0, formulas.hp.eval(values.data()));
+    ASSERT_DOUBLE_EQ(3.0, formulas.GetClass(0).damage.eval(values.data()));
+    ASSERT_DOUBLE_EQ(2.0, formulas.GetClass(2).evade.eval(values.data()));
+    ASSERT_DOUBLE_EQ(0.0, formulas.GetClass(1).damage.eval(values.data()));
+    ASSERT_DOUBLE_EQ(0.0, formulas.GetClass(7).damage.eval(values.data()));
+}
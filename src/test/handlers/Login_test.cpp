@@ -6,6 +6,10 @@
 
 #include "console.hpp"
 
+#include <mutex>
+#include <thread>
+#include <vector>
+
 static constexpr unsigned short TestServerPort = 38078;
 
 GTEST_TEST(LoginTests, BasicParameterTests)
@@ -38,7 +42,7 @@ GTEST_TEST(LoginTests, BasicParameterTests)
         EXPECT_CALL(client, Close(_)).Times(0);
 
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
-        PacketReader r(b.AddBreakString(std::string(AccountMaxLength + 1, 'a')).AddBreakString("test_pass").Get());
+        PacketReader r(b.AddBreakString(std::string(AccountMaxLength + 1, 'a')).AddBreakString("test_pass").Raw());
         r.GetShort();
         Handlers::Login_Request(&client, r);
     }
@@ -51,7 +55,7 @@ GTEST_TEST(LoginTests, BasicParameterTests)
         EXPECT_CALL(client, Close(_)).Times(0);
 
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
-        PacketReader r(b.AddBreakString("test_user").AddBreakString(std::string(PasswordMaxLength + 1, 'a')).Get());
+        PacketReader r(b.AddBreakString("test_user").AddBreakString(std::string(PasswordMaxLength + 1, 'a')).Raw());
         r.GetShort();
         Handlers::Login_Request(&client, r);
     }
@@ -66,7 +70,7 @@ GTEST_TEST(LoginTests, BasicParameterTests)
         EXPECT_CALL(client, Close(false)).Times(0);
 
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
-        PacketReader r(b.AddBreakString(std::string(AccountMinLength - 1, 'a')).AddBreakString("test_pass").Get());
+        PacketReader r(b.AddBreakString(std::string(AccountMinLength - 1, 'a')).AddBreakString("test_pass").Raw());
         r.GetShort();
         Handlers::Login_Request(&client, r);
     }
@@ -81,7 +85,7 @@ GTEST_TEST(LoginTests, BasicParameterTests)
         EXPECT_CALL(client, Close(false)).Times(0);
 
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
-        PacketReader r(b.AddBreakString("test_user").AddBreakString(std::string(PasswordMinLength - 1, 'a')).Get());
+        PacketReader r(b.AddBreakString("test_user").AddBreakString(std::string(PasswordMinLength - 1, 'a')).Raw());
         r.GetShort();
         Handlers::Login_Request(&client, r);
     }
@@ -96,7 +100,7 @@ GTEST_TEST(LoginTests, BasicParameterTests)
         EXPECT_CALL(client, Close(false)).Times(1);
 
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
-        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Get());
+        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Raw());
         r.GetShort();
         Handlers::Login_Request(&client, r);
     }
@@ -135,7 +139,7 @@ GTEST_TEST(LoginTests, LoginWhenBannedReturnsBan)
         EXPECT_CALL(client, Close(false)).Times(1);
 
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
-        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Get());
+        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Raw());
         r.GetShort();
         Handlers::Login_Request(&client, r);
     }
@@ -151,7 +155,7 @@ GTEST_TEST(LoginTests, LoginWhenBannedReturnsBan)
         EXPECT_CALL(client, Close(false)).Times(1);
 
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
-        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Get());
+        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Raw());
         r.GetShort();
         Handlers::Login_Request(&client, r);
     }
@@ -187,12 +191,41 @@ GTEST_TEST(LoginTests, LoginUnderStressReturnsServerBusy)
         EXPECT_CALL(*client, Close(false)).Times(0);
 
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
-        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Get());
+        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Raw());
         Handlers::Login_Request(client.get(), r);
     }
 
     // wait for the threads to finish
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    RunCompletionsFor(server, std::chrono::milliseconds(1000));
+}
+
+GTEST_TEST(LoginTests, ServerShutdownWaitsForPendingLogins)
+{
+    Console::SuppressOutput(true);
+
+    Config config, admin_config;
+    CreateConfigWithTestDefaults(config, admin_config);
+
+    auto mockDatabase = CreateMockDatabase();
+    auto mockDatabaseFactory = CreateMockDatabaseFactory(mockDatabase, true);
+
+    // The client outlives the server, so the reply can only come from the server's destructor
+    std::shared_ptr<MockClient> client;
+
+    {
+        EOServer server(IPAddress("127.0.0.1"), TestServerPort, mockDatabaseFactory, config, admin_config);
+        client.reset(new MockClient(&server));
+
+        PacketBuilder expectedResponse(PACKET_LOGIN, PACKET_REPLY, 2);
+        expectedResponse.AddShort(LOGIN_WRONG_USER);
+        EXPECT_CALL(*client, Send(expectedResponse)).Times(1);
+
+        PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
+        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Raw());
+        Handlers::Login_Request(client.get(), r);
+    }
+
+    ASSERT_FALSE(client->IsAsyncOpPending());
 }
 
 GTEST_TEST(LoginTests, TooManyRepeatedLoginAttemptsDisconnectsClient)
@@ -222,10 +255,10 @@ GTEST_TEST(LoginTests, TooManyRepeatedLoginAttemptsDisconnectsClient)
     for (auto i = 0; i < MaxLoginAttempts; i++)
     {
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, 20);
-        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Get());
+        PacketReader r(b.AddBreakString("test_user").AddBreakString("test_pass").Raw());
         Handlers::Login_Request(&client, r);
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        RunCompletionsFor(server, std::chrono::milliseconds(500));
     }
 }
 
@@ -269,11 +302,11 @@ GTEST_TEST(LoginTests, LoginWithOldPasswordVersionDoesNotUpgradeOnWrongPassword)
     EXPECT_CALL(client, Send(expectedResponse)).Times(1);
 
     PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, ExpectedUsername.size() + UnhashedPassword.size() + 2);
-    PacketReader r(b.AddBreakString(ExpectedUsername).AddBreakString(UnhashedPassword).Get());
+    PacketReader r(b.AddBreakString(ExpectedUsername).AddBreakString(UnhashedPassword).Raw());
     r.GetShort(); // skip first two bytes (Family/Action - packet id, normally consumed from the reader when selecting the handler)
     Handlers::Login_Request(&client, r);
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    RunCompletionsFor(server, std::chrono::milliseconds(500));
 }
 
 GTEST_TEST(LoginTests, LoginWithOldPasswordVersionUpgradesInBackground)
@@ -362,10 +395,83 @@ GTEST_TEST(LoginTests, LoginWithOldPasswordVersionUpgradesInBackground)
         EXPECT_CALL(*dynamic_cast<MockClient*>(client.get()), Connected()).WillRepeatedly(Return(true));
 
         PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, ExpectedUsername.size() + UnhashedPassword.size() + 2);
-        PacketReader r(b.AddBreakString(ExpectedUsername).AddBreakString(UnhashedPassword).Get());
+        PacketReader r(b.AddBreakString(ExpectedUsername).AddBreakString(UnhashedPassword).Raw());
         r.GetShort(); // skip first two bytes (Family/Action - packet id, normally consumed from the reader when selecting the handler)
         Handlers::Login_Request(client.get(), r);
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        RunCompletionsFor(server, std::chrono::milliseconds(1500));
     }
 }
+
+GTEST_TEST(LoginTests, CharactersAreReadOffTheGameThread)
+{
+    Console::SuppressOutput(true);
+
+    const std::string ExpectedUsername = "test_user";
+    const std::string UnhashedPassword = "test_pass";
+
+    Config config, admin_config;
+    CreateConfigWithTestDefaults(config, admin_config);
+    config["PasswordCurrentVersion"] = int(HashFunc::SHA256);
+
+    std::string passwordCopy(UnhashedPassword);
+    Sha256Hasher sha256;
+    auto saltedPassword = Hasher::SaltPassword(std::string(config["PasswordSalt"]), ExpectedUsername, std::move(passwordCopy)).str();
+
+    auto mockDatabase = CreateMockDatabase();
+    auto mockDatabaseFactory = CreateMockDatabaseFactory(mockDatabase, false);
+
+    Database_Result passwordResult;
+    std::unordered_map<std::string, util::variant> passwordColumns;
+    passwordColumns["password_version"] = util::variant(HashFunc::SHA256);
+    passwordColumns["password"] = sha256.hash(saltedPassword);
+    passwordResult.push_back(passwordColumns);
+
+    EXPECT_CALL(*dynamic_cast<MockDatabase*>(mockDatabase.get()),
+                RawQuery(StartsWith("SELECT password, password_version FROM accounts"), _, _))
+        .WillOnce(Return(passwordResult));
+
+    // Remember which threads read the account's characters
+    std::mutex threadsLock;
+    std::vector<std::thread::id> characterThreads;
+
+    EXPECT_CALL(*dynamic_cast<MockDatabase*>(mockDatabase.get()),
+                RawQuery(HasSubstr("FROM characters"), _, _))
+        .WillRepeatedly(DoAll(InvokeWithoutArgs([&]()
+        {
+            std::lock_guard<std::mutex> guard(threadsLock);
+            characterThreads.push_back(std::this_thread::get_id());
+        }), Return(Database_Result())));
+
+    EXPECT_CALL(*dynamic_cast<MockDatabase*>(mockDatabase.get()),
+                RawQuery(StartsWith("UPDATE accounts SET lastused = "), _, _))
+        .WillRepeatedly(Return(Database_Result()));
+
+    EOServer server(IPAddress("127.0.0.1"), TestServerPort, mockDatabaseFactory, config, admin_config);
+
+    {
+        MockClient client(&server);
+
+        PacketBuilder expectedResponse(PACKET_LOGIN, PACKET_REPLY, 5);
+        expectedResponse.AddShort(LOGIN_OK);
+        expectedResponse.AddChar(0);
+        expectedResponse.AddByte(2);
+        expectedResponse.AddByte(255);
+        EXPECT_CALL(client, Send(expectedResponse)).Times(1);
+        EXPECT_CALL(client, Connected()).WillRepeatedly(Return(true));
+
+        PacketBuilder b(PACKET_LOGIN, PACKET_REQUEST, ExpectedUsername.size() + UnhashedPassword.size() + 2);
+        PacketReader r(b.AddBreakString(ExpectedUsername).AddBreakString(UnhashedPassword).Raw());
+        r.GetShort();
+        Handlers::Login_Request(&client, r);
+
+        RunCompletionsFor(server, std::chrono::milliseconds(1000));
+    }
+
+    // Building the Player on the game thread must not go back to the database
+    std::lock_guard<std::mutex> guard(threadsLock);
+    ASSERT_FALSE(characterThreads.empty());
+
+    for (const auto& id : characterThreads)
+        ASSERT_NE(std::this_thread::get_id(), id);
+}
@@ -0,0 +1,423 @@
+#include <gtest/gtest.h>
+
+#include "character.hpp"
+#include "console.hpp"
+#include "map.hpp"
+#include "npc.hpp"
+#include "pathfinder.hpp"
+#include "packet.hpp"
+#include "player.hpp"
+#include "world.hpp"
+
+#include "testhelper/mocks.hpp"
+#include "testhelper/setup.hpp"
+
+// include the CPP file with the Chair functions in it for testing
+#include "../handlers/Chair.cpp"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// The grid only stores and compares pointers, so these never need to be real characters
+static Character* FakeCharacter(int n)
+{
+    static char storage[16];
+    return reinterpret_cast<Character*>(&storage[n]);
+}
+
+static std::vector<Character*> CharactersNear(const Map_Grid& grid, int x, int y, int range)
+{
+    std::vector<Character*> found;
+    grid.ForEachCharacter(x, y, range, [&found](Character* character) { found.push_back(character); });
+    return found;
+}
+
+GTEST_TEST(MapGridTests, QueriesOnlyVisitNearbyCells)
+{
+    Map_Grid grid;
+    grid.Reset(100, 100, 10);
+
+    grid.Add(FakeCharacter(0), 5, 5);
+    grid.Add(FakeCharacter(1), 95, 95);
+
+    auto near_origin = CharactersNear(grid, 2, 2, 5);
+    ASSERT_EQ(1u, near_origin.size());
+    ASSERT_EQ(FakeCharacter(0), near_origin[0]);
+
+    auto near_corner = CharactersNear(grid, 99, 99, 5);
+    ASSERT_EQ(1u, near_corner.size());
+    ASSERT_EQ(FakeCharacter(1), near_corner[0]);
+
+    ASSERT_EQ(2u, CharactersNear(grid, 50, 50, 50).size());
+}
+
+GTEST_TEST(MapGridTests, MoveAndRemoveKeepCellsInSync)
+{
+    Map_Grid grid;
+    grid.Reset(100, 100, 10);
+
+    grid.Add(FakeCharacter(0), 5, 5);
+    grid.Move(FakeCharacter(0), 5, 5, 55, 55);
+
+    ASSERT_TRUE(grid.At(5, 5).characters.empty());
+    ASSERT_EQ(1u, grid.At(55, 55).characters.size());
+
+    // Removing with a stale position still finds the entry
+    grid.Remove(FakeCharacter(0), 5, 5);
+
+    ASSERT_TRUE(grid.At(55, 55).characters.empty());
+    ASSERT_TRUE(CharactersNear(grid, 50, 50, 100).empty());
+}
+
+GTEST_TEST(MapGridTests, ItemsAreIndexedByTheirPosition)
+{
+    Map_Grid grid;
+    grid.Reset(20, 20, 4);
+
+    auto item = std::make_shared<Map_Item>(1, 1, 1, 10, 10, 0, 0.0);
+    grid.Add(item);
+
+    ASSERT_EQ(1u, grid.At(10, 10).items.size());
+    ASSERT_EQ(1u, grid.At(11, 9).items.size());
+    ASSERT_TRUE(grid.At(0, 0).items.empty());
+
+    grid.Remove(item.get());
+
+    ASSERT_TRUE(grid.At(10, 10).items.empty());
+}
+
+GTEST_TEST(MapGridTests, RectangleQueriesStayInsideTheRectangle)
+{
+    Map_Grid grid;
+    grid.Reset(100, 100, 10);
+
+    grid.Add(FakeCharacter(0), 45, 50);
+    grid.Add(FakeCharacter(1), 55, 50);
+
+    std::vector<Character*> found;
+    grid.ForEachCellIn(50, 40, 60, 60, [&found](const Map_Grid::Cell& cell)
+    {
+        found.insert(found.end(), cell.characters.begin(), cell.characters.end());
+    });
+
+    ASSERT_EQ(1u, found.size());
+    ASSERT_EQ(FakeCharacter(1), found[0]);
+}
+
+// Only NPC::scheduled is used by the schedule. The destructor needs a real map, so these are never destroyed.
+struct ScheduleNPCs
+{
+    alignas(NPC) unsigned char storage[3][sizeof(NPC)];
+
+    NPC* operator[](int n)
+    {
+        return reinterpret_cast<NPC*>(storage[n]);
+    }
+
+    ScheduleNPCs()
+    {
+        for (int n = 0; n < 3; ++n)
+            new (storage[n]) NPC(nullptr, 1, 0, 0, 0, 0, n + 1);
+    }
+};
+
+GTEST_TEST(MapNPCScheduleTests, TakesDueEventsSoonestFirst)
+{
+    ScheduleNPCs npcs;
+    Map_NPCSchedule schedule;
+    std::vector<NPC*> due;
+
+    schedule.Add(npcs[0], Map_NPCSchedule::Act, 3.0);
+    schedule.Add(npcs[1], Map_NPCSchedule::Act, 1.0);
+    schedule.Add(npcs[2], Map_NPCSchedule::Act, 2.0);
+    schedule.Add(npcs[2], Map_NPCSchedule::Talk, 0.5);
+
+    schedule.TakeDue(Map_NPCSchedule::Act, 2.5, due);
+    ASSERT_EQ((std::vector<NPC*>{npcs[1], npcs[2]}), due);
+
+    // Taken events are off the schedule until added again
+    schedule.TakeDue(Map_NPCSchedule::Act, 2.5, due);
+    ASSERT_TRUE(due.empty());
+
+    schedule.TakeDue(Map_NPCSchedule::Act, 10.0, due);
+    ASSERT_EQ((std::vector<NPC*>{npcs[0]}), due);
+
+    schedule.TakeDue(Map_NPCSchedule::Talk, 10.0, due);
+    ASSERT_EQ((std::vector<NPC*>{npcs[2]}), due);
+}
+
+GTEST_TEST(MapNPCScheduleTests, EarlierTimesReplaceLaterOnes)
+{
+    ScheduleNPCs npcs;
+    Map_NPCSchedule schedule;
+    std::vector<NPC*> due;
+
+    schedule.Add(npcs[0], Map_NPCSchedule::Spawn, 5.0);
+    schedule.Add(npcs[0], Map_NPCSchedule::Spawn, 1.0);
+    schedule.Add(npcs[0], Map_NPCSchedule::Spawn, 3.0);
+
+    schedule.TakeDue(Map_NPCSchedule::Spawn, 2.0, due);
+    ASSERT_EQ(1u, due.size());
+
+    // The superseded entry at 5.0 is dropped rather than firing a second time
+    schedule.TakeDue(Map_NPCSchedule::Spawn, 10.0, due);
+    ASSERT_TRUE(due.empty());
+}
+
+GTEST_TEST(MapNPCScheduleTests, RemoveAndClearDropEntries)
+{
+    ScheduleNPCs npcs;
+    Map_NPCSchedule schedule;
+    std::vector<NPC*> due;
+
+    schedule.Add(npcs[0], Map_NPCSchedule::Act, 1.0);
+    schedule.Add(npcs[1], Map_NPCSchedule::Act, 2.0);
+    schedule.Add(npcs[1], Map_NPCSchedule::Talk, 2.0);
+
+    schedule.Remove(npcs[1]);
+    schedule.TakeDue(Map_NPCSchedule::Act, 10.0, due);
+    ASSERT_EQ((std::vector<NPC*>{npcs[0]}), due);
+
+    schedule.TakeDue(Map_NPCSchedule::Talk, 10.0, due);
+    ASSERT_TRUE(due.empty());
+
+    schedule.Add(npcs[2], Map_NPCSchedule::Act, 1.0);
+    schedule.Clear();
+    schedule.TakeDue(Map_NPCSchedule::Act, 10.0, due);
+    ASSERT_TRUE(due.empty());
+
+    // Cleared NPCs can be scheduled again at any time
+    schedule.Add(npcs[2], Map_NPCSchedule::Act, 4.0);
+    schedule.TakeDue(Map_NPCSchedule::Act, 10.0, due);
+    ASSERT_EQ((std::vector<NPC*>{npcs[2]}), due);
+}
+
+static constexpr unsigned short TestServerPort = 38079;
+
+namespace
+{
+    // Just enough of a logged in character for the chair handler and map view tracking
+    struct ChairTestCharacter
+    {
+        NiceMock<MockClient> client;
+        Player player;
+        Character character;
+
+        ChairTestCharacter(EOServer& server, Map& map, const std::string& name, unsigned int id, unsigned char x, unsigned char y)
+            : client(&server)
+            , player(name)
+            , character(server.world)
+        {
+            player.id = id;
+            player.client = &client;
+            player.character = &character;
+            client.player = &player;
+
+            character.player = &player;
+            character.map = &map;
+            character.x = x;
+            character.y = y;
+            character.direction = DIRECTION_DOWN;
+            character.sitting = SIT_STAND;
+            character.nowhere = false;
+            character.spell_event = nullptr;
+            character.spell_ready = false;
+
+            map.characters.push_back(&character);
+            map.grid.Add(&character, x, y);
+            map.TrackView(&character);
+        }
+
+        ~ChairTestCharacter()
+        {
+            character.map->characters.clear();
+            client.player = nullptr;
+            player.client = nullptr;
+        }
+    };
+}
+
+// Sits a character on a chair one tile past the edge of a grid cell, then stands them back up
+GTEST_TEST(MapChairTests, StandingUpMovesBackAcrossCellEdge)
+{
+    Console::SuppressOutput(true);
+
+    Config config, aConfig;
+    CreateConfigWithTestDefaults(config, aConfig);
+
+    auto database = CreateMockDatabase();
+    EOServer server(IPAddress("127.0.0.1"), TestServerPort, CreateMockDatabaseFactory(database), config, aConfig);
+
+    Map map(-1, server.world);
+    map.width = 40;
+    map.height = 40;
+    map.tiles.resize(map.width * map.height);
+    map.grid.Reset(map.width, map.height, 10);
+
+    // The chair is the first column of the second cell, and faces back into the first
+    const unsigned char chair_x = 10;
+    const unsigned char y = 5;
+    map.GetTile(chair_x, y).tilespec = Map_Tile::ChairLeft;
+
+    ChairTestCharacter watcher(server, map, "watcher", 2, chair_x - 3, y);
+    ChairTestCharacter sitter(server, map, "sitter", 1, chair_x - 1, y);
+    Character& character = sitter.character;
+
+    {
+        PacketBuilder b(PACKET_CHAIR, PACKET_REQUEST, 3);
+        PacketReader r(b.AddChar(SIT_ACT_SIT).AddChar(chair_x).AddChar(y).Raw());
+        r.GetShort();
+        Handlers::Chair_Request(&character, r);
+    }
+
+    ASSERT_EQ(SIT_CHAIR, character.sitting);
+    ASSERT_EQ(chair_x, character.x);
+    ASSERT_EQ(1u, map.grid.At(chair_x, y).characters.size());
+    ASSERT_EQ(1u, map.grid.At(chair_x - 1, y).characters.size());
+
+    {
+        PacketBuilder b(PACKET_CHAIR, PACKET_REQUEST, 1);
+        PacketReader r(b.AddChar(SIT_ACT_STAND).Raw());
+        r.GetShort();
+        Handlers::Chair_Request(&character, r);
+    }
+
+    ASSERT_EQ(SIT_STAND, character.sitting);
+    ASSERT_EQ(chair_x - 1, character.x);
+    ASSERT_TRUE(map.grid.At(chair_x, y).characters.empty());
+    ASSERT_EQ(2u, map.grid.At(chair_x - 1, y).characters.size());
+
+    // Each still sees the other exactly once after the view sets were rebuilt twice
+    ASSERT_EQ((std::vector<Character*>{&watcher.character}), character.view_characters);
+    ASSERT_EQ((std::vector<Character*>{&character}), watcher.character.view_characters);
+}
+
+// A door opening or closing next to an NPC's cached path sends it looking for a new way
+GTEST_TEST(MapDoorTests, DoorsInvalidateCachedPaths)
+{
+    Console::SuppressOutput(true);
+
+    Config config, aConfig;
+    CreateConfigWithTestDefaults(config, aConfig);
+
+    auto database = CreateMockDatabase();
+    EOServer server(IPAddress("127.0.0.1"), TestServerPort, CreateMockDatabaseFactory(database), config, aConfig);
+
+    Map map(-1, server.world);
+    map.width = 6;
+    map.height = 2;
+    map.tiles.resize(map.width * map.height);
+    map.grid.Reset(map.width, map.height, 10);
+
+    Map_Warp& door = map.GetTile(3, 0).warp;
+    door.map = 1;
+    door.spec = Map_Warp::Door;
+
+    map.pathfinder.Reset(map.width, map.height, [&map](int x, int y) { return map.GetTile(x, y).Walkable(true); });
+
+    Pathfinder::Path path;
+    Direction direction;
+
+    ASSERT_TRUE(map.pathfinder.NextStep(path, 0, 0, 5, 0, 10, nullptr, direction));
+    ASSERT_EQ(map.pathfinder.Revision(), path.revision);
+
+    ASSERT_TRUE(map.OpenDoor(nullptr, 3, 0));
+    ASSERT_NE(map.pathfinder.Revision(), path.revision);
+
+    // The next step searches again instead of following the old path
+    ASSERT_TRUE(map.pathfinder.NextStep(path, path.from_x, path.from_y, 5, 0, 10, nullptr, direction));
+    ASSERT_EQ(map.pathfinder.Revision(), path.revision);
+
+    map.CloseDoor(3, 0);
+    ASSERT_NE(map.pathfinder.Revision(), path.revision);
+}
+
+// Bytes of a map file for small numbers, the way EO encodes them
+static char MapNumber(int n)
+{
+    return char(n + 1);
+}
+
+static std::string TestMapFile()
+{
+    std::string emf(0x2E, char(1));
+    emf[0x1F] = MapNumber(3);
+    emf[0x20] = MapNumber(0);
+    emf[0x25] = MapNumber(9);
+    emf[0x26] = MapNumber(7);
+    emf[0x2A] = MapNumber(0);
+    emf[0x2B] = MapNumber(4);
+    emf[0x2C] = MapNumber(5);
+
+    // No NPCs, unknowns or chests, then one row each of tile specs and warps
+    const char body[] = {
+        MapNumber(0), MapNumber(0), MapNumber(0),
+        MapNumber(1), MapNumber(2), MapNumber(1), MapNumber(3), MapNumber(Map_Tile::Wall),
+        MapNumber(1), MapNumber(6), MapNumber(1), MapNumber(7), MapNumber(2), char(254), MapNumber(1), MapNumber(2), MapNumber(0), MapNumber(0), char(254)
+    };
+
+    emf.append(body, sizeof(body));
+    return emf;
+}
+
+// The map is parsed from the file cache's image, so it loads even once the file is gone from disk
+GTEST_TEST(MapLoadTests, ParsesTheCachedImage)
+{
+    Console::SuppressOutput(true);
+
+    Config config, aConfig;
+    CreateConfigWithTestDefaults(config, aConfig);
+
+    auto database = CreateMockDatabase();
+    EOServer server(IPAddress("127.0.0.1"), TestServerPort, CreateMockDatabaseFactory(database), config, aConfig);
+    server.world->config["MapDir"] = "map_test_";
+
+    const std::string filename = "map_test_00001.emf";
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file << TestMapFile();
+    }
+
+    ASSERT_NE(nullptr, server.world->file_cache.Get(filename));
+    std::remove(filename.c_str());
+
+    Map map(1, server.world);
+
+    ASSERT_TRUE(map.exists);
+    ASSERT_TRUE(map.pk);
+    ASSERT_EQ(10, map.width);
+    ASSERT_EQ(8, map.height);
+    ASSERT_EQ(4, map.relog_x);
+    ASSERT_EQ(5, map.relog_y);
+    ASSERT_EQ(Map_Tile::Wall, map.GetTile(3, 2).tilespec);
+    ASSERT_EQ(2, map.GetTile(7, 6).warp.map);
+    ASSERT_EQ(1, map.GetTile(7, 6).warp.x);
+    ASSERT_EQ(2, map.GetTile(7, 6).warp.y);
+}
+
+GTEST_TEST(MapLoadTests, TruncatedImageFailsToLoad)
+{
+    Console::SuppressOutput(true);
+
+    Config config, aConfig;
+    CreateConfigWithTestDefaults(config, aConfig);
+
+    auto database = CreateMockDatabase();
+    EOServer server(IPAddress("127.0.0.1"), TestServerPort, CreateMockDatabaseFactory(database), config, aConfig);
+    server.world->config["MapDir"] = "map_test_";
+
+    const std::string filename = "map_test_00002.emf";
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file << TestMapFile().substr(0, 0x30);
+    }
+
+    Map map(2, server.world);
+    std::remove(filename.c_str());
+
+    ASSERT_FALSE(map.exists);
+}
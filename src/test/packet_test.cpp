@@ -0,0 +1,393 @@
+#include <gtest/gtest.h>
+
+#include "testhelper/mocks.hpp"
+#include "testhelper/setup.hpp"
+
+#include "console.hpp"
+#include "eoclient.hpp"
+#include "netthread.hpp"
+#include "packet.hpp"
+#include "util/ringbuffer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+
+namespace
+{
+    std::atomic<std::size_t> allocation_count{0};
+    thread_local bool count_allocations = false;
+    std::atomic<bool> count_all_allocations{false};
+}
+
+// Counts allocations made by the current thread while count_allocations is set, or by any thread while count_all_allocations is
+void* operator new(std::size_t size)
+{
+    if (count_allocations || count_all_allocations.load(std::memory_order_relaxed))
+        ++allocation_count;
+
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    // Straightforward copy-based implementation of the client encoding, used as a reference
+    std::string ReferenceEncode(const std::string& rawstr, unsigned char emulti)
+    {
+        if (emulti == 0 || ((unsigned char)rawstr[2] == PACKET_A_INIT && (unsigned char)rawstr[3] == PACKET_F_INIT))
+            return rawstr;
+
+        std::string str = PacketProcessor::DickWinder(rawstr, emulti);
+        int length = str.length();
+        std::string newstr(length, char());
+
+        newstr[0] = str[0];
+        newstr[1] = str[1];
+
+        int i = 2;
+        int ii = 2;
+
+        for (; i < length; i += 2)
+            newstr[i] = (unsigned char)str[ii++] ^ 0x80;
+
+        i = length - 1;
+
+        if (length % 2)
+            --i;
+
+        for (; i >= 2; i -= 2)
+            newstr[i] = (unsigned char)str[ii++] ^ 0x80;
+
+        for (int i = 2; i < length; ++i)
+        {
+            if (static_cast<unsigned char>(newstr[i]) == 128)
+                newstr[i] = 0;
+            else if (newstr[i] == 0)
+                newstr[i] = (char)128;
+        }
+
+        return newstr;
+    }
+
+    // Copy of the original byte-at-a-time decoder
+    std::string ReferenceDecode(const std::string& str, unsigned char emulti)
+    {
+        if (emulti == 0 || ((unsigned char)str[0] == PACKET_A_INIT && (unsigned char)str[1] == PACKET_F_INIT))
+            return str;
+
+        std::string newstr(str.length(), char());
+        int length = str.length();
+        int i = 0;
+        int ii = 0;
+
+        while (i < length)
+        {
+            newstr[ii++] = (unsigned char)str[i] ^ 0x80;
+            i += 2;
+        }
+
+        --i;
+
+        if (length % 2)
+            i -= 2;
+
+        do
+        {
+            newstr[ii++] = (unsigned char)str[i] ^ 0x80;
+            i -= 2;
+        } while (i >= 0);
+
+        for (int i = 2; i < length; ++i)
+        {
+            if (static_cast<unsigned char>(newstr[i]) == 128)
+                newstr[i] = 0;
+            else if (newstr[i] == 0)
+                newstr[i] = (char)128;
+        }
+
+        std::string wound;
+        std::string buffer;
+
+        for (char c : newstr)
+        {
+            if ((unsigned char)c % emulti == 0)
+            {
+                buffer += c;
+                continue;
+            }
+
+            wound.append(buffer.rbegin(), buffer.rend());
+            buffer.clear();
+            wound += c;
+        }
+
+        wound.append(buffer.rbegin(), buffer.rend());
+        return wound;
+    }
+
+    // Runs a test body once with each kernel the CPU supports, restoring the default afterwards
+    template <class F> void ForEachKernel(F f)
+    {
+        const PacketProcessor::Kernel original = PacketProcessor::ActiveKernel();
+
+        for (PacketProcessor::Kernel kernel : {PacketProcessor::Kernel::Scalar, PacketProcessor::Kernel::SSE2, PacketProcessor::Kernel::AVX2})
+        {
+            if (!PacketProcessor::SetKernel(kernel))
+                continue;
+
+            SCOPED_TRACE(int(kernel));
+            f();
+        }
+
+        PacketProcessor::SetKernel(original);
+    }
+
+    std::string RandomPacket(std::mt19937& rng, std::size_t length)
+    {
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::string packet(length, char());
+
+        // Bias towards values which hit the 0/128 swap and the multiple-of-emulti runs
+        for (char& c : packet)
+        {
+            switch (byte(rng) % 4)
+            {
+                case 0: c = 0; break;
+                case 1: c = char(128); break;
+                default: c = char(byte(rng)); break;
+            }
+        }
+
+        packet[2] = char(PACKET_REPLY);
+        packet[3] = char(PACKET_TALK);
+        return packet;
+    }
+}
+
+GTEST_TEST(PacketProcessorTests, EncodeMatchesReference)
+{
+    ForEachKernel([]()
+    {
+        std::mt19937 rng(1234);
+
+        for (unsigned char emulti = 6; emulti <= 12; ++emulti)
+        {
+            PacketProcessor processor;
+            processor.SetEMulti(emulti, emulti);
+
+            for (std::size_t length = 4; length < 300; ++length)
+            {
+                std::string packet = RandomPacket(rng, length);
+                ASSERT_EQ(ReferenceEncode(packet, emulti), processor.Encode(packet)) << "emulti=" << int(emulti) << " length=" << length;
+            }
+        }
+    });
+}
+
+GTEST_TEST(PacketProcessorTests, DecodeMatchesReference)
+{
+    ForEachKernel([]()
+    {
+        std::mt19937 rng(4321);
+
+        for (unsigned char emulti = 1; emulti <= 12; ++emulti)
+        {
+            PacketProcessor processor;
+            processor.SetEMulti(emulti, emulti);
+
+            for (std::size_t length = 2; length < 300; ++length)
+            {
+                std::string packet = RandomPacket(rng, length + 2).substr(2);
+                ASSERT_EQ(ReferenceDecode(packet, emulti), processor.Decode(packet)) << "emulti=" << int(emulti) << " length=" << length;
+            }
+        }
+    });
+}
+
+GTEST_TEST(PacketProcessorTests, InitPacketsAreNotEncoded)
+{
+    PacketProcessor processor;
+    processor.SetEMulti(8, 8);
+
+    std::string packet("\x05\x01\xFF\xFF\x11\x22\x33", 7);
+    ASSERT_EQ(packet, processor.Encode(packet));
+}
+
+GTEST_TEST(PacketProcessorTests, EncodeIntoWrappedRingBuffer)
+{
+    std::mt19937 rng(5678);
+    PacketProcessor processor;
+    processor.SetEMulti(9, 9);
+
+    util::RingBuffer buffer(64);
+
+    // Move the write position close to the end so the encoded packet wraps around
+    ASSERT_TRUE(buffer.Write(std::string(50, 'x')));
+    buffer.Consume(48);
+
+    std::string packet = RandomPacket(rng, 40);
+
+    util::RingBuffer::Segments segments = buffer.WritableSegments();
+    processor.Encode(packet.data(), packet.length(), segments);
+    buffer.Commit(packet.length());
+
+    ASSERT_EQ(std::string(2, 'x'), buffer.Read(2));
+    ASSERT_EQ(ReferenceEncode(packet, 9), buffer.Read(packet.length()));
+}
+
+GTEST_TEST(PacketProcessorTests, SharedPacketMatchesBuilder)
+{
+    PacketBuilder builder(PACKET_TALK, PACKET_MSG, 8);
+    builder.AddBreakString("server");
+    builder.AddBreakString("hello");
+
+    SharedPacket packet(builder);
+
+    ASSERT_EQ(builder.Get(), packet.Get());
+    ASSERT_EQ(builder.GetID(), packet.GetID());
+    ASSERT_EQ(builder.Length(), packet.Length());
+}
+
+GTEST_TEST(PacketProcessorTests, RoundTripDoesNotAllocate)
+{
+    PacketProcessor processor;
+    processor.SetEMulti(9, 9);
+
+    util::RingBuffer wire(4096);
+    std::array<char, 64> received;
+    std::array<char, 64> decoded;
+    ActionQueue queue;
+
+    // Builds a packet, sends it through the encoder and decoder and queues it as the server would
+    auto round_trip = [&](int i)
+    {
+        PacketBuilder builder(PACKET_TALK, PACKET_REPORT, 16);
+        builder.AddChar(i % 200).AddShort(1000 + i).AddBreakString("hello").AddString("world");
+
+        util::string_view raw = builder.Raw();
+        processor.Encode(raw.data(), raw.length(), wire.WritableSegments());
+        wire.Commit(raw.length());
+
+        std::size_t length = wire.Read(received.data(), raw.length()) - 2;
+        processor.Decode(received.data() + 2, length, decoded.data());
+
+        PacketReader reader(util::string_view(decoded.data(), length));
+        queue.AddAction(reader, 0.0);
+
+        std::unique_ptr<ActionQueue_Action> action = queue.Pop();
+        ASSERT_EQ(PACKET_TALK, action->reader.Family());
+        ASSERT_EQ(PACKET_REPORT, action->reader.Action());
+        ASSERT_EQ(unsigned(i % 200), action->reader.GetChar());
+        ASSERT_EQ(unsigned(1000 + i), action->reader.GetShort());
+        ASSERT_TRUE(action->reader.GetBreakStringView() == "hello");
+        ASSERT_TRUE(action->reader.GetEndStringView() == "world");
+        queue.Recycle(std::move(action));
+    };
+
+    // Fills the buffer pools
+    for (int i = 0; i < 10; ++i)
+        round_trip(i);
+
+    allocation_count = 0;
+    count_allocations = true;
+
+    for (int i = 0; i < 1000; ++i)
+        round_trip(i);
+
+    count_allocations = false;
+
+    ASSERT_EQ(0U, allocation_count.load());
+}
+
+GTEST_TEST(NetThreadTests, SteadyTrafficDoesNotAllocate)
+{
+    if (!ClientPoller::Available())
+        GTEST_SKIP() << "No ClientPoller on this system";
+
+    static const unsigned short TestServerPort = 38081;
+
+    Console::SuppressOutput(true);
+
+    Config config, admin_config;
+    CreateConfigWithTestDefaults(config, admin_config);
+    config["NetworkThreads"] = 1;
+
+    auto mockDatabase = CreateMockDatabase();
+    auto mockDatabaseFactory = CreateMockDatabaseFactory(mockDatabase, true);
+
+    EOServer server(IPAddress("127.0.0.1"), TestServerPort, mockDatabaseFactory, config, admin_config);
+    server.Listen(2, 2);
+
+    Client remote(IPAddress("127.0.0.1"), TestServerPort);
+    ASSERT_TRUE(remote.Connected());
+    remote.SetRecvBuffer(4096);
+    remote.SetSendBuffer(4096);
+
+    while (server.clients.empty())
+        server.Tick();
+
+    EOClient *client = static_cast<EOClient *>(server.clients.front());
+    ASSERT_NE(nullptr, client->net_thread);
+
+    PacketBuilder builder(PACKET_TALK, PACKET_REPORT, 40);
+    builder.AddChar(1).AddShort(1000).AddBreakString("hello").AddString("a message long enough to need the heap");
+
+    const std::string incoming = builder.Get();
+    std::array<char, 4096> received;
+    NetThread::Event event;
+
+    // One packet each way, through the network thread's queues, as the server would send and dispatch them
+    auto exchange = [&]()
+    {
+        client->Send(builder);
+        client->net_thread->Notify();
+        remote.Send(incoming);
+
+        std::size_t sent_back = 0;
+        bool dispatched = false;
+
+        while (sent_back < incoming.length() || !dispatched)
+        {
+            remote.Select(0.001);
+            sent_back += remote.Recv(received.data(), received.size());
+
+            if (!dispatched && client->net_thread->Receive(event))
+            {
+                ASSERT_EQ(NetThread::Event::Packet, event.type);
+                dispatched = true;
+                client->net_thread->Recycle(std::move(event.data));
+            }
+        }
+    };
+
+    // Fills the recycled buffers and the queues' spare nodes
+    for (int i = 0; i < 20; ++i)
+        exchange();
+
+    allocation_count = 0;
+    count_all_allocations = true;
+
+    for (int i = 0; i < 500; ++i)
+        exchange();
+
+    count_all_allocations = false;
+
+    ASSERT_EQ(0U, allocation_count.load());
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include "packettrace.hpp"
+#include "packet.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#ifndef NO_PACKET_TRACE
+GTEST_TEST(PacketTraceTests, IgnoreListFiltersFamiliesAndActions)
+{
+    PacketTrace trace;
+
+    ASSERT_FALSE(trace.Enabled(PACKET_WALK, PACKET_PLAYER));
+
+    trace.Configure("Walk, Connection:Ping", "");
+
+    ASSERT_FALSE(trace.Enabled(PACKET_WALK, PACKET_PLAYER));
+    ASSERT_FALSE(trace.Enabled(PACKET_WALK, PACKET_SPEC));
+    ASSERT_FALSE(trace.Enabled(PACKET_CONNECTION, PACKET_PING));
+    ASSERT_TRUE(trace.Enabled(PACKET_CONNECTION, PACKET_ACCEPT));
+    ASSERT_TRUE(trace.Enabled(PACKET_FACE, PACKET_PLAYER));
+
+    trace.Configure("*", "");
+
+    ASSERT_FALSE(trace.Enabled(PACKET_FACE, PACKET_PLAYER));
+}
+#endif // NO_PACKET_TRACE
+
+GTEST_TEST(PacketTraceTests, RecordsRoundTripThroughTraceFile)
+{
+    const char* filename = "packettrace_test.bin";
+    std::remove(filename);
+
+    {
+        PacketTrace trace;
+        trace.Configure("Walk", filename);
+
+        trace.Trace(7, PACKET_TALK, PACKET_REPORT, 42, PacketTrace::Recv, "Someone");
+        trace.Trace(7, PACKET_FACE, PACKET_PLAYER, 3, PacketTrace::Send, nullptr);
+        trace.Flush();
+    }
+
+    std::FILE* in = std::fopen(filename, "rb");
+    ASSERT_NE(nullptr, in);
+
+    char magic[sizeof PacketTrace::Magic];
+    ASSERT_EQ(sizeof magic, std::fread(magic, 1, sizeof magic, in));
+
+    unsigned char buffer[PacketTrace::RecordSize];
+    ASSERT_EQ(sizeof buffer, std::fread(buffer, 1, sizeof buffer, in));
+
+    PacketTrace::Record record = PacketTrace::DecodeRecord(buffer);
+    ASSERT_EQ(7U, record.client);
+    ASSERT_EQ(42U, record.length);
+    ASSERT_EQ(PACKET_TALK, record.family);
+    ASSERT_EQ(PACKET_REPORT, record.action);
+    ASSERT_EQ(PacketTrace::Recv, record.direction);
+    ASSERT_EQ(std::string("Someone"), record.name.data());
+
+    ASSERT_EQ(sizeof buffer, std::fread(buffer, 1, sizeof buffer, in));
+    record = PacketTrace::DecodeRecord(buffer);
+    ASSERT_EQ(PACKET_FACE, record.family);
+    ASSERT_EQ(std::string(), record.name.data());
+
+    ASSERT_EQ(0U, std::fread(buffer, 1, sizeof buffer, in));
+
+    std::rewind(in);
+    std::FILE* out = std::tmpfile();
+    ASSERT_TRUE(PacketTrace::Dump(in, out));
+
+    std::rewind(out);
+    char line[256];
+    ASSERT_NE(nullptr, std::fgets(line, sizeof line, out));
+    ASSERT_NE(nullptr, std::strstr(line, "Someone"));
+    ASSERT_NE(nullptr, std::strstr(line, "Family: Talk"));
+
+    std::fclose(out);
+    std::fclose(in);
+    std::remove(filename);
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include "pathfinder.hpp"
+#include "character.hpp"
+#include "util.hpp"
+
+#include <string>
+#include <vector>
+
+// '#' is a wall, everything else is walkable
+static void LoadLayout(Pathfinder& pathfinder, const std::vector<std::string>& layout)
+{
+    pathfinder.Reset(int(layout[0].size()), int(layout.size()), [&layout](int x, int y) { return layout[y][x] != '#'; });
+}
+
+static void Follow(std::vector<Direction> steps, int& x, int& y)
+{
+    while (!steps.empty())
+    {
+        switch (steps.back())
+        {
+            case DIRECTION_DOWN: ++y; break;
+            case DIRECTION_LEFT: --x; break;
+            case DIRECTION_UP: --y; break;
+            case DIRECTION_RIGHT: ++x; break;
+        }
+
+        steps.pop_back();
+    }
+}
+
+GTEST_TEST(PathfinderTests, FindPathGoesAroundWalls)
+{
+    Pathfinder pathfinder;
+    LoadLayout(pathfinder, {
+        ".....",
+        ".###.",
+        ".#...",
+        ".#.#.",
+        ".....",
+    });
+
+    std::vector<Direction> steps;
+    ASSERT_TRUE(pathfinder.FindPath(2, 3, 2, 0, 20, nullptr, steps));
+
+    // Up the corridor on the right: 2,3 -> 2,2 -> 3,2 -> 4,2 -> 4,1 -> 4,0 -> 3,0 -> 2,0
+    ASSERT_EQ(7u, steps.size());
+
+    int x = 2, y = 3;
+    Follow(steps, x, y);
+    ASSERT_EQ(2, x);
+    ASSERT_EQ(0, y);
+}
+
+GTEST_TEST(PathfinderTests, FindPathFailsWhenWalledIn)
+{
+    Pathfinder pathfinder;
+    LoadLayout(pathfinder, {
+        ".....",
+        ".###.",
+        ".#.#.",
+        ".###.",
+        ".....",
+    });
+
+    std::vector<Direction> steps;
+    ASSERT_FALSE(pathfinder.FindPath(2, 2, 0, 0, 50, nullptr, steps));
+    ASSERT_FALSE(pathfinder.FindPath(0, 0, 4, 4, 7, nullptr, steps));
+    ASSERT_TRUE(pathfinder.FindPath(0, 0, 4, 4, 8, nullptr, steps));
+}
+
+GTEST_TEST(PathfinderTests, OccupiedTilesNearTheStartAreAvoided)
+{
+    Pathfinder pathfinder;
+    LoadLayout(pathfinder, {
+        "...",
+        "...",
+        "...",
+    });
+
+    auto occupied = [](int x, int y) { return x == 1 && y == 1; };
+
+    std::vector<Direction> steps;
+    ASSERT_TRUE(pathfinder.FindPath(1, 2, 1, 0, 10, occupied, steps));
+    ASSERT_EQ(4u, steps.size());
+}
+
+GTEST_TEST(PathfinderTests, NextStepReusesThePathUntilTheMapChanges)
+{
+    Pathfinder pathfinder;
+    LoadLayout(pathfinder, {
+        "......",
+        "......",
+    });
+
+    Pathfinder::Path path;
+    Direction direction;
+
+    ASSERT_TRUE(pathfinder.NextStep(path, 0, 0, 5, 0, 10, nullptr, direction));
+    ASSERT_EQ(DIRECTION_RIGHT, direction);
+    ASSERT_EQ(4u, path.steps.size());
+
+    ASSERT_TRUE(pathfinder.NextStep(path, 1, 0, 5, 0, 10, nullptr, direction));
+    ASSERT_EQ(3u, path.steps.size());
+
+    pathfinder.SetWalkable(3, 0, false);
+
+    ASSERT_TRUE(pathfinder.NextStep(path, 2, 0, 5, 0, 10, nullptr, direction));
+    ASSERT_EQ(DIRECTION_DOWN, direction);
+}
+
+GTEST_TEST(PathfinderTests, FlowFieldLeadsEveryoneToTheTarget)
+{
+    Pathfinder pathfinder;
+    LoadLayout(pathfinder, {
+        ".....",
+        ".###.",
+        ".#...",
+        ".#.#.",
+        ".....",
+    });
+
+    const Pathfinder::FlowField& field = pathfinder.Field(1, 2, 0, 10);
+
+    ASSERT_EQ(0, field.At(2, 0));
+    ASSERT_EQ(7, field.At(2, 3));
+    ASSERT_EQ(Pathfinder::Unreachable, field.At(1, 1));
+
+    int x = 2, y = 3;
+    Direction direction;
+
+    while (field.At(x, y) > 1)
+    {
+        ASSERT_TRUE(pathfinder.FlowStep(field, x, y, nullptr, direction));
+        Follow({direction}, x, y);
+    }
+
+    ASSERT_EQ(1, util::path_length(x, y, 2, 0));
+}
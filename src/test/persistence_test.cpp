@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+
+#include "database.hpp"
+#include "persistence.hpp"
+
+#include "console.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef DATABASE_SQLITE
+
+namespace
+{
+    // Starting a transaction fails a set number of times before the database behaves
+    class FlakyDatabase : public Database
+    {
+    public:
+        explicit FlakyDatabase(int failures)
+            : Database(Database::SQLite, ":memory:", 0, "", "")
+            , failures(failures)
+        { }
+
+        bool BeginTransaction() override
+        {
+            if (failures > 0)
+            {
+                --failures;
+                throw Database_QueryFailed("Flaky database");
+            }
+
+            return Database::BeginTransaction();
+        }
+
+    private:
+        std::atomic<int> failures;
+    };
+
+    class PersistenceTest : public testing::Test
+    {
+    public:
+        PersistenceTest()
+            : db(std::make_shared<Database>(Database::SQLite, ":memory:", 0, "", ""))
+        {
+            Console::SuppressOutput(true);
+            db->RawQuery("CREATE TABLE characters (name TEXT, hp INTEGER)");
+            db->RawQuery("INSERT INTO characters (name, hp) VALUES ('alice', 0)");
+        }
+
+        ~PersistenceTest()
+        {
+            Console::SuppressOutput(false);
+        }
+
+    protected:
+        std::shared_ptr<Database> db;
+
+        static Persistence_Batch SetHP(int hp)
+        {
+            Persistence_Batch batch;
+            batch.queries.push_back(Database_Query{"UPDATE characters SET hp = # WHERE name = '$'", {std::to_string(hp), "alice"}});
+            batch.characters.push_back("alice");
+            return batch;
+        }
+
+        int HP()
+        {
+            return static_cast<int>(db->Query("SELECT hp FROM characters WHERE name = 'alice'").front()["hp"]);
+        }
+    };
+}
+
+TEST_F(PersistenceTest, BatchesAreWrittenInOrder)
+{
+    Persistence persistence(db, true);
+    ASSERT_TRUE(persistence.Threaded());
+
+    for (int i = 1; i <= 100; ++i)
+        persistence.Queue(SetHP(i));
+
+    persistence.Drain();
+
+    ASSERT_EQ(0u, persistence.Pending());
+    ASSERT_EQ(100, HP());
+}
+
+TEST_F(PersistenceTest, WaitingForACharacterWaitsForItsSaves)
+{
+    Persistence persistence(db, true);
+
+    persistence.Queue(SetHP(5));
+    persistence.WaitForCharacter("alice");
+
+    ASSERT_EQ(5, HP());
+    ASSERT_FALSE(persistence.WaitForCharacter("alice"));
+    ASSERT_FALSE(persistence.WaitForCharacter("bob"));
+}
+
+TEST_F(PersistenceTest, DestroyingWritesWhatIsLeft)
+{
+    {
+        Persistence persistence(db, true);
+
+        for (int i = 1; i <= 20; ++i)
+            persistence.Queue(SetHP(i));
+    }
+
+    ASSERT_EQ(20, HP());
+}
+
+TEST_F(PersistenceTest, FailedBatchesAreRolledBackAndReported)
+{
+    Persistence persistence(db, false);
+
+    Persistence_Batch batch = SetHP(7);
+    batch.queries.push_back(Database_Query{"UPDATE missing_table SET hp = 1", {}});
+    batch.guilds.push_back("ABC");
+    persistence.Queue(std::move(batch));
+
+    // Nothing in the batch is written
+    ASSERT_EQ(0, HP());
+
+    // The whole batch is handed back, so whoever it saved can be saved in full
+    std::vector<Persistence_Batch> failed;
+    ASSERT_TRUE(persistence.TakeFailures(failed));
+    ASSERT_EQ(1u, failed.size());
+    ASSERT_EQ(2u, failed[0].queries.size());
+    ASSERT_EQ(std::vector<std::string>{"alice"}, failed[0].characters);
+    ASSERT_EQ(std::vector<std::string>{"ABC"}, failed[0].guilds);
+
+    ASSERT_FALSE(persistence.TakeFailures(failed));
+
+    persistence.Queue(SetHP(8));
+    ASSERT_EQ(8, HP());
+}
+
+TEST_F(PersistenceTest, FailedBatchesAreRetriedBeforeLaterSaves)
+{
+    // Fails the whole first round of attempts and the start of the second
+    std::shared_ptr<FlakyDatabase> flaky = std::make_shared<FlakyDatabase>(Persistence::Attempts + 1);
+    flaky->RawQuery("CREATE TABLE characters (name TEXT, hp INTEGER)");
+    flaky->RawQuery("INSERT INTO characters (name, hp) VALUES ('alice', 0)");
+    flaky->RawQuery("CREATE TABLE saves (hp INTEGER)");
+    db = flaky;
+
+    Persistence persistence(db, true, 0.0);
+
+    for (int hp = 1; hp <= 2; ++hp)
+    {
+        Persistence_Batch batch = SetHP(hp);
+        batch.queries.push_back(Database_Query{"INSERT INTO saves (hp) VALUES (#)", {std::to_string(hp)}});
+        persistence.Queue(std::move(batch));
+    }
+
+    persistence.Drain();
+
+    // The newer save lands last and the older one is not lost
+    ASSERT_EQ(2, HP());
+
+    Database_Result saves = db->Query("SELECT hp FROM saves ORDER BY rowid");
+    ASSERT_EQ(2u, saves.size());
+    ASSERT_EQ(1, static_cast<int>(saves[0]["hp"]));
+    ASSERT_EQ(2, static_cast<int>(saves[1]["hp"]));
+
+    std::vector<Persistence_Batch> failed;
+    ASSERT_FALSE(persistence.TakeFailures(failed));
+}
+
+TEST_F(PersistenceTest, CharactersStayPendingWhileTheirSaveIsRetried)
+{
+    std::shared_ptr<FlakyDatabase> flaky = std::make_shared<FlakyDatabase>(Persistence::Attempts + 1);
+    flaky->RawQuery("CREATE TABLE characters (name TEXT, hp INTEGER)");
+    flaky->RawQuery("INSERT INTO characters (name, hp) VALUES ('alice', 0)");
+    db = flaky;
+
+    Persistence persistence(db, true, 0.0);
+
+    persistence.Queue(SetHP(3));
+
+    // Whoever loads the character next must see the retried save
+    persistence.WaitForCharacter("alice");
+    ASSERT_EQ(3, HP());
+}
+
+#endif // DATABASE_SQLITE
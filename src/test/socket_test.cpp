@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include "socket.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SLEEP_MS(x) std::this_thread::sleep_for(std::chrono::milliseconds(x))
+
+class SocketBackendTest : public testing::TestWithParam<SocketBackend>
+{
+protected:
+    static const uint16_t Port = 38079;
+
+    Client* AcceptOne(Server& server)
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            Client* client = server.Poll();
+            if (client)
+                return client;
+            SLEEP_MS(1);
+        }
+
+        return nullptr;
+    }
+
+    bool SelectUntilActive(Server& server, Client* client)
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            std::vector<Client*>* active = server.Select(0.01);
+            bool found = std::find(active->begin(), active->end(), client) != active->end();
+            active->clear();
+
+            if (found)
+                return true;
+        }
+
+        return false;
+    }
+};
+
+TEST_P(SocketBackendTest, ReceivesAndSendsData)
+{
+    Server server(IPAddress("127.0.0.1"), Port);
+    server.Listen(10);
+    server.SetBackend(GetParam());
+
+    Client remote(IPAddress("127.0.0.1"), Port);
+    remote.SetRecvBuffer(4096);
+    remote.SetSendBuffer(4096);
+    ASSERT_TRUE(remote.Connected());
+
+    Client* accepted = AcceptOne(server);
+    ASSERT_NE(nullptr, accepted);
+
+    remote.Send("hello");
+    while (remote.SendBufferRemaining() != 4096)
+        remote.Select(0.1);
+
+    ASSERT_TRUE(SelectUntilActive(server, accepted));
+    ASSERT_EQ("hello", accepted->Recv(5));
+
+    accepted->Send("world");
+
+    std::string received;
+    for (int i = 0; i < 100 && received.length() < 5; ++i)
+    {
+        server.Select(0.01)->clear();
+        remote.Select(0.01);
+        received += remote.Recv(5 - received.length());
+    }
+
+    ASSERT_EQ("world", received);
+}
+
+TEST_P(SocketBackendTest, SendsFileAfterBufferedData)
+{
+    Server server(IPAddress("127.0.0.1"), Port);
+    server.Listen(10);
+    server.SetBackend(GetParam());
+
+    Client remote(IPAddress("127.0.0.1"), Port);
+    remote.SetRecvBuffer(4096);
+    remote.SetSendBuffer(4096);
+
+    Client* accepted = AcceptOne(server);
+    ASSERT_NE(nullptr, accepted);
+
+    std::string file(256 * 1024, char());
+    for (std::size_t i = 0; i < file.length(); ++i)
+        file[i] = char(i * 7);
+
+    accepted->Send("head");
+    accepted->SendFile(std::make_shared<const std::string>(file));
+    ASSERT_TRUE(accepted->SendPending());
+
+    std::string expected = "head" + file;
+    std::string received;
+    for (int i = 0; i < 10000 && received.length() < expected.length(); ++i)
+    {
+        server.Select(0.001)->clear();
+        remote.Select(0.001);
+        received += remote.Recv(4096);
+    }
+
+    ASSERT_EQ(expected.length(), received.length());
+    ASSERT_TRUE(expected == received);
+    ASSERT_FALSE(accepted->SendPending());
+}
+
+TEST_P(SocketBackendTest, CoalescesSendsWithinATick)
+{
+    Server server(IPAddress("127.0.0.1"), Port);
+    server.Listen(10);
+    server.SetBackend(GetParam());
+
+    Client remote(IPAddress("127.0.0.1"), Port);
+    remote.SetRecvBuffer(4096);
+    remote.SetSendBuffer(4096);
+
+    Client* accepted = AcceptOne(server);
+    ASSERT_NE(nullptr, accepted);
+
+    std::string expected;
+    for (int i = 0; i < 20; ++i)
+    {
+        std::string packet(5 + i, char('a' + i));
+        accepted->Send(packet);
+        expected += packet;
+    }
+
+    server.Flush();
+
+    for (int i = 0; i < 100 && accepted->SendPending(); ++i)
+        server.Select(0.01)->clear();
+
+    ASSERT_FALSE(accepted->SendPending());
+    ASSERT_EQ(1u, accepted->Stats().send_calls.load());
+    ASSERT_EQ(expected.length(), accepted->Stats().bytes_sent.load());
+
+    std::string received;
+    for (int i = 0; i < 100 && received.length() < expected.length(); ++i)
+    {
+        remote.Select(0.01);
+        received += remote.Recv(4096);
+    }
+
+    ASSERT_EQ(expected, received);
+}
+
+TEST_P(SocketBackendTest, IdleClientsAreNotSelected)
+{
+    Server server(IPAddress("127.0.0.1"), Port);
+    server.Listen(10);
+    server.SetBackend(GetParam());
+
+    Client remote(IPAddress("127.0.0.1"), Port);
+    ASSERT_NE(nullptr, AcceptOne(server));
+
+    for (int i = 0; i < 10; ++i)
+    {
+        std::vector<Client*>* active = server.Select(0.001);
+        ASSERT_TRUE(active->empty());
+    }
+}
+
+TEST_P(SocketBackendTest, DisconnectClosesClient)
+{
+    Server server(IPAddress("127.0.0.1"), Port);
+    server.Listen(10);
+    server.SetBackend(GetParam());
+
+    Client* accepted = nullptr;
+
+    {
+        Client remote(IPAddress("127.0.0.1"), Port);
+        accepted = AcceptOne(server);
+        ASSERT_NE(nullptr, accepted);
+    }
+
+    for (int i = 0; i < 100 && accepted->Connected(); ++i)
+        server.Select(0.01)->clear();
+
+    ASSERT_FALSE(accepted->Connected());
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, SocketBackendTest,
+    testing::Values(SocketBackend::Select, SocketBackend::Poll, SocketBackend::Epoll));
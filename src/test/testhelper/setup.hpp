@@ -1,8 +1,10 @@
 #pragma once
 
+#include <chrono>
 #include <thread>
 
 #include "config.hpp"
+#include "eoserver.hpp"
 #include "eoserv_config.hpp"
 
 static void CreateConfigWithTestDefaults(Config& config, Config& admin_config)
@@ -73,3 +75,17 @@ static std::shared_ptr<DatabaseFactory> CreateMockDatabaseFactory(std::shared_pt
             }));
     return mockDatabaseFactory;
 }
+
+// Async operation callbacks are posted back to the game thread, so tests stand in for EOServer::Tick while they wait
+inline void RunCompletionsFor(EOServer& server, std::chrono::milliseconds duration)
+{
+    auto until = std::chrono::steady_clock::now() + duration;
+
+    while (std::chrono::steady_clock::now() < until)
+    {
+        server.RunCompletions();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    server.RunCompletions();
+}
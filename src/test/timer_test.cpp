@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+
+#include "timer.hpp"
+
+#include <vector>
+
+namespace
+{
+    struct Counter
+    {
+        int calls = 0;
+        TimeEvent* other = nullptr;
+        Timer* timer = nullptr;
+    };
+
+    void Count(void* param)
+    {
+        ++static_cast<Counter*>(param)->calls;
+    }
+
+    void CountAndDeleteOther(void* param)
+    {
+        Counter* counter = static_cast<Counter*>(param);
+        ++counter->calls;
+        delete counter->other;
+        counter->other = nullptr;
+    }
+
+    void CountAndDeleteSelf(void* param)
+    {
+        Counter* counter = static_cast<Counter*>(param);
+        ++counter->calls;
+        delete counter->other;
+    }
+
+    void CountAndUnregisterSelf(void* param)
+    {
+        Counter* counter = static_cast<Counter*>(param);
+        ++counter->calls;
+        counter->timer->Unregister(counter->other);
+    }
+}
+
+GTEST_TEST(TimerTests, EventFiresOnceItsTimeHasPassed)
+{
+    Timer timer;
+    Counter counter;
+
+    TimeEvent* event = new TimeEvent(Count, &counter, 0.5, 1);
+    timer.Register(event);
+    double start = event->lasttime;
+
+    timer.Tick(start + 0.4);
+    ASSERT_EQ(0, counter.calls);
+
+    timer.Tick(start + 0.6);
+    ASSERT_EQ(1, counter.calls);
+    ASSERT_EQ(0u, timer.Count());
+
+    timer.Tick(start + 2.0);
+    ASSERT_EQ(1, counter.calls);
+}
+
+GTEST_TEST(TimerTests, RepeatingEventFiresOncePerTick)
+{
+    Timer timer;
+    Counter counter;
+
+    TimeEvent* event = new TimeEvent(Count, &counter, 0.1, Timer::FOREVER);
+    timer.Register(event);
+    double start = event->lasttime;
+
+    // Falling behind catches up one call per Tick, as it always has
+    timer.Tick(start + 0.35);
+    ASSERT_EQ(1, counter.calls);
+
+    timer.Tick(start + 0.352);
+    ASSERT_EQ(2, counter.calls);
+
+    timer.Tick(start + 0.354);
+    ASSERT_EQ(3, counter.calls);
+
+    timer.Tick(start + 0.356);
+    ASSERT_EQ(3, counter.calls);
+    ASSERT_EQ(1u, timer.Count());
+}
+
+GTEST_TEST(TimerTests, LongEventsCascadeDownTheWheel)
+{
+    Timer timer;
+    std::vector<Counter> counters(4);
+    const double speeds[] = {0.2, 30.0, 400.0, 20000.0};
+
+    double start = 0.0;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        TimeEvent* event = new TimeEvent(Count, &counters[i], speeds[i], 1);
+        timer.Register(event);
+        start = event->lasttime;
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        timer.Tick(start + speeds[i] - 0.01);
+        ASSERT_EQ(0, counters[i].calls) << speeds[i];
+
+        timer.Tick(start + speeds[i] + 0.01);
+        ASSERT_EQ(1, counters[i].calls) << speeds[i];
+    }
+}
+
+GTEST_TEST(TimerTests, DeletingAnEventCancelsIt)
+{
+    Timer timer;
+    Counter counter;
+
+    TimeEvent* event = new TimeEvent(Count, &counter, 0.1, Timer::FOREVER);
+    timer.Register(event);
+    double start = event->lasttime;
+
+    delete event;
+    ASSERT_EQ(0u, timer.Count());
+
+    timer.Tick(start + 1.0);
+    ASSERT_EQ(0, counter.calls);
+}
+
+GTEST_TEST(TimerTests, CallbacksCanCancelEventsDueInTheSameTick)
+{
+    Timer timer;
+    Counter first, second;
+
+    TimeEvent* a = new TimeEvent(CountAndDeleteOther, &first, 0.1, Timer::FOREVER);
+    TimeEvent* b = new TimeEvent(CountAndDeleteOther, &second, 0.1, Timer::FOREVER);
+    first.other = b;
+    second.other = a;
+
+    timer.Register(a);
+    timer.Register(b);
+
+    timer.Tick(a->lasttime + 0.5);
+    ASSERT_EQ(1, first.calls + second.calls);
+    ASSERT_EQ(1u, timer.Count());
+}
+
+GTEST_TEST(TimerTests, CallbacksCanDeleteOrUnregisterTheirOwnEvent)
+{
+    Timer timer;
+    Counter deleted, unregistered;
+    unregistered.timer = &timer;
+
+    deleted.other = new TimeEvent(CountAndDeleteSelf, &deleted, 0.1, 1);
+    unregistered.other = new TimeEvent(CountAndUnregisterSelf, &unregistered, 0.1, Timer::FOREVER);
+
+    timer.Register(deleted.other);
+    timer.Register(unregistered.other);
+    double start = deleted.other->lasttime;
+
+    timer.Tick(start + 0.5);
+    timer.Tick(start + 1.0);
+
+    ASSERT_EQ(1, deleted.calls);
+    ASSERT_EQ(1, unregistered.calls);
+    ASSERT_EQ(0u, timer.Count());
+}
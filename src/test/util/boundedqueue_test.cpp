@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "util/boundedqueue.hpp"
+
+GTEST_TEST(BoundedQueueTests, PushFailsWhenFull)
+{
+    util::BoundedQueue<int> queue(4);
+    int value = 0;
+
+    ASSERT_FALSE(queue.TryPop(value));
+
+    for (int i = 0; i < 4; ++i)
+        ASSERT_TRUE(queue.TryPush(i));
+
+    ASSERT_FALSE(queue.TryPush(4));
+
+    ASSERT_TRUE(queue.TryPop(value));
+    ASSERT_EQ(0, value);
+
+    // The freed slot can be used again after wrapping around
+    ASSERT_TRUE(queue.TryPush(4));
+
+    for (int i = 1; i <= 4; ++i)
+    {
+        ASSERT_TRUE(queue.TryPop(value));
+        ASSERT_EQ(i, value);
+    }
+
+    ASSERT_FALSE(queue.TryPop(value));
+}
+
+GTEST_TEST(BoundedQueueTests, ValuesFromManyProducersArriveOnce)
+{
+    const int producers = 4;
+    const int count = 50000;
+    util::BoundedQueue<int> queue(256);
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, p]()
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                while (!queue.TryPush(p * count + i))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    // Each producer's values must come out in the order it pushed them
+    std::vector<int> next(producers, 0);
+    int received = 0;
+    int value;
+
+    while (received < producers * count)
+    {
+        if (!queue.TryPop(value))
+            continue;
+
+        int p = value / count;
+        ASSERT_EQ(next[p], value % count);
+        ++next[p];
+        ++received;
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    ASSERT_FALSE(queue.TryPop(value));
+}
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/mpscqueue.hpp"
+
+GTEST_TEST(MPSCQueueTests, PopFailsWhenEmpty)
+{
+    util::MPSCQueue<int> queue;
+    int value = 0;
+
+    ASSERT_TRUE(queue.Empty());
+    ASSERT_FALSE(queue.Pop(value));
+}
+
+GTEST_TEST(MPSCQueueTests, ValuesArePoppedInOrder)
+{
+    util::MPSCQueue<std::string> queue;
+    std::string value;
+
+    queue.Push("one");
+    queue.Push("two");
+    ASSERT_FALSE(queue.Empty());
+
+    ASSERT_TRUE(queue.Pop(value));
+    ASSERT_EQ("one", value);
+    ASSERT_TRUE(queue.Pop(value));
+    ASSERT_EQ("two", value);
+    ASSERT_FALSE(queue.Pop(value));
+}
+
+GTEST_TEST(MPSCQueueTests, EveryProducerIsReceivedInOrder)
+{
+    const int producers = 4;
+    const int count = 50000;
+    util::MPSCQueue<std::pair<int, int>> queue;
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, p]()
+        {
+            for (int i = 0; i < count; ++i)
+                queue.Push(std::make_pair(p, i));
+        });
+    }
+
+    // Values from one producer arrive in the order it pushed them
+    std::vector<int> expected(producers, 0);
+    int received = 0;
+    std::pair<int, int> value;
+
+    while (received < producers * count)
+    {
+        if (queue.Pop(value))
+        {
+            ASSERT_EQ(expected[value.first], value.second);
+            ++expected[value.first];
+            ++received;
+        }
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    ASSERT_TRUE(queue.Empty());
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "util/parallelfor.hpp"
+
+GTEST_TEST(ParallelForTests, EveryShardRunsOnce)
+{
+    util::ParallelFor pool(4);
+    std::vector<std::atomic<int>> runs(1000);
+
+    for (int round = 0; round < 50; ++round)
+    {
+        for (auto& count : runs)
+            count = 0;
+
+        pool.Run(runs.size(), [&](std::size_t shard) { ++runs[shard]; });
+
+        for (auto& count : runs)
+            ASSERT_EQ(1, count.load());
+    }
+}
+
+GTEST_TEST(ParallelForTests, NoThreadsRunsInOrderOnTheCaller)
+{
+    util::ParallelFor pool;
+    std::vector<std::size_t> order;
+    std::thread::id caller = std::this_thread::get_id();
+
+    pool.Run(5, [&](std::size_t shard)
+    {
+        ASSERT_EQ(caller, std::this_thread::get_id());
+        order.push_back(shard);
+    });
+
+    ASSERT_EQ((std::vector<std::size_t>{0, 1, 2, 3, 4}), order);
+}
+
+GTEST_TEST(ParallelForTests, ShardsAreSpreadOverThreads)
+{
+    util::ParallelFor pool(3);
+    std::atomic<int> waiting(0);
+    std::set<std::thread::id> threads;
+    std::mutex lock;
+
+    // Every shard waits for the others to start, which can only happen if they run at the same time
+    pool.Run(4, [&](std::size_t)
+    {
+        ++waiting;
+
+        while (waiting.load() < 4)
+            std::this_thread::yield();
+
+        std::lock_guard<std::mutex> guard(lock);
+        threads.insert(std::this_thread::get_id());
+    });
+
+    ASSERT_EQ(4u, threads.size());
+}
+
+GTEST_TEST(ParallelForTests, ExceptionsReachTheCaller)
+{
+    util::ParallelFor pool(2);
+    std::atomic<int> runs(0);
+
+    ASSERT_THROW(pool.Run(10, [&](std::size_t shard)
+    {
+        ++runs;
+
+        if (shard == 3)
+            throw std::runtime_error("shard failed");
+    }), std::runtime_error);
+
+    ASSERT_EQ(10, runs.load());
+
+    // Still usable afterwards, including after changing the number of threads
+    pool.SetNumThreads(4);
+    runs = 0;
+    pool.Run(10, [&](std::size_t) { ++runs; });
+    ASSERT_EQ(10, runs.load());
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include "util/ringbuffer.hpp"
+
+#include <stdexcept>
+#include <string>
+
+using RingBuffer = util::RingBuffer;
+
+GTEST_TEST(RingBufferTests, NonPowerOfTwoCapacityThrows)
+{
+    ASSERT_THROW(RingBuffer(12), std::runtime_error);
+}
+
+GTEST_TEST(RingBufferTests, WriteThenReadReturnsData)
+{
+    RingBuffer b(16);
+
+    ASSERT_TRUE(b.Write("hello"));
+    ASSERT_EQ(5u, b.Used());
+    ASSERT_EQ("hello", b.Read(5));
+    ASSERT_TRUE(b.Empty());
+}
+
+GTEST_TEST(RingBufferTests, WriteLargerThanRemainingFails)
+{
+    RingBuffer b(8);
+
+    ASSERT_TRUE(b.Write("12345"));
+    ASSERT_FALSE(b.Write("6789"));
+    ASSERT_EQ(5u, b.Used());
+}
+
+GTEST_TEST(RingBufferTests, ReadMoreThanUsedReturnsAvailable)
+{
+    RingBuffer b(8);
+
+    b.Write("abc");
+
+    ASSERT_EQ("abc", b.Read(100));
+}
+
+GTEST_TEST(RingBufferTests, WrappedDataSpansTwoSegments)
+{
+    RingBuffer b(8);
+
+    b.Write("123456");
+    b.Read(4);
+    ASSERT_TRUE(b.Write("7890"));
+
+    RingBuffer::Segments segments = b.ReadableSegments();
+    ASSERT_EQ("5678", std::string(segments[0].data, segments[0].length));
+    ASSERT_EQ("90", std::string(segments[1].data, segments[1].length));
+
+    ASSERT_EQ("567890", b.Read(6));
+}
+
+GTEST_TEST(RingBufferTests, CommitAfterFillingWritableSegments)
+{
+    RingBuffer b(8);
+
+    b.Write("123456");
+    b.Read(6);
+    b.Write("ab");
+
+    RingBuffer::Segments segments = b.WritableSegments();
+    ASSERT_EQ(6u, segments[0].length + segments[1].length);
+
+    std::string fill = "cdefgh";
+    std::size_t offset = 0;
+    for (const auto& segment : segments)
+    {
+        fill.copy(segment.data, segment.length, offset);
+        offset += segment.length;
+    }
+
+    b.Commit(6);
+
+    ASSERT_TRUE(b.Full());
+    ASSERT_EQ("abcdefgh", b.Read(8));
+}
+
+GTEST_TEST(RingBufferTests, ConsumeDiscardsFromFront)
+{
+    RingBuffer b(8);
+
+    b.Write("abcdef");
+    b.Consume(2);
+
+    ASSERT_EQ("cdef", b.Read(4));
+}
+
+GTEST_TEST(RingBufferTests, SwapExchangesContents)
+{
+    RingBuffer a(8), b(16);
+
+    a.Write("aaa");
+    b.Write("bb");
+
+    swap(a, b);
+
+    ASSERT_EQ(16u, a.Capacity());
+    ASSERT_EQ("bb", a.Read(2));
+    ASSERT_EQ(8u, b.Capacity());
+    ASSERT_EQ("aaa", b.Read(3));
+}
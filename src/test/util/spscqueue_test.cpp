@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+#include "util/spscqueue.hpp"
+
+GTEST_TEST(SPSCQueueTests, PopFailsWhenEmpty)
+{
+    util::SPSCQueue<int> queue;
+    int value = 0;
+
+    ASSERT_TRUE(queue.Empty());
+    ASSERT_FALSE(queue.Pop(value));
+}
+
+GTEST_TEST(SPSCQueueTests, ValuesArePoppedInOrder)
+{
+    util::SPSCQueue<std::string> queue;
+    std::string value;
+
+    queue.Push("one");
+    queue.Push("two");
+    ASSERT_FALSE(queue.Empty());
+
+    ASSERT_TRUE(queue.Pop(value));
+    ASSERT_EQ("one", value);
+
+    // Recycled nodes must not leak old values
+    queue.Push("three");
+
+    ASSERT_TRUE(queue.Pop(value));
+    ASSERT_EQ("two", value);
+    ASSERT_TRUE(queue.Pop(value));
+    ASSERT_EQ("three", value);
+    ASSERT_FALSE(queue.Pop(value));
+}
+
+GTEST_TEST(SPSCQueueTests, ValuesCrossThreadsInOrder)
+{
+    const int count = 100000;
+    util::SPSCQueue<int> queue;
+
+    std::thread producer([&queue]()
+    {
+        for (int i = 0; i < count; ++i)
+            queue.Push(i);
+    });
+
+    int expected = 0;
+    int value;
+
+    while (expected < count)
+    {
+        if (queue.Pop(value))
+        {
+            ASSERT_EQ(expected, value);
+            ++expected;
+        }
+    }
+
+    producer.join();
+    ASSERT_TRUE(queue.Empty());
+}
@@ -16,14 +16,28 @@ public:
     TestThreadPool(size_t numThreads = 4)
         : ThreadPool(numThreads) { }
 
-    void QueueWork(const util::ThreadPool::WorkFunc workFunc, const void * state)
+    void QueueWork(const util::ThreadPool::WorkFunc& workFunc, const void * state)
     {
         this->queueInternal(workFunc, state);
     }
 
+    void QueueWork(const util::ThreadPool::WorkFunc& workFunc, ThreadPool::Priority priority, const util::CancellationToken* token = nullptr)
+    {
+        this->queueInternal(workFunc, nullptr, priority, token);
+    }
+
+    bool TryQueueWork(const util::ThreadPool::WorkFunc& workFunc, ThreadPool::Priority priority)
+    {
+        return this->tryQueueInternal(workFunc, nullptr, priority);
+    }
+
+    void SetQueueLimit(ThreadPool::Priority priority, size_t limit) { this->setQueueLimitInternal(priority, limit); }
+    size_t Pending(ThreadPool::Priority priority) const { return this->pendingInternal(priority); }
+    util::ThreadPoolStats Stats() const { return this->statsInternal(); }
+
     size_t GetNumThreads() const { return this->_threads.size(); }
 
-    bool IsShutdown() const { return this->_workReadySemaphore.Count() == this->_threads.size() && this->_terminating; }
+    bool IsShutdown() const { return this->_liveThreads == 0 && this->_terminating; }
 
     void SetNumThreads(size_t numThreads)
     {
@@ -284,3 +298,172 @@ GTEST_TEST(ThreadPoolTests, ShutdownPreventsStateChanges)
 
     testThreadPool.JoinAll();
 }
+
+GTEST_TEST(ThreadPoolTests, InteractiveWorkRunsBeforeBackgroundWork)
+{
+    TestThreadPool testThreadPool(1);
+
+    Semaphore blocker(0);
+    std::vector<ThreadPool::Priority> order;
+
+    testThreadPool.QueueWork([&blocker](const void *) { blocker.Wait(std::chrono::milliseconds(1000)); }, ThreadPool::Priority::Interactive);
+    SLEEP_MS(50);
+
+    // Background work queued first still waits for the interactive work queued after it
+    testThreadPool.QueueWork([&order](const void *) { order.push_back(ThreadPool::Priority::Background); }, ThreadPool::Priority::Background);
+    testThreadPool.QueueWork([&order](const void *) { order.push_back(ThreadPool::Priority::Interactive); }, ThreadPool::Priority::Interactive);
+
+    blocker.Release();
+    SLEEP_MS(100);
+
+    ASSERT_EQ(2u, order.size());
+    ASSERT_EQ(ThreadPool::Priority::Interactive, order[0]) << "Expected interactive work to run first";
+    ASSERT_EQ(ThreadPool::Priority::Background, order[1]);
+
+    testThreadPool.JoinAll();
+}
+
+GTEST_TEST(ThreadPoolTests, CancelledWorkIsNotRun)
+{
+    TestThreadPool testThreadPool(1);
+
+    Semaphore blocker(0);
+    volatile bool ran = false;
+    util::CancellationToken token;
+
+    testThreadPool.QueueWork([&blocker](const void *) { blocker.Wait(std::chrono::milliseconds(1000)); }, ThreadPool::Priority::Interactive);
+    testThreadPool.QueueWork([&ran](const void *) { ran = true; }, ThreadPool::Priority::Interactive, &token);
+
+    token.Cancel();
+    blocker.Release();
+    SLEEP_MS(100);
+
+    ASSERT_FALSE(ran) << "Expected cancelled work to be dropped";
+    ASSERT_EQ(0u, testThreadPool.Pending(ThreadPool::Priority::Interactive));
+
+    util::ThreadPoolStats stats = testThreadPool.Stats();
+    const util::ThreadPoolStats::Class& interactive = stats.classes[static_cast<size_t>(ThreadPool::Priority::Interactive)];
+    ASSERT_EQ(1ull, interactive.completed);
+    ASSERT_EQ(1ull, interactive.cancelled);
+
+    testThreadPool.JoinAll();
+}
+
+GTEST_TEST(ThreadPoolTests, TryQueueRejectsWorkOverLimit)
+{
+    TestThreadPool testThreadPool(1);
+    testThreadPool.SetQueueLimit(ThreadPool::Priority::Background, 2);
+
+    Semaphore blocker(0);
+    auto workFunc = [&blocker](const void *) { blocker.Wait(std::chrono::milliseconds(1000)); };
+
+    ASSERT_TRUE(testThreadPool.TryQueueWork(workFunc, ThreadPool::Priority::Background));
+    ASSERT_TRUE(testThreadPool.TryQueueWork(workFunc, ThreadPool::Priority::Background));
+    ASSERT_FALSE(testThreadPool.TryQueueWork(workFunc, ThreadPool::Priority::Background)) << "Expected background work over the limit to be refused";
+
+    // The limit only applies to its own class
+    ASSERT_TRUE(testThreadPool.TryQueueWork(workFunc, ThreadPool::Priority::Interactive));
+
+    ASSERT_EQ(2u, testThreadPool.Pending(ThreadPool::Priority::Background));
+    ASSERT_EQ(1ull, testThreadPool.Stats().classes[static_cast<size_t>(ThreadPool::Priority::Background)].rejected);
+
+    blocker.Release(3);
+    SLEEP_MS(100);
+
+    ASSERT_EQ(0u, testThreadPool.Pending(ThreadPool::Priority::Background));
+    ASSERT_TRUE(testThreadPool.TryQueueWork(workFunc, ThreadPool::Priority::Background)) << "Expected room once queued work has run";
+
+    blocker.Release();
+    testThreadPool.JoinAll();
+}
+
+GTEST_TEST(ThreadPoolTests, LatencyHistogramsSampleQueuedWork)
+{
+    const unsigned sampledWork = 3;
+
+    TestThreadPool testThreadPool(1);
+
+    // A new thread starts its own sample count, so exactly one job in every LATENCY_SAMPLE it queues is timed
+    std::thread producer([&testThreadPool]()
+    {
+        for (unsigned i = 0; i < sampledWork * util::ThreadPoolStats::LATENCY_SAMPLE; ++i)
+            testThreadPool.QueueWork([](const void *) { }, nullptr);
+    });
+
+    producer.join();
+    SLEEP_MS(100);
+
+    util::ThreadPoolStats stats = testThreadPool.Stats();
+    const util::ThreadPoolStats::Class& interactive = stats.classes[static_cast<size_t>(ThreadPool::Priority::Interactive)];
+    ASSERT_EQ(sampledWork * util::ThreadPoolStats::LATENCY_SAMPLE, interactive.completed);
+
+    unsigned long long waits = 0, runs = 0;
+    for (size_t i = 0; i < util::ThreadPoolStats::LATENCY_BUCKETS; ++i)
+    {
+        waits += interactive.wait_latency[i];
+        runs += interactive.run_latency[i];
+    }
+
+    ASSERT_EQ(sampledWork, waits) << "Expected one in every LATENCY_SAMPLE jobs in the wait histogram";
+    ASSERT_EQ(sampledWork, runs) << "Expected one in every LATENCY_SAMPLE jobs in the run histogram";
+
+    testThreadPool.JoinAll();
+}
+
+GTEST_TEST(ThreadPoolTests, IdleWorkersStealQueuedWork)
+{
+    const size_t nestedWork = 3;
+
+    TestThreadPool testThreadPool(4);
+
+    Semaphore nestedDone(0);
+    volatile bool allDone = false;
+
+    // Work queued from inside a job goes to that worker's own deque, so the job can only
+    //   see it finish while it is still running if other workers take it
+    testThreadPool.QueueWork([&](const void *)
+    {
+        for (size_t i = 0; i < nestedWork; ++i)
+            testThreadPool.QueueWork([&nestedDone](const void *) { nestedDone.Release(); }, nullptr);
+
+        bool finished = true;
+        for (size_t i = 0; i < nestedWork; ++i)
+            finished = nestedDone.Wait(std::chrono::milliseconds(1000)) && finished;
+
+        allDone = finished;
+    }, nullptr);
+
+    SLEEP_MS(200);
+
+    ASSERT_TRUE(allDone) << "Expected nested work to be stolen by idle workers";
+    ASSERT_GE(testThreadPool.Stats().classes[static_cast<size_t>(ThreadPool::Priority::Interactive)].stolen, nestedWork);
+
+    testThreadPool.JoinAll();
+}
+
+GTEST_TEST(ThreadPoolTests, ResizeKeepsQueuedWork)
+{
+    const size_t queuedWork = 3;
+
+    TestThreadPool testThreadPool(2);
+
+    Semaphore blocker(0);
+    volatile unsigned workCounter = 0;
+
+    for (size_t i = 0; i < 2; i++)
+        testThreadPool.QueueWork([&blocker](const void *) { blocker.Wait(std::chrono::milliseconds(200)); }, nullptr);
+
+    SLEEP_MS(50);
+
+    for (size_t i = 0; i < queuedWork; i++)
+        testThreadPool.QueueWork([&workCounter](const void *) { workCounter++; }, nullptr);
+
+    // Waits for the blocked work to time out, then restarts with one thread
+    testThreadPool.SetNumThreads(1);
+    SLEEP_MS(100);
+
+    ASSERT_EQ(1u, testThreadPool.GetNumThreads());
+    ASSERT_EQ(queuedWork, workCounter) << "Expected work queued before the resize to run after it";
+
+    testThreadPool.JoinAll();
+}
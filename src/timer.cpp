@@ -12,6 +12,9 @@
 #include "socket.hpp"
 #include "util.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <ctime>
 #include <exception>
 #include <memory>
@@ -107,6 +110,11 @@ void Clock::SetMaxDelta(int max_delta)
 
 std::unique_ptr<Clock> Timer::clock;
 
+const int Timer::WheelBits;
+const int Timer::WheelSize;
+const int Timer::WheelLevels;
+const int Timer::TicksPerSecond;
+
 struct Timer::impl_t
 {
 	std::mutex m;
@@ -124,8 +132,16 @@ struct Timer::impl_t
 	}
 };
 
+static std::uint64_t timer_tick(double time)
+{
+	return (time > 0.0) ? static_cast<std::uint64_t>(time * Timer::TicksPerSecond) : 0;
+}
+
 Timer::Timer()
 	: impl(new impl_t)
+	, due(nullptr)
+	, running(nullptr)
+	, count(0)
 {
 #ifdef WIN32
 #ifndef TIMER_GETTICKCOUNT
@@ -158,7 +174,10 @@ Timer::Timer()
 
 	this->resolution = sum / 100.0 - first;
 
-	this->changed = true;
+	for (auto &level : this->wheel)
+		level.fill(nullptr);
+
+	this->current = timer_tick(Timer::GetTime());
 }
 
 double Timer::GetTime()
@@ -177,80 +196,154 @@ void Timer::SetMaxDelta(int max_delta)
 		clock->SetMaxDelta(max_delta);
 }
 
+void Timer::Schedule(TimeEvent *timer)
+{
+	// Fires once the time is strictly past lasttime + speed, and never again within the same Tick
+	timer->expire = std::max(timer_tick(timer->lasttime + timer->speed) + 1, this->current + 1);
+	this->Place(timer);
+}
+
+void Timer::Place(TimeEvent *timer)
+{
+	std::uint64_t delta = timer->expire - this->current;
+	std::uint64_t place = timer->expire;
+	int level = 0;
+
+	while (level < WheelLevels - 1 && delta >= (std::uint64_t(1) << (WheelBits * (level + 1))))
+		++level;
+
+	// Anything further away than the top level covers waits in its last slot and is placed again from there
+	std::uint64_t limit = std::uint64_t(1) << (WheelBits * WheelLevels);
+
+	if (delta >= limit)
+		place = this->current + limit - 1;
+
+	timer->Link(this->wheel[level][(place >> (WheelBits * level)) & (WheelSize - 1)]);
+}
+
+void Timer::Cascade(int level)
+{
+	TimeEvent *&slot = this->wheel[level][(this->current >> (WheelBits * level)) & (WheelSize - 1)];
+
+	while (slot)
+	{
+		TimeEvent *timer = slot;
+		timer->Unlink();
+		this->Place(timer);
+	}
+}
+
 void Timer::Tick()
 {
-	double currenttime = Timer::GetTime();
+	this->Tick(Timer::GetTime());
+}
+
+void Timer::Tick(double currenttime)
+{
+	std::uint64_t target = timer_tick(currenttime);
 
 	impl->lock();
-	if (this->changed)
+
+	if (this->count == 0)
+		this->current = std::max(this->current, target);
+
+	while (this->current < target)
 	{
-		this->execlist = this->timers;
-		this->changed = false;
+		++this->current;
+
+		// Each time a level wraps around, the next slot of the level above is spread out below it, top down
+		int wrapped = 0;
+
+		while (wrapped < WheelLevels - 1 && (this->current & ((std::uint64_t(1) << (WheelBits * (wrapped + 1))) - 1)) == 0)
+			++wrapped;
+
+		for (int level = wrapped; level > 0; --level)
+			this->Cascade(level);
+
+		TimeEvent *&slot = this->wheel[0][this->current & (WheelSize - 1)];
+
+		while (slot)
+		{
+			TimeEvent *timer = slot;
+			timer->Unlink();
+			timer->Link(this->due);
+		}
 	}
 
-	UTIL_FOREACH(this->execlist, timer)
+	while (this->due)
 	{
-		if (this->timers.find(timer) == this->timers.end())
-			continue;
+		TimeEvent *timer = this->due;
+		timer->Unlink();
 
-		if (timer->lasttime + timer->speed < currenttime)
+		if (!(timer->lasttime + timer->speed < currenttime))
 		{
-			impl->unlock();
-			timer->lasttime += timer->speed;
+			this->Schedule(timer);
+			continue;
+		}
+
+		timer->lasttime += timer->speed;
+
+		if (timer->lifetime != Timer::FOREVER)
+			--timer->lifetime;
 
-			if (timer->lifetime != Timer::FOREVER)
-			{
-				--timer->lifetime;
+		if (timer->lifetime != 0)
+			this->Schedule(timer);
+		else
+			--this->count;
 
-				if (timer->lifetime == 0)
-				{
-					this->Unregister(timer);
-				}
-			}
+		this->running = timer;
+		impl->unlock();
 
 #ifndef DEBUG_EXCEPTIONS
-			try
-			{
+		try
+		{
 #endif // DEBUG_EXCEPTIONS
-				timer->callback(timer->param);
+			timer->callback(timer->param);
 #ifndef DEBUG_EXCEPTIONS
-			}
-			catch (Socket_Exception& e)
-			{
-				Console::Err("Timer callback caused an exception");
-				Console::Err("%s: %s", e.what(), e.error());
-			}
-			catch (Database_Exception& e)
-			{
-				Console::Err("Timer callback caused an exception");
-				Console::Err("%s: %s", e.what(), e.error());
-			}
-			catch (std::runtime_error& e)
-			{
-				Console::Err("Timer callback caused an exception");
-				Console::Err("Runtime Error: %s", e.what());
-			}
-			catch (std::logic_error& e)
-			{
-				Console::Err("Timer callback caused an exception");
-				Console::Err("Logic Error: %s", e.what());
-			}
-			catch (std::exception& e)
-			{
-				Console::Err("Timer callback caused an exception");
-				Console::Err("Uncaught Exception: %s", e.what());
-			}
-			catch (...)
-			{
-				Console::Err("Timer callback caused an exception");
-			}
+		}
+		catch (Socket_Exception& e)
+		{
+			Console::Err("Timer callback caused an exception");
+			Console::Err("%s: %s", e.what(), e.error());
+		}
+		catch (Database_Exception& e)
+		{
+			Console::Err("Timer callback caused an exception");
+			Console::Err("%s: %s", e.what(), e.error());
+		}
+		catch (std::runtime_error& e)
+		{
+			Console::Err("Timer callback caused an exception");
+			Console::Err("Runtime Error: %s", e.what());
+		}
+		catch (std::logic_error& e)
+		{
+			Console::Err("Timer callback caused an exception");
+			Console::Err("Logic Error: %s", e.what());
+		}
+		catch (std::exception& e)
+		{
+			Console::Err("Timer callback caused an exception");
+			Console::Err("Uncaught Exception: %s", e.what());
+		}
+		catch (...)
+		{
+			Console::Err("Timer callback caused an exception");
+		}
 #endif // DEBUG_EXCEPTIONS
 
-			if (timer->manager == 0)
-				delete timer;
+		impl->lock();
 
+		// Not scheduled any more, either out of lifetime or unregistered by the callback
+		if (this->running && !timer->Linked())
+		{
+			timer->manager = 0;
+			impl->unlock();
+			delete timer;
 			impl->lock();
 		}
+
+		this->running = nullptr;
 	}
 
 	impl->unlock();
@@ -264,32 +357,75 @@ void Timer::Register(TimeEvent *timer)
 	}
 
 	timer->lasttime = Timer::GetTime();
-	timer->manager = this;
 
 	impl->lock();
-	this->changed = true;
-	this->timers.insert(timer);
+
+	if (timer->manager == this && timer->Linked())
+	{
+		timer->Unlink();
+		--this->count;
+	}
+
+	timer->manager = this;
+	this->Schedule(timer);
+	++this->count;
 	impl->unlock();
 }
 
 void Timer::Unregister(TimeEvent *timer)
 {
 	impl->lock();
-	this->changed = true;
-	this->timers.erase(timer);
+
+	if (timer->Linked())
+	{
+		timer->Unlink();
+		--this->count;
+	}
+
+	// Tick deletes it once its callback returns, and needs to hear about it if the callback deletes it first
+	if (timer != this->running)
+		timer->manager = 0;
+
 	impl->unlock();
-	timer->manager = 0;
 }
 
-Timer::~Timer()
+void Timer::Release(TimeEvent *timer)
 {
 	impl->lock();
-	UTIL_FOREACH(this->timers, timer)
+
+	if (timer->Linked())
 	{
-		timer->manager = 0;
-		delete timer;
+		timer->Unlink();
+		--this->count;
 	}
-	this->timers.clear();
+
+	if (timer == this->running)
+		this->running = nullptr;
+
+	impl->unlock();
+}
+
+Timer::~Timer()
+{
+	impl->lock();
+
+	auto free_list = [](TimeEvent *&list)
+	{
+		while (list)
+		{
+			TimeEvent *timer = list;
+			timer->Unlink();
+			timer->manager = 0;
+			delete timer;
+		}
+	};
+
+	for (auto &level : this->wheel)
+		for (TimeEvent *&slot : level)
+			free_list(slot);
+
+	free_list(this->due);
+	this->count = 0;
 	impl->unlock();
 
 #ifdef WIN32
@@ -302,6 +438,9 @@ Timer::~Timer()
 }
 
 TimeEvent::TimeEvent(TimerCallback callback, void *param, double speed, int lifetime)
+	: expire(0)
+	, next(nullptr)
+	, pprev(nullptr)
 {
 	this->callback = callback;
 	this->param = param;
@@ -314,6 +453,28 @@ TimeEvent::~TimeEvent()
 {
 	if (this->manager != 0)
 	{
-		this->manager->Unregister(this);
+		this->manager->Release(this);
 	}
 }
+
+void TimeEvent::Link(TimeEvent *&head)
+{
+	this->next = head;
+
+	if (head)
+		head->pprev = &this->next;
+
+	head = this;
+	this->pprev = &head;
+}
+
+void TimeEvent::Unlink()
+{
+	*this->pprev = this->next;
+
+	if (this->next)
+		this->next->pprev = this->pprev;
+
+	this->next = nullptr;
+	this->pprev = nullptr;
+}
@@ -9,8 +9,10 @@
 
 #include "fwd/timer.hpp"
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
-#include <set>
 
 #include "platform.h"
 
@@ -37,6 +39,8 @@ class Clock
 
 /**
  * Manages and calls TimerEvent objects
+ * Events are kept in a hierarchical timing wheel, so registering and unregistering is O(1)
+ * and a Tick only touches the events that are due.
  */
 class Timer
 {
@@ -45,21 +49,52 @@ class Timer
 		std::unique_ptr<impl_t> impl;
 		static std::unique_ptr<Clock> clock;
 
+	public:
+		/**
+		 * Number of slots in each level of the wheel, as a power of two
+		 */
+		static const int WheelBits = 8;
+		static const int WheelSize = 1 << WheelBits;
+		static const int WheelLevels = 4;
+
+		/**
+		 * Number of slots in the bottom level per second
+		 */
+		static const int TicksPerSecond = 1000;
+
 	protected:
 		/**
-		 * List of TimeEvent objects a Timer controls
+		 * Events by the tick they expire on, each level covering WheelSize times the range of the one below
 		 */
-		std::set<TimeEvent *> timers;
+		std::array<std::array<TimeEvent *, WheelSize>, WheelLevels> wheel;
 
 		/**
-		 * Copy of timers which is used to allow timers to unregister themselves safely
+		 * Events that are due and yet to be called during a Tick
 		 */
-		std::set<TimeEvent *> execlist;
+		TimeEvent *due;
 
 		/**
-		 * Used to track when execlist needs to be remade
+		 * Last tick the wheel has been advanced to
 		 */
-		bool changed;
+		std::uint64_t current;
+
+		/**
+		 * Event whose callback is running, cleared if it gets destroyed
+		 */
+		TimeEvent *running;
+
+		std::size_t count;
+
+		void Schedule(TimeEvent *);
+		void Place(TimeEvent *);
+		void Cascade(int level);
+
+		/**
+		 * Unregisters a TimeEvent that is being destroyed
+		 */
+		void Release(TimeEvent *);
+
+		friend struct TimeEvent;
 
 	public:
 		/**
@@ -80,10 +115,15 @@ class Timer
 		static void SetMaxDelta(int max_delta);
 
 		/**
-		 * Check all contained TimeEvent objects and call any which are ready
+		 * Call any contained TimeEvent objects which are ready
 		 */
 		void Tick();
 
+		/**
+		 * Call any contained TimeEvent objects which are ready by currenttime
+		 */
+		void Tick(double currenttime);
+
 		/**
 		 * Register a TimeEvent object with the Timer object
 		 */
@@ -91,9 +131,15 @@ class Timer
 
 		/**
 		 * Unregister a TimeEvent object with the Timer object
+		 * Safe to call from any callback, including the event's own
 		 */
 		void Unregister(TimeEvent *);
 
+		/**
+		 * Number of registered TimeEvent objects
+		 */
+		std::size_t Count() const { return this->count; }
+
 		/**
 		 * Delete any remaining autofree TimeEvent objects
 		 */
@@ -102,49 +148,67 @@ class Timer
 
 /**
  * A timed event that should be managed by a Timer object
+ * Deleting it unregisters it, which is how timed events are cancelled.
+ * An event that runs out of lifetime, or is unregistered from a callback, is deleted by the Timer.
  */
 struct TimeEvent
 {
-	/**
-	 * Pointer to the Timer object that owns it
-	 * Set once it has been passed to Timer::Register
-	 */
-	Timer *manager;
-
-	/**
-	 * Function that is called each tick of the timer
-	 */
-	TimerCallback callback;
-
-	/**
-	 * Parameter that's passed to the callback function
-	 */
-	void *param;
-
-	/**
-	 * Time between ticks in seconds
-	 */
-	double speed;
-
-	/**
-	 * Time that the event last "ticked"
-	 */
-	double lasttime;
-
-	/**
-	 * Number of ticks before the Timer will stop calling it
-	 */
-	int lifetime;
-
-	/**
-	 * Construct a new TimeEvent object
-	 */
-	TimeEvent(TimerCallback callback, void *param, double speed, int lifetime = 1);
-
-	/**
-	 * Unregister the object from it's owning Timer object if it has one
-	 */
-	~TimeEvent();
+	private:
+		/**
+		 * Tick the event is next due on, and its place in the Timer's wheel
+		 */
+		std::uint64_t expire;
+		TimeEvent *next;
+		TimeEvent **pprev;
+
+		void Link(TimeEvent *&head);
+		void Unlink();
+
+		bool Linked() const { return this->pprev != nullptr; }
+
+		friend class Timer;
+
+	public:
+		/**
+		 * Pointer to the Timer object that owns it
+		 * Set once it has been passed to Timer::Register
+		 */
+		Timer *manager;
+
+		/**
+		 * Function that is called each tick of the timer
+		 */
+		TimerCallback callback;
+
+		/**
+		 * Parameter that's passed to the callback function
+		 */
+		void *param;
+
+		/**
+		 * Time between ticks in seconds
+		 */
+		double speed;
+
+		/**
+		 * Time that the event last "ticked"
+		 */
+		double lasttime;
+
+		/**
+		 * Number of ticks before the Timer will stop calling it
+		 */
+		int lifetime;
+
+		/**
+		 * Construct a new TimeEvent object
+		 */
+		TimeEvent(TimerCallback callback, void *param, double speed, int lifetime = 1);
+
+		/**
+		 * Unregister the object from it's owning Timer object if it has one
+		 */
+		~TimeEvent();
 };
 
 #endif // TIMER_HPP_INCLUDED
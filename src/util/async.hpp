@@ -6,10 +6,27 @@
 
 #pragma once
 
+#include <exception>
 #include <functional>
+#include <list>
+#include <memory>
 
-#include "threadpool.hpp"
-#include "../eoclient.hpp"
+class EOClient;
+
+// The parts of running an operation that need the client's server. They are defined with the server in eoserver.cpp,
+//   so this header stays free of it.
+struct AsyncHooks
+{
+    // Marks the client as running an operation, throwing if it already is
+    static void Claim(EOClient* client);
+    static void Release(EOClient* client);
+
+    // Runs work on the threadpool, then posts done back to the game thread of the client's server. done is told
+    //   whether work returned rather than threw, and the server waits for it before shutting down.
+    static void Dispatch(EOClient* client, std::function<void()> work, std::function<void(bool)> done);
+
+    static void ReportError(const std::exception& e);
+};
 
 template<typename TState, typename TResult = int>
 class AsyncOperation
@@ -51,6 +68,9 @@ public:
     }
 
 private:
+    // Runs the callbacks and frees the operation, on the game thread
+    void Finish(bool completed);
+
     AsyncOperation(TResult result, EOClient* client, TResult successCode = 0)
         : _client(client), _operation(nullptr), _successCode(successCode), _result(result) { }
 
@@ -66,69 +86,62 @@ private:
 template<typename TState, typename TResult>
 void AsyncOperation<TState, TResult>::Execute(const std::shared_ptr<TState>& state)
 {
-    if (this->_client->IsAsyncOpPending())
+    AsyncHooks::Claim(this->_client);
+
+    // There may not be an operation if the result is already known, in that case
+    //   finish synchronously so the callbacks still get called
+    if (this->_operation == nullptr)
     {
-        throw std::runtime_error("Client attempted to do something asynchronously but is already running an async operation");
+        this->Finish(true);
+        return;
     }
 
-    this->_client->AsyncOpPending(true);
+    // Only the operation itself runs on the threadpool. The callbacks use the client and the world, so they are
+    //   posted back to the game thread, which is what lets EOClient::Send go without a lock.
+    AsyncHooks::Dispatch(this->_client,
+        [this, state]() { this->_result = this->_operation(state); },
+        [this](bool completed) { this->Finish(completed); });
+}
 
-    auto workerProc = [this, state](const void*)
+template<typename TState, typename TResult>
+void AsyncOperation<TState, TResult>::Finish(bool completed)
+{
+    try
     {
-        try
+        if (completed && this->_result == this->_successCode)
         {
-            this->_result = this->_operation
-                ? this->_operation(state)
-                : this->_result;
-
-            if (this->_result == this->_successCode)
-            {
-                for (auto& cb : this->_successCallbacks)
-                    cb(this->_client);
-            }
-            else
-            {
-                for (auto& cb : this->_failureCallbacks)
-                    cb(this->_client, this->_result);
-            }
-
-            this->_client->AsyncOpPending(false);
-            for (auto& cb : this->_completeCallbacks)
-                cb();
-
-            // why `delete this`?
-            //
-            // AsyncOperation *must* be allocated with new in order for the long-running operation to keep going even after the calling
-            // context goes out of scope. In order to clean up these objects, we either have to rely on the caller to manually delete the
-            // object that is returned, or we can clean it up automatically here. Alternatively we could introduce a GC-like mechanism that
-            // periodically audits any AsyncOperation objects to see if they're still running and then deletes them, but that introduces
-            // tight coupling with AsyncOperation to other classes (World probably).
-            //
-            // Two assumptions:
-            // 1. The caller does not use AsyncOperation after it has completed its work (unlikely anyway)
-            // 2. The creator of AsyncOperation uses new to allocate it so delete doesn't corrupt the stack (hopefully they see this comment)
-            //
-            // This is very dangerous and I still don't like it but I think it's the best option available for dealing with how to clean
-            // up the memory. At this point the operation is done and there shouldn't be a reference to it anymore anyway so I think it should be fine.
-            //
-            delete this;
+            for (auto& cb : this->_successCallbacks)
+                cb(this->_client);
         }
-        catch (std::exception&)
+        else if (completed)
         {
-            this->_client->AsyncOpPending(false);
-            for (auto& cb : this->_completeCallbacks)
-                cb();
-
-            delete this;
-            throw;
+            for (auto& cb : this->_failureCallbacks)
+                cb(this->_client, this->_result);
         }
-    };
+    }
+    catch (std::exception& e)
+    {
+        AsyncHooks::ReportError(e);
+    }
 
-    // If there is an operation, queue it on the threadpool
-    // There may not be an operation if the result is already known, in that case
-    //   invoke the procedure synchronously so the callbacks still get called
-    if (this->_operation != nullptr)
-        util::ThreadPool::Queue(workerProc, nullptr);
-    else
-        workerProc(nullptr);
+    AsyncHooks::Release(this->_client);
+    for (auto& cb : this->_completeCallbacks)
+        cb();
+
+    // why `delete this`?
+    //
+    // AsyncOperation *must* be allocated with new in order for the long-running operation to keep going even after the calling
+    // context goes out of scope. In order to clean up these objects, we either have to rely on the caller to manually delete the
+    // object that is returned, or we can clean it up automatically here. Alternatively we could introduce a GC-like mechanism that
+    // periodically audits any AsyncOperation objects to see if they're still running and then deletes them, but that introduces
+    // tight coupling with AsyncOperation to other classes (World probably).
+    //
+    // Two assumptions:
+    // 1. The caller does not use AsyncOperation after it has completed its work (unlikely anyway)
+    // 2. The creator of AsyncOperation uses new to allocate it so delete doesn't corrupt the stack (hopefully they see this comment)
+    //
+    // This is very dangerous and I still don't like it but I think it's the best option available for dealing with how to clean
+    // up the memory. At this point the operation is done and there shouldn't be a reference to it anymore anyway so I think it should be fine.
+    //
+    delete this;
 }
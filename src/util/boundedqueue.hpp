@@ -0,0 +1,119 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace util
+{
+
+// Fixed-capacity lock-free queue which any number of threads may push to and pop from.
+// Each slot carries a sequence number saying whose turn it is to use it (D. Vyukov's bounded MPMC queue),
+// so TryPush fails instead of blocking when the queue is full.
+template <class T>
+class BoundedQueue
+{
+public:
+    // Capacity must be a power of two
+    explicit BoundedQueue(std::size_t capacity)
+        : _slots(new Slot[capacity])
+        , _mask(capacity - 1)
+        , _enqueue(0)
+        , _dequeue(0)
+    {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+            throw std::invalid_argument("BoundedQueue capacity must be a power of two");
+
+        for (std::size_t i = 0; i < capacity; ++i)
+            this->_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    std::size_t Capacity() const { return this->_mask + 1; }
+
+    bool TryPush(T value)
+    {
+        std::size_t pos = this->_enqueue.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        for (;;)
+        {
+            slot = &this->_slots[pos & this->_mask];
+            std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(pos);
+
+            if (diff == 0)
+            {
+                if (this->_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = this->_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->value = std::move(value);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& out)
+    {
+        std::size_t pos = this->_dequeue.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        for (;;)
+        {
+            slot = &this->_slots[pos & this->_mask];
+            std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(pos + 1);
+
+            if (diff == 0)
+            {
+                if (this->_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = this->_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+
+        out = std::move(slot->value);
+        slot->sequence.store(pos + this->_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    std::size_t _mask;
+
+    alignas(64) std::atomic<std::size_t> _enqueue;
+    alignas(64) std::atomic<std::size_t> _dequeue;
+};
+
+}
@@ -0,0 +1,85 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace util
+{
+
+// Unbounded lock-free queue for passing values from any number of producer threads to exactly one consumer thread.
+// Push may be called from any thread and Pop/Empty only from the consumer thread.
+// A value pushed by one thread may not be visible to Pop until that Push returns.
+template <class T>
+class MPSCQueue
+{
+public:
+    MPSCQueue()
+        : _head(new Node)
+        , _tail(_head.load(std::memory_order_relaxed)) { }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    ~MPSCQueue()
+    {
+        Node* node = this->_tail;
+
+        while (node)
+        {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    void Push(T value)
+    {
+        Node* node = new Node;
+        node->value = std::move(value);
+
+        // Claim the end of the queue, then link the previous end to it
+        Node* prev = this->_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool Pop(T& out)
+    {
+        Node* tail = this->_tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+
+        if (!next)
+            return false;
+
+        // next becomes the new stub node, its value is moved out and the old stub freed
+        out = std::move(next->value);
+        next->value = T();
+        this->_tail = next;
+        delete tail;
+        return true;
+    }
+
+    bool Empty() const
+    {
+        return this->_tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next{nullptr};
+        T value{};
+    };
+
+    // Producer side
+    alignas(64) std::atomic<Node*> _head;
+
+    // Consumer side
+    alignas(64) Node* _tail;
+};
+
+}
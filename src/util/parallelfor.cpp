@@ -0,0 +1,152 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#include "parallelfor.hpp"
+
+#include <algorithm>
+
+namespace util
+{
+
+const std::size_t ParallelFor::MAX_THREADS = 32;
+
+ParallelFor::ParallelFor(std::size_t numThreads)
+    : _generation(0)
+    , _busy(0)
+    , _terminating(false)
+    , _work(nullptr)
+    , _count(0)
+    , _next(0)
+{
+    this->SetNumThreads(numThreads);
+}
+
+ParallelFor::~ParallelFor()
+{
+    this->stopThreads();
+}
+
+void ParallelFor::SetNumThreads(std::size_t numThreads)
+{
+    numThreads = std::min(numThreads, MAX_THREADS);
+
+    if (numThreads == this->_threads.size())
+        return;
+
+    this->stopThreads();
+
+    // Workers start out having seen the current job, so none can miss a Run that follows
+    std::size_t generation = this->_generation;
+
+    for (std::size_t i = 0; i < numThreads; ++i)
+        this->_threads.emplace_back([this, generation]() { this->workerProc(generation); });
+}
+
+void ParallelFor::stopThreads()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->_lock);
+        this->_terminating = true;
+    }
+
+    this->_workReady.notify_all();
+
+    for (auto& thread : this->_threads)
+        thread.join();
+
+    this->_threads.clear();
+    this->_terminating = false;
+}
+
+void ParallelFor::Run(std::size_t count, const WorkFunc& work)
+{
+    if (count == 0)
+        return;
+
+    if (this->_threads.empty() || count == 1)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            work(i);
+
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(this->_lock);
+        this->_work = &work;
+        this->_count = count;
+        this->_next.store(0, std::memory_order_relaxed);
+        this->_error = nullptr;
+        this->_busy = this->_threads.size();
+        ++this->_generation;
+    }
+
+    this->_workReady.notify_all();
+
+    this->runShards();
+
+    std::exception_ptr error;
+
+    {
+        std::unique_lock<std::mutex> guard(this->_lock);
+        this->_workDone.wait(guard, [this]() { return this->_busy == 0; });
+        this->_work = nullptr;
+        error = this->_error;
+        this->_error = nullptr;
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void ParallelFor::runShards()
+{
+    for (;;)
+    {
+        std::size_t shard = this->_next.fetch_add(1, std::memory_order_relaxed);
+
+        if (shard >= this->_count)
+            break;
+
+        try
+        {
+            (*this->_work)(shard);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(this->_lock);
+
+            if (!this->_error)
+                this->_error = std::current_exception();
+        }
+    }
+}
+
+void ParallelFor::workerProc(std::size_t seen)
+{
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> guard(this->_lock);
+            this->_workReady.wait(guard, [this, seen]() { return this->_terminating || this->_generation != seen; });
+
+            if (this->_terminating)
+                return;
+
+            seen = this->_generation;
+        }
+
+        this->runShards();
+
+        {
+            std::lock_guard<std::mutex> guard(this->_lock);
+
+            if (--this->_busy == 0)
+                this->_workDone.notify_one();
+        }
+    }
+}
+
+}
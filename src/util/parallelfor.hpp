@@ -0,0 +1,67 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+
+// Fork/join helper for splitting one step of work in to independent shards.
+// Run hands out shard indexes from a shared counter, so whichever thread runs out of work first
+// takes the next unclaimed shard and large shards do not hold up the rest.
+// The calling thread works on shards too, and Run only returns once every shard is done.
+// Kept apart from ThreadPool so shards never wait behind queued database work.
+class ParallelFor
+{
+public:
+    typedef std::function<void(std::size_t shard)> WorkFunc;
+
+    // With no worker threads, Run calls every shard on the calling thread in order
+    explicit ParallelFor(std::size_t numThreads = 0);
+    ParallelFor(const ParallelFor&) = delete;
+    ParallelFor& operator=(const ParallelFor&) = delete;
+    ~ParallelFor();
+
+    // Must not be called while Run is in progress
+    void SetNumThreads(std::size_t numThreads);
+    std::size_t GetNumThreads() const { return this->_threads.size(); }
+
+    // Calls work(i) for every i in [0, count). Rethrows the first exception any shard threw, once all have finished.
+    void Run(std::size_t count, const WorkFunc& work);
+
+    static const std::size_t MAX_THREADS;
+
+private:
+    void stopThreads();
+    void workerProc(std::size_t seen);
+    void runShards();
+
+    std::mutex _lock;
+    std::condition_variable _workReady;
+    std::condition_variable _workDone;
+
+    // Bumped for every Run, so workers can tell a new job from one they have already finished
+    std::size_t _generation;
+    std::size_t _busy;
+    bool _terminating;
+
+    const WorkFunc* _work;
+    std::size_t _count;
+    std::atomic<std::size_t> _next;
+    std::exception_ptr _error;
+
+    std::vector<std::thread> _threads;
+};
+
+}
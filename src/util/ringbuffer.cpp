@@ -0,0 +1,173 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#include "ringbuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace util
+{
+
+static void ringbuffer_assert_power_of_two(std::size_t size)
+{
+	if (size != 0 && (size & (size - 1)) != 0)
+		throw std::runtime_error("Buffer size must be a power of two");
+}
+
+RingBuffer::RingBuffer()
+	: capacity(0)
+	, mask(0)
+	, gpos(0)
+	, used(0)
+{ }
+
+RingBuffer::RingBuffer(std::size_t capacity)
+	: RingBuffer()
+{
+	this->Reset(capacity);
+}
+
+RingBuffer::RingBuffer(RingBuffer &&other) noexcept
+	: RingBuffer()
+{
+	this->swap(other);
+}
+
+RingBuffer &RingBuffer::operator =(RingBuffer &&other) noexcept
+{
+	RingBuffer temp(std::move(other));
+	this->swap(temp);
+	return *this;
+}
+
+void RingBuffer::Reset(std::size_t capacity)
+{
+	ringbuffer_assert_power_of_two(capacity);
+
+	this->buffer.reset(capacity ? new char[capacity] : nullptr);
+	this->capacity = capacity;
+	this->mask = capacity ? capacity - 1 : 0;
+	this->gpos = 0;
+	this->used = 0;
+}
+
+RingBuffer::Segments RingBuffer::Split(std::size_t pos, std::size_t length) const
+{
+	Segments segments{{{nullptr, 0}, {nullptr, 0}}};
+
+	if (length == 0)
+		return segments;
+
+	const std::size_t first = std::min(length, this->capacity - pos);
+
+	segments[0] = {this->buffer.get() + pos, first};
+
+	if (first < length)
+		segments[1] = {this->buffer.get(), length - first};
+
+	return segments;
+}
+
+bool RingBuffer::Write(const char *data, std::size_t length)
+{
+	if (length > this->Remaining())
+		return false;
+
+	for (const Segment &segment : this->WritableSegments())
+	{
+		const std::size_t n = std::min(segment.length, length);
+
+		if (n == 0)
+			break;
+
+		std::memcpy(segment.data, data, n);
+		data += n;
+		length -= n;
+		this->used += n;
+	}
+
+	return true;
+}
+
+std::size_t RingBuffer::Read(char *out, std::size_t length)
+{
+	length = std::min(length, this->used);
+	std::size_t remaining = length;
+
+	for (const Segment &segment : this->ReadableSegments())
+	{
+		const std::size_t n = std::min(segment.length, remaining);
+
+		if (n == 0)
+			break;
+
+		std::memcpy(out, segment.data, n);
+		out += n;
+		remaining -= n;
+	}
+
+	this->Consume(length);
+
+	return length;
+}
+
+std::string RingBuffer::Read(std::size_t length)
+{
+	std::string ret(std::min(length, this->used), char());
+
+	if (!ret.empty())
+		this->Read(&ret[0], ret.length());
+
+	return ret;
+}
+
+RingBuffer::Segments RingBuffer::ReadableSegments() const
+{
+	return this->Split(this->gpos, this->used);
+}
+
+RingBuffer::Segments RingBuffer::WritableSegments() const
+{
+	return this->Split((this->gpos + this->used) & this->mask, this->Remaining());
+}
+
+void RingBuffer::Commit(std::size_t length)
+{
+	this->used += std::min(length, this->Remaining());
+}
+
+void RingBuffer::Consume(std::size_t length)
+{
+	length = std::min(length, this->used);
+
+	this->gpos = (this->gpos + length) & this->mask;
+	this->used -= length;
+
+	// Keep data contiguous for as long as possible
+	if (this->used == 0)
+		this->gpos = 0;
+}
+
+void RingBuffer::Clear()
+{
+	this->gpos = 0;
+	this->used = 0;
+}
+
+void RingBuffer::swap(RingBuffer &other) noexcept
+{
+	using std::swap;
+
+	swap(this->buffer, other.buffer);
+	swap(this->capacity, other.capacity);
+	swap(this->mask, other.mask);
+	swap(this->gpos, other.gpos);
+	swap(this->used, other.used);
+}
+
+}
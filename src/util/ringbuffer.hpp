@@ -0,0 +1,129 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef UTIL_RINGBUFFER_HPP_INCLUDED
+#define UTIL_RINGBUFFER_HPP_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace util
+{
+
+/**
+ * Fixed-capacity byte FIFO with a power-of-two size.
+ * Every operation touches at most two contiguous regions of the underlying storage,
+ * which are also exposed directly so they can be handed to readv/writev.
+ */
+class RingBuffer
+{
+	public:
+		/**
+		 * A contiguous region of the buffer's storage.
+		 */
+		struct Segment
+		{
+			char *data;
+			std::size_t length;
+		};
+
+		/**
+		 * Up to two segments, unused segments have a length of 0.
+		 */
+		typedef std::array<Segment, 2> Segments;
+
+	protected:
+		std::unique_ptr<char[]> buffer;
+		std::size_t capacity;
+		std::size_t mask;
+
+		/**
+		 * Offset of the first unread byte.
+		 */
+		std::size_t gpos;
+
+		/**
+		 * Number of bytes stored.
+		 */
+		std::size_t used;
+
+		Segments Split(std::size_t pos, std::size_t length) const;
+
+	public:
+		RingBuffer();
+
+		/**
+		 * Initializes an empty buffer.
+		 * @throw std::runtime_error if capacity is not a power of two
+		 */
+		explicit RingBuffer(std::size_t capacity);
+
+		RingBuffer(RingBuffer &&other) noexcept;
+		RingBuffer &operator =(RingBuffer &&other) noexcept;
+
+		RingBuffer(const RingBuffer &) = delete;
+		RingBuffer &operator =(const RingBuffer &) = delete;
+
+		/**
+		 * Discards all stored data and changes the capacity.
+		 * @throw std::runtime_error if capacity is not a power of two
+		 */
+		void Reset(std::size_t capacity);
+
+		std::size_t Capacity() const { return this->capacity; }
+		std::size_t Used() const { return this->used; }
+		std::size_t Remaining() const { return this->capacity - this->used; }
+		bool Empty() const { return this->used == 0; }
+		bool Full() const { return this->used == this->capacity; }
+
+		/**
+		 * Appends data to the buffer.
+		 * @return false (and writes nothing) if there is not enough room
+		 */
+		bool Write(const char *data, std::size_t length);
+		bool Write(const std::string &data) { return this->Write(data.data(), data.length()); }
+
+		/**
+		 * Removes up to length bytes from the front of the buffer.
+		 * @return Number of bytes copied to out
+		 */
+		std::size_t Read(char *out, std::size_t length);
+		std::string Read(std::size_t length);
+
+		/**
+		 * Regions holding stored data, in order. Pass to writev then call Consume.
+		 */
+		Segments ReadableSegments() const;
+
+		/**
+		 * Regions of free space, in order. Pass to readv then call Commit.
+		 */
+		Segments WritableSegments() const;
+
+		/**
+		 * Marks bytes written in to WritableSegments as stored.
+		 */
+		void Commit(std::size_t length);
+
+		/**
+		 * Discards bytes from the front of the buffer.
+		 */
+		void Consume(std::size_t length);
+
+		void Clear();
+
+		void swap(RingBuffer &other) noexcept;
+};
+
+inline void swap(RingBuffer &a, RingBuffer &b) noexcept
+{
+	a.swap(b);
+}
+
+}
+
+#endif // UTIL_RINGBUFFER_HPP_INCLUDED
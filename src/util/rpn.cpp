@@ -67,119 +67,122 @@ std::stack<util::variant> rpn_parse(std::string expr)
 	return stack;
 }
 
-static double rpn_eval_add(std::vector<double> args)   { return args[0] + args[1]; }
-static double rpn_eval_sub(std::vector<double> args)   { return args[0] - args[1]; }
-static double rpn_eval_mul(std::vector<double> args)   { return args[0] * args[1]; }
-static double rpn_eval_div(std::vector<double> args)   { return args[0] / args[1]; }
-static double rpn_eval_mod(std::vector<double> args)   { return int(std::floor(args[0] + 0.5)) % int(std::floor(args[1] + 0.5)); }
-static double rpn_eval_and(std::vector<double> args)   { return int(std::floor(args[0] + 0.5)) & int(std::floor(args[1] + 0.5)); }
-static double rpn_eval_or(std::vector<double> args)    { return int(std::floor(args[0] + 0.5)) | int(std::floor(args[1] + 0.5)); }
-static double rpn_eval_xor(std::vector<double> args)   { return int(std::floor(args[0] + 0.5)) ^ int(std::floor(args[1] + 0.5)); }
-static double rpn_eval_not(std::vector<double> args)   { return ~int(std::floor(args[0] + 0.5)); }
-static double rpn_eval_pow(std::vector<double> args)   { return std::pow(args[0], args[1]); }
-static double rpn_eval_log(std::vector<double> args)   { return std::log10(args[0]); }
-static double rpn_eval_exp(std::vector<double> args)   { return std::exp(args[0]); }
-static double rpn_eval_ln(std::vector<double> args)    { return std::log(args[0]); }
-static double rpn_eval_sqrt(std::vector<double> args)  { return std::sqrt(args[0]); }
-static double rpn_eval_sin(std::vector<double> args)   { return std::sin(args[0]); }
-static double rpn_eval_cos(std::vector<double> args)   { return std::cos(args[0]); }
-static double rpn_eval_tan(std::vector<double> args)   { return std::tan(args[0]); }
-static double rpn_eval_rand(std::vector<double> args)  { return rand(args[0], args[1]); }
-static double rpn_eval_min(std::vector<double> args)   { return std::min(args[0], args[1]); }
-static double rpn_eval_max(std::vector<double> args)   { return std::max(args[0], args[1]); }
-static double rpn_eval_ceil(std::vector<double> args)  { return std::ceil(args[0]); }
-static double rpn_eval_round(std::vector<double> args) { return std::floor(args[0] + 0.5); }
-static double rpn_eval_floor(std::vector<double> args) { return std::floor(args[0]); }
-static double rpn_eval_lt(std::vector<double> args)    { return args[0] < args[1] - rpn_cmp_epsilon; }
-static double rpn_eval_lte(std::vector<double> args)   { return args[0] <= args[1] + rpn_cmp_epsilon; }
-static double rpn_eval_eq(std::vector<double> args)    { return args[0] >= args[1] - rpn_cmp_epsilon_2 && args[0] <= args[1] + rpn_cmp_epsilon_2; }
-static double rpn_eval_gte(std::vector<double> args)   { return args[0] >= args[1] - rpn_cmp_epsilon; }
-static double rpn_eval_gt(std::vector<double> args)    { return args[0] > args[1] + rpn_cmp_epsilon; }
-
-static double rpn_eval_iif(std::vector<double> args)   { return std::floor(args[0] + 0.5) ? args[1] : args[2]; }
-
-double rpn_eval(std::stack<util::variant> stack, std::unordered_map<std::string, double> vars)
+static double rpn_eval_add(const double *args)   { return args[0] + args[1]; }
+static double rpn_eval_sub(const double *args)   { return args[0] - args[1]; }
+static double rpn_eval_mul(const double *args)   { return args[0] * args[1]; }
+static double rpn_eval_div(const double *args)   { return args[0] / args[1]; }
+static double rpn_eval_mod(const double *args)   { return int(std::floor(args[0] + 0.5)) % int(std::floor(args[1] + 0.5)); }
+static double rpn_eval_and(const double *args)   { return int(std::floor(args[0] + 0.5)) & int(std::floor(args[1] + 0.5)); }
+static double rpn_eval_or(const double *args)    { return int(std::floor(args[0] + 0.5)) | int(std::floor(args[1] + 0.5)); }
+static double rpn_eval_xor(const double *args)   { return int(std::floor(args[0] + 0.5)) ^ int(std::floor(args[1] + 0.5)); }
+static double rpn_eval_not(const double *args)   { return ~int(std::floor(args[0] + 0.5)); }
+static double rpn_eval_pow(const double *args)   { return std::pow(args[0], args[1]); }
+static double rpn_eval_log(const double *args)   { return std::log10(args[0]); }
+static double rpn_eval_exp(const double *args)   { return std::exp(args[0]); }
+static double rpn_eval_ln(const double *args)    { return std::log(args[0]); }
+static double rpn_eval_sqrt(const double *args)  { return std::sqrt(args[0]); }
+static double rpn_eval_sin(const double *args)   { return std::sin(args[0]); }
+static double rpn_eval_cos(const double *args)   { return std::cos(args[0]); }
+static double rpn_eval_tan(const double *args)   { return std::tan(args[0]); }
+static double rpn_eval_rand(const double *args)  { return rand(args[0], args[1]); }
+static double rpn_eval_min(const double *args)   { return std::min(args[0], args[1]); }
+static double rpn_eval_max(const double *args)   { return std::max(args[0], args[1]); }
+static double rpn_eval_ceil(const double *args)  { return std::ceil(args[0]); }
+static double rpn_eval_round(const double *args) { return std::floor(args[0] + 0.5); }
+static double rpn_eval_floor(const double *args) { return std::floor(args[0]); }
+static double rpn_eval_lt(const double *args)    { return args[0] < args[1] - rpn_cmp_epsilon; }
+static double rpn_eval_lte(const double *args)   { return args[0] <= args[1] + rpn_cmp_epsilon; }
+static double rpn_eval_eq(const double *args)    { return args[0] >= args[1] - rpn_cmp_epsilon_2 && args[0] <= args[1] + rpn_cmp_epsilon_2; }
+static double rpn_eval_gte(const double *args)   { return args[0] >= args[1] - rpn_cmp_epsilon; }
+static double rpn_eval_gt(const double *args)    { return args[0] > args[1] + rpn_cmp_epsilon; }
+
+static double rpn_eval_iif(const double *args)   { return std::floor(args[0] + 0.5) ? args[1] : args[2]; }
+
+struct rpn_eval_func
 {
-	struct rpn_eval_func
+	char op;
+	const char *name;
+	std::size_t args;
+	double (*func)(const double *);
+};
+
+static const std::size_t rpn_max_args = 3;
+
+static const rpn_eval_func rpn_eval_funcs[] = {
+	{'+', "add",   2, rpn_eval_add},
+	{'-', "sub",   2, rpn_eval_sub},
+	{'*', "mul",   2, rpn_eval_mul},
+	{'/', "div",   2, rpn_eval_div},
+	{'%', "mod",   2, rpn_eval_mod},
+	{'&', "and",   2, rpn_eval_and},
+	{'|', "or",    2, rpn_eval_or},
+	{'^', "xor",   2, rpn_eval_xor},
+	{'~', "not",   1, rpn_eval_not},
+	{' ', "pow",   2, rpn_eval_pow},
+	{' ', "sqrt",  1, rpn_eval_sqrt},
+	{' ', "log",   1, rpn_eval_log},
+	{' ', "exp",   1, rpn_eval_exp},
+	{' ', "ln",    1, rpn_eval_ln},
+	{' ', "sin",   1, rpn_eval_sin},
+	{' ', "cos",   1, rpn_eval_cos},
+	{' ', "tan",   1, rpn_eval_tan},
+	{' ', "rand",  2, rpn_eval_rand},
+	{' ', "min",   2, rpn_eval_min},
+	{' ', "max",   2, rpn_eval_max},
+	{' ', "ceil",  1, rpn_eval_ceil},
+	{' ', "round", 1, rpn_eval_round},
+	{' ', "floor", 1, rpn_eval_floor},
+	{'<', "lt",    2, rpn_eval_lt},
+	{' ', "lte",   2, rpn_eval_lte},
+	{'=', "eq",    2, rpn_eval_eq},
+	{' ', "gte",   2, rpn_eval_gte},
+	{'>', "gt",    2, rpn_eval_gt},
+
+	{'?', "iif",   3, rpn_eval_iif},
+};
+
+// Tokens starting with an operator character are that operator, so "-1" is a subtraction
+static const rpn_eval_func *rpn_find_func(const std::string &token)
+{
+	for (const rpn_eval_func &func : rpn_eval_funcs)
 	{
-		char op;
-		const char *name;
-		std::size_t args;
-		double (*func)(std::vector<double>);
-
-		rpn_eval_func(char op_, const char *name_, std::size_t args_, double (*func_)(std::vector<double>)) : op(op_), name(name_), args(args_), func(func_) { }
-	};
-
-	rpn_eval_func rpn_eval_funcs[] = {
-		rpn_eval_func('+', "add",   2, rpn_eval_add),
-		rpn_eval_func('-', "sub",   2, rpn_eval_sub),
-		rpn_eval_func('*', "mul",   2, rpn_eval_mul),
-		rpn_eval_func('/', "div",   2, rpn_eval_div),
-		rpn_eval_func('%', "mod",   2, rpn_eval_mod),
-		rpn_eval_func('&', "and",   2, rpn_eval_and),
-		rpn_eval_func('|', "or",    2, rpn_eval_or),
-		rpn_eval_func('^', "xor",   2, rpn_eval_xor),
-		rpn_eval_func('~', "not",   1, rpn_eval_not),
-		rpn_eval_func(' ', "pow",   2, rpn_eval_pow),
-		rpn_eval_func(' ', "sqrt",  1, rpn_eval_sqrt),
-		rpn_eval_func(' ', "log",   1, rpn_eval_log),
-		rpn_eval_func(' ', "exp",   1, rpn_eval_exp),
-		rpn_eval_func(' ', "ln",    1, rpn_eval_ln),
-		rpn_eval_func(' ', "sin",   1, rpn_eval_sin),
-		rpn_eval_func(' ', "cos",   1, rpn_eval_cos),
-		rpn_eval_func(' ', "tan",   1, rpn_eval_tan),
-		rpn_eval_func(' ', "rand",  2, rpn_eval_rand),
-		rpn_eval_func(' ', "min",   2, rpn_eval_min),
-		rpn_eval_func(' ', "max",   2, rpn_eval_max),
-		rpn_eval_func(' ', "ceil",  1, rpn_eval_ceil),
-		rpn_eval_func(' ', "round", 1, rpn_eval_round),
-		rpn_eval_func(' ', "floor", 1, rpn_eval_floor),
-		rpn_eval_func('<', "lt",    2, rpn_eval_lt),
-		rpn_eval_func(' ', "lte",   2, rpn_eval_lte),
-		rpn_eval_func('=', "eq",    2, rpn_eval_eq),
-		rpn_eval_func(' ', "gte",   2, rpn_eval_gte),
-		rpn_eval_func('>', "gt",    2, rpn_eval_gt),
-
-		rpn_eval_func('?', "iif",   3, rpn_eval_iif),
-	};
+		if (token == func.name || (func.op != ' ' && !token.empty() && token[0] == func.op))
+			return &func;
+	}
+
+	return nullptr;
+}
 
+double rpn_eval(std::stack<util::variant> stack, const std::unordered_map<std::string, double> &vars)
+{
 	std::stack<double> argstack;
 
 	while (!stack.empty())
 	{
-		start_of_loop:
-
 		util::variant val = stack.top();
+		std::string token = val;
 		stack.pop();
 
-		for (std::size_t i = 0; i < sizeof(rpn_eval_funcs) / sizeof(rpn_eval_func); ++i)
+		if (const rpn_eval_func *func = rpn_find_func(token))
 		{
-			rpn_eval_func &func = rpn_eval_funcs[i];
+			double args[rpn_max_args];
 
-			if (static_cast<std::string>(val) == func.name || (func.op != ' ' && static_cast<std::string>(val)[0] == func.op))
+			for (std::size_t i = 0; i < func->args; ++i)
 			{
-				std::vector<double> args(func.args);
-
-				for (std::size_t i = 0; i < func.args; ++i)
+				if (argstack.empty())
 				{
-					if (argstack.empty())
-					{
-						throw std::runtime_error("RPN Stack underflow");
-					}
-
-					args[i] = argstack.top();
-					argstack.pop();
+					throw std::runtime_error("RPN Stack underflow");
 				}
 
-				argstack.push(func.func(args));
-
-				if (stack.empty()) return argstack.top();
-
-				goto start_of_loop;
+				args[i] = argstack.top();
+				argstack.pop();
 			}
+
+			argstack.push(func->func(args));
+			continue;
 		}
 
-		std::unordered_map<std::string, double>::iterator findvar = vars.find(val);
+		auto findvar = vars.find(token);
 
 		if (findvar != vars.end())
 		{
@@ -194,4 +197,99 @@ double rpn_eval(std::stack<util::variant> stack, std::unordered_map<std::string,
 	return argstack.top();
 }
 
+rpn_formula::rpn_formula()
+	: depth(0)
+	, underflow(false)
+{ }
+
+rpn_formula::rpn_formula(const std::string &expr, const resolver &resolve)
+	: depth(0)
+	, underflow(false)
+{
+	std::size_t stack_size = 0;
+	std::size_t pos = 0;
+
+	while (pos < expr.length())
+	{
+		std::size_t end = expr.find(' ', pos);
+
+		if (end == std::string::npos)
+			end = expr.length();
+
+		std::string token = expr.substr(pos, end - pos);
+		pos = end + 1;
+
+		if (token.empty())
+			continue;
+
+		op instruction{nullptr, 0, -1, 0.0};
+
+		if (const rpn_eval_func *func = rpn_find_func(token))
+		{
+			instruction.func = func->func;
+			instruction.args = func->args;
+
+			if (stack_size < func->args)
+				this->underflow = true;
+
+			stack_size = (stack_size < func->args) ? 1 : stack_size - func->args + 1;
+		}
+		else
+		{
+			int var = resolve ? resolve(token) : -1;
+
+			if (var >= 0)
+				instruction.var = var;
+			else
+				instruction.value = static_cast<double>(util::variant(token));
+
+			++stack_size;
+		}
+
+		this->depth = std::max(this->depth, stack_size);
+		this->program.push_back(instruction);
+	}
+}
+
+double rpn_formula::eval(const double *vars) const
+{
+	if (this->underflow)
+		throw std::runtime_error("RPN Stack underflow");
+
+	if (this->program.empty())
+		return 0.0;
+
+	// Formulas are short, so the stack almost always fits in a local array
+	double local_stack[32];
+	std::vector<double> heap_stack;
+	double *stack = local_stack;
+
+	if (this->depth > sizeof local_stack / sizeof local_stack[0])
+	{
+		heap_stack.resize(this->depth);
+		stack = heap_stack.data();
+	}
+
+	std::size_t top = 0;
+
+	for (const op &instruction : this->program)
+	{
+		if (instruction.func)
+		{
+			double args[rpn_max_args];
+
+			for (std::size_t i = 0; i < instruction.args; ++i)
+				args[i] = stack[--top];
+
+			stack[top++] = instruction.func(args);
+		}
+		else
+		{
+			stack[top++] = (instruction.var >= 0) ? vars[instruction.var] : instruction.value;
+		}
+	}
+
+	return stack[top - 1];
+}
+
 }
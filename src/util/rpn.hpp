@@ -9,9 +9,12 @@
 
 #include "../util/variant.hpp"
 
+#include <cstddef>
+#include <functional>
 #include <stack>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace util
 {
@@ -20,7 +23,59 @@ static const double rpn_cmp_epsilon = 0.0001;
 static const double rpn_cmp_epsilon_2 = rpn_cmp_epsilon / 2.0;
 
 std::stack<util::variant> rpn_parse(std::string expr);
-double rpn_eval(std::stack<util::variant>, std::unordered_map<std::string, double> vars);
+double rpn_eval(std::stack<util::variant>, const std::unordered_map<std::string, double> &vars);
+
+/**
+ * A formula parsed once in to a flat program, to be evaluated any number of times.
+ * Variable names are resolved to indexes in to an array of values when the formula is compiled.
+ * Gives the same results as rpn_eval(rpn_parse(expr), vars) would.
+ */
+class rpn_formula
+{
+	public:
+		/**
+		 * Returns the index a variable's value will be at, or -1 if the name is not a variable
+		 */
+		typedef std::function<int(const std::string &name)> resolver;
+
+	protected:
+		struct op
+		{
+			/**
+			 * Function to call, or null to push a value
+			 */
+			double (*func)(const double *args);
+			std::size_t args;
+
+			/**
+			 * Index of the variable to push, or -1 to push value
+			 */
+			int var;
+			double value;
+		};
+
+		std::vector<op> program;
+
+		/**
+		 * Most values ever on the stack at once
+		 */
+		std::size_t depth;
+
+		bool underflow;
+
+	public:
+		rpn_formula();
+		rpn_formula(const std::string &expr, const resolver &resolve);
+
+		bool empty() const { return this->program.empty(); }
+
+		/**
+		 * @param vars Values of the variables, at the indexes given by the resolver
+		 * @return The result, or 0 for an empty formula
+		 * @throw std::runtime_error if the formula runs out of arguments
+		 */
+		double eval(const double *vars) const;
+};
 
 }
 
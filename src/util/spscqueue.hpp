@@ -0,0 +1,99 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace util
+{
+
+// Unbounded lock-free queue for passing values from exactly one producer thread to exactly one consumer thread.
+// Push may only be called from the producer thread and Pop/Empty only from the consumer thread.
+template <class T>
+class SPSCQueue
+{
+public:
+    SPSCQueue()
+        : _head(new Node)
+        , _tail(_head)
+        , _cache(_head) { }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    ~SPSCQueue()
+    {
+        Node* node = this->_cache;
+
+        while (node)
+        {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    void Push(T value)
+    {
+        Node* node = this->allocNode();
+        node->value = std::move(value);
+        node->next.store(nullptr, std::memory_order_relaxed);
+
+        this->_tail->next.store(node, std::memory_order_release);
+        this->_tail = node;
+    }
+
+    bool Pop(T& out)
+    {
+        Node* head = this->_head.load(std::memory_order_relaxed);
+        Node* next = head->next.load(std::memory_order_acquire);
+
+        if (!next)
+            return false;
+
+        out = std::move(next->value);
+        next->value = T();
+
+        // The old head becomes reusable by the producer once this store is visible
+        this->_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool Empty() const
+    {
+        return this->_head.load(std::memory_order_relaxed)->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next{nullptr};
+        T value{};
+    };
+
+    // Consumed nodes between _cache and _head are recycled by the producer instead of being freed
+    Node* allocNode()
+    {
+        if (this->_cache != this->_head.load(std::memory_order_acquire))
+        {
+            Node* node = this->_cache;
+            this->_cache = node->next.load(std::memory_order_relaxed);
+            return node;
+        }
+
+        return new Node;
+    }
+
+    // Consumer side
+    alignas(64) std::atomic<Node*> _head;
+
+    // Producer side
+    alignas(64) Node* _tail;
+    Node* _cache;
+};
+
+}
@@ -0,0 +1,79 @@
+/* $Id$
+ * EOSERV is released under the zlib license.
+ * See LICENSE.txt for more info.
+ */
+
+#ifndef UTIL_STRING_VIEW_HPP_INCLUDED
+#define UTIL_STRING_VIEW_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace util
+{
+
+/**
+ * Non-owning reference to a range of characters, a subset of C++17's std::string_view.
+ * The referenced characters must outlive the view.
+ */
+class string_view
+{
+	protected:
+		const char *ptr;
+		std::size_t len;
+
+	public:
+		static const std::size_t npos = std::size_t(-1);
+
+		string_view() : ptr(nullptr), len(0) { }
+		string_view(const char *data, std::size_t length) : ptr(data), len(length) { }
+		string_view(const char *str) : ptr(str), len(std::strlen(str)) { }
+		string_view(const std::string &str) : ptr(str.data()), len(str.length()) { }
+
+		const char *data() const { return this->ptr; }
+		std::size_t size() const { return this->len; }
+		std::size_t length() const { return this->len; }
+		bool empty() const { return this->len == 0; }
+
+		const char *begin() const { return this->ptr; }
+		const char *end() const { return this->ptr + this->len; }
+
+		char operator [](std::size_t i) const { return this->ptr[i]; }
+
+		/**
+		 * Unlike std::string_view, a pos past the end returns an empty view rather than throwing.
+		 */
+		string_view substr(std::size_t pos, std::size_t n = npos) const
+		{
+			if (pos > this->len)
+				return string_view(this->ptr + this->len, 0);
+
+			return string_view(this->ptr + pos, std::min(n, this->len - pos));
+		}
+
+		std::size_t find(char c, std::size_t pos = 0) const
+		{
+			if (pos >= this->len)
+				return npos;
+
+			const void *found = std::memchr(this->ptr + pos, c, this->len - pos);
+
+			return found ? static_cast<const char *>(found) - this->ptr : npos;
+		}
+
+		std::string to_string() const { return std::string(this->ptr, this->len); }
+		operator std::string() const { return this->to_string(); }
+
+		bool operator ==(const string_view &rhs) const
+		{
+			return this->len == rhs.len && (this->len == 0 || std::memcmp(this->ptr, rhs.ptr, this->len) == 0);
+		}
+
+		bool operator !=(const string_view &rhs) const { return !(*this == rhs); }
+};
+
+}
+
+#endif // UTIL_STRING_VIEW_HPP_INCLUDED
@@ -1,9 +1,9 @@
-
 /* $Id$
  * EOSERV is released under the zlib license.
  * See LICENSE.txt for more info.
  */
 
+#include <algorithm>
 #include <future>
 
 #include "../console.hpp"
@@ -17,13 +17,105 @@ namespace util
     // Otherwise, they aren't in the object file in unity build mode and test linking fails
     const size_t ThreadPool::MAX_THREADS = 32;
     const size_t ThreadPool::DEFAULT_THREADS = 4;
+    const size_t ThreadPool::PRIORITIES;
+    const size_t ThreadPoolStats::LATENCY_BUCKETS;
+    const unsigned ThreadPoolStats::LATENCY_SAMPLE;
 
     // There should really only be a single thread pool per application
     static ThreadPool threadPoolInstance;
 
-    void ThreadPool::Queue(const WorkFunc workerFunction, const void* state)
+    // Lets work queued from inside a job go to the deque of the worker running it
+    static thread_local const ThreadPool* currentPool = nullptr;
+    static thread_local size_t currentWorker = 0;
+    static thread_local unsigned latencySample = 0;
+
+    // For counters with a single writer, either the thread that owns them or whoever holds the lock guarding them.
+    //   A plain load and store is enough, and keeps locked instructions off the path every job takes.
+    template <typename T>
+    static void bump(std::atomic<T>& counter, T by = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    static size_t latencyBucket(std::chrono::steady_clock::duration elapsed)
+    {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+
+        size_t bucket = 0;
+        while (ms > 0 && bucket < ThreadPoolStats::LATENCY_BUCKETS - 1)
+        {
+            ms >>= 1;
+            ++bucket;
+        }
+
+        return bucket;
+    }
+
+    int ThreadPoolStats::Class::Percentile(const unsigned long long (&histogram)[LATENCY_BUCKETS], double fraction)
+    {
+        unsigned long long total = 0;
+        for (auto count : histogram)
+            total += count;
+
+        if (total == 0)
+            return 0;
+
+        unsigned long long seen = 0;
+        for (size_t i = 0; i < LATENCY_BUCKETS - 1; ++i)
+        {
+            seen += histogram[i];
+
+            if (seen >= total * fraction)
+                return 1 << i;
+        }
+
+        return -1;
+    }
+
+    ThreadPool::WorkerCounters::WorkerCounters()
+        : running(0), completed(0), cancelled(0), stolen(0)
+    {
+        for (auto& count : this->wait_latency)
+            count = 0;
+
+        for (auto& count : this->run_latency)
+            count = 0;
+    }
+
+    ThreadPool::Worker::Worker()
+    {
+        for (auto& count : this->size)
+            count = 0;
+    }
+
+    void ThreadPool::Queue(const WorkFunc& workerFunction, const void* state, Priority priority)
+    {
+        threadPoolInstance.queueInternal(workerFunction, state, priority, nullptr);
+    }
+
+    void ThreadPool::Queue(const WorkFunc& workerFunction, const void* state, Priority priority, const CancellationToken& token)
+    {
+        threadPoolInstance.queueInternal(workerFunction, state, priority, &token);
+    }
+
+    bool ThreadPool::TryQueue(const WorkFunc& workerFunction, const void* state, Priority priority)
+    {
+        return threadPoolInstance.tryQueueInternal(workerFunction, state, priority);
+    }
+
+    void ThreadPool::SetQueueLimit(Priority priority, size_t limit)
+    {
+        threadPoolInstance.setQueueLimitInternal(priority, limit);
+    }
+
+    size_t ThreadPool::Pending(Priority priority)
+    {
+        return threadPoolInstance.pendingInternal(priority);
+    }
+
+    ThreadPoolStats ThreadPool::Stats()
     {
-        threadPoolInstance.queueInternal(workerFunction, state);
+        return threadPoolInstance.statsInternal();
     }
 
     void ThreadPool::SetNumThreads(size_t numThreads)
@@ -38,13 +130,25 @@ namespace util
 
     ThreadPool::ThreadPool(size_t numThreads)
         : _terminating(false)
-        , _workReadySemaphore(0)
+        , _sleeping(0)
+        , _liveThreads(0)
+        , _numWorkers(0)
+        , _nextWorker(0)
+        , _usedWorkers(0)
     {
         if (numThreads == 0 || numThreads > MAX_THREADS)
         {
             numThreads = DEFAULT_THREADS;
         }
 
+        for (size_t i = 0; i < MAX_THREADS; i++)
+        {
+            this->_workers.emplace_back(new Worker);
+        }
+
+        this->_numWorkers = numThreads;
+        this->_usedWorkers = numThreads;
+
         for (size_t i = 0; i < numThreads; i++)
         {
             auto newThread = std::thread([this, i]() { this->_workerProc(i); });
@@ -57,19 +161,135 @@ namespace util
         this->shutdownInternal();
     }
 
-    void ThreadPool::queueInternal(const ThreadPool::WorkFunc workerFunction, const void* state)
+    void ThreadPool::queueInternal(const ThreadPool::WorkFunc& workerFunction, const void* state)
+    {
+        this->queueInternal(workerFunction, state, Priority::Interactive, nullptr);
+    }
+
+    void ThreadPool::queueInternal(const ThreadPool::WorkFunc& workerFunction, const void* state, Priority priority, const CancellationToken* token)
+    {
+        if (this->_terminating)
+        {
+            throw std::runtime_error("Unable to queue work while ThreadPool is terminating");
+        }
+
+        ClassCounters& counters = this->_counters[static_cast<size_t>(priority)];
+        const size_t pending = ++counters.pending;
+
+        size_t maxPending = counters.max_pending;
+        while (pending > maxPending && !counters.max_pending.compare_exchange_weak(maxPending, pending)) { }
+
+        this->push(Job { workerFunction, state, priority, token ? token->_cancelled : nullptr, std::chrono::steady_clock::time_point() });
+    }
+
+    bool ThreadPool::tryQueueInternal(const ThreadPool::WorkFunc& workerFunction, const void* state, Priority priority)
     {
         if (this->_terminating)
         {
             throw std::runtime_error("Unable to queue work while ThreadPool is terminating");
         }
 
-        std::lock_guard<std::mutex> queueGuard(this->_workQueueLock);
+        ClassCounters& counters = this->_counters[static_cast<size_t>(priority)];
+        const size_t limit = counters.limit;
+        size_t pending = counters.pending;
+
+        do
+        {
+            if (limit != 0 && pending >= limit)
+            {
+                ++counters.rejected;
+                return false;
+            }
+        } while (!counters.pending.compare_exchange_weak(pending, pending + 1));
+
+        size_t maxPending = counters.max_pending;
+        while (pending + 1 > maxPending && !counters.max_pending.compare_exchange_weak(maxPending, pending + 1)) { }
+
+        this->push(Job { workerFunction, state, priority, nullptr, std::chrono::steady_clock::time_point() });
+        return true;
+    }
+
+    void ThreadPool::push(Job&& job)
+    {
+        // Work queued by a job stays with the thread that queued it, anything else is dealt out in turn
+        const size_t slot = currentPool == this
+            ? currentWorker
+            : this->_nextWorker.fetch_add(1, std::memory_order_relaxed) % this->_numWorkers;
+
+        Worker& worker = *this->_workers[slot];
+        const size_t priority = static_cast<size_t>(job.priority);
+
+        if (latencySample++ % ThreadPoolStats::LATENCY_SAMPLE == 0)
+            job.queued = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> workerGuard(worker.lock);
+            worker.jobs[priority].push_back(std::move(job));
+
+            // Not relaxed: this store and the load of _sleeping below pair with the reverse in _workerProc,
+            //   so either the sleeping worker sees this job or this thread sees it is asleep
+            worker.size[priority].store(worker.size[priority].load(std::memory_order_relaxed) + 1);
+        }
+
+        // Workers only sleep once they find nothing to take, so there is only someone to wake when one has run dry
+        if (this->_sleeping > 0)
+        {
+            std::lock_guard<std::mutex> sleepGuard(this->_sleepLock);
+            this->_workReady.notify_one();
+        }
+    }
+
+    void ThreadPool::setQueueLimitInternal(Priority priority, size_t limit)
+    {
+        this->_counters[static_cast<size_t>(priority)].limit = limit;
+    }
 
-        auto newPair = std::make_pair(workerFunction, state);
-        this->_work.emplace(std::move(newPair));
+    size_t ThreadPool::pendingInternal(Priority priority) const
+    {
+        return this->_counters[static_cast<size_t>(priority)].pending;
+    }
+
+    ThreadPoolStats ThreadPool::statsInternal() const
+    {
+        ThreadPoolStats stats;
+
+        for (size_t i = 0; i < PRIORITIES; ++i)
+        {
+            ThreadPoolStats::Class& out = stats.classes[i];
+
+            out.queued = 0;
+            out.running = 0;
+            out.max_pending = this->_counters[i].max_pending;
+            out.completed = 0;
+            out.cancelled = 0;
+            out.rejected = this->_counters[i].rejected;
+            out.stolen = 0;
+
+            for (size_t bucket = 0; bucket < ThreadPoolStats::LATENCY_BUCKETS; ++bucket)
+            {
+                out.wait_latency[bucket] = 0;
+                out.run_latency[bucket] = 0;
+            }
+
+            for (const auto& worker : this->_workers)
+            {
+                const WorkerCounters& counters = worker->counters[i];
+
+                out.queued += worker->size[i];
+                out.running += counters.running;
+                out.completed += counters.completed;
+                out.cancelled += counters.cancelled;
+                out.stolen += counters.stolen;
+
+                for (size_t bucket = 0; bucket < ThreadPoolStats::LATENCY_BUCKETS; ++bucket)
+                {
+                    out.wait_latency[bucket] += counters.wait_latency[bucket];
+                    out.run_latency[bucket] += counters.run_latency[bucket];
+                }
+            }
+        }
 
-        this->_workReadySemaphore.Release();
+        return stats;
     }
 
     void ThreadPool::setNumThreadsInternal(size_t numWorkers)
@@ -87,24 +307,16 @@ namespace util
             throw std::runtime_error("Unable to set number of threads while ThreadPool is terminating");
         }
 
-        std::lock_guard<std::mutex> queueGuard(this->_workQueueLock);
-
         if (numWorkers < this->_threads.size())
         {
-            while (!this->_work.empty())
-                this->_work.pop();
-
-            this->_terminating = true;
-            this->_workReadySemaphore.Release(this->_threads.size());
-
-            for (auto& thread : this->_threads)
-                thread.join();
-
+            this->stopThreads();
             this->_threads.clear();
             this->_terminating = false;
         }
 
-        this->_workReadySemaphore.Reset(0);
+        // Work left in the deques of stopped workers is stolen by the rest
+        this->_numWorkers = numWorkers;
+        this->_usedWorkers = std::max<size_t>(this->_usedWorkers, numWorkers);
 
         for (size_t i = this->_threads.size(); i < numWorkers; ++i)
         {
@@ -117,40 +329,101 @@ namespace util
     {
         if (!this->_terminating)
         {
+            this->stopThreads();
+        }
+    }
+
+    void ThreadPool::stopThreads()
+    {
+        {
+            std::lock_guard<std::mutex> sleepGuard(this->_sleepLock);
             this->_terminating = true;
-            this->_workReadySemaphore.Release(this->_threads.size());
+            this->_workReady.notify_all();
+        }
 
-            for (auto& thread : this->_threads)
-            {
-                thread.join();
-            }
+        for (auto& thread : this->_threads)
+        {
+            thread.join();
         }
     }
 
-    void ThreadPool::_workerProc(size_t threadNum)
+    bool ThreadPool::workQueued() const
     {
-        while (!this->_terminating)
-        {
-            this->_workReadySemaphore.Wait();
+        const size_t usedWorkers = this->_usedWorkers;
 
-#if DEBUG
-            Console::Dbg("Thread %d starting work", threadNum);
-#endif
+        for (size_t i = 0; i < usedWorkers; ++i)
+            for (const auto& size : this->_workers[i]->size)
+                if (size > 0)
+                    return true;
 
-            if (this->_terminating)
-                break;
+        return false;
+    }
 
-            std::unique_ptr<WorkFuncWithState> workPair;
+    bool ThreadPool::takeWork(size_t threadNum, Job& job)
+    {
+        const size_t usedWorkers = this->_usedWorkers;
 
+        // All interactive work, this worker's or anyone else's, runs before any background work
+        for (size_t priority = 0; priority < PRIORITIES; ++priority)
+        {
+            for (size_t offset = 0; offset < usedWorkers; ++offset)
             {
-                std::lock_guard<std::mutex> queueGuard(this->_workQueueLock);
-                workPair = std::make_unique<WorkFuncWithState>(std::move(this->_work.front()));
-                this->_work.pop();
+                Worker& worker = *this->_workers[(threadNum + offset) % usedWorkers];
+
+                if (worker.size[priority].load(std::memory_order_relaxed) == 0)
+                    continue;
+
+                std::lock_guard<std::mutex> workerGuard(worker.lock);
+                auto& jobs = worker.jobs[priority];
+
+                if (jobs.empty())
+                    continue;
+
+                WorkerCounters& counters = this->_workers[threadNum]->counters[priority];
+
+                if (offset == 0)
+                {
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                else
+                {
+                    job = std::move(jobs.back());
+                    jobs.pop_back();
+                    bump<unsigned long long>(counters.stolen);
+                }
+
+                bump<size_t>(worker.size[priority], size_t(-1));
+                bump<size_t>(counters.running);
+                return true;
             }
+        }
+
+        return false;
+    }
+
+    void ThreadPool::runJob(size_t threadNum, Job& job)
+    {
+        const size_t priority = static_cast<size_t>(job.priority);
+        WorkerCounters& counters = this->_workers[threadNum]->counters[priority];
+        const bool timed = job.queued != std::chrono::steady_clock::time_point();
+        std::chrono::steady_clock::time_point started;
 
+        if (timed)
+        {
+            started = std::chrono::steady_clock::now();
+            bump<unsigned long long>(counters.wait_latency[latencyBucket(started - job.queued)]);
+        }
+
+        if (job.cancelled && *job.cancelled)
+        {
+            bump<unsigned long long>(counters.cancelled);
+        }
+        else
+        {
             try
             {
-                workPair->first(workPair->second);
+                job.func(job.state);
             }
             catch (const Socket_Exception& se)
             {
@@ -165,6 +438,44 @@ namespace util
                 Console::Err("Exception on thread %d: %s", threadNum, e.what());
             }
 
+            if (timed)
+                bump<unsigned long long>(counters.run_latency[latencyBucket(std::chrono::steady_clock::now() - started)]);
+
+            bump<unsigned long long>(counters.completed);
+        }
+
+        bump<size_t>(counters.running, size_t(-1));
+        --this->_counters[priority].pending;
+    }
+
+    void ThreadPool::_workerProc(size_t threadNum)
+    {
+        currentPool = this;
+        currentWorker = threadNum;
+        ++this->_liveThreads;
+
+        while (!this->_terminating)
+        {
+            Job job;
+
+            if (!this->takeWork(threadNum, job))
+            {
+                std::unique_lock<std::mutex> sleepGuard(this->_sleepLock);
+
+                // Counted as asleep before looking again, see ThreadPool::push
+                ++this->_sleeping;
+                this->_workReady.wait(sleepGuard, [this]() { return this->_terminating || this->workQueued(); });
+                --this->_sleeping;
+
+                continue;
+            }
+
+#if DEBUG
+            Console::Dbg("Thread %d starting work", threadNum);
+#endif
+
+            this->runJob(threadNum, job);
+
 #if DEBUG
             Console::Dbg("Thread %d completed work", threadNum);
 #endif
@@ -173,5 +484,7 @@ namespace util
 #if DEBUG
         Console::Dbg("Thread %d terminating", threadNum);
 #endif
+
+        --this->_liveThreads;
     }
-}
\ No newline at end of file
+}
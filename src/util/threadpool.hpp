@@ -1,4 +1,3 @@
-
 /* $Id$
  * EOSERV is released under the zlib license.
  * See LICENSE.txt for more info.
@@ -6,26 +5,93 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <memory>
-#include <queue>
+#include <mutex>
 #include <thread>
 #include <vector>
 
-#include "semaphore.hpp"
-
 namespace util
 {
+    // Shared flag for abandoning queued work. Copies share the same flag.
+    class CancellationToken
+    {
+    public:
+        CancellationToken() : _cancelled(std::make_shared<std::atomic<bool>>(false)) { }
+
+        void Cancel() { this->_cancelled->store(true); }
+        bool Cancelled() const { return this->_cancelled->load(); }
+
+    private:
+        friend class ThreadPool;
+        std::shared_ptr<std::atomic<bool>> _cancelled;
+    };
+
+    struct ThreadPoolStats
+    {
+        // Bucket 0 counts jobs under 1 ms, bucket i under 2^i ms, and the last bucket everything longer
+        static const size_t LATENCY_BUCKETS = 14;
+
+        // Reading the clock costs more than a short job, so only one job in this many from each queueing thread is timed
+        static const unsigned LATENCY_SAMPLE = 8;
+
+        struct Class
+        {
+            size_t queued;
+            size_t running;
+            size_t max_pending;
+
+            unsigned long long completed;
+            unsigned long long cancelled;
+            unsigned long long rejected;
+            unsigned long long stolen;
+
+            // Time from being queued to starting, and time spent running, of the sampled jobs
+            unsigned long long wait_latency[LATENCY_BUCKETS];
+            unsigned long long run_latency[LATENCY_BUCKETS];
+
+            // Upper bound in ms of the bucket holding the given fraction of jobs, or -1 if it is the last bucket
+            static int Percentile(const unsigned long long (&histogram)[LATENCY_BUCKETS], double fraction);
+        };
+
+        Class classes[2];
+    };
+
     class ThreadPool
     {
     public:
         typedef std::function<void(const void*)> WorkFunc;
 
+        // Interactive work (logins, account changes) always runs before background work (password rehashes)
+        enum class Priority
+        {
+            Interactive,
+            Background
+        };
+
         // Queue work on the thread pool. Memory allocated and passed to 'state' must be freed by the caller.
-        static void Queue(const WorkFunc workerFunction, const void * state);
+        static void Queue(const WorkFunc& workerFunction, const void * state, Priority priority = Priority::Interactive);
+
+        // Work queued with a token is dropped without being called if the token is cancelled before it starts.
+        //   Anything passed as state must then be freed by whoever cancelled it.
+        static void Queue(const WorkFunc& workerFunction, const void * state, Priority priority, const CancellationToken& token);
+
+        // As Queue, but refuses the work and returns false when the priority class is at its limit
+        static bool TryQueue(const WorkFunc& workerFunction, const void * state, Priority priority = Priority::Interactive);
 
-        // Set the number of threads in the thread pool. Any queued work will be removed. In-progress work will be allowed to complete.
+        // Limit on queued plus running jobs of a priority class that TryQueue accepts. 0 is unlimited.
+        static void SetQueueLimit(Priority priority, size_t limit);
+
+        // Number of jobs of a priority class that are queued or running
+        static size_t Pending(Priority priority);
+
+        static ThreadPoolStats Stats();
+
+        // Set the number of threads in the thread pool. Queued work is kept. In-progress work will be allowed to complete.
         static void SetNumThreads(size_t numThreads);
 
         // Shut down the threadpool
@@ -41,21 +107,96 @@ namespace util
         static const size_t DEFAULT_THREADS;
 
     private:
-        typedef std::pair<const WorkFunc, const void*> WorkFuncWithState;
+        static const size_t PRIORITIES = 2;
+
+        struct Job
+        {
+            WorkFunc func;
+            const void* state;
+            Priority priority;
+            std::shared_ptr<std::atomic<bool>> cancelled;
+            // Left at the epoch for jobs which aren't timed
+            std::chrono::steady_clock::time_point queued;
+        };
+
+        // Counters for the jobs a worker thread has taken. Only that thread writes them, so they are kept per worker
+        //   rather than shared by every thread, and summed when stats are read.
+        struct WorkerCounters
+        {
+            std::atomic<size_t> running;
+
+            std::atomic<unsigned long long> completed;
+            std::atomic<unsigned long long> cancelled;
+            std::atomic<unsigned long long> stolen;
+
+            std::atomic<unsigned long long> wait_latency[ThreadPoolStats::LATENCY_BUCKETS];
+            std::atomic<unsigned long long> run_latency[ThreadPoolStats::LATENCY_BUCKETS];
+
+            WorkerCounters();
+        };
+
+        // Every worker owns a deque per priority. The owner takes the oldest job from the front and idle workers
+        //   steal from the back, so the two only meet when a deque is down to its last job.
+        struct Worker
+        {
+            std::mutex lock;
+            std::deque<Job> jobs[PRIORITIES];
+
+            // Deque sizes, read without the lock so empty deques are passed over
+            std::atomic<size_t> size[PRIORITIES];
+
+            WorkerCounters counters[PRIORITIES];
+
+            Worker();
+        };
+
+        struct ClassCounters
+        {
+            // Queued plus running, so TryQueue can check and claim a place in one step
+            std::atomic<size_t> pending;
+            std::atomic<size_t> max_pending;
+            std::atomic<size_t> limit;
+            std::atomic<unsigned long long> rejected;
+
+            ClassCounters() : pending(0), max_pending(0), limit(0), rejected(0) { }
+        };
+
+        void push(Job&& job);
+        bool workQueued() const;
+        bool takeWork(size_t threadNum, Job& job);
+        void runJob(size_t threadNum, Job& job);
 
     protected:
-        void queueInternal(const WorkFunc workerFunction, const void * state);
+        void queueInternal(const WorkFunc& workerFunction, const void * state);
+        void queueInternal(const WorkFunc& workerFunction, const void * state, Priority priority, const CancellationToken* token);
+        bool tryQueueInternal(const WorkFunc& workerFunction, const void * state, Priority priority);
+        void setQueueLimitInternal(Priority priority, size_t limit);
+        size_t pendingInternal(Priority priority) const;
+        ThreadPoolStats statsInternal() const;
         void setNumThreadsInternal(size_t numWorkers);
         void shutdownInternal();
+        void stopThreads();
 
         void _workerProc(size_t threadNum);
 
         volatile bool _terminating;
 
-        Semaphore _workReadySemaphore;
-        std::mutex _workQueueLock;
-        std::queue<WorkFuncWithState> _work;
+        // Idle workers wait here. Busy workers go straight from one job to the next without touching it.
+        std::mutex _sleepLock;
+        std::condition_variable _workReady;
+        std::atomic<size_t> _sleeping;
+        std::atomic<size_t> _liveThreads;
+
+        // One slot per possible thread, so queued work outlives a resize and never moves between slots
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::atomic<size_t> _numWorkers;
+        std::atomic<size_t> _nextWorker;
+
+        // Slots that may hold work: the most threads there have ever been, as a smaller pool still drains the rest
+        std::atomic<size_t> _usedWorkers;
+
+        ClassCounters _counters[PRIORITIES];
 
         std::vector<std::thread> _threads;
     };
-}
\ No newline at end of file
+}
@@ -13,7 +13,9 @@
 #include "eoclient.hpp"
 #include "eodata.hpp"
 #include "eoplus.hpp"
+#include "eoserv_config.hpp"
 #include "eoserver.hpp"
+#include "formula.hpp"
 #include "guild.hpp"
 #include "i18n.hpp"
 #include "map.hpp"
@@ -21,6 +23,7 @@
 #include "npc_data.hpp"
 #include "packet.hpp"
 #include "party.hpp"
+#include "persistence.hpp"
 #include "player.hpp"
 #include "quest.hpp"
 #include "timer.hpp"
@@ -51,20 +54,27 @@ void world_spawn_npcs(void *world_void)
 {
 	World *world(static_cast<World *>(world_void));
 
-	double spawnrate = world->config["SpawnRate"];
 	double current_time = Timer::GetTime();
 	UTIL_FOREACH(world->maps, map)
 	{
-		UTIL_FOREACH(map->npcs, npc)
+		if (!map->awake)
+			continue;
+
+		map->npc_schedule.TakeDue(Map_NPCSchedule::Spawn, current_time, map->npcs_due);
+
+		UTIL_FOREACH(map->npcs_due, npc)
 		{
-			if ((!npc->alive && npc->dead_since + (double(npc->spawn_time) * spawnrate) < current_time)
-			 && (!npc->ENF().child || (npc->parent && npc->parent->alive && world->config["RespawnBossChildren"])))
+			if (npc->RespawnTime() < current_time)
 			{
 #ifdef DEBUG
 				Console::Dbg("Spawning NPC %i on map %i", npc->id, map->id);
 #endif // DEBUG
 				npc->Spawn();
 			}
+			else
+			{
+				map->ScheduleNPC(npc);
+			}
 		}
 	}
 }
@@ -74,15 +84,72 @@ void world_act_npcs(void *world_void)
 	World *world(static_cast<World *>(world_void));
 
 	double current_time = Timer::GetTime();
-	UTIL_FOREACH(world->maps, map)
+
+	if (world->npc_threads.GetNumThreads() == 0)
 	{
-		UTIL_FOREACH(map->npcs, npc)
+		UTIL_FOREACH(world->maps, map)
+		{
+			if (!map->awake)
+				continue;
+
+			map->npc_schedule.TakeDue(Map_NPCSchedule::Act, current_time, map->npcs_due);
+
+			UTIL_FOREACH(map->npcs_due, npc)
+			{
+				// Killing the last player on the map puts it to sleep part way through the list
+				if (!map->awake)
+					break;
+
+				if (npc->alive && npc->last_act + npc->act_speed < current_time)
+				{
+					npc->Act();
+				}
+
+				map->ScheduleNPC(npc);
+			}
+		}
+
+		return;
+	}
+
+	// Each map decides on its own, in parallel, against the world as it was at the start of the tick
+	world->npc_threads.Run(world->maps.size(), [&](std::size_t i)
+	{
+		Map *map = world->maps[i];
+
+		if (!map->awake)
+			return;
+
+		map->npc_schedule.TakeDue(Map_NPCSchedule::Act, current_time, map->npcs_due);
+
+		UTIL_FOREACH(map->npcs_due, npc)
 		{
 			if (npc->alive && npc->last_act + npc->act_speed < current_time)
 			{
-				npc->Act();
+				npc->Decide(current_time, map->npc_random);
 			}
 		}
+	});
+
+	// Then everything is carried out here, always in the same order
+	UTIL_FOREACH(world->maps, map)
+	{
+		if (!map->awake)
+			continue;
+
+		UTIL_FOREACH(map->npcs_due, npc)
+		{
+			// Same as above: an attack here may kill the last player and put the map to sleep
+			if (!map->awake)
+				break;
+
+			if (npc->intent.action != NPC::Intent::None)
+			{
+				npc->Apply();
+			}
+
+			map->ScheduleNPC(npc);
+		}
 	}
 }
 
@@ -93,12 +160,23 @@ void world_talk_npcs(void *world_void)
 	double current_time = Timer::GetTime();
 	UTIL_FOREACH(world->maps, map)
 	{
-		UTIL_FOREACH(map->npcs, npc)
+		if (!map->awake)
+			continue;
+
+		map->npc_schedule.TakeDue(Map_NPCSchedule::Talk, current_time, map->npcs_due);
+
+		UTIL_FOREACH(map->npcs_due, npc)
 		{
+			// Stop if the map fell asleep earlier in this tick
+			if (!map->awake)
+				break;
+
 			if (npc->alive && npc->last_talk + npc->Data().talk_speed < current_time)
 			{
 				npc->Talk();
 			}
+
+			map->ScheduleNPC(npc);
 		}
 	}
 }
@@ -113,8 +191,8 @@ void world_recover(void *world_void)
 
 		if (character->hp != character->maxhp)
 		{
-			if (character->sitting != SIT_STAND) character->hp += static_cast<short>(character->maxhp * double(world->config["SitHPRecoverRate"]));
-			else                                 character->hp += static_cast<short>(character->maxhp * double(world->config["HPRecoverRate"]));
+			if (character->sitting != SIT_STAND) character->hp += static_cast<short>(character->maxhp * world->settings->SitHPRecoverRate);
+			else                                 character->hp += static_cast<short>(character->maxhp * world->settings->HPRecoverRate);
 
 			character->hp = std::min(character->hp, character->maxhp);
 			updated = true;
@@ -127,8 +205,8 @@ void world_recover(void *world_void)
 
 		if (character->tp != character->maxtp)
 		{
-			if (character->sitting != SIT_STAND) character->tp += static_cast<short>(character->maxtp * double(world->config["SitTPRecoverRate"]));
-			else                                 character->tp += static_cast<short>(character->maxtp * double(world->config["TPRecoverRate"]));
+			if (character->sitting != SIT_STAND) character->tp += static_cast<short>(character->maxtp * world->settings->SitTPRecoverRate);
+			else                                 character->tp += static_cast<short>(character->maxtp * world->settings->TPRecoverRate);
 
 			character->tp = std::min(character->tp, character->maxtp);
 			updated = true;
@@ -151,11 +229,15 @@ void world_npc_recover(void *world_void)
 
 	UTIL_FOREACH(world->maps, map)
 	{
+		// Sleeping maps catch up when they wake
+		if (!map->awake)
+			continue;
+
 		UTIL_FOREACH(map->npcs, npc)
 		{
 			if (npc->alive && npc->hp < npc->ENF().hp)
 			{
-				npc->hp += static_cast<int>(npc->ENF().hp * double(world->config["NPCRecoverRate"]));
+				npc->hp += static_cast<int>(npc->ENF().hp * world->settings->NPCRecoverRate);
 
 				npc->hp = std::min(npc->hp, npc->ENF().hp);
 			}
@@ -185,7 +267,7 @@ void world_warp_suck(void *world_void)
 	World *world(static_cast<World *>(world_void));
 
 	double now = Timer::GetTime();
-	double delay = world->config["WarpSuck"];
+	double delay = world->settings->WarpSuck;
 
 	UTIL_FOREACH(world->maps, map)
 	{
@@ -240,7 +322,7 @@ void world_despawn_items(void *world_void)
 		restart_loop:
 		UTIL_FOREACH(map->items, item)
 		{
-			if (item->unprotecttime < (Timer::GetTime() - static_cast<double>(world->config["ItemDespawnRate"])))
+			if (item->unprotecttime < (Timer::GetTime() - world->settings->ItemDespawnRate))
 			{
 				map->DelItem(item->uid, 0);
 				goto restart_loop;
@@ -256,24 +338,88 @@ void world_timed_save(void *world_void)
 	if (!world->config["TimedSave"])
 		return;
 
-	world->db->BeginTransaction();
+	// Only changed columns are written, several characters to a statement
+	std::vector<Character_SaveDelta> deltas;
+	deltas.reserve(world->characters.size());
 
 	UTIL_FOREACH(world->characters, character)
 	{
-		character->Save();
+		Character_SaveDelta delta;
+
+		if (character->CollectSave(delta))
+			deltas.push_back(std::move(delta));
 	}
 
-	world->guildmanager->SaveAll();
+	Persistence_Batch batch;
+	Character::SaveQueries(deltas, batch.queries);
 
-	try
+	UTIL_FOREACH_REF(deltas, delta)
 	{
-		world->db->Commit();
+		batch.characters.push_back(delta.name);
+		delta.character->SaveCompleted(delta);
 	}
-	catch (Database_Exception& e)
+
+	world->guildmanager->SaveAll(batch);
+
+	world->persistence->Queue(std::move(batch));
+}
+
+void world_check_saves(void *world_void)
+{
+	World *world = static_cast<World *>(world_void);
+
+	std::vector<Persistence_Batch> failed;
+
+	if (!world->persistence->TakeFailures(failed))
+		return;
+
+	UTIL_FOREACH_CREF(failed, batch)
 	{
-		(void)e;
-		Console::Wrn("Database commit failed - no data was saved!");
-		world->db->Rollback();
+		// What is still loaded is saved in full next time, the rest of the batch is lost
+		std::string resaved;
+		std::string dropped;
+
+		auto add = [](std::string &list, const std::string &name)
+		{
+			list += (list.empty() ? "" : ", ") + name;
+		};
+
+		UTIL_FOREACH_CREF(batch.characters, name)
+		{
+			Character *character = world->GetCharacterReal(name);
+
+			if (character)
+			{
+				character->saved_columns.clear();
+				add(resaved, name);
+			}
+			else
+			{
+				add(dropped, name);
+			}
+		}
+
+		UTIL_FOREACH_CREF(batch.guilds, tag)
+		{
+			auto it = world->guildmanager->cache.find(tag);
+			std::shared_ptr<Guild> guild = (it != world->guildmanager->cache.end()) ? it->second.lock() : nullptr;
+
+			if (guild)
+			{
+				guild->needs_save = true;
+				add(resaved, "guild " + tag);
+			}
+			else
+			{
+				add(dropped, "guild " + tag);
+			}
+		}
+
+		if (!resaved.empty())
+			Console::Err("Could not save %s, they will be saved in full next time", resaved.c_str());
+
+		if (!dropped.empty())
+			Console::Err("Could not save %s, their changes have been lost", dropped.c_str());
 	}
 }
 
@@ -309,7 +455,11 @@ void world_quakes(void *world_void)
 
 void World::UpdateConfig()
 {
+	this->settings = std::make_shared<ServerSettings>(this->config);
+	this->formulas = std::make_shared<Formulas>(this->formulas_config);
+
 	this->timer.SetMaxDelta(this->config["ClockMaxDelta"]);
+	this->npc_threads.SetNumThreads(std::max(this->settings->NPCThreads, 0));
 
 	double rate_face = this->config["PacketRateFace"];
 	double rate_walk = this->config["PacketRateWalk"];
@@ -372,6 +522,10 @@ World::World(std::shared_ptr<DatabaseFactory> databaseFactory, const Config &eos
 	, admin_count(0)
 {
 	this->db = databaseFactory->CreateDatabase(this->config, true);
+
+	// SQLite connections are shared by every thread, so there is no connection to give a save thread of its own
+	bool async_save = this->config["AsyncSave"] && util::lowercase(std::string(this->config["DBType"])) != "sqlite";
+	this->persistence.reset(new Persistence(async_save ? databaseFactory->CreateDatabase(this->config) : this->db, async_save));
 	this->Initialize();
 }
 
@@ -388,7 +542,7 @@ void World::Initialize()
 
 	this->passwordHashers[SHA256].reset(new Sha256Hasher());
 	this->passwordHashers[BCRYPT].reset(new BcryptHasher(int(this->config["BcryptWorkload"])));
-	this->loginManager.reset(new LoginManager(databaseFactory, this->config, this->passwordHashers));
+	this->loginManager.reset(new LoginManager(databaseFactory, this->config, this->passwordHashers, *this->persistence));
 
 	try
 	{
@@ -413,6 +567,11 @@ void World::Initialize()
 	this->esf = new ESF(this->config["ESF"]);
 	this->ecf = new ECF(this->config["ECF"]);
 
+	this->file_cache.Get(this->config["EIF"]);
+	this->file_cache.Get(this->config["ENF"]);
+	this->file_cache.Get(this->config["ESF"]);
+	this->file_cache.Get(this->config["ECF"]);
+
 	std::size_t num_npcs = this->enf->data.size();
 	this->npc_data.resize(num_npcs);
 	for (std::size_t i = 0; i < num_npcs; ++i)
@@ -478,7 +637,7 @@ void World::Initialize()
 		this->timer.Register(event);
 	}
 
-	if (int(this->config["WarpSuck"]) > 0)
+	if (int(this->settings->WarpSuck) > 0)
 	{
 		event = new TimeEvent(world_warp_suck, this, 1.0, Timer::FOREVER);
 		this->timer.Register(event);
@@ -496,6 +655,9 @@ void World::Initialize()
 		this->timer.Register(event);
 	}
 
+	event = new TimeEvent(world_check_saves, this, 1.0, Timer::FOREVER);
+	this->timer.Register(event);
+
 	if (this->config["SpikeTime"])
 	{
 		event = new TimeEvent(world_spikes, this, static_cast<double>(this->config["SpikeTime"]), Timer::FOREVER);
@@ -848,6 +1010,8 @@ void World::RestoreFromDump(const std::string& fileName)
 				i["y"].get<unsigned char>(),
 				0, 0));
 
+		(*map)->grid.Add((*map)->items.back());
+
 #ifdef DEBUG
 		Console::Dbg("Restored item:     %dx%d", i["itemId"].get<int>(), i["amount"].get<int>());
 #endif
@@ -1087,16 +1251,31 @@ void World::Logout(Character *character)
 	);
 }
 
+void World::Broadcast(const PacketBuilder &builder, const std::vector<Character *> &recipients)
+{
+	if (recipients.empty())
+		return;
+
+	SharedPacket packet(builder);
+
+	UTIL_FOREACH(recipients, character)
+	{
+		character->Send(packet);
+	}
+}
+
 void World::Msg(Command_Source *from, std::string message, bool echo)
 {
 	std::string from_str = from ? from->SourceName() : "server";
 
-	message = util::text_cap(message, static_cast<int>(this->config["ChatMaxWidth"]) - util::text_width(util::ucfirst(from_str) + "  "));
+	message = util::text_cap(message, this->settings->ChatMaxWidth - util::text_width(util::ucfirst(from_str) + "  "));
 
 	PacketBuilder builder(PACKET_TALK, PACKET_MSG, 2 + from_str.length() + message.length());
 	builder.AddBreakString(from_str);
 	builder.AddBreakString(message);
 
+	SharedPacket packet(builder);
+
 	UTIL_FOREACH(this->characters, character)
 	{
 		character->AddChatLog("~", from_str, message);
@@ -1106,7 +1285,7 @@ void World::Msg(Command_Source *from, std::string message, bool echo)
 			continue;
 		}
 
-		character->Send(builder);
+		character->Send(packet);
 	}
 }
 
@@ -1114,12 +1293,14 @@ void World::AdminMsg(Command_Source *from, std::string message, int minlevel, bo
 {
 	std::string from_str = from ? from->SourceName() : "server";
 
-	message = util::text_cap(message, static_cast<int>(this->config["ChatMaxWidth"]) - util::text_width(util::ucfirst(from_str) + "  "));
+	message = util::text_cap(message, this->settings->ChatMaxWidth - util::text_width(util::ucfirst(from_str) + "  "));
 
 	PacketBuilder builder(PACKET_TALK, PACKET_ADMIN, 2 + from_str.length() + message.length());
 	builder.AddBreakString(from_str);
 	builder.AddBreakString(message);
 
+	SharedPacket packet(builder);
+
 	UTIL_FOREACH(this->characters, character)
 	{
 		character->AddChatLog("+", from_str, message);
@@ -1129,7 +1310,7 @@ void World::AdminMsg(Command_Source *from, std::string message, int minlevel, bo
 			continue;
 		}
 
-		character->Send(builder);
+		character->Send(packet);
 	}
 }
 
@@ -1137,12 +1318,14 @@ void World::AnnounceMsg(Command_Source *from, std::string message, bool echo)
 {
 	std::string from_str = from ? from->SourceName() : "server";
 
-	message = util::text_cap(message, static_cast<int>(this->config["ChatMaxWidth"]) - util::text_width(util::ucfirst(from_str) + "  "));
+	message = util::text_cap(message, this->settings->ChatMaxWidth - util::text_width(util::ucfirst(from_str) + "  "));
 
 	PacketBuilder builder(PACKET_TALK, PACKET_ANNOUNCE, 2 + from_str.length() + message.length());
 	builder.AddBreakString(from_str);
 	builder.AddBreakString(message);
 
+	SharedPacket packet(builder);
+
 	UTIL_FOREACH(this->characters, character)
 	{
 		character->AddChatLog("@", from_str, message);
@@ -1152,26 +1335,23 @@ void World::AnnounceMsg(Command_Source *from, std::string message, bool echo)
 			continue;
 		}
 
-		character->Send(builder);
+		character->Send(packet);
 	}
 }
 
 void World::ServerMsg(std::string message)
 {
-	message = util::text_cap(message, static_cast<int>(this->config["ChatMaxWidth"]) - util::text_width("Server  "));
+	message = util::text_cap(message, this->settings->ChatMaxWidth - util::text_width("Server  "));
 
 	PacketBuilder builder(PACKET_TALK, PACKET_SERVER, message.length());
 	builder.AddString(message);
 
-	UTIL_FOREACH(this->characters, character)
-	{
-		character->Send(builder);
-	}
+	this->Broadcast(builder, this->characters);
 }
 
 void World::AdminReport(Character *from, std::string reportee, std::string message)
 {
-	message = util::text_cap(message, static_cast<int>(this->config["ChatMaxWidth"]) - util::text_width(util::ucfirst(from->SourceName()) + "  reports: " + reportee + ", "));
+	message = util::text_cap(message, this->settings->ChatMaxWidth - util::text_width(util::ucfirst(from->SourceName()) + "  reports: " + reportee + ", "));
 
 	PacketBuilder builder(PACKET_ADMININTERACT, PACKET_REPLY, 5 + from->SourceName().length() + message.length() + reportee.length());
 	builder.AddChar(2); // message type
@@ -1203,7 +1383,7 @@ void World::AdminReport(Character *from, std::string reportee, std::string messa
 		newpost->body = message;
 		newpost->time = Timer::GetTime();
 
-		if (int(this->config["ReportChatLogSize"]) > 0)
+		if (this->settings->ReportChatLogSize > 0)
 		{
 			chat_log_dump = from->GetChatLogDump();
 			newpost->body += "\r\n\r\n";
@@ -1240,7 +1420,7 @@ void World::AdminReport(Character *from, std::string reportee, std::string messa
 
 void World::AdminRequest(Character *from, std::string message)
 {
-	message = util::text_cap(message, static_cast<int>(this->config["ChatMaxWidth"]) - util::text_width(util::ucfirst(from->SourceName()) + "  needs help: "));
+	message = util::text_cap(message, this->settings->ChatMaxWidth - util::text_width(util::ucfirst(from->SourceName()) + "  needs help: "));
 
 	PacketBuilder builder(PACKET_ADMININTERACT, PACKET_REPLY, 4 + from->SourceName().length() + message.length());
 	builder.AddChar(1); // message type
@@ -1302,9 +1482,15 @@ void World::Rehash()
 	this->LoadHome();
 	this->server->UpdateConfig();
 
+	// File paths may have changed
+	this->file_cache.Clear();
+
 	UTIL_FOREACH(this->maps, map)
 	{
 		map->LoadArena();
+
+		// SeeDistance may have changed
+		map->ResetViews();
 	}
 
 	UTIL_FOREACH_CREF(this->npc_data, npc)
@@ -1312,6 +1498,12 @@ void World::Rehash()
 		if (npc->id != 0)
 			npc->Load();
 	}
+
+	// SpawnRate, RespawnBossChildren and talk speeds may have changed
+	UTIL_FOREACH(this->maps, map)
+	{
+		map->RescheduleNPCs();
+	}
 }
 
 void World::ReloadPub(bool quiet)
@@ -1326,6 +1518,11 @@ void World::ReloadPub(bool quiet)
 	this->esf->Read(this->config["ESF"]);
 	this->ecf->Read(this->config["ECF"]);
 
+	this->file_cache.Reload(this->config["EIF"]);
+	this->file_cache.Reload(this->config["ENF"]);
+	this->file_cache.Reload(this->config["ESF"]);
+	this->file_cache.Reload(this->config["ECF"]);
+
 	if (eif_id != this->eif->rid || enf_id != this->enf->rid
 	 || esf_id != this->esf->rid || ecf_id != this->ecf->rid)
 	{
@@ -1644,10 +1841,27 @@ void World::DeleteCharacter(std::string name)
 	this->db->Query("DELETE FROM `characters` WHERE name = '$'", name.c_str());
 }
 
-Player *World::PlayerFactory(std::string username)
+void World::UpdateCharacter(const std::string &name, Database_Query &&query)
+{
+	Persistence_Batch batch;
+	batch.queries.push_back(std::move(query));
+	batch.characters.push_back(name);
+
+	this->persistence->Queue(std::move(batch));
+}
+
+Player *World::PlayerFactory(const AccountCredentials &credentials)
+{
+	// The rows were read by the login worker, so building the Player here never touches the database
+	if (!credentials.characters)
+		return nullptr;
+
+	return new Player(credentials.username, this, *credentials.characters);
+}
+
+DatabasePoolStats World::DBPoolStats() const
 {
-	auto database = this->databaseFactory->CreateDatabase(this->config);
-	return new Player(username, this, database.get());
+	return this->databaseFactory->PoolStats();
 }
 
 AsyncOperation<AccountCredentials, LoginReply>* World::CheckCredential(EOClient* client)
@@ -1719,7 +1933,7 @@ void World::Jail(Command_Source *from, Character *victim, bool announce)
 	if (charfrom && charfrom->IsHideWarp())
 		bubbles = false;
 
-	victim->Warp(static_cast<int>(this->config["JailMap"]), static_cast<int>(this->config["JailX"]), static_cast<int>(this->config["JailY"]), bubbles ? WARP_ANIMATION_ADMIN : WARP_ANIMATION_NONE);
+	victim->Warp(this->settings->JailMap, this->settings->JailX, this->settings->JailY, bubbles ? WARP_ANIMATION_ADMIN : WARP_ANIMATION_NONE);
 }
 
 void World::Unjail(Command_Source *from, Character *victim)
@@ -1731,10 +1945,10 @@ void World::Unjail(Command_Source *from, Character *victim)
 	if (charfrom && charfrom->IsHideWarp())
 		bubbles = false;
 
-	if (victim->mapid != static_cast<int>(this->config["JailMap"]))
+	if (victim->mapid != this->settings->JailMap)
 		return;
 
-	victim->Warp(static_cast<int>(this->config["JailMap"]), static_cast<int>(this->config["UnJailX"]), static_cast<int>(this->config["UnJailY"]), bubbles ? WARP_ANIMATION_ADMIN : WARP_ANIMATION_NONE);
+	victim->Warp(this->settings->JailMap, this->settings->UnJailX, this->settings->UnJailY, bubbles ? WARP_ANIMATION_ADMIN : WARP_ANIMATION_NONE);
 }
 
 void World::Ban(Command_Source *from, Character *victim, int duration, bool announce)
@@ -1817,26 +2031,6 @@ int World::CheckBan(const std::string *username, const IPAddress *address, const
 	return static_cast<int>(res[0]["expires"]);
 }
 
-static std::list<int> PKExceptUnserialize(std::string serialized)
-{
-	std::list<int> list;
-	std::size_t p = 0;
-	std::size_t lastp = std::numeric_limits<std::size_t>::max();
-
-	if (!serialized.empty() && *(serialized.end()-1) != ',')
-	{
-		serialized.push_back(',');
-	}
-
-	while ((p = serialized.find_first_of(',', p+1)) != std::string::npos)
-	{
-		list.push_back(util::to_int(serialized.substr(lastp+1, p-lastp-1)));
-		lastp = p;
-	}
-
-	return list;
-}
-
 bool World::PKExcept(const Map *map)
 {
 	return this->PKExcept(map->id);
@@ -1844,7 +2038,7 @@ bool World::PKExcept(const Map *map)
 
 bool World::PKExcept(int mapid)
 {
-	if (mapid == static_cast<int>(this->config["JailMap"]))
+	if (mapid == this->settings->JailMap)
 	{
 		return true;
 	}
@@ -1854,9 +2048,9 @@ bool World::PKExcept(int mapid)
 		return true;
 	}
 
-	std::list<int> except_list = PKExceptUnserialize(this->config["PKExcept"]);
+	const std::vector<int> &except_list = this->settings->PKExceptMaps;
 
-	return std::find(except_list.begin(), except_list.end(), mapid) != except_list.end();
+	return std::find(UTIL_RANGE(except_list), mapid) != except_list.end();
 }
 
 bool World::IsInstrument(int graphic_id)
@@ -1882,4 +2076,7 @@ World::~World()
 	delete this->ecf;
 
 	delete this->guildmanager;
+
+	// Writes out every save still queued, including those of the guilds just unloaded
+	this->persistence.reset();
 }
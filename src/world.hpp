@@ -12,15 +12,20 @@
 #include "fwd/character.hpp"
 #include "fwd/command_source.hpp"
 #include "fwd/eodata.hpp"
+#include "fwd/eoserv_config.hpp"
 #include "fwd/eoserver.hpp"
+#include "fwd/formula.hpp"
 #include "fwd/guild.hpp"
 #include "fwd/map.hpp"
 #include "fwd/npc_data.hpp"
+#include "fwd/packet.hpp"
 #include "fwd/party.hpp"
+#include "fwd/persistence.hpp"
 #include "fwd/player.hpp"
 #include "fwd/quest.hpp"
 #include "config.hpp"
 #include "database.hpp"
+#include "filecache.hpp"
 #include "i18n.hpp"
 #include "hash.hpp"
 #include "map.hpp"
@@ -30,6 +35,7 @@
 #include "fwd/socket.hpp"
 #include "util/secure_string.hpp"
 #include "util/async.hpp"
+#include "util/parallelfor.hpp"
 
 #include <array>
 #include <list>
@@ -95,6 +101,11 @@ class World
 
 		GuildManager *guildmanager;
 
+		/**
+		 * Where character and guild saves are queued to be written, see AsyncSave
+		 */
+		std::unique_ptr<Persistence> persistence;
+
 		EIF *eif;
 		ENF *enf;
 		ESF *esf;
@@ -103,17 +114,36 @@ class World
 		std::vector<std::unique_ptr<NPC_Data>> npc_data;
 
 		Config config;
+
+		/**
+		 * Typed snapshot of config, rebuilt by UpdateConfig on startup and rehash.
+		 * Only replaced on the game thread, NPC threads read it while the game thread waits for them.
+		 */
+		std::shared_ptr<const ServerSettings> settings;
+
 		Config admin_config;
 		Config drops_config;
 		Config shops_config;
 		Config arenas_config;
 		Config formulas_config;
+
+		/**
+		 * formulas_config compiled by UpdateConfig, shared like settings
+		 */
+		std::shared_ptr<const Formulas> formulas;
 		Config home_config;
 		Config skills_config;
 		Config speech_config;
 
 		I18N i18n;
 
+		FileCache file_cache;
+
+		/**
+		 * Threads NPCs decide what to do on, see NPCThreads
+		 */
+		util::ParallelFor npc_threads;
+
 		std::vector<Character *> characters;
 		std::vector<Party *> parties;
 		std::vector<Map *> maps;
@@ -149,6 +179,11 @@ class World
 		void Login(Character *);
 		void Logout(Character *);
 
+		/**
+		 * Sends the same packet to every character in recipients, serializing it only once.
+		 */
+		void Broadcast(const PacketBuilder &builder, const std::vector<Character *> &recipients);
+
 		void Msg(Command_Source *from, std::string message, bool echo = true);
 		void AdminMsg(Command_Source *from, std::string message, int minlevel = ADMIN_GUARDIAN, bool echo = true);
 		void AnnounceMsg(Command_Source *from, std::string message, bool echo = true);
@@ -185,7 +220,13 @@ class World
 		Character *CreateCharacter(Player *, std::string name, Gender, int hairstyle, int haircolor, Skin);
 		void DeleteCharacter(std::string name);
 
-		Player *PlayerFactory(std::string username);
+		/**
+		 * Queues a change to a character who isn't loaded, so it is written after any save of theirs still queued
+		 */
+		void UpdateCharacter(const std::string &name, Database_Query &&query);
+
+		Player *PlayerFactory(const AccountCredentials &credentials);
+		DatabasePoolStats DBPoolStats() const;
 		AsyncOperation<AccountCredentials, LoginReply>* CheckCredential(EOClient* client);
 		AsyncOperation<PasswordChangeInfo, bool>* ChangePassword(EOClient* client);
 
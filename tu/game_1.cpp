@@ -10,6 +10,7 @@
 #include "../src/npc.cpp"
 #include "../src/npc_data.cpp"
 #include "../src/party.cpp"
+#include "../src/pathfinder.cpp"
 #include "../src/player.cpp"
 #include "../src/wedding.cpp"
 #include "../src/world.cpp"
@@ -8,5 +8,10 @@
 #include "../src/eodata.cpp"
 #include "../src/eoserv_config.cpp"
 #include "../src/eoserver.cpp"
+#include "../src/filecache.cpp"
+#include "../src/formula.cpp"
+#include "../src/netthread.cpp"
 #include "../src/packet.cpp"
+#include "../src/packettrace.cpp"
+#include "../src/persistence.cpp"
 #include "../src/sln.cpp"
@@ -14,6 +14,8 @@
 #include "../src/socket.cpp"
 #include "../src/timer.cpp"
 #include "../src/util.cpp"
+#include "../src/util/parallelfor.cpp"
+#include "../src/util/ringbuffer.cpp"
 #include "../src/util/rpn.cpp"
 #include "../src/util/semaphore.cpp"
 #include "../src/util/threadpool.cpp"